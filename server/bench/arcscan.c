@@ -0,0 +1,85 @@
+/**
+ * @file arcscan.c
+ * @brief Statistics over a finished-game archive, read through mmap.
+ *
+ * Maps every segment of an archive directory (format in archive.h), walks its
+ * index and aggregates results, end reasons and game lengths. With verify=1
+ * every record's crc32 is checked as well; unpacking moves (moves=1) touches
+ * every move the way an exporter would. The scan rate shows how close the
+ * reader gets to disk (or page cache) bandwidth.
+ *
+ * Usage: arcscan.exe dir=archive [verify=0] [moves=0]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "archive.h"
+#include "bench_util.h"
+
+/* The server objects expect these (normally defined in main.c) */
+int max_rooms = -1;
+int max_players = -1;
+
+#define MAX_SEGMENTS 100000
+
+static const char *reason_names[] = {
+    "none", "checkmate", "stalemate", "resign", "draw_agreed",
+    "timeout", "abandon", "disconnect", "kicked", "cancelled"
+};
+
+int main(int argc, char *argv[]) {
+    const char *dir = "archive";
+    int verify = 0, unpack = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "dir=", 4) == 0) dir = argv[i] + 4;
+        else if (strncmp(argv[i], "verify=", 7) == 0) verify = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "moves=", 6) == 0) unpack = atoi(argv[i] + 6);
+        else { fprintf(stderr, "Unknown argument %s\n", argv[i]); return 1; }
+    }
+
+    int *segs = malloc(MAX_SEGMENTS * sizeof(int));
+    int nseg = segs ? archive_list_segments(dir, segs, MAX_SEGMENTS) : -1;
+    if (nseg < 0) { fprintf(stderr, "Cannot read archive directory %s\n", dir); free(segs); return 1; }
+
+    uint64_t games = 0, moves = 0, bytes = 0, bad = 0, longest = 0, checksum = 0;
+    uint64_t by_reason[END_CANCELLED + 2] = { 0 };
+    uint64_t by_winner[3] = { 0 };  /* white, black, none */
+    uint64_t t0 = bench_now_ns();
+
+    for (int s = 0; s < nseg; s++) {
+        ArchiveSegment seg;
+        if (archive_map(dir, segs[s], &seg) != 0) { fprintf(stderr, "Skipping unreadable segment %d\n", segs[s]); continue; }
+        bytes += seg.data_len + seg.index_len;
+        size_t n = archive_game_count(&seg);
+        for (size_t i = 0; i < n; i++) {
+            ArchiveGame g;
+            if (archive_game(&seg, i, verify, &g) != 0) { bad++; continue; }
+            games++;
+            moves += g.move_count;
+            if (g.move_count > longest) longest = g.move_count;
+            by_reason[(unsigned)g.end_reason <= END_CANCELLED ? g.end_reason : END_CANCELLED + 1]++;
+            by_winner[g.winner == 0 ? 0 : g.winner == 1 ? 1 : 2]++;
+            if (unpack) {
+                char mv[6];
+                for (size_t k = 0; k < g.move_count; k++) { archive_decode_move(&g, k, mv); checksum += (unsigned char)mv[1] ^ (unsigned char)mv[3]; }
+            }
+        }
+        archive_unmap(&seg);
+    }
+    double secs = (double)(bench_now_ns() - t0) / 1e9;
+    free(segs);
+
+    printf("segments %d, games %llu, moves %llu, corrupt %llu, %.1f MB\n", nseg,
+           (unsigned long long)games, (unsigned long long)moves, (unsigned long long)bad, bytes / 1e6);
+    printf("results  white %llu, black %llu, no winner %llu\n",
+           (unsigned long long)by_winner[0], (unsigned long long)by_winner[1], (unsigned long long)by_winner[2]);
+    printf("reasons ");
+    for (int r = 1; r <= END_CANCELLED + 1; r++) {
+        if (by_reason[r]) printf(" %s=%llu", r <= END_CANCELLED ? reason_names[r] : "unknown", (unsigned long long)by_reason[r]);
+    }
+    printf("\nplies    mean %.1f, longest %llu\n", games ? (double)moves / (double)games : 0.0, (unsigned long long)longest);
+    printf("scan     %.3f s, %.0f games/s, %.1f MB/s\n", secs, secs > 0 ? games / secs : 0.0, secs > 0 ? bytes / 1e6 / secs : 0.0);
+    if (unpack) printf("unpacked %llu moves (checksum %llx)\n", (unsigned long long)moves, (unsigned long long)checksum);
+    return bad ? 2 : 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file bench_util.c
+ * @brief Clock and histogram helpers shared by the benchmark tools.
+ *
+ * The histogram is log-linear: values below 64 us are stored exactly, larger
+ * values are split into 64 sub-buckets per power of two, which keeps the
+ * relative error under 2% with a fixed memory footprint.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <time.h>
+#include "bench_util.h"
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void hist_init(Hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/**
+ * @brief Maps a microsecond value to its bucket index.
+ */
+static int hist_index(uint64_t v) {
+    if (v < HIST_SUB_COUNT) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > HIST_MAX_EXP) { e = HIST_MAX_EXP; v = (2ull << HIST_MAX_EXP) - 1; }
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/**
+ * @brief Returns the lowest value stored in a bucket.
+ */
+static uint64_t hist_value(int idx) {
+    if (idx < HIST_SUB_COUNT) return (uint64_t)idx;
+    int group = idx / HIST_SUB_COUNT;
+    int sub = idx % HIST_SUB_COUNT;
+    return (uint64_t)(HIST_SUB_COUNT + sub) << (group - 1);
+}
+
+void hist_record_us(Hist *h, uint64_t us) {
+    h->counts[hist_index(us)]++;
+    h->total++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+void hist_merge(Hist *dst, const Hist *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum_us += src->sum_us;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+}
+
+uint64_t hist_percentile(const Hist *h, double pct) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)h->total);
+    if (rank >= h->total) rank = h->total - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen > rank) {
+            uint64_t v = hist_value(i);
+            return (v > h->max_us) ? h->max_us : v;
+        }
+    }
+    return h->max_us;
+}
+
+void hist_print(FILE *out, const char *label, const Hist *h) {
+    double mean = h->total ? (double)h->sum_us / (double)h->total : 0.0;
+    fprintf(out, "%-14s n=%-9llu mean=%.3fms p50=%.3fms p90=%.3fms p99=%.3fms p99.9=%.3fms max=%.3fms\n",
+            label, (unsigned long long)h->total, mean / 1000.0,
+            hist_percentile(h, 50.0) / 1000.0, hist_percentile(h, 90.0) / 1000.0,
+            hist_percentile(h, 99.0) / 1000.0, hist_percentile(h, 99.9) / 1000.0,
+            h->max_us / 1000.0);
+}
@@ -0,0 +1,49 @@
+/**
+ * @file bench_util.h
+ * @brief Shared helpers for the benchmark tools.
+ *
+ * Provides a monotonic nanosecond clock and a log-linear latency histogram
+ * that can be recorded from a single thread and merged afterwards.
+ */
+
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 6                         /**< 64 sub-buckets per power of two (~1.5% error) */
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP 40                         /**< Values up to 2^40 us (~12 days) */
+#define HIST_BUCKETS ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB_COUNT)
+
+/**
+ * @brief Latency histogram with microsecond resolution.
+ */
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;     /**< Number of recorded samples */
+    uint64_t sum_us;    /**< Sum of all samples (for the mean) */
+    uint64_t max_us;    /**< Largest recorded sample */
+} Hist;
+
+/**
+ * @brief Returns CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t bench_now_ns(void);
+
+void hist_init(Hist *h);
+void hist_record_us(Hist *h, uint64_t us);
+void hist_merge(Hist *dst, const Hist *src);
+
+/**
+ * @brief Returns the value (in microseconds) at the given percentile (0-100).
+ */
+uint64_t hist_percentile(const Hist *h, double pct);
+
+/**
+ * @brief Prints "label: n=.. mean=.. p50=.. p90=.. p99=.. p99.9=.. max=.." in milliseconds.
+ */
+void hist_print(FILE *out, const char *label, const Hist *h);
+
+#endif /* BENCH_UTIL_H */
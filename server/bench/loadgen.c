@@ -0,0 +1,890 @@
+/**
+ * @file loadgen.c
+ * @brief Protocol-level load generator for the chess server.
+ *
+ * Simulates many concurrent players speaking the text protocol defined in
+ * client.h. Bots are grouped in pairs: the host creates a room (NEW), its peer
+ * joins it (JOIN) and both play random legal moves validated by the server's
+ * own rules engine (game.c). Every server message is acknowledged the same
+ * way the Java client does, bots send PING heartbeats, occasionally offer
+ * draws and end games by resigning, agreeing to a draw or leaving (EXT).
+ *
+ * Each worker thread drives its share of bots with epoll over non-blocking
+ * sockets. At the end a report with connection rate, move rate, latency
+ * percentiles and error counters is printed.
+ *
+ * The "storm" scenario additionally drops a fraction of all in-game players
+ * at the same moment (abortive close, like a Wi-Fi outage) and reconnects
+ * them with the same HELLO name/id after a configurable downtime, measuring
+ * time to RESUME, HISTORY delivery and resume failures. With storm_every the
+ * outage repeats (churn). If the server runs with an admin console, its lock
+ * statistics are fetched and printed at the end.
+ *
+ * With queue=1 bots do not use rooms at all: every bot sends QUEUE from the
+ * lobby and plays whoever the server's matchmaker pairs it with.
+ *
+ * Usage: loadgen.exe [ip=127.0.0.1] [port=10001] [clients=1000] [threads=4]
+ *                    [duration=30] [ramp=0] [plies=60] [games=0] [think=0]
+ *                    [ping=5000] [draw=2] [list=20] [seed=1]
+ *                    [scenario=play|storm] [storm_pct=50] [storm_at=5]
+ *                    [storm_every=0] [storm_down_ms=500] [admin=0] [queue=0]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "client.h"
+#include "match.h"
+#include "game.h"
+#include "bench_util.h"
+
+#define RBUF_SZ (BUFFER_SZ * 4)         /**< Per-bot receive buffer */
+#define MOVE_TIMEOUT_NS 10000000000ull  /**< MV without OK_MV for this long counts as a timeout */
+#define FIRST_MOVE_DELAY_NS 200000000ull /**< Host thread may still be in its 100 ms waiting poll */
+#define DRAIN_GRACE_NS 10000000000ull   /**< Time allowed for running games to finish after duration */
+#define RESUME_TIMEOUT_NS 10000000000ull /**< Reconnect without RESUME for this long counts as failed */
+#define MAX_LEGAL_MOVES 256
+
+/**
+ * @brief Lifecycle phase of a simulated player.
+ */
+typedef enum {
+    BOT_IDLE,           /**< Not connected yet (ramp-up) */
+    BOT_CONNECTING,     /**< Non-blocking connect in progress */
+    BOT_HANDSHAKE,      /**< Connected, HELLO exchange in progress */
+    BOT_LOBBY,          /**< In lobby */
+    BOT_WAITING,        /**< Hosting a room (or queued), waiting for the peer */
+    BOT_GAME,           /**< Playing */
+    BOT_POSTGAME,       /**< Game over, waiting for LOBBY */
+    BOT_DOWN,           /**< Dropped by a storm, waiting to reconnect */
+    BOT_CLOSED          /**< Finished or failed */
+} BotPhase;
+
+/**
+ * @brief Error categories reported in the summary.
+ */
+typedef enum {
+    ERR_CONNECT,        /**< connect() failed */
+    ERR_EOF,            /**< Server closed the connection unexpectedly */
+    ERR_MSG,            /**< Server answered with ERR */
+    ERR_FULL,           /**< Server rejected the connection (FULL) */
+    ERR_KICK,           /**< Opponent kicked for protocol violation */
+    ERR_TIMEOUT,        /**< Move not confirmed in time */
+    ERR_SEND,           /**< send() failed or would block */
+    ERR_UNKNOWN,        /**< Unrecognized server message */
+    ERR_COUNT
+} ErrKind;
+
+static const char *err_names[ERR_COUNT] = {
+    "connect", "eof", "err_msg", "full", "kicked", "timeout", "send", "unknown"
+};
+
+/**
+ * @brief Event counters, written by the owning thread and read by the reporter.
+ */
+typedef struct {
+    uint64_t conns;         /**< Completed handshakes */
+    uint64_t moves;         /**< Confirmed moves (OK_MV) */
+    uint64_t game_ends;     /**< Games finished, counted by each player (two per game) */
+    uint64_t lists;         /**< ROOMLIST answers */
+    uint64_t draws_offered;
+    uint64_t errors[ERR_COUNT];
+    /* Storm scenario */
+    uint64_t dropped;       /**< In-game players disconnected by storms */
+    uint64_t resumed;       /**< Reconnects answered with RESUME */
+    uint64_t resume_miss;   /**< Reconnects that landed in the lobby instead */
+    uint64_t resume_timeout;/**< Reconnects without any answer in time */
+    uint64_t wait_conn;     /**< WAIT_CONN notifications (opponent paused) */
+    uint64_t opp_resumed;   /**< OPP_RESUME notifications */
+} Counters;
+
+/**
+ * @brief Per-thread counters and latency histograms.
+ */
+typedef struct {
+    Counters c;
+    Hist conn_lat;          /**< connect() to LOBBY */
+    Hist move_lat;          /**< MV to OK_MV */
+    Hist ping_lat;          /**< PING to PNG */
+    Hist join_lat;          /**< NEW (or QUEUE) to START (matchmaking round trip) */
+    Hist resume_lat;        /**< Reconnect start to RESUME */
+    Hist history_lat;       /**< Reconnect start to HISTORY */
+} Stats;
+
+typedef struct Bot {
+    int fd;
+    int index;
+    int host;                   /**< 1 if this bot creates rooms for its peer */
+    struct Bot *peer;
+    BotPhase phase;
+    char rbuf[RBUF_SZ];
+    size_t rlen;
+
+    Match board;                /**< Local replica of the game used for move generation */
+    int color;
+    int plies;
+    int games;
+    int join_room;              /**< Room announced by the host, -1 if none */
+    char pending_mv[8];         /**< Move sent but not yet confirmed */
+    int ending;                 /**< 1 once a game-ending action was sent */
+    int resuming;               /**< 1 while reconnecting after a storm */
+    int sync_pending;           /**< 1 between RESUME and the TIME that closes the resync */
+
+    uint64_t connect_at_ns;
+    uint64_t conn_start_ns;
+    uint64_t new_sent_ns;
+    uint64_t mv_sent_ns;
+    uint64_t move_due_ns;       /**< Scheduled time of our next move, 0 if none */
+    uint64_t ping_sent_ns;
+    uint64_t next_ping_ns;
+    uint64_t down_until_ns;     /**< Reconnect time after a storm drop */
+    uint64_t reconn_start_ns;
+    unsigned rng;
+} Bot;
+
+typedef struct {
+    int id;
+    Bot *bots;
+    int nbots;
+    int epfd;
+    uint64_t next_storm_ns;
+    Stats stats;
+} Worker;
+
+/* --- Configuration --- */
+static struct sockaddr_in server_addr;
+static int cfg_clients = 1000;
+static int cfg_threads = 4;
+static int cfg_duration = 30;
+static int cfg_ramp = 0;            /**< Connections per second, 0 = all at once */
+static int cfg_plies = 60;          /**< Plies before a scripted game ending */
+static int cfg_games = 0;           /**< Games per pair, 0 = until duration ends */
+static int cfg_think_ms = 0;
+static int cfg_ping_ms = 5000;
+static int cfg_draw_pct = 2;        /**< Chance per move of a (declined) draw offer */
+static int cfg_list_pct = 20;       /**< Chance of LIST before NEW */
+static unsigned cfg_seed = 1;
+static int cfg_storm = 0;           /**< scenario=storm */
+static int cfg_storm_pct = 50;      /**< Share of in-game players dropped per storm */
+static int cfg_storm_at = 5;        /**< Seconds after start of the first storm */
+static int cfg_storm_every = 0;     /**< Repeat interval in seconds, 0 = single storm */
+static int cfg_storm_down_ms = 500; /**< Downtime before reconnecting */
+static int cfg_admin_port = 0;      /**< Server admin console to fetch lock stats from */
+static int cfg_queue = 0;           /**< Pair through QUEUE instead of NEW/JOIN */
+
+static uint64_t start_ns;
+static uint64_t stop_ns;
+static volatile int hard_stop = 0;
+
+#define STAT_ADD(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#define STAT_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+static unsigned rnd(Bot *b) {
+    b->rng = b->rng * 1103515245u + 12345u;
+    return (b->rng >> 16) & 0x7fff;
+}
+
+/* --- Local Board --- */
+
+/**
+ * @brief Resets the local replica to the initial position (mirrors match_create).
+ */
+static void board_reset(Match *m) {
+    init_board(&m->state);
+    m->turn = 0;
+    m->w_can_kingside = m->w_can_queenside = 1;
+    m->b_can_kingside = m->b_can_queenside = 1;
+    m->ep_r = m->ep_c = -1;
+}
+
+static void format_move(char *out, int r1, int c1, int r2, int c2, int promo) {
+    out[0] = 'a' + c1; out[1] = '1' + (7 - r1);
+    out[2] = 'a' + c2; out[3] = '1' + (7 - r2);
+    out[4] = promo ? 'q' : '\0'; out[5] = '\0';
+}
+
+/**
+ * @brief Picks a uniformly random legal move for the side to move.
+ * @return 1 if a move was written to out, 0 if there is none.
+ */
+static int pick_random_move(Bot *b, char *out) {
+    Match *m = &b->board;
+    int moves[MAX_LEGAL_MOVES][4];
+    int n = 0;
+    for (int r1 = 0; r1 < 8; r1++) for (int c1 = 0; c1 < 8; c1++) {
+        Piece p = m->state.board[r1][c1];
+        if (p == EMPTY || piece_color(p) != b->color) continue;
+        for (int r2 = 0; r2 < 8; r2++) for (int c2 = 0; c2 < 8; c2++) {
+            if (n >= MAX_LEGAL_MOVES) break;
+            if (!is_legal_move_basic(m, b->color, r1, c1, r2, c2)) continue;
+            if (move_leaves_in_check(m, b->color, r1, c1, r2, c2)) continue;
+            moves[n][0] = r1; moves[n][1] = c1; moves[n][2] = r2; moves[n][3] = c2; n++;
+        }
+    }
+    if (n == 0) return 0;
+    int *mv = moves[rnd(b) % n];
+    Piece p = m->state.board[mv[0]][mv[1]];
+    int promo = (abs(p) == 1 && (mv[2] == 0 || mv[2] == 7));
+    format_move(out, mv[0], mv[1], mv[2], mv[3], promo);
+    return 1;
+}
+
+static void board_apply(Match *m, const char *mv) {
+    int r1, c1, r2, c2;
+    if (!is_move_format(mv)) return;
+    parse_move(mv, &r1, &c1, &r2, &c2);
+    apply_move(m, r1, c1, r2, c2, (strlen(mv) >= 5) ? mv[4] : 0);
+}
+
+/* --- Socket Helpers --- */
+
+static void bot_close(Worker *w, Bot *b) {
+    if (b->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, b->fd, NULL);
+        close(b->fd);
+    }
+    b->fd = -1;
+    b->phase = BOT_CLOSED;
+}
+
+static void bot_fail(Worker *w, Bot *b, ErrKind kind) {
+    STAT_ADD(w->stats.c.errors[kind], 1);
+    bot_close(w, b);
+}
+
+static int bot_send(Worker *w, Bot *b, const char *line) {
+    char out[LINEBUF_SZ];
+    int n = snprintf(out, sizeof(out), "%s\n", line);
+    if (b->fd < 0) return -1;
+    if (send(b->fd, out, n, MSG_NOSIGNAL | MSG_DONTWAIT) != n) {
+        bot_fail(w, b, ERR_SEND);
+        return -1;
+    }
+    return 0;
+}
+
+static void bot_connect(Worker *w, Bot *b) {
+    b->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (b->fd < 0) { bot_fail(w, b, ERR_CONNECT); return; }
+    int one = 1;
+    setsockopt(b->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    b->conn_start_ns = bench_now_ns();
+    b->rlen = 0;
+    if (connect(b->fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 && errno != EINPROGRESS) {
+        bot_fail(w, b, ERR_CONNECT);
+        return;
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.ptr = b };
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, b->fd, &ev);
+    b->phase = BOT_CONNECTING;
+}
+
+/* --- Protocol Logic --- */
+
+/**
+ * @brief Returns the ACK code the Java client sends for a server message.
+ */
+static const char *ack_for(const char *msg) {
+    if (strncmp(msg, "WAITING", 7) == 0) return WAIT_ACK;
+    if (strncmp(msg, "START", 5) == 0) return START_ACK;
+    if (strncmp(msg, ACCEPT_MOVE, 5) == 0) return ACCEPT_MOVE_ACK;
+    if (strncmp(msg, "OPP_MV", 6) == 0) return OPPONENT_MOVE_ACK;
+    if (strcmp(msg, IN_CHECK) == 0) return CHECK_ACK;
+    if (strncmp(msg, WON_BY_CHECKMATE, 8) == 0) return WIN_BY_CHEKMATE_ACK;
+    if (strncmp(msg, LOST_BY_CHECKMATE, 4) == 0) return LOST_BY_CHECKMATE_ACK;
+    if (strncmp(msg, STALEMATE, 2) == 0) return STALEMATE_ACK;
+    if (strncmp(msg, DRAW_OFFER, 7) == 0) return DRAW_OFFER_ACK_SC;
+    if (strncmp(msg, DRAW_ACCEPTED, 7) == 0) return DRAW_ACCEPTED_ACK;
+    if (strncmp(msg, DRAW_DECLINED, 7) == 0) return DRAW_DECLINED_ACK;
+    if (strncmp(msg, YOU_RESIGNED, 3) == 0) return RESIGN_ACK_SC;
+    if (strncmp(msg, OPPONENT_RESIGNED, 7) == 0) return OPPONENT_RESIGNED_ACK;
+    if (strncmp(msg, YOU_TIMED_OUT, 4) == 0) return TOU_TIMED_OUT_ACK;
+    if (strncmp(msg, OPPONENT_TIMED_OUT, 8) == 0) return OPPONENT_TIMED_OUT_ACK;
+    if (strncmp(msg, OPPONENT_QUIT, 7) == 0) return OPPONENT_QUIT_ACK;
+    if (strncmp(msg, "RESUME", 6) == 0) return RESUME_ACK;
+    if (strncmp(msg, ENTER_LOBBY, 5) == 0) return LOBBY_ACK;
+    if (strncmp(msg, "ERR", 3) == 0) return ERR_ACK;
+    return GENERIC_ACK;
+}
+
+static int run_over(void) {
+    return bench_now_ns() >= stop_ns;
+}
+
+/**
+ * @brief Decides what a bot does after entering the lobby.
+ */
+static void lobby_action(Worker *w, Bot *b) {
+    Bot *host = (b->host || cfg_queue) ? b : b->peer;
+    if (run_over() || (cfg_games > 0 && host->games >= cfg_games)) {
+        bot_send(w, b, EXIT);
+        bot_close(w, b);
+        return;
+    }
+    if (cfg_queue) {
+        b->new_sent_ns = bench_now_ns();
+        bot_send(w, b, QUEUE_REQUEST);
+    } else if (b->host) {
+        if ((int)(rnd(b) % 100) < cfg_list_pct) bot_send(w, b, ROOM_LIST_REQUEST);
+        b->new_sent_ns = bench_now_ns();
+        bot_send(w, b, CREATE_ROOM);
+    } else if (b->join_room > 0) {
+        char line[32];
+        snprintf(line, sizeof(line), "%s%d", JOIN_ROOM, b->join_room);
+        bot_send(w, b, line);
+    }
+}
+
+/**
+ * @brief Accounts a finished game and waits for the server to return us to the lobby.
+ */
+static void finish_game(Worker *w, Bot *b) {
+    STAT_ADD(w->stats.c.game_ends, 1);
+    if (b->host || cfg_queue) b->games++;
+    b->phase = BOT_POSTGAME;
+    b->move_due_ns = 0;
+    b->mv_sent_ns = 0;
+}
+
+static void schedule_move(Bot *b) {
+    uint64_t delay = cfg_think_ms ? (uint64_t)(rnd(b) % (2 * cfg_think_ms + 1)) * 1000000ull : 0;
+    b->move_due_ns = bench_now_ns() + delay;
+}
+
+/**
+ * @brief Plays our move, or ends the game once the ply budget is spent.
+ */
+static void make_move(Worker *w, Bot *b) {
+    b->move_due_ns = 0;
+    if (b->phase != BOT_GAME || b->ending) return;
+
+    if (b->plies >= cfg_plies || run_over()) {
+        b->ending = 1;
+        switch (rnd(b) % 3) {
+            case 0: bot_send(w, b, RESIGN); break;
+            case 1: bot_send(w, b, DRAW_OFFER); STAT_ADD(w->stats.c.draws_offered, 1); break;
+            default:
+                /* EXT ends the game without a result message for us */
+                if (bot_send(w, b, EXIT) == 0) finish_game(w, b);
+                break;
+        }
+        return;
+    }
+
+    char mv[8];
+    if (!pick_random_move(b, mv)) return; /* Mate or stalemate, server sends the result */
+    if ((int)(rnd(b) % 100) < cfg_draw_pct) {
+        bot_send(w, b, DRAW_OFFER);
+        STAT_ADD(w->stats.c.draws_offered, 1);
+    }
+    char line[16];
+    snprintf(line, sizeof(line), "%s%s", MOVE_COMMAND, mv);
+    snprintf(b->pending_mv, sizeof(b->pending_mv), "%s", mv);
+    b->mv_sent_ns = bench_now_ns();
+    bot_send(w, b, line);
+}
+
+static void game_over(Worker *w, Bot *b) {
+    if (b->phase != BOT_GAME) return;
+    finish_game(w, b);
+    /* Like the Java client: any line moves a finished player back to the lobby */
+    bot_send(w, b, ROOM_LIST_REQUEST);
+}
+
+/**
+ * @brief Handles one line received from the server.
+ */
+static void handle_line(Worker *w, Bot *b, char *line) {
+    uint64_t now = bench_now_ns();
+
+    /* Server ACKs of our commands */
+    if (strlen(line) == 2 && line[0] >= '0' && line[0] <= '9') return;
+
+    if (strcmp(line, PING_RESPONSE) == 0) {
+        if (b->ping_sent_ns) hist_record_us(&w->stats.ping_lat, (now - b->ping_sent_ns) / 1000);
+        b->ping_sent_ns = 0;
+        return;
+    }
+
+    bot_send(w, b, ack_for(line));
+    if (b->fd < 0) return;
+
+    if (strncmp(line, WELCOME, 7) == 0) {
+        char hello[LINEBUF_SZ];
+        snprintf(hello, sizeof(hello), "%sbot%d lg%d_%d", HELLO, b->index, (int)getpid(), b->index);
+        bot_send(w, b, hello);
+    }
+    else if (strcmp(line, "FULL") == 0) bot_fail(w, b, ERR_FULL);
+    else if (strncmp(line, ENTER_LOBBY, 5) == 0) {
+        if (b->phase == BOT_HANDSHAKE) {
+            hist_record_us(&w->stats.conn_lat, (now - b->conn_start_ns) / 1000);
+            STAT_ADD(w->stats.c.conns, 1);
+        }
+        if (b->resuming) {
+            /* Session was gone: the server treated us as a new player */
+            STAT_ADD(w->stats.c.resume_miss, 1);
+            b->resuming = 0;
+        }
+        b->phase = BOT_LOBBY;
+        lobby_action(w, b);
+    }
+    else if (strncmp(line, "ROOMLIST", 8) == 0) STAT_ADD(w->stats.c.lists, 1);
+    else if (strncmp(line, "QUEUED", 6) == 0) b->phase = BOT_WAITING;
+    else if (strncmp(line, "WAITING", 7) == 0) {
+        b->phase = BOT_WAITING;
+        int room = atoi(line + 13);
+        b->peer->join_room = room;
+        if (b->peer->phase == BOT_LOBBY) lobby_action(w, b->peer);
+    }
+    else if (strncmp(line, "START", 5) == 0) {
+        b->phase = BOT_GAME;
+        b->color = strstr(line, "white") ? 0 : 1;
+        b->plies = 0;
+        b->ending = 0;
+        b->join_room = -1;
+        board_reset(&b->board);
+        if ((b->host || cfg_queue) && b->new_sent_ns) hist_record_us(&w->stats.join_lat, (now - b->new_sent_ns) / 1000);
+        if (b->color == 0) b->move_due_ns = now + FIRST_MOVE_DELAY_NS;
+    }
+    else if (strcmp(line, ACCEPT_MOVE) == 0) {
+        if (b->mv_sent_ns) {
+            hist_record_us(&w->stats.move_lat, (now - b->mv_sent_ns) / 1000);
+            STAT_ADD(w->stats.c.moves, 1);
+            board_apply(&b->board, b->pending_mv);
+            b->plies++;
+        }
+        b->mv_sent_ns = 0;
+    }
+    else if (strncmp(line, "OPP_MV ", 7) == 0) {
+        board_apply(&b->board, line + 7);
+        b->plies++;
+        schedule_move(b);
+    }
+    else if (strcmp(line, DRAW_OFFER) == 0) {
+        /* Offers made during the scripted ending are accepted, others declined */
+        bot_send(w, b, (b->plies >= cfg_plies || run_over()) ? ACCEPT_DRAW : DECLINE_DRAW);
+    }
+    else if (strcmp(line, DRAW_DECLINED) == 0) {
+        if (b->ending) bot_send(w, b, RESIGN);
+    }
+    else if (strncmp(line, "OPP_RESUME", 10) == 0) STAT_ADD(w->stats.c.opp_resumed, 1);
+    else if (strcmp(line, WAIT_FOR_RECONNECT) == 0) STAT_ADD(w->stats.c.wait_conn, 1);
+    else if (strncmp(line, "RESUME ", 7) == 0) {
+        if (b->resuming) {
+            hist_record_us(&w->stats.resume_lat, (now - b->reconn_start_ns) / 1000);
+            STAT_ADD(w->stats.c.resumed, 1);
+            STAT_ADD(w->stats.c.conns, 1);
+        }
+        /* The replica is rebuilt from HISTORY; TIME closes the resync */
+        b->resuming = 0;
+        b->phase = BOT_GAME;
+        b->color = strstr(line, " white") ? 0 : 1;
+        b->plies = 0;
+        b->ending = 0;
+        b->sync_pending = 1;
+        board_reset(&b->board);
+    }
+    else if (strncmp(line, "HISTORY ", 8) == 0) {
+        if (b->sync_pending) {
+            hist_record_us(&w->stats.history_lat, (now - b->reconn_start_ns) / 1000);
+            char *save = NULL;
+            for (char *tok = strtok_r(line + 8, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+                board_apply(&b->board, tok);
+                b->plies++;
+            }
+        }
+    }
+    else if (strncmp(line, "TIME", 4) == 0) {
+        if (b->sync_pending) {
+            b->sync_pending = 0;
+            if (b->plies % 2 == b->color) schedule_move(b);
+        }
+    }
+    else if (strcmp(line, IN_CHECK) == 0) {
+        /* Informational */
+    }
+    else if (strcmp(line, WON_BY_CHECKMATE) == 0 || strcmp(line, LOST_BY_CHECKMATE) == 0 ||
+             strcmp(line, STALEMATE) == 0 || strcmp(line, YOU_RESIGNED) == 0 ||
+             strcmp(line, OPPONENT_RESIGNED) == 0 || strcmp(line, DRAW_ACCEPTED) == 0 ||
+             strcmp(line, OPPONENT_QUIT) == 0 || strcmp(line, YOU_TIMED_OUT) == 0 ||
+             strcmp(line, OPPONENT_TIMED_OUT) == 0) {
+        game_over(w, b);
+    }
+    else if (strcmp(line, OPPONENT_KICKED_OUT) == 0) {
+        STAT_ADD(w->stats.c.errors[ERR_KICK], 1);
+        game_over(w, b);
+    }
+    else if (strncmp(line, "ERR", 3) == 0) {
+        STAT_ADD(w->stats.c.errors[ERR_MSG], 1);
+        if (b->phase == BOT_GAME && b->mv_sent_ns) {
+            /* Our replica diverged from the server: give the game up */
+            b->mv_sent_ns = 0;
+            b->ending = 1;
+            bot_send(w, b, RESIGN);
+        }
+    }
+    else STAT_ADD(w->stats.c.errors[ERR_UNKNOWN], 1);
+}
+
+static void handle_readable(Worker *w, Bot *b) {
+    while (b->fd >= 0) {
+        ssize_t n = recv(b->fd, b->rbuf + b->rlen, sizeof(b->rbuf) - b->rlen - 1, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+            bot_fail(w, b, ERR_EOF);
+            return;
+        }
+        if (n == 0) {
+            bot_fail(w, b, ERR_EOF);
+            return;
+        }
+        b->rlen += n;
+        size_t start = 0;
+        for (size_t i = 0; i < b->rlen && b->fd >= 0; i++) {
+            if (b->rbuf[i] != '\n') continue;
+            b->rbuf[i] = '\0';
+            if (i > start && b->rbuf[i - 1] == '\r') b->rbuf[i - 1] = '\0';
+            if (b->rbuf[start]) handle_line(w, b, b->rbuf + start);
+            start = i + 1;
+        }
+        if (b->fd < 0) return;
+        memmove(b->rbuf, b->rbuf + start, b->rlen - start);
+        b->rlen -= start;
+        if (b->rlen >= sizeof(b->rbuf) - 1) b->rlen = 0; /* Oversized line, drop it */
+    }
+}
+
+static void handle_event(Worker *w, Bot *b, uint32_t events) {
+    if (b->phase == BOT_CONNECTING) {
+        int err = 0; socklen_t len = sizeof(err);
+        getsockopt(b->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) { bot_fail(w, b, ERR_CONNECT); return; }
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = b };
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, b->fd, &ev);
+        b->phase = BOT_HANDSHAKE;
+        b->next_ping_ns = bench_now_ns() + (uint64_t)cfg_ping_ms * 1000000ull;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) handle_readable(w, b);
+}
+
+/**
+ * @brief Drops a share of this worker's in-game bots at once with an abortive close.
+ */
+static void storm_hit(Worker *w, uint64_t now) {
+    struct linger lg = { 1, 0 }; /* RST instead of FIN, like a vanished client */
+    for (int i = 0; i < w->nbots; i++) {
+        Bot *b = &w->bots[i];
+        if (b->phase != BOT_GAME || b->fd < 0) continue;
+        if ((int)(rnd(b) % 100) >= cfg_storm_pct) continue;
+        setsockopt(b->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, b->fd, NULL);
+        close(b->fd);
+        b->fd = -1;
+        b->phase = BOT_DOWN;
+        b->resuming = 1;
+        b->sync_pending = 0;
+        b->mv_sent_ns = 0;
+        b->move_due_ns = 0;
+        b->down_until_ns = now + (uint64_t)cfg_storm_down_ms * 1000000ull;
+        STAT_ADD(w->stats.c.dropped, 1);
+    }
+}
+
+/**
+ * @brief Fires time-based actions: ramp-up connects, storms, moves, pings and timeouts.
+ */
+static void run_timers(Worker *w, uint64_t now) {
+    if (cfg_storm && now >= w->next_storm_ns) {
+        storm_hit(w, now);
+        w->next_storm_ns = cfg_storm_every > 0 ? now + (uint64_t)cfg_storm_every * 1000000000ull : UINT64_MAX;
+    }
+    for (int i = 0; i < w->nbots; i++) {
+        Bot *b = &w->bots[i];
+        if (b->phase == BOT_IDLE) {
+            if (now >= b->connect_at_ns) bot_connect(w, b);
+            continue;
+        }
+        if (b->phase == BOT_DOWN) {
+            if (now >= b->down_until_ns) {
+                b->reconn_start_ns = now;
+                bot_connect(w, b);
+            }
+            continue;
+        }
+        if (b->resuming && now > b->reconn_start_ns + RESUME_TIMEOUT_NS) {
+            STAT_ADD(w->stats.c.resume_timeout, 1);
+            b->resuming = 0;
+        }
+        if (b->phase == BOT_CLOSED || b->phase == BOT_CONNECTING) continue;
+        if (b->move_due_ns && now >= b->move_due_ns) make_move(w, b);
+        if (b->fd >= 0 && b->mv_sent_ns && now > b->mv_sent_ns + MOVE_TIMEOUT_NS) {
+            STAT_ADD(w->stats.c.errors[ERR_TIMEOUT], 1);
+            b->mv_sent_ns = 0;
+        }
+        if (b->fd >= 0 && cfg_ping_ms > 0 && now >= b->next_ping_ns) {
+            b->ping_sent_ns = now;
+            b->next_ping_ns = now + (uint64_t)cfg_ping_ms * 1000000ull;
+            bot_send(w, b, PING);
+        }
+    }
+}
+
+static int worker_done(Worker *w) {
+    for (int i = 0; i < w->nbots; i++) if (w->bots[i].phase != BOT_CLOSED) return 0;
+    return 1;
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = (Worker *)arg;
+    struct epoll_event events[256];
+    while (!hard_stop && !worker_done(w)) {
+        int n = epoll_wait(w->epfd, events, 256, 5);
+        for (int i = 0; i < n; i++) handle_event(w, (Bot *)events[i].data.ptr, events[i].events);
+        uint64_t now = bench_now_ns();
+        run_timers(w, now);
+        if (now > stop_ns + DRAIN_GRACE_NS) break;
+    }
+    for (int i = 0; i < w->nbots; i++) if (w->bots[i].fd >= 0) bot_close(w, &w->bots[i]);
+    return NULL;
+}
+
+/* --- Reporting --- */
+
+static void sum_counters(Worker *ws, int n, Counters *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < n; i++) {
+        const Counters *c = &ws[i].stats.c;
+        out->conns += STAT_GET(c->conns);
+        out->moves += STAT_GET(c->moves);
+        out->game_ends += STAT_GET(c->game_ends);
+        out->lists += STAT_GET(c->lists);
+        out->draws_offered += STAT_GET(c->draws_offered);
+        out->dropped += STAT_GET(c->dropped);
+        out->resumed += STAT_GET(c->resumed);
+        out->resume_miss += STAT_GET(c->resume_miss);
+        out->resume_timeout += STAT_GET(c->resume_timeout);
+        out->wait_conn += STAT_GET(c->wait_conn);
+        out->opp_resumed += STAT_GET(c->opp_resumed);
+        for (int e = 0; e < ERR_COUNT; e++) out->errors[e] += STAT_GET(c->errors[e]);
+    }
+}
+
+static uint64_t total_errors(const Counters *s) {
+    uint64_t t = 0;
+    for (int e = 0; e < ERR_COUNT; e++) t += s->errors[e];
+    return t;
+}
+
+static void stats_init(Stats *s) {
+    memset(&s->c, 0, sizeof(s->c));
+    hist_init(&s->conn_lat); hist_init(&s->move_lat);
+    hist_init(&s->ping_lat); hist_init(&s->join_lat);
+    hist_init(&s->resume_lat); hist_init(&s->history_lat);
+}
+
+/**
+ * @brief Prints the server's STATS (and, on chaos builds, FAULTS) replies from
+ * its admin console, if configured.
+ */
+static void print_server_stats(void) {
+    if (cfg_admin_port <= 0) return;
+    struct sockaddr_in addr = server_addr;
+    addr.sin_port = htons(cfg_admin_port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        printf("server stats   unavailable (admin port %d)\n", cfg_admin_port);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    const char *req = cfg_queue ? "STATS\nQUEUE\nFAULTS\nQUIT\n" : "STATS\nFAULTS\nQUIT\n";
+    send(fd, req, strlen(req), MSG_NOSIGNAL);
+    char buf[BIG_BUFFER_SZ];
+    size_t len = 0;
+    ssize_t n;
+    while (len + 1 < sizeof(buf) && (n = recv(fd, buf + len, sizeof(buf) - len - 1, 0)) > 0) len += n;
+    buf[len] = '\0';
+    printf("--- server (admin STATS) ---\n");
+    for (char *save = NULL, *line = strtok_r(buf, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        /* Servers built without FAULT_INJECT reject FAULTS */
+        if (strcmp(line, "END") == 0 || strncmp(line, "ERR ", 4) == 0) continue;
+        printf("%s\n", line);
+    }
+    close(fd);
+}
+
+static void print_summary(Worker *ws, int n, double elapsed) {
+    static Stats total;
+    stats_init(&total);
+    sum_counters(ws, n, &total.c);
+    for (int i = 0; i < n; i++) {
+        hist_merge(&total.conn_lat, &ws[i].stats.conn_lat);
+        hist_merge(&total.move_lat, &ws[i].stats.move_lat);
+        hist_merge(&total.ping_lat, &ws[i].stats.ping_lat);
+        hist_merge(&total.join_lat, &ws[i].stats.join_lat);
+        hist_merge(&total.resume_lat, &ws[i].stats.resume_lat);
+        hist_merge(&total.history_lat, &ws[i].stats.history_lat);
+    }
+
+    printf("\n=== Load generator summary (%.1fs, %d clients, %d threads) ===\n", elapsed, cfg_clients, cfg_threads);
+    printf("connections    %llu (%.1f/s)\n", (unsigned long long)total.c.conns, total.c.conns / elapsed);
+    printf("moves          %llu (%.1f/s)\n", (unsigned long long)total.c.moves, total.c.moves / elapsed);
+    printf("games          %llu (%.1f/s)\n", (unsigned long long)(total.c.game_ends / 2), total.c.game_ends / 2 / elapsed);
+    printf("room lists     %llu\n", (unsigned long long)total.c.lists);
+    printf("draw offers    %llu\n", (unsigned long long)total.c.draws_offered);
+    hist_print(stdout, "connect", &total.conn_lat);
+    hist_print(stdout, "new->start", &total.join_lat);
+    hist_print(stdout, "move", &total.move_lat);
+    hist_print(stdout, "ping", &total.ping_lat);
+    if (cfg_storm) {
+        printf("--- storm (pct=%d at=%ds every=%ds down=%dms) ---\n", cfg_storm_pct, cfg_storm_at, cfg_storm_every, cfg_storm_down_ms);
+        printf("dropped        %llu\n", (unsigned long long)total.c.dropped);
+        printf("resumed        %llu\n", (unsigned long long)total.c.resumed);
+        printf("resume_miss    %llu\n", (unsigned long long)total.c.resume_miss);
+        printf("resume_timeout %llu\n", (unsigned long long)total.c.resume_timeout);
+        printf("wait_conn      %llu\n", (unsigned long long)total.c.wait_conn);
+        printf("opp_resumed    %llu\n", (unsigned long long)total.c.opp_resumed);
+        hist_print(stdout, "resume", &total.resume_lat);
+        hist_print(stdout, "history", &total.history_lat);
+    }
+    printf("errors         %llu\n", (unsigned long long)total_errors(&total.c));
+    for (int e = 0; e < ERR_COUNT; e++)
+        if (total.c.errors[e]) printf("  %-12s %llu\n", err_names[e], (unsigned long long)total.c.errors[e]);
+    print_server_stats();
+}
+
+static void on_sigint(int sig) {
+    (void)sig;
+    hard_stop = 1;
+}
+
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *ip = "127.0.0.1";
+    int port = DEFAULT_PORT;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "ip=", 3) == 0) ip = argv[i] + 3;
+        else if (strncmp(argv[i], "port=", 5) == 0) port = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "clients=", 8) == 0) cfg_clients = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "threads=", 8) == 0) cfg_threads = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "duration=", 9) == 0) cfg_duration = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "ramp=", 5) == 0) cfg_ramp = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "plies=", 6) == 0) cfg_plies = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "games=", 6) == 0) cfg_games = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "think=", 6) == 0) cfg_think_ms = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "ping=", 5) == 0) cfg_ping_ms = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "draw=", 5) == 0) cfg_draw_pct = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "list=", 5) == 0) cfg_list_pct = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "seed=", 5) == 0) cfg_seed = (unsigned)strtoul(argv[i] + 5, NULL, 10);
+        else if (strncmp(argv[i], "scenario=", 9) == 0) cfg_storm = (strcmp(argv[i] + 9, "storm") == 0);
+        else if (strncmp(argv[i], "storm_pct=", 10) == 0) cfg_storm_pct = atoi(argv[i] + 10);
+        else if (strncmp(argv[i], "storm_at=", 9) == 0) cfg_storm_at = atoi(argv[i] + 9);
+        else if (strncmp(argv[i], "storm_every=", 12) == 0) cfg_storm_every = atoi(argv[i] + 12);
+        else if (strncmp(argv[i], "storm_down_ms=", 14) == 0) cfg_storm_down_ms = atoi(argv[i] + 14);
+        else if (strncmp(argv[i], "admin=", 6) == 0) cfg_admin_port = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "queue=", 6) == 0) cfg_queue = atoi(argv[i] + 6);
+        else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return EXIT_FAILURE; }
+    }
+    if (cfg_clients < 2) cfg_clients = 2;
+    cfg_clients &= ~1; /* Bots play in pairs */
+    if (cfg_threads < 1) cfg_threads = 1;
+    if (cfg_threads > cfg_clients / 2) cfg_threads = cfg_clients / 2;
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &server_addr.sin_addr) != 1) { fprintf(stderr, "Bad ip: %s\n", ip); return EXIT_FAILURE; }
+
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_sigint);
+
+    Bot *bots = calloc(cfg_clients, sizeof(Bot));
+    Worker *ws = calloc(cfg_threads, sizeof(Worker));
+    if (!bots || !ws) return EXIT_FAILURE;
+
+    start_ns = bench_now_ns();
+    stop_ns = start_ns + (uint64_t)cfg_duration * 1000000000ull;
+
+    /* Pairs are assigned round-robin and kept on one thread so peers never race */
+    int pairs = cfg_clients / 2;
+    int *per_thread = calloc(cfg_threads, sizeof(int));
+    for (int p = 0; p < pairs; p++) per_thread[p % cfg_threads] += 2;
+    int offset = 0;
+    for (int t = 0; t < cfg_threads; t++) {
+        ws[t].id = t;
+        ws[t].bots = bots + offset;
+        ws[t].nbots = per_thread[t];
+        ws[t].epfd = epoll_create1(0);
+        ws[t].next_storm_ns = start_ns + (uint64_t)cfg_storm_at * 1000000000ull;
+        stats_init(&ws[t].stats);
+        offset += per_thread[t];
+    }
+    free(per_thread);
+
+    for (int i = 0; i < cfg_clients; i++) {
+        Bot *b = &bots[i];
+        b->fd = -1;
+        b->index = i;
+        b->host = (i % 2 == 0);
+        b->peer = b->host ? &bots[i + 1] : &bots[i - 1];
+        b->join_room = -1;
+        b->phase = BOT_IDLE;
+        b->rng = cfg_seed * 2654435761u + (unsigned)i * 40503u + 1;
+        b->connect_at_ns = start_ns + (cfg_ramp > 0 ? (uint64_t)i * 1000000000ull / cfg_ramp : 0);
+    }
+
+    pthread_t *tids = calloc(cfg_threads, sizeof(pthread_t));
+    int *joined = calloc(cfg_threads, sizeof(int));
+    for (int t = 0; t < cfg_threads; t++) pthread_create(&tids[t], NULL, worker_main, &ws[t]);
+
+    /* Interval report once per second */
+    Counters prev, cur;
+    memset(&prev, 0, sizeof(prev));
+    int running = cfg_threads;
+    while (running > 0 && !hard_stop) {
+        sleep(1);
+        sum_counters(ws, cfg_threads, &cur);
+        printf("t=%3llus conns/s=%-7llu moves/s=%-8llu games/s=%-6llu errors=%llu\n",
+               (unsigned long long)((bench_now_ns() - start_ns) / 1000000000ull),
+               (unsigned long long)(cur.conns - prev.conns),
+               (unsigned long long)(cur.moves - prev.moves),
+               (unsigned long long)((cur.game_ends - prev.game_ends) / 2),
+               (unsigned long long)total_errors(&cur));
+        fflush(stdout);
+        prev = cur;
+        running = 0;
+        for (int t = 0; t < cfg_threads; t++) {
+            if (!joined[t] && pthread_tryjoin_np(tids[t], NULL) == 0) joined[t] = 1;
+            if (!joined[t]) running++;
+        }
+    }
+    for (int t = 0; t < cfg_threads; t++) if (!joined[t]) pthread_join(tids[t], NULL);
+
+    double elapsed = (bench_now_ns() - start_ns) / 1e9;
+    print_summary(ws, cfg_threads, elapsed);
+
+    Counters final;
+    sum_counters(ws, cfg_threads, &final);
+    free(joined); free(tids); free(ws); free(bots);
+    return total_errors(&final) ? 2 : 0;
+}
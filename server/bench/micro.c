@@ -0,0 +1,380 @@
+/**
+ * @file micro.c
+ * @brief Microbenchmarks for the move validator and the room registry.
+ *
+ * Times the functions on the per-move path (game.c) and the lobby LIST path
+ * (get_room_list_str) in isolation, so a change to the rules code can be
+ * measured without the network in the way. Inputs come from a fixed corpus of
+ * middlegame and endgame positions; every benchmark walks the same inputs in
+ * the same order on every run.
+ *
+ * Each benchmark is calibrated until one repetition takes at least MIN_REP_NS,
+ * then repeated `reps` times. The reported figures are the median over the
+ * repetitions (min in parentheses): nanoseconds per call and TSC ticks per
+ * call (x86 only; the TSC runs at the nominal frequency, not the boosted one).
+ *
+ * With json=FILE the results are also written one benchmark per line, so two
+ * builds can be compared with a plain diff.
+ *
+ * Usage: micro.exe [filter=NAME] [reps=9] [rooms=200] [json=FILE|-] [label=TEXT]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "client.h"
+#include "match.h"
+#include "game.h"
+#include "bench_util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+static inline uint64_t tsc_now(void) { return __rdtsc(); }
+#else
+#define HAVE_TSC 0
+static inline uint64_t tsc_now(void) { return 0; }
+#endif
+
+#define MIN_REP_NS 20000000ull  /**< 20 ms per repetition after calibration */
+#define MAX_REPS 64
+#define MAX_INPUTS 200000
+
+/* The server globals normally defined in main.c */
+int max_rooms = -1;
+int max_players = -1;
+
+/**
+ * @brief Benchmark corpus: typical middlegames first, then endgames.
+ */
+static const char *corpus[] = {
+    /* Middlegames */
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r1bq1rk1/pp2bppp/2n1pn2/2pp4/3P4/2PBPN2/PP1N1PPP/R1BQ1RK1 w - - 0 8",
+    "r2q1rk1/ppp2ppp/2npbn2/2b1p3/2B1P3/2NP1N2/PPP1QPPP/R1B2RK1 w - - 6 8",
+    "r1bqk2r/pp1nbppp/2p1pn2/3p4/2PP4/2N1PN2/PPQ2PPP/R1B1KB1R w KQkq - 2 7",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "2rq1rk1/pb1nbppp/1p2pn2/2pp4/2PP4/1PN1PN2/PB2BPPP/2RQ1RK1 w - - 4 11",
+    "r1b2rk1/2q1bppp/p2ppn2/1p6/3BPP2/2N2B2/PPPQ2PP/R4R1K b - - 0 14",
+    "rnbqkb1r/pp3ppp/4pn2/2pp4/2PP4/2N2N2/PP2PPPP/R1BQKB1R w KQkq c6 0 5",
+    "3r1rk1/p4ppp/1qp1bn2/2b1p3/4P3/1BN2Q2/PPP2PPP/R1B2RK1 w - - 2 15",
+    "r1bq1rk1/pp3ppp/2n1p3/3n4/1b1P4/2NB1N2/PP3PPP/R1BQR1K1 w - - 0 11",
+    "r2qr1k1/1b1nbppp/p2p1n2/1p2p3/3PP3/1BP2N1P/PP1N1PP1/R1BQR1K1 b - - 0 13",
+    /* Endgames */
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1",
+    "8/5pk1/6p1/7p/7P/6P1/5PK1/3R4 w - - 0 40",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "8/8/8/4k3/8/8/4KQ2/8 w - - 0 1",
+    "8/1k6/8/8/3N4/8/4B3/4K3 w - - 0 1",
+    "4r1k1/5ppp/8/8/8/2B5/5PPP/4R1K1 b - - 0 30",
+    "8/6pk/7p/8/1R6/6PK/8/8 w - - 0 45",
+    "2k5/8/1P6/8/8/8/5K2/8 w - - 0 50",
+    "4k3/8/8/8/8/8/8/R3K2R w KQ - 0 1",
+    "8/P7/8/8/8/8/6k1/4K3 w - - 0 1",
+    "5rk1/pp3ppp/8/3q4/8/1P3Q2/P4PPP/5RK1 b - - 3 28",
+};
+#define NPOS ((int)(sizeof(corpus) / sizeof(corpus[0])))
+
+static Match positions[NPOS];
+
+/* --- Prepared inputs --- */
+
+typedef struct { uint8_t pos, color, r1, c1, r2, c2; char promo; } Move;
+
+static Move *squares;       /**< every square x both colours (is_square_attacked) */
+static Move *lines;         /**< aligned square pairs (path_clear) */
+static Move *tries;         /**< own piece x every destination (is_legal_move_basic) */
+static Move *pseudo;        /**< moves passing is_legal_move_basic */
+static Move *legal;         /**< moves also passing move_leaves_in_check */
+static char (*texts)[8];    /**< move strings, legal and malformed */
+static int n_squares, n_lines, n_tries, n_pseudo, n_legal, n_texts;
+static int cfg_rooms = 200;
+
+static volatile uint64_t sink;
+
+static void push(Move *arr, int *n, int pos, int color, int r1, int c1, int r2, int c2) {
+    if (*n >= MAX_INPUTS) return;
+    arr[(*n)++] = (Move){ (uint8_t)pos, (uint8_t)color, (uint8_t)r1, (uint8_t)c1, (uint8_t)r2, (uint8_t)c2, 0 };
+}
+
+static void format_move(const Move *mv, char *out) {
+    out[0] = (char)('a' + mv->c1); out[1] = (char)('8' - mv->r1);
+    out[2] = (char)('a' + mv->c2); out[3] = (char)('8' - mv->r2);
+    out[4] = mv->promo; out[5] = '\0';
+}
+
+static int prepare(void) {
+    static const char *malformed[] = { "e2e9", "i2i4", "e2-e4", "e7e8k", "e2", "E2E4", "e2e4qq", "" };
+
+    squares = malloc(sizeof(Move) * MAX_INPUTS);
+    lines = malloc(sizeof(Move) * MAX_INPUTS);
+    tries = malloc(sizeof(Move) * MAX_INPUTS);
+    pseudo = malloc(sizeof(Move) * MAX_INPUTS);
+    legal = malloc(sizeof(Move) * MAX_INPUTS);
+    texts = malloc(sizeof(*texts) * MAX_INPUTS);
+    if (!squares || !lines || !tries || !pseudo || !legal || !texts) return -1;
+
+    for (int p = 0; p < NPOS; p++) {
+        Match *m = &positions[p];
+        if (load_fen(m, corpus[p]) != 0) {
+            fprintf(stderr, "bad corpus FEN: %s\n", corpus[p]);
+            return -1;
+        }
+        for (int r = 0; r < 8; r++) for (int c = 0; c < 8; c++) {
+            push(squares, &n_squares, p, 0, r, c, r, c);
+            push(squares, &n_squares, p, 1, r, c, r, c);
+            for (int r2 = 0; r2 < 8; r2++) for (int c2 = 0; c2 < 8; c2++) {
+                int dr = abs(r2 - r), dc = abs(c2 - c);
+                if ((dr == 0 || dc == 0 || dr == dc) && (dr > 1 || dc > 1))
+                    push(lines, &n_lines, p, 0, r, c, r2, c2);
+            }
+            Piece pc = m->state.board[r][c];
+            if (pc == EMPTY || piece_color(pc) != m->turn) continue;
+            for (int r2 = 0; r2 < 8; r2++) for (int c2 = 0; c2 < 8; c2++) {
+                push(tries, &n_tries, p, m->turn, r, c, r2, c2);
+                if (!is_legal_move_basic(m, m->turn, r, c, r2, c2)) continue;
+                push(pseudo, &n_pseudo, p, m->turn, r, c, r2, c2);
+                if (move_leaves_in_check(m, m->turn, r, c, r2, c2)) continue;
+                push(legal, &n_legal, p, m->turn, r, c, r2, c2);
+                if (abs(pc) == WPAWN && (r2 == 0 || r2 == 7)) legal[n_legal - 1].promo = 'n';
+            }
+        }
+    }
+    for (int i = 0; i < n_legal; i++) format_move(&legal[i], texts[n_texts++]);
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+        snprintf(texts[n_texts++], sizeof(texts[0]), "%s", malformed[i]);
+
+    /* Open rooms for LIST. sock 0 keeps the watchdogs from touching them. */
+    for (int i = 0; i < cfg_rooms; i++) {
+        Client *c = client_create(0, (uint32_t)i);
+        if (!c) return -1;
+        snprintf(c->name, sizeof(c->name), "player%04d", i);
+        if (!match_create(c, NULL)) return -1;
+    }
+    return 0;
+}
+
+/* --- Benchmarks: each runs one pass over its inputs and returns the call count --- */
+
+static uint64_t bench_square_attacked(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < n_squares; i++) {
+        const Move *mv = &squares[i];
+        acc += is_square_attacked(&positions[mv->pos].state, mv->r1, mv->c1, mv->color);
+    }
+    sink += acc;
+    return n_squares;
+}
+
+static uint64_t bench_path_clear(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < n_lines; i++) {
+        const Move *mv = &lines[i];
+        acc += path_clear(&positions[mv->pos].state, mv->r1, mv->c1, mv->r2, mv->c2);
+    }
+    sink += acc;
+    return n_lines;
+}
+
+static uint64_t bench_legal_basic(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < n_tries; i++) {
+        const Move *mv = &tries[i];
+        acc += is_legal_move_basic(&positions[mv->pos], mv->color, mv->r1, mv->c1, mv->r2, mv->c2);
+    }
+    sink += acc;
+    return n_tries;
+}
+
+static uint64_t bench_leaves_in_check(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < n_pseudo; i++) {
+        const Move *mv = &pseudo[i];
+        acc += move_leaves_in_check(&positions[mv->pos], mv->color, mv->r1, mv->c1, mv->r2, mv->c2);
+    }
+    sink += acc;
+    return n_pseudo;
+}
+
+static uint64_t bench_any_legal(void) {
+    uint64_t acc = 0;
+    for (int p = 0; p < NPOS; p++) {
+        acc += has_any_legal_move(&positions[p], 0);
+        acc += has_any_legal_move(&positions[p], 1);
+    }
+    sink += acc;
+    return 2 * NPOS;
+}
+
+/* Includes restoring the position (board copy plus the rule flags) */
+static uint64_t bench_apply_move(void) {
+    static Match scratch;
+    uint64_t acc = 0;
+    for (int i = 0; i < n_legal; i++) {
+        const Move *mv = &legal[i];
+        const Match *src = &positions[mv->pos];
+        scratch.state = src->state;
+        scratch.turn = src->turn;
+        scratch.w_can_kingside = src->w_can_kingside; scratch.w_can_queenside = src->w_can_queenside;
+        scratch.b_can_kingside = src->b_can_kingside; scratch.b_can_queenside = src->b_can_queenside;
+        scratch.ep_r = src->ep_r; scratch.ep_c = src->ep_c;
+        apply_move(&scratch, mv->r1, mv->c1, mv->r2, mv->c2, mv->promo);
+        acc += (uint64_t)scratch.state.board[mv->r2][mv->c2];
+    }
+    sink += acc;
+    return n_legal;
+}
+
+static uint64_t bench_find_king(void) {
+    uint64_t acc = 0;
+    for (int p = 0; p < NPOS; p++) {
+        int r, c;
+        acc += find_king(&positions[p].state, 0, &r, &c) + (uint64_t)r;
+        acc += find_king(&positions[p].state, 1, &r, &c) + (uint64_t)c;
+    }
+    sink += acc;
+    return 2 * NPOS;
+}
+
+static uint64_t bench_parse_move(void) {
+    uint64_t acc = 0;
+    for (int i = 0; i < n_texts; i++) {
+        if (!is_move_format(texts[i])) continue;
+        int r1, c1, r2, c2;
+        parse_move(texts[i], &r1, &c1, &r2, &c2);
+        acc += (uint64_t)(r1 + c1 + r2 + c2);
+    }
+    sink += acc;
+    return n_texts;
+}
+
+static uint64_t bench_room_list(void) {
+    char *s = get_room_list_str();
+    if (s) { sink += (uint64_t)s[0]; free(s); }
+    return 1;
+}
+
+typedef struct {
+    const char *name;
+    uint64_t (*pass)(void);
+} MicroBench;
+
+static const MicroBench benches[] = {
+    { "is_square_attacked",  bench_square_attacked },
+    { "path_clear",          bench_path_clear },
+    { "is_legal_move_basic", bench_legal_basic },
+    { "move_leaves_in_check", bench_leaves_in_check },
+    { "has_any_legal_move",  bench_any_legal },
+    { "apply_move",          bench_apply_move },
+    { "find_king",           bench_find_king },
+    { "parse_move",          bench_parse_move },
+    { "get_room_list_str",   bench_room_list },
+};
+
+typedef struct {
+    uint64_t calls;         /**< Calls per repetition */
+    double ns_med, ns_min;
+    double tsc_med, tsc_min;
+} Result;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static Result run_bench(const MicroBench *b, int reps) {
+    Result res = {0};
+    double ns[MAX_REPS], tsc[MAX_REPS];
+
+    /* Calibrate (also warms caches and branch predictors) */
+    uint64_t passes = 1;
+    for (;;) {
+        uint64_t t0 = bench_now_ns();
+        for (uint64_t i = 0; i < passes; i++) b->pass();
+        if (bench_now_ns() - t0 >= MIN_REP_NS) break;
+        passes *= 2;
+    }
+
+    for (int r = 0; r < reps; r++) {
+        uint64_t calls = 0;
+        uint64_t c0 = tsc_now();
+        uint64_t t0 = bench_now_ns();
+        for (uint64_t i = 0; i < passes; i++) calls += b->pass();
+        uint64_t t1 = bench_now_ns();
+        uint64_t c1 = tsc_now();
+        ns[r] = (double)(t1 - t0) / calls;
+        tsc[r] = (double)(c1 - c0) / calls;
+        res.calls = calls;
+    }
+    qsort(ns, reps, sizeof(double), cmp_double);
+    qsort(tsc, reps, sizeof(double), cmp_double);
+    res.ns_med = ns[reps / 2]; res.ns_min = ns[0];
+    res.tsc_med = tsc[reps / 2]; res.tsc_min = tsc[0];
+    return res;
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL, *json_path = NULL, *label = "";
+    int reps = 9;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "filter=", 7) == 0) filter = argv[i] + 7;
+        else if (strncmp(argv[i], "reps=", 5) == 0) reps = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "rooms=", 6) == 0) cfg_rooms = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "json=", 5) == 0) json_path = argv[i] + 5;
+        else if (strncmp(argv[i], "label=", 6) == 0) label = argv[i] + 6;
+        else {
+            fprintf(stderr, "usage: %s [filter=NAME] [reps=9] [rooms=200] [json=FILE|-] [label=TEXT]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    if (cfg_rooms < 0) cfg_rooms = 0;
+
+    if (prepare() != 0) {
+        fprintf(stderr, "failed to prepare inputs\n");
+        return 1;
+    }
+    printf("corpus: %d positions, %d pseudo-legal / %d legal moves, %d open rooms, %d reps\n",
+           NPOS, n_pseudo, n_legal, cfg_rooms, reps);
+    printf("%-22s %12s %18s %18s\n", "benchmark", "calls/rep", "ns/op (min)", HAVE_TSC ? "tsc/op (min)" : "tsc/op (n/a)");
+
+    FILE *json = NULL;
+    if (json_path) {
+        json = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!json) { perror(json_path); return 1; }
+    }
+
+    Result results[sizeof(benches) / sizeof(benches[0])];
+    int ran[sizeof(benches) / sizeof(benches[0])] = {0};
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (filter && !strstr(benches[i].name, filter)) continue;
+        results[i] = run_bench(&benches[i], reps);
+        ran[i] = 1;
+        printf("%-22s %12llu %9.1f (%6.1f) %9.1f (%6.1f)\n", benches[i].name,
+               (unsigned long long)results[i].calls, results[i].ns_med, results[i].ns_min,
+               results[i].tsc_med, results[i].tsc_min);
+        fflush(stdout);
+    }
+
+    if (json) {
+        fprintf(json, "{\"label\":\"%s\",\"positions\":%d,\"rooms\":%d,\"reps\":%d,\"tsc\":%s,\"results\":[\n",
+                label, NPOS, cfg_rooms, reps, HAVE_TSC ? "true" : "false");
+        const char *sep = "";
+        for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            if (!ran[i]) continue;
+            fprintf(json, "%s{\"name\":\"%s\",\"calls\":%llu,\"ns_per_op\":%.2f,\"ns_per_op_min\":%.2f,"
+                    "\"tsc_per_op\":%.2f,\"tsc_per_op_min\":%.2f}",
+                    sep, benches[i].name, (unsigned long long)results[i].calls,
+                    results[i].ns_med, results[i].ns_min, results[i].tsc_med, results[i].tsc_min);
+            sep = ",\n";
+        }
+        fprintf(json, "\n]}\n");
+        if (json != stdout) fclose(json);
+    }
+    return 0;
+}
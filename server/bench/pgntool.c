@@ -0,0 +1,805 @@
+/**
+ * @file pgntool.c
+ * @brief PGN export of the game archive and parallel PGN import / validation.
+ *
+ * All three modes run every move through the server's own rules engine
+ * (game.c), so a collection that passes validation replays move for move on
+ * the server and an exported game is legal by the same definition.
+ *
+ *   export    archive segments -> PGN (SAN moves, Seven Tag Roster plus
+ *             UTCDate/UTCTime, EndDate/EndTime, Room, Termination, PlyCount)
+ *   validate  parses a PGN file and replays every game, reporting illegal or
+ *             ambiguous moves and results that contradict the final position
+ *   import    validate, then append the good games to an archive directory
+ *
+ * The input (mmap'd PGN file or mapped archive segments) is cut into tasks of
+ * whole games. Each worker owns a deque of task numbers, dealt round-robin so
+ * work proceeds roughly in file order; it takes its own lowest task first and,
+ * once empty, steals the highest task from another worker. Task output goes
+ * into a private buffer and the main thread merges the buffers strictly in
+ * task order, so the output is the same for any number of threads.
+ *
+ * Usage: pgntool.exe mode=export dir=archive [out=games.pgn] [threads=N]
+ *        pgntool.exe mode=validate in=games.pgn [threads=N] [max_errors=20]
+ *        pgntool.exe mode=import in=games.pgn dir=archive [threads=N]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "codec.h"
+#include "game.h"
+#include "match.h"
+#include "bench_util.h"
+
+/* The server objects expect these (normally defined in main.c) */
+int max_rooms = -1;
+int max_players = -1;
+
+#define MAX_SEGMENTS 100000
+#define MAX_THREADS 256
+#define PGN_TASK_BYTES (4 << 20)     /**< Target PGN bytes per task */
+#define PGN_MIN_TASK_BYTES (64 << 10)
+#define EXPORT_TASK_GAMES 4096       /**< Archived games per export task */
+#define PGN_LINE_WIDTH 79
+#define SAN_MAX 16
+
+/**
+ * @brief Gives up once a buffer could not grow: the tool writes no partial output.
+ */
+static void buf_check(const Buf *b) {
+    if (b->failed) { fprintf(stderr, "Out of memory\n"); exit(1); }
+}
+
+static void buf_printf(Buf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || b->failed || buf_reserve(b, (size_t)n + 1) != 0) return;
+    va_start(ap, fmt);
+    vsnprintf((char *)b->data + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+}
+
+/**
+ * An imported game waiting for the in-order merge (names and moves in one block).
+ */
+typedef struct {
+    ArchiveGame g;
+    void *mem;
+} ImportGame;
+
+/**
+ * Output of one task, merged by the main thread in task order.
+ */
+typedef struct {
+    Buf out;                 /**< PGN text (export) or error lines (validate, import) */
+    ImportGame *imported;    /**< Games to append (import) */
+    size_t n_imported, cap_imported;
+    uint64_t games, moves, errors;
+    int done;
+} TaskResult;
+
+/**
+ * Per-worker deque of task numbers (ascending). The owner takes from the head,
+ * thieves from the tail.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t *items;
+    size_t head, tail;
+} Deque;
+
+typedef enum { MODE_EXPORT, MODE_VALIDATE, MODE_IMPORT } Mode;
+
+static Mode mode;
+static int nthreads;
+static Deque deques[MAX_THREADS];
+static TaskResult *results;
+static size_t ntasks;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t n_steals;
+
+/* Input: a PGN file cut at game boundaries, or archive segments cut in game ranges */
+static const char *pgn;
+static size_t *task_off;     /**< ntasks + 1 offsets into pgn */
+static ArchiveSegment *segs;
+static struct { int seg, seg_no; size_t first, count; } *export_tasks;
+
+/** Position every game starts from, copied instead of calling match_alloc() per game */
+static Match *start_pos;
+
+/* --- Rules engine helpers --- */
+
+static int legal(Match *m, int r1, int c1, int r2, int c2) {
+    return is_legal_move_basic(m, m->turn, r1, c1, r2, c2) && !move_leaves_in_check(m, m->turn, r1, c1, r2, c2);
+}
+
+static void play(Match *m, int r1, int c1, int r2, int c2, char promo) {
+    apply_move(m, r1, c1, r2, c2, promo);
+    m->turn = 1 - m->turn;
+}
+
+/**
+ * @brief Resolves a SAN move ("Nbd7", "exd8=Q+", "O-O") in the current position.
+ * Long algebraic ("Ng1-f3") is accepted as well.
+ * @return 0 and the squares on success, -1 if it is malformed, illegal or ambiguous.
+ */
+static int san_to_move(Match *m, const char *san, int *r1, int *c1, int *r2, int *c2, char *promo) {
+    size_t len = strlen(san);
+    int home = m->turn == 0 ? 7 : 0;
+    *promo = 0;
+
+    if (strncmp(san, "O-O", 3) == 0 || strncmp(san, "0-0", 3) == 0) {
+        int queenside = len >= 5;
+        *r1 = *r2 = home; *c1 = 4; *c2 = queenside ? 2 : 6;
+        return abs(m->state.board[home][4]) == 6 && legal(m, *r1, *c1, *r2, *c2) ? 0 : -1;
+    }
+
+    int piece = 1;
+    const char *s = san;
+    const char *letter = *s ? strchr("NBRQK", *s) : NULL;
+    if (letter) { piece = (int)(letter - "NBRQK") + 2; s++; }
+    size_t end = len;
+    if (piece == 1 && end >= 2 && san[end - 2] == '=') { *promo = san[end - 1]; end -= 2; }
+    else if (piece == 1 && end >= 3 && strchr("NBRQ", san[end - 1]) && san[end - 2] >= '1' && san[end - 2] <= '8') { *promo = san[end - 1]; end--; }
+    if (*promo && !strchr("NBRQ", *promo)) return -1;
+
+    const char *dest = san + end - 2;
+    if (dest < s || dest[0] < 'a' || dest[0] > 'h' || dest[1] < '1' || dest[1] > '8') return -1;
+    *c2 = dest[0] - 'a';
+    *r2 = 7 - (dest[1] - '1');
+
+    int want_c = -1, want_r = -1;
+    for (const char *q = s; q < dest; q++) {
+        if (*q >= 'a' && *q <= 'h') want_c = *q - 'a';
+        else if (*q >= '1' && *q <= '8') want_r = 7 - (*q - '1');
+        else if (*q != 'x' && *q != '-' && *q != ':') return -1;
+    }
+
+    Piece own = (Piece)(m->turn == 0 ? piece : -piece);
+    int found = 0;
+    for (int r = 0; r < 8; r++) {
+        if (want_r >= 0 && r != want_r) continue;
+        for (int c = 0; c < 8; c++) {
+            if (want_c >= 0 && c != want_c) continue;
+            if (m->state.board[r][c] != own || !legal(m, r, c, *r2, *c2)) continue;
+            if (found++) return -1;
+            *r1 = r; *c1 = c;
+        }
+    }
+    if (!found) return -1;
+    int last_rank = m->turn == 0 ? 0 : 7;
+    if (piece == 1 && *r2 == last_rank) { if (!*promo) return -1; }
+    else if (*promo) return -1;
+    *promo = *promo ? (char)(*promo | 0x20) : 0;
+    return 0;
+}
+
+/**
+ * @brief Writes the SAN of a legal move (without check marks) before it is played.
+ */
+static void move_to_san(Match *m, int r1, int c1, int r2, int c2, char promo, char *out) {
+    Piece p = m->state.board[r1][c1];
+    int kind = abs(p);
+    char *o = out;
+    if (kind == 6 && abs(c2 - c1) == 2) {
+        strcpy(out, c2 > c1 ? "O-O" : "O-O-O");
+        return;
+    }
+    int capture = m->state.board[r2][c2] != EMPTY || (kind == 1 && c1 != c2);
+    if (kind == 1) {
+        if (capture) { *o++ = (char)('a' + c1); *o++ = 'x'; }
+    } else {
+        *o++ = "NBRQK"[kind - 2];
+        int others = 0, same_file = 0, same_rank = 0;
+        for (int r = 0; r < 8; r++) {
+            for (int c = 0; c < 8; c++) {
+                if ((r == r1 && c == c1) || m->state.board[r][c] != p || !legal(m, r, c, r2, c2)) continue;
+                others++;
+                if (c == c1) same_file = 1;
+                if (r == r1) same_rank = 1;
+            }
+        }
+        if (others && (!same_file || same_rank)) *o++ = (char)('a' + c1);
+        if (others && same_file) *o++ = (char)('1' + 7 - r1);
+        if (capture) *o++ = 'x';
+    }
+    *o++ = (char)('a' + c2);
+    *o++ = (char)('1' + 7 - r2);
+    if (promo) { *o++ = '='; *o++ = (char)(promo & ~0x20); }
+    *o = '\0';
+}
+
+/**
+ * @brief "+" or "#" for the side to move after a move has been played.
+ */
+static const char *check_mark(Match *m) {
+    if (!is_in_check(&m->state, m->turn)) return "";
+    return has_any_legal_move(m, m->turn) ? "+" : "#";
+}
+
+static const char *result_text(int winner, EndReason reason) {
+    if (winner == 0) return "1-0";
+    if (winner == 1) return "0-1";
+    if (reason == END_STALEMATE || reason == END_DRAW_AGREED) return "1/2-1/2";
+    return "*";
+}
+
+static const char *termination_text(EndReason reason) {
+    switch (reason) {
+        case END_TIMEOUT: return "time forfeit";
+        case END_ABANDON: case END_DISCONNECT: return "abandoned";
+        case END_KICKED: return "rules infraction";
+        case END_NONE: case END_CANCELLED: return "unterminated";
+        default: return "normal";
+    }
+}
+
+/* --- Export --- */
+
+static void put_tag(Buf *b, const char *name, const char *value, size_t len) {
+    buf_printf(b, "[%s \"", name);
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] == '"' || value[i] == '\\') buf_put(b, "\\", 1);
+        buf_put(b, value + i, 1);
+    }
+    buf_put(b, "\"]\n", 3);
+}
+
+static void put_time_tags(Buf *b, const char *date_tag, const char *time_tag, uint64_t t) {
+    char date[32] = "????.??.??", clock[32] = "??:??:??";
+    time_t tt = (time_t)t;
+    struct tm tm;
+    if (t && gmtime_r(&tt, &tm)) {
+        strftime(date, sizeof(date), "%Y.%m.%d", &tm);
+        strftime(clock, sizeof(clock), "%H:%M:%S", &tm);
+    }
+    put_tag(b, date_tag, date, strlen(date));
+    if (time_tag) put_tag(b, time_tag, clock, strlen(clock));
+}
+
+/**
+ * @brief Appends one archived game as PGN.
+ * @return Plies written, or -1 if a move is not legal (the game is not written).
+ */
+static long export_game(const ArchiveGame *g, Buf *b, Buf *moves) {
+    Match m = *start_pos;
+    moves->len = 0;
+    size_t col = 0;
+    for (size_t i = 0; i < g->move_count; i++) {
+        char mv[6], san[SAN_MAX], tok[SAN_MAX + 12];
+        int r1, c1, r2, c2;
+        archive_decode_move(g, i, mv);
+        parse_move(mv, &r1, &c1, &r2, &c2);
+        if (!legal(&m, r1, c1, r2, c2)) return -1;
+        move_to_san(&m, r1, c1, r2, c2, mv[4], san);
+        play(&m, r1, c1, r2, c2, mv[4]);
+        int n = (i % 2 == 0) ? snprintf(tok, sizeof(tok), "%zu. %s%s", i / 2 + 1, san, check_mark(&m))
+                             : snprintf(tok, sizeof(tok), "%s%s", san, check_mark(&m));
+        if (col && col + 1 + (size_t)n > PGN_LINE_WIDTH) { buf_put(moves, "\n", 1); col = 0; }
+        else if (col) { buf_put(moves, " ", 1); col++; }
+        buf_put(moves, tok, (size_t)n);
+        col += (size_t)n;
+    }
+    const char *result = result_text(g->winner, g->end_reason);
+    if (col && col + 1 + strlen(result) > PGN_LINE_WIDTH) buf_put(moves, "\n", 1);
+    else if (col) buf_put(moves, " ", 1);
+    buf_printf(moves, "%s\n\n", result);
+
+    char room[16];
+    put_tag(b, "Event", "KIV-UPS online game", 19);
+    put_tag(b, "Site", "?", 1);
+    put_time_tags(b, "Date", NULL, g->started);
+    put_tag(b, "Round", "-", 1);
+    put_tag(b, "White", g->white, g->white_len);
+    put_tag(b, "Black", g->black, g->black_len);
+    put_tag(b, "Result", result, strlen(result));
+    put_time_tags(b, "UTCDate", "UTCTime", g->started);
+    put_time_tags(b, "EndDate", "EndTime", g->ended);
+    put_tag(b, "Room", room, (size_t)snprintf(room, sizeof(room), "%d", g->room_id));
+    put_tag(b, "Termination", termination_text(g->end_reason), strlen(termination_text(g->end_reason)));
+    put_tag(b, "PlyCount", room, (size_t)snprintf(room, sizeof(room), "%zu", g->move_count));
+    buf_put(b, "\n", 1);
+    buf_put(b, moves->data, moves->len);
+    return (long)g->move_count;
+}
+
+static void run_export_task(size_t t, TaskResult *res) {
+    Buf moves = { 0 };
+    ArchiveSegment *seg = &segs[export_tasks[t].seg];
+    for (size_t i = export_tasks[t].first; i < export_tasks[t].first + export_tasks[t].count; i++) {
+        ArchiveGame g;
+        size_t mark = res->out.len;
+        long plies = archive_game(seg, i, 1, &g) == 0 ? export_game(&g, &res->out, &moves) : -1;
+        if (plies < 0) {
+            res->out.len = mark;
+            res->errors++;
+            fprintf(stderr, "Skipping game %zu of segment %d: corrupt record or illegal move\n", i, export_tasks[t].seg_no);
+            continue;
+        }
+        res->games++;
+        res->moves += (uint64_t)plies;
+    }
+    buf_check(&moves);
+    free(moves.data);
+}
+
+/* --- Import / validate --- */
+
+/**
+ * Tag values of the game being parsed (pointers into the mapped file).
+ */
+typedef struct {
+    const char *white, *black, *result, *termination;
+    size_t white_len, black_len, result_len, termination_len;
+    char date[11], time[9], end_date[11], end_time[9];
+    int room;
+} Tags;
+
+static int is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'; }
+
+static int at_line_start(const char *p) { return p == pgn || p[-1] == '\n'; }
+
+static void copy_tag(char *dst, size_t sz, const char *v, size_t len) {
+    if (len >= sz) len = sz - 1;
+    memcpy(dst, v, len);
+    dst[len] = '\0';
+}
+
+/**
+ * @brief Parses one tag pair line starting at '['; returns the start of the next line.
+ */
+static const char *parse_tag(const char *p, const char *end, Tags *tags) {
+    const char *eol = memchr(p, '\n', (size_t)(end - p));
+    if (!eol) eol = end;
+    const char *name = p + 1;
+    while (name < eol && is_space(*name)) name++;
+    const char *name_end = name;
+    while (name_end < eol && !is_space(*name_end) && *name_end != '"') name_end++;
+    const char *v = memchr(name_end, '"', (size_t)(eol - name_end));
+    if (!v) return eol < end ? eol + 1 : end;
+    v++;
+    const char *v_end = v;
+    while (v_end < eol && *v_end != '"') v_end += (*v_end == '\\' && v_end + 1 < eol) ? 2 : 1;
+    if (v_end > eol) v_end = eol;
+
+    size_t nl = (size_t)(name_end - name), vl = (size_t)(v_end - v);
+#define TAG_IS(s) (nl == sizeof(s) - 1 && memcmp(name, s, nl) == 0)
+    if (TAG_IS("White")) { tags->white = v; tags->white_len = vl; }
+    else if (TAG_IS("Black")) { tags->black = v; tags->black_len = vl; }
+    else if (TAG_IS("Result")) { tags->result = v; tags->result_len = vl; }
+    else if (TAG_IS("Termination")) { tags->termination = v; tags->termination_len = vl; }
+    else if (TAG_IS("Date") && !tags->date[0]) copy_tag(tags->date, sizeof(tags->date), v, vl);
+    else if (TAG_IS("UTCDate")) copy_tag(tags->date, sizeof(tags->date), v, vl);
+    else if (TAG_IS("UTCTime")) copy_tag(tags->time, sizeof(tags->time), v, vl);
+    else if (TAG_IS("EndDate")) copy_tag(tags->end_date, sizeof(tags->end_date), v, vl);
+    else if (TAG_IS("EndTime")) copy_tag(tags->end_time, sizeof(tags->end_time), v, vl);
+    else if (TAG_IS("Room")) tags->room = atoi(v);
+#undef TAG_IS
+    return eol < end ? eol + 1 : end;
+}
+
+/**
+ * @brief Unix time of "YYYY.MM.DD" and "HH:MM:SS" (UTC); 0 if the date is unknown.
+ */
+static uint64_t tag_time(const char *date, const char *clock) {
+    struct tm tm = { 0 };
+    if (sscanf(date, "%4d.%2d.%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3) return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    if (sscanf(clock, "%2d:%2d:%2d", &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 3) tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    time_t t = timegm(&tm);
+    return t > 0 ? (uint64_t)t : 0;
+}
+
+static int token_is(const char *tok, size_t len, const char *s) { return strlen(s) == len && memcmp(tok, s, len) == 0; }
+
+/**
+ * @brief Skips a comment, variation, NAG or escape line at p.
+ * @return The position after it, or p if there is none.
+ */
+static const char *skip_annotation(const char *p, const char *end) {
+    if (*p == '{') {
+        const char *q = memchr(p, '}', (size_t)(end - p));
+        return q ? q + 1 : end;
+    }
+    if (*p == ';' || (*p == '%' && at_line_start(p))) {
+        const char *q = memchr(p, '\n', (size_t)(end - p));
+        return q ? q + 1 : end;
+    }
+    if (*p == '$') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') p++;
+        return p;
+    }
+    if (*p == '(') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '{' || *p == ';') { p = skip_annotation(p, end); continue; }
+            if (*p == '(') depth++;
+            else if (*p == ')' && --depth == 0) return p + 1;
+            p++;
+        }
+        return end;
+    }
+    return p;
+}
+
+static void report(TaskResult *res, const char *game, const Tags *tags, const char *fmt, const char *arg) {
+    res->errors++;
+    buf_printf(&res->out, "offset %zu (%.*s - %.*s): ", (size_t)(game - pgn),
+               (int)(tags->white_len > 40 ? 40 : tags->white_len), tags->white ? tags->white : "",
+               (int)(tags->black_len > 40 ? 40 : tags->black_len), tags->black ? tags->black : "");
+    buf_printf(&res->out, fmt, arg);
+    buf_put(&res->out, "\n", 1);
+}
+
+/**
+ * @brief Parses and replays the game starting at p; returns where the next one starts.
+ */
+static const char *import_game(const char *p, const char *end, TaskResult *res, Buf *packed) {
+    const char *game = p;
+    Tags tags = { 0 };
+    while (p < end && *p == '[') {
+        p = parse_tag(p, end, &tags);
+        while (p < end && is_space(*p)) p++;
+    }
+
+    Match m = *start_pos;
+    const char *marker = NULL;
+    size_t marker_len = 0, plies = 0;
+    int bad = 0;
+    packed->len = 0;
+
+    while (p < end) {
+        if (is_space(*p)) { p++; continue; }
+        if (*p == '[' && at_line_start(p)) break;   /* next game, result marker missing */
+        const char *q = skip_annotation(p, end);
+        if (q != p) { p = q; continue; }
+        if (*p == ')' || *p == '!' || *p == '?') { p++; continue; }
+
+        const char *tok = p;
+        while (p < end && !is_space(*p) && !strchr("{}();[$", *p)) p++;
+        size_t len = (size_t)(p - tok);
+        if (!len) { p++; continue; }   /* stray delimiter */
+        if (token_is(tok, len, "1-0") || token_is(tok, len, "0-1") || token_is(tok, len, "1/2-1/2") || token_is(tok, len, "*")) {
+            marker = tok;
+            marker_len = len;
+            break;
+        }
+        while (len && tok[0] >= '0' && tok[0] <= '9') { tok++; len--; }   /* move number */
+        while (len && tok[0] == '.') { tok++; len--; }
+        while (len && strchr("+#!?", tok[len - 1])) len--;
+        if (!len || bad) continue;
+
+        char san[SAN_MAX];
+        int r1, c1, r2, c2;
+        char promo;
+        copy_tag(san, sizeof(san), tok, len);
+        if (len >= SAN_MAX || san_to_move(&m, san, &r1, &c1, &r2, &c2, &promo) != 0) {
+            char where[SAN_MAX + 24];
+            snprintf(where, sizeof(where), "%zu%s %s", plies / 2 + 1, m.turn ? "..." : ".", san);
+            report(res, game, &tags, "illegal or ambiguous move %s", where);
+            bad = 1;
+            continue;
+        }
+        play(&m, r1, c1, r2, c2, promo);
+        unsigned packed_promo = promo ? (unsigned)(strchr("nbrq", promo) - "nbrq") + 1 : 0;
+        uint16_t v = (uint16_t)((r1 * 8 + c1) | (r2 * 8 + c2) << 6 | packed_promo << 12);
+        buf_put_le(packed, v, 2);
+        plies++;
+    }
+    if (p == game) return end;   /* nothing recognisable, give up on the task */
+    if (bad) return p;
+
+    const char *result = marker ? marker : tags.result;
+    size_t result_len = marker ? marker_len : tags.result_len;
+    if (marker && tags.result && !(tags.result_len == marker_len && memcmp(tags.result, marker, marker_len) == 0)) {
+        char text[8];
+        copy_tag(text, sizeof(text), marker, marker_len);
+        report(res, game, &tags, "result marker %s contradicts the Result tag", text);
+        return p;
+    }
+
+    int winner = -1;
+    EndReason reason = END_NONE;
+    int stuck = !has_any_legal_move(&m, m.turn);
+    if (stuck && is_in_check(&m.state, m.turn)) { winner = 1 - m.turn; reason = END_CHECKMATE; }
+    else if (stuck) reason = END_STALEMATE;
+    else if (result && (token_is(result, result_len, "1-0") || token_is(result, result_len, "0-1"))) {
+        winner = result[0] == '1' ? 0 : 1;
+        reason = END_RESIGN;
+        if (tags.termination && token_is(tags.termination, tags.termination_len, "time forfeit")) reason = END_TIMEOUT;
+        else if (tags.termination && token_is(tags.termination, tags.termination_len, "abandoned")) reason = END_ABANDON;
+        else if (tags.termination && token_is(tags.termination, tags.termination_len, "rules infraction")) reason = END_KICKED;
+    } else if (result && token_is(result, result_len, "1/2-1/2")) reason = END_DRAW_AGREED;
+
+    if (reason == END_CHECKMATE || reason == END_STALEMATE) {
+        const char *expect = result_text(winner, reason);
+        if (result && !token_is(result, result_len, expect) && !token_is(result, result_len, "*")) {
+            report(res, game, &tags, "result contradicts the final position (%s)", end_reason_name(reason));
+            return p;
+        }
+    }
+    if (plies > 0xffff) {
+        report(res, game, &tags, "%s", "too many moves for the archive");
+        return p;
+    }
+
+    res->games++;
+    res->moves += plies;
+    if (mode != MODE_IMPORT) return p;
+
+    if (res->n_imported == res->cap_imported) {
+        res->cap_imported = res->cap_imported ? res->cap_imported * 2 : 256;
+        res->imported = realloc(res->imported, res->cap_imported * sizeof(ImportGame));
+        if (!res->imported) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    }
+    ImportGame *ig = &res->imported[res->n_imported++];
+    size_t wl = tags.white_len > 255 ? 255 : tags.white_len, bl = tags.black_len > 255 ? 255 : tags.black_len;
+    buf_check(packed);
+    char *mem = malloc(wl + bl + packed->len + 1);
+    if (!mem) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    if (wl) memcpy(mem, tags.white, wl);
+    if (bl) memcpy(mem + wl, tags.black, bl);
+    memcpy(mem + wl + bl, packed->data, packed->len);
+    ig->mem = mem;
+    ig->g.room_id = tags.room;
+    ig->g.started = tag_time(tags.date, tags.time);
+    ig->g.ended = tags.end_date[0] ? tag_time(tags.end_date, tags.end_time) : ig->g.started;
+    ig->g.winner = winner;
+    ig->g.end_reason = reason;
+    ig->g.white = mem;
+    ig->g.white_len = wl;
+    ig->g.black = mem + wl;
+    ig->g.black_len = bl;
+    ig->g.moves = (const unsigned char *)mem + wl + bl;
+    ig->g.move_count = plies;
+    return p;
+}
+
+static void run_pgn_task(size_t t, TaskResult *res) {
+    Buf packed = { 0 };
+    const char *p = pgn + task_off[t], *end = pgn + task_off[t + 1];
+    while (p < end) {
+        while (p < end && is_space(*p)) p++;
+        if (p < end) p = import_game(p, end, res, &packed);
+    }
+    free(packed.data);
+}
+
+/**
+ * @brief Start of the first game at or after off: a '[' opening a line that
+ * follows a blank line (tag sections never contain blank lines and movetext
+ * never starts with '[').
+ */
+static size_t next_game_start(size_t off, size_t size) {
+    while (off < size) {
+        const char *nl = memchr(pgn + off, '\n', size - off);
+        if (!nl) return size;
+        const char *q = nl + 1;
+        while (q < pgn + size && (*q == '\r' || *q == ' ' || *q == '\t')) q++;
+        if (q < pgn + size && *q == '\n' && q + 1 < pgn + size && q[1] == '[') return (size_t)(q + 1 - pgn);
+        off = (size_t)(nl + 1 - pgn);
+    }
+    return size;
+}
+
+/* --- Work-stealing scheduler --- */
+
+/**
+ * @brief Takes the worker's lowest own task, or steals another worker's highest.
+ * @return 1 with *t set, or 0 when every deque is empty (no task creates new ones).
+ */
+static int next_task(int self, size_t *t) {
+    for (int k = 0; k < nthreads; k++) {
+        Deque *d = &deques[(self + k) % nthreads];
+        pthread_mutex_lock(&d->lock);
+        int got = d->head < d->tail;
+        if (got) *t = k == 0 ? d->items[d->head++] : d->items[--d->tail];
+        pthread_mutex_unlock(&d->lock);
+        if (got) {
+            if (k) __atomic_fetch_add(&n_steals, 1, __ATOMIC_RELAXED);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_func(void *arg) {
+    int self = (int)(intptr_t)arg;
+    size_t t;
+    while (next_task(self, &t)) {
+        TaskResult *res = &results[t];
+        if (mode == MODE_EXPORT) run_export_task(t, res);
+        else run_pgn_task(t, res);
+        pthread_mutex_lock(&done_lock);
+        res->done = 1;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs all tasks and merges their output in task order as it completes.
+ */
+static void run_tasks(FILE *out, uint64_t *games, uint64_t *moves, uint64_t *errors, int max_errors) {
+    results = calloc(ntasks ? ntasks : 1, sizeof(TaskResult));
+    if (!results) { fprintf(stderr, "Out of memory\n"); exit(1); }
+    for (int w = 0; w < nthreads; w++) {
+        pthread_mutex_init(&deques[w].lock, NULL);
+        deques[w].items = malloc((ntasks / (size_t)nthreads + 1) * sizeof(size_t));
+        deques[w].head = deques[w].tail = 0;
+    }
+    for (size_t t = 0; t < ntasks; t++) {
+        Deque *d = &deques[t % (size_t)nthreads];
+        d->items[d->tail++] = t;
+    }
+
+    pthread_t tids[MAX_THREADS];
+    for (int w = 0; w < nthreads; w++) pthread_create(&tids[w], NULL, worker_func, (void *)(intptr_t)w);
+
+    uint64_t shown = 0;
+    for (size_t t = 0; t < ntasks; t++) {
+        TaskResult *res = &results[t];
+        pthread_mutex_lock(&done_lock);
+        while (!res->done) pthread_cond_wait(&done_cond, &done_lock);
+        pthread_mutex_unlock(&done_lock);
+
+        buf_check(&res->out);
+        if (mode == MODE_EXPORT) {
+            fwrite(res->out.data, 1, res->out.len, out);
+        } else {
+            /* Error lines, at most max_errors of them */
+            const char *line = (const char *)res->out.data, *end = line + res->out.len;
+            while (line < end && shown < (uint64_t)max_errors) {
+                const char *nl = memchr(line, '\n', (size_t)(end - line));
+                fprintf(stderr, "%.*s\n", (int)(nl - line), line);
+                line = nl + 1;
+                shown++;
+            }
+        }
+        for (size_t i = 0; i < res->n_imported; i++) {
+            if (archive_append(&res->imported[i].g) != 0) (*errors)++;
+            free(res->imported[i].mem);
+        }
+        *games += res->games;
+        *moves += res->moves;
+        *errors += res->errors;
+        free(res->out.data);
+        free(res->imported);
+    }
+
+    for (int w = 0; w < nthreads; w++) {
+        pthread_join(tids[w], NULL);
+        free(deques[w].items);
+        pthread_mutex_destroy(&deques[w].lock);
+    }
+    free(results);
+}
+
+/* --- Inputs --- */
+
+static int plan_export(const char *dir, size_t *bytes) {
+    int *nums = malloc(MAX_SEGMENTS * sizeof(int));
+    int nseg = nums ? archive_list_segments(dir, nums, MAX_SEGMENTS) : -1;
+    if (nseg < 0) { fprintf(stderr, "Cannot read archive directory %s\n", dir); free(nums); return -1; }
+    segs = calloc((size_t)nseg + 1, sizeof(ArchiveSegment));
+    size_t cap = 64;
+    export_tasks = malloc(cap * sizeof(*export_tasks));
+    for (int s = 0; s < nseg; s++) {
+        if (archive_map(dir, nums[s], &segs[s]) != 0) { fprintf(stderr, "Skipping unreadable segment %d\n", nums[s]); continue; }
+        *bytes += segs[s].data_len + segs[s].index_len;
+        size_t n = archive_game_count(&segs[s]);
+        for (size_t first = 0; first < n; first += EXPORT_TASK_GAMES) {
+            if (ntasks == cap) export_tasks = realloc(export_tasks, (cap *= 2) * sizeof(*export_tasks));
+            export_tasks[ntasks].seg = s;
+            export_tasks[ntasks].seg_no = nums[s];
+            export_tasks[ntasks].first = first;
+            export_tasks[ntasks].count = n - first < EXPORT_TASK_GAMES ? n - first : EXPORT_TASK_GAMES;
+            ntasks++;
+        }
+    }
+    free(nums);
+    return nseg;
+}
+
+static int plan_pgn(const char *path, size_t *bytes) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { fprintf(stderr, "Cannot open %s\n", path); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    size_t size = (size_t)st.st_size;
+    if (size > 0) {
+        void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(fd); fprintf(stderr, "Cannot map %s\n", path); return -1; }
+        madvise(p, size, MADV_SEQUENTIAL);
+        pgn = p;
+    }
+    close(fd);
+    *bytes = size;
+
+    /* Several tasks per thread so stealing can even out uneven games */
+    size_t target = size / ((size_t)nthreads * 8);
+    if (target > PGN_TASK_BYTES) target = PGN_TASK_BYTES;
+    if (target < PGN_MIN_TASK_BYTES) target = PGN_MIN_TASK_BYTES;
+    size_t cap = size / target + 2;
+    task_off = malloc((cap + 1) * sizeof(size_t));
+    task_off[0] = 0;
+    size_t off = 0;
+    while (off < size) {
+        size_t next = next_game_start(off + target < size ? off + target : size, size);
+        task_off[++ntasks] = next;
+        off = next;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode_arg = NULL, *dir = NULL, *in = NULL, *out_path = NULL;
+    int max_errors = 20;
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "mode=", 5) == 0) mode_arg = argv[i] + 5;
+        else if (strncmp(argv[i], "dir=", 4) == 0) dir = argv[i] + 4;
+        else if (strncmp(argv[i], "in=", 3) == 0) in = argv[i] + 3;
+        else if (strncmp(argv[i], "out=", 4) == 0) out_path = argv[i] + 4;
+        else if (strncmp(argv[i], "threads=", 8) == 0) nthreads = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "max_errors=", 11) == 0) max_errors = atoi(argv[i] + 11);
+        else { fprintf(stderr, "Unknown argument %s\n", argv[i]); return 1; }
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+    if (mode_arg && strcmp(mode_arg, "export") == 0 && dir) mode = MODE_EXPORT;
+    else if (mode_arg && strcmp(mode_arg, "validate") == 0 && in) mode = MODE_VALIDATE;
+    else if (mode_arg && strcmp(mode_arg, "import") == 0 && in && dir) mode = MODE_IMPORT;
+    else {
+        fprintf(stderr, "Usage: %s mode=export dir=DIR [out=FILE] | mode=validate in=FILE | mode=import in=FILE dir=DIR\n"
+                        "       [threads=N] [max_errors=N]\n", argv[0]);
+        return 1;
+    }
+
+    start_pos = match_alloc(0);
+    if (!start_pos) return 1;
+
+    FILE *out = stdout;
+    size_t bytes = 0;
+    uint64_t t0 = bench_now_ns();
+    if (mode == MODE_EXPORT) {
+        if (plan_export(dir, &bytes) < 0) return 1;
+        if (out_path && !(out = fopen(out_path, "w"))) { fprintf(stderr, "Cannot create %s\n", out_path); return 1; }
+    } else {
+        if (plan_pgn(in, &bytes) != 0) return 1;
+        if (mode == MODE_IMPORT && archive_open(dir) != 0) { fprintf(stderr, "Cannot open archive directory %s\n", dir); return 1; }
+    }
+
+    uint64_t games = 0, moves = 0, errors = 0;
+    run_tasks(out, &games, &moves, &errors, max_errors);
+    if (mode == MODE_IMPORT) archive_close();
+    if (out != stdout) fclose(out);
+    double secs = (double)(bench_now_ns() - t0) / 1e9;
+
+    FILE *summary = (mode == MODE_EXPORT && !out_path) ? stderr : stdout;
+    fprintf(summary, "%s: games %llu, moves %llu, errors %llu, %.1f MB in\n", mode_arg,
+            (unsigned long long)games, (unsigned long long)moves, (unsigned long long)errors, bytes / 1e6);
+    fprintf(summary, "threads  %d, tasks %zu, steals %llu\n", nthreads, ntasks, (unsigned long long)n_steals);
+    fprintf(summary, "rate     %.3f s, %.0f games/s, %.1f MB/s\n", secs, secs > 0 ? games / secs : 0.0,
+            secs > 0 ? bytes / 1e6 / secs : 0.0);
+    return errors ? 2 : 0;
+}
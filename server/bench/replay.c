@@ -0,0 +1,331 @@
+/**
+ * @file replay.c
+ * @brief Time-accurate replayer for traffic captured with capture=FILE.
+ *
+ * Reads a capture file (format in capture.h) and re-drives a server with the
+ * exact same connections and inbound lines. Events are scheduled at their
+ * captured offsets divided by the speed factor; speed=max sends everything
+ * as fast as possible while keeping the per-connection order. Server output
+ * is drained and discarded, only lines and ERR replies are counted; ERR
+ * replies measure how far the replay diverged from the captured session.
+ *
+ * Room ids differ between runs, so JOIN targets are rewritten: the CAP_ROOM
+ * record of the creating connection is paired with the "WAITING Room N" the
+ * live server sent on that connection. Likewise an MV line is held back
+ * (for at most a second) until the live server has handed the connection
+ * the move, because bots answer OPP_MV faster than scheduling jitter.
+ *
+ * Usage: replay.exe file=capture.bin [ip=127.0.0.1] [port=10001]
+ *                   [speed=1|N|max] [drain=2] [dump=0]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "capture.h"
+#include "config.h"
+#include "bench_util.h"
+
+/**
+ * @brief One decoded capture record.
+ */
+typedef struct {
+    uint64_t ts_us;     /**< Offset from the first record */
+    uint32_t conn_id;
+    uint8_t type;
+    uint32_t off;       /**< Payload offset in the file buffer */
+    uint32_t len;       /**< Payload length, or the room id of a CAP_ROOM */
+} Event;
+
+/**
+ * @brief Replay-side state of a captured connection.
+ */
+typedef struct {
+    int fd;
+    size_t rpos;        /**< Bytes of the current (partial) response line */
+    char rline[32];     /**< First bytes of the current response line */
+    int cap_room;       /**< Captured room id awaiting its live counterpart, -1 if none */
+    int live_room;      /**< Live room id awaiting its captured counterpart, -1 if none */
+    int my_turn;        /**< Set by START white / OPP_MV, cleared when an MV is sent */
+} Conn;
+
+static struct sockaddr_in server_addr;
+static Conn *conns = NULL;
+static size_t conns_cap = 0;
+static int epfd = -1;
+static int *room_map = NULL;    /**< Captured room id -> live room id (0 = unknown) */
+static size_t room_map_cap = 0;
+
+/* Results */
+static uint64_t n_opens, n_lines, n_closes, n_resp_lines, n_resp_err, n_connect_fail, n_send_fail;
+
+static int get_varint(const unsigned char *buf, size_t len, size_t *pos, uint64_t *out) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (*pos < len && shift < 64) {
+        unsigned char b = buf[(*pos)++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *out = v; return 0; }
+        shift += 7;
+    }
+    return -1;
+}
+
+/**
+ * @brief Decodes all records of a capture file held in memory.
+ * @return Number of events, or -1 on a malformed file.
+ */
+static long decode_capture(const unsigned char *buf, size_t len, Event **out) {
+    if (len < CAPTURE_HEADER_SZ || memcmp(buf, CAPTURE_MAGIC, 4) != 0 || buf[4] != CAPTURE_VERSION) return -1;
+    size_t cap = 1024, n = 0, pos = CAPTURE_HEADER_SZ;
+    Event *ev = malloc(cap * sizeof(Event));
+    uint64_t ts = 0;
+    while (ev && pos < len) {
+        uint64_t delta, conn, plen = 0;
+        uint8_t type = buf[pos++];
+        if (get_varint(buf, len, &pos, &delta) || get_varint(buf, len, &pos, &conn)) break;
+        if (type == CAP_LINE && (get_varint(buf, len, &pos, &plen) || pos + plen > len)) break;
+        if (type == CAP_ROOM && get_varint(buf, len, &pos, &plen)) break;
+        if (type < CAP_OPEN || type > CAP_ROOM) { free(ev); return -1; }
+        if (n == cap) {
+            Event *tmp = realloc(ev, cap * 2 * sizeof(Event));
+            if (!tmp) break;
+            ev = tmp; cap *= 2;
+        }
+        ts += delta;
+        ev[n].ts_us = ts;
+        ev[n].conn_id = (uint32_t)conn;
+        ev[n].type = type;
+        ev[n].off = (uint32_t)pos;
+        ev[n].len = (uint32_t)plen;
+        if (type == CAP_LINE) pos += plen;
+        n++;
+    }
+    *out = ev;
+    return ev ? (long)n : -1;
+}
+
+static Conn *conn_get(uint32_t id) {
+    if (id >= conns_cap) {
+        size_t cap = conns_cap ? conns_cap : 256;
+        while (cap <= id) cap *= 2;
+        Conn *tmp = realloc(conns, cap * sizeof(Conn));
+        if (!tmp) return NULL;
+        for (size_t i = conns_cap; i < cap; i++) { tmp[i].fd = -1; tmp[i].rpos = 0; tmp[i].cap_room = tmp[i].live_room = -1; tmp[i].my_turn = 0; }
+        conns = tmp; conns_cap = cap;
+    }
+    return &conns[id];
+}
+
+/**
+ * @brief Records captured -> live once both ids of a room are known.
+ */
+static void room_pair(Conn *c) {
+    if (c->cap_room < 0 || c->live_room < 0) return;
+    size_t id = (size_t)c->cap_room;
+    if (id >= room_map_cap) {
+        size_t cap = room_map_cap ? room_map_cap : 256;
+        while (cap <= id) cap *= 2;
+        int *tmp = realloc(room_map, cap * sizeof(int));
+        if (!tmp) return;
+        memset(tmp + room_map_cap, 0, (cap - room_map_cap) * sizeof(int));
+        room_map = tmp; room_map_cap = cap;
+    }
+    room_map[id] = c->live_room;
+    c->cap_room = c->live_room = -1;
+}
+
+static int room_lookup(int captured) {
+    return (captured >= 0 && (size_t)captured < room_map_cap) ? room_map[captured] : 0;
+}
+
+static void conn_close(Conn *c) {
+    if (c->fd < 0) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void conn_open(Conn *c) {
+    conn_close(c);
+    c->rpos = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { n_connect_fail++; return; }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        close(fd);
+        n_connect_fail++;
+        return;
+    }
+    c->fd = fd;
+    /* By id: conn_get() may move the array while the socket is registered */
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = (uint32_t)(c - conns) };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    n_opens++;
+}
+
+/**
+ * @brief Reads and discards server output, counting lines and ERR replies.
+ */
+static void conn_drain(Conn *c) {
+    char buf[BUFFER_SZ];
+    while (c->fd >= 0) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        if (n <= 0) { conn_close(c); return; }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] == '\n') {
+                n_resp_lines++;
+                size_t l = c->rpos < sizeof(c->rline) ? c->rpos : sizeof(c->rline) - 1;
+                c->rline[l] = '\0';
+                if (strncmp(c->rline, "ERR", 3) == 0) n_resp_err++;
+                if (strncmp(c->rline, "WAITING Room ", 13) == 0) { c->live_room = atoi(c->rline + 13); room_pair(c); }
+                else if (strncmp(c->rline, "OPP_MV ", 7) == 0) c->my_turn = 1;
+                else if (strncmp(c->rline, "START ", 6) == 0) c->my_turn = strstr(c->rline, " white") != NULL;
+                c->rpos = 0;
+            } else {
+                if (c->rpos < sizeof(c->rline) - 1) c->rline[c->rpos] = buf[i];
+                c->rpos++;
+            }
+        }
+    }
+}
+
+static void poll_responses(int timeout_ms) {
+    struct epoll_event events[256];
+    int n = epoll_wait(epfd, events, 256, timeout_ms);
+    for (int i = 0; i < n; i++) conn_drain(&conns[events[i].data.u32]);
+}
+
+static void dump_events(const unsigned char *buf, const Event *ev, long n) {
+    for (long i = 0; i < n; i++) {
+        static const char *kinds[] = { "?", "OPEN", "LINE", "CLOSE", "ROOM" };
+        printf("%12.6f conn=%-6u %-5s", ev[i].ts_us / 1e6, ev[i].conn_id, kinds[ev[i].type]);
+        if (ev[i].type == CAP_LINE) printf(" %.*s", (int)ev[i].len, (const char *)buf + ev[i].off);
+        if (ev[i].type == CAP_ROOM) printf(" %u", ev[i].len);
+        printf("\n");
+    }
+}
+
+static unsigned char *read_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long sz = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char *buf = (sz > 0) ? malloc(sz) : NULL;
+    if (buf && fread(buf, 1, sz, fp) != (size_t)sz) { free(buf); buf = NULL; }
+    fclose(fp);
+    *len = buf ? (size_t)sz : 0;
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    const char *file = NULL, *ip = "127.0.0.1";
+    int port = DEFAULT_PORT, dump = 0, drain_s = 2;
+    double speed = 1.0; /* 0 = as fast as possible */
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "file=", 5) == 0) file = argv[i] + 5;
+        else if (strncmp(argv[i], "ip=", 3) == 0) ip = argv[i] + 3;
+        else if (strncmp(argv[i], "port=", 5) == 0) port = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "speed=", 6) == 0) speed = strcmp(argv[i] + 6, "max") == 0 ? 0.0 : atof(argv[i] + 6);
+        else if (strncmp(argv[i], "drain=", 6) == 0) drain_s = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "dump=", 5) == 0) dump = atoi(argv[i] + 5);
+        else { fprintf(stderr, "Unknown argument: %s\n", argv[i]); return EXIT_FAILURE; }
+    }
+    if (!file) { fprintf(stderr, "Usage: %s file=capture.bin [ip=] [port=] [speed=1|N|max] [drain=2] [dump=1]\n", argv[0]); return EXIT_FAILURE; }
+
+    size_t len;
+    unsigned char *buf = read_file(file, &len);
+    if (!buf) { fprintf(stderr, "Cannot read %s\n", file); return EXIT_FAILURE; }
+    Event *ev = NULL;
+    long nev = decode_capture(buf, len, &ev);
+    if (nev < 0) { fprintf(stderr, "%s is not a capture file\n", file); free(buf); return EXIT_FAILURE; }
+    if (dump) { dump_events(buf, ev, nev); free(ev); free(buf); return 0; }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &server_addr.sin_addr) != 1) { fprintf(stderr, "Bad ip: %s\n", ip); return EXIT_FAILURE; }
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) { rl.rlim_cur = rl.rlim_max; setrlimit(RLIMIT_NOFILE, &rl); }
+    epfd = epoll_create1(0);
+
+    Hist lateness;
+    hist_init(&lateness);
+    uint64_t start = bench_now_ns();
+
+    for (long i = 0; i < nev; i++) {
+        uint64_t due = start + (speed > 0 ? (uint64_t)(ev[i].ts_us * 1000.0 / speed) : 0);
+        uint64_t now;
+        while ((now = bench_now_ns()) < due) {
+            uint64_t wait_ms = (due - now) / 1000000ull;
+            poll_responses(wait_ms > 0 ? (int)(wait_ms > 50 ? 50 : wait_ms) : 0);
+        }
+        if (speed > 0) hist_record_us(&lateness, (now - due) / 1000);
+
+        Conn *c = conn_get(ev[i].conn_id);
+        if (!c) break;
+        switch (ev[i].type) {
+            case CAP_OPEN: conn_open(c); break;
+            case CAP_CLOSE: conn_close(c); n_closes++; break;
+            case CAP_ROOM: c->cap_room = (int)ev[i].len; room_pair(c); break;
+            case CAP_LINE: {
+                if (c->fd < 0) { n_send_fail++; break; }
+                char line[LINEBUF_SZ + 1];
+                size_t l = ev[i].len < LINEBUF_SZ ? ev[i].len : LINEBUF_SZ - 1;
+                memcpy(line, buf + ev[i].off, l);
+                line[l] = '\0';
+                if (strncmp(line, "JOIN ", 5) == 0) {
+                    /* Give the live server a moment to announce the room we need */
+                    int captured = atoi(line + 5);
+                    uint64_t give_up = bench_now_ns() + 1000000000ull;
+                    while (!room_lookup(captured) && bench_now_ns() < give_up) poll_responses(1);
+                    if (room_lookup(captured)) snprintf(line, sizeof(line), "JOIN %d", room_lookup(captured));
+                    l = strlen(line);
+                } else if (strncmp(line, "MV", 2) == 0) {
+                    uint64_t give_up = bench_now_ns() + 1000000000ull;
+                    while (c->fd >= 0 && !c->my_turn && bench_now_ns() < give_up) poll_responses(1);
+                    c->my_turn = 0;
+                }
+                line[l++] = '\n';
+                if (send(c->fd, line, l, MSG_NOSIGNAL) != (ssize_t)l) n_send_fail++;
+                else n_lines++;
+                break;
+            }
+        }
+        if ((i & 63) == 0) poll_responses(0);
+    }
+    double send_s = (bench_now_ns() - start) / 1e9;
+
+    uint64_t drain_end = bench_now_ns() + (uint64_t)drain_s * 1000000000ull;
+    while (bench_now_ns() < drain_end) poll_responses(50);
+    for (size_t i = 0; i < conns_cap; i++) conn_close(&conns[i]);
+
+    double captured_s = nev ? ev[nev - 1].ts_us / 1e6 : 0.0;
+    printf("=== Replay of %s (%ld events, captured span %.2fs) ===\n", file, nev, captured_s);
+    if (speed > 0) printf("speed          %.2fx\n", speed);
+    else printf("speed          max\n");
+    printf("replay time    %.2fs\n", send_s);
+    printf("connections    %llu opened, %llu closed, %llu failed\n",
+           (unsigned long long)n_opens, (unsigned long long)n_closes, (unsigned long long)n_connect_fail);
+    printf("lines sent     %llu (%.1f/s), %llu failed\n",
+           (unsigned long long)n_lines, send_s > 0 ? n_lines / send_s : 0.0, (unsigned long long)n_send_fail);
+    printf("server lines   %llu (%llu ERR)\n", (unsigned long long)n_resp_lines, (unsigned long long)n_resp_err);
+    if (speed > 0) hist_print(stdout, "lateness", &lateness);
+
+    free(room_map); free(conns); free(ev); free(buf);
+    return (n_connect_fail || n_send_fail) ? 2 : 0;
+}
@@ -0,0 +1,654 @@
+/**
+ * @file simulate.c
+ * @brief Deterministic scenario runner built on the simulated transport.
+ *
+ * Links the real client and match modules against sim.c: every simulated
+ * player is an in-memory connection served by an unmodified client_worker
+ * thread, and protocol timeouts elapse in virtual time. Each scenario is run
+ * many times with varied (seeded) delays and checks the server's observable
+ * behaviour and its timing against the limits in config.h:
+ *
+ *   timeout    TOUT/OPP_TOUT exactly TURN_TIMEOUT_SECONDS after the last move
+ *   clock      Fischer clocks: increment credited, flag exactly when time runs out
+ *   grace      WAIT_CONN after DISCONNECT_GRACE_PERIOD, OPP_EXT after DISCONNECT_TIMEOUT_SECONDS
+ *   reconnect  RESUME + HISTORY inside the window, a fresh session after it
+ *   heartbeat  silent players are shut down after HEARTBEAT_TIMEOUT_SECONDS
+ *   load       many pairs playing random games, reports virtual vs wall time
+ *
+ * A run is a pure function of the seed; the printed trace hash covers every
+ * byte exchanged and must be identical across invocations.
+ *
+ * Usage: simulate.exe [scenario=all|timeout|clock|grace|reconnect|heartbeat|load]
+ *                     [runs=200] [seed=1] [pairs=200] [plies=100] [log=0]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "client.h"
+#include "match.h"
+#include "game.h"
+#include "logging.h"
+#include "netio.h"
+#include "sim.h"
+#include "bench_util.h"
+
+#define PING_EVERY_MS 5000
+#define MAX_LEGAL_MOVES 256
+
+/* The server globals normally defined in main.c */
+int max_rooms = -1;
+int max_players = -1;
+
+static int cfg_pairs = 200;
+static int cfg_plies = 100;
+
+static uint32_t next_conn_id = 0;
+
+/**
+ * @brief State of one scenario run (the argument of its first sim thread).
+ */
+typedef struct {
+    int iter;
+    uint64_t rng;
+    int failed;
+    char why[256];
+    volatile int active;    /**< Keeps the heartbeat thread alive */
+} Run;
+
+/**
+ * @brief Client side of one simulated connection.
+ */
+typedef struct {
+    int fd;
+    int ping;               /**< Send PING heartbeats like the Java client */
+    char name[NAME_LEN];
+    char id[ID_LEN];
+    char buf[BUFFER_SZ];
+    size_t len;
+} Peer;
+
+#define RUN_PEERS 4
+
+typedef struct {
+    Run *run;
+    Peer *peers[RUN_PEERS];
+    volatile int done;      /**< Set by the heartbeat thread when it exits */
+} Keepalive;
+
+static unsigned rnd(uint64_t *state) {
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+    return (unsigned)(*state >> 33);
+}
+
+static unsigned rnd_range(uint64_t *state, unsigned lo, unsigned hi) {
+    return lo + rnd(state) % (hi - lo + 1);
+}
+
+static void fail(Run *r, const char *fmt, ...) {
+    if (r->failed) return;
+    r->failed = 1;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(r->why, sizeof(r->why), fmt, ap);
+    va_end(ap);
+}
+
+#define CHECK(run, cond, ...) do { if (!(cond)) { fail((run), __VA_ARGS__); goto out; } } while (0)
+
+/* --- Peers --- */
+
+/**
+ * @brief Opens a simulated connection served by a fresh client_worker.
+ */
+static int peer_open(Peer *p, const char *name, const char *id) {
+    int fds[2];
+    if (sim_socketpair(fds) != 0) return -1;
+    Client *c = client_create(fds[0], ++next_conn_id);
+    if (!c || client_start(c) != 0) return -1;
+    p->fd = fds[1];
+    p->len = 0;
+    p->ping = 1;
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    snprintf(p->id, sizeof(p->id), "%s", id);
+    return 0;
+}
+
+static void peer_close(Peer *p) {
+    if (p->fd >= 0) io_close(p->fd);
+    p->fd = -1;
+}
+
+static void peer_send(Peer *p, const char *fmt, ...) {
+    char out[LINEBUF_SZ];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out, sizeof(out) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0 || p->fd < 0) return;
+    if ((size_t)n > sizeof(out) - 2) n = sizeof(out) - 2;
+    out[n++] = '\n';
+    io_send(p->fd, out, n, 0);
+}
+
+/**
+ * @brief Reads one line (without CR/LF).
+ * @return 1 on a line, 0 on EOF, -1 on timeout.
+ */
+static int peer_line(Peer *p, char *out, size_t sz, uint64_t timeout_ms) {
+    uint64_t deadline = sim_now_ms() + timeout_ms;
+    while (1) {
+        char *nl = memchr(p->buf, '\n', p->len);
+        if (nl) {
+            size_t l = nl - p->buf;
+            size_t c = l < sz - 1 ? l : sz - 1;
+            memcpy(out, p->buf, c);
+            out[c] = '\0';
+            trim_crlf(out);
+            p->len -= l + 1;
+            memmove(p->buf, nl + 1, p->len);
+            return 1;
+        }
+        if (p->len == sizeof(p->buf)) p->len = 0;
+        uint64_t now = sim_now_ms();
+        if (p->fd < 0 || now >= deadline) return -1;
+        ssize_t n = sim_recv_timeout(p->fd, p->buf + p->len, sizeof(p->buf) - p->len, deadline - now);
+        if (n == 0) return 0;
+        if (n < 0) return -1;
+        p->len += n;
+    }
+}
+
+/**
+ * @brief Skips lines until one starts with prefix.
+ * @return 1 if found (copied to out when given), 0 on EOF, -1 on timeout.
+ */
+static int peer_expect(Peer *p, const char *prefix, uint64_t timeout_ms, char *out, size_t sz) {
+    uint64_t deadline = sim_now_ms() + timeout_ms;
+    char line[LINEBUF_SZ];
+    while (1) {
+        uint64_t now = sim_now_ms();
+        if (now >= deadline) return -1;
+        int r = peer_line(p, line, sizeof(line), deadline - now);
+        if (r <= 0) return r;
+        if (strncmp(line, prefix, strlen(prefix)) == 0) {
+            if (out) snprintf(out, sz, "%s", line);
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Discards input until the server closes the connection.
+ * @return 0 on EOF, -1 on timeout.
+ */
+static int peer_wait_eof(Peer *p, uint64_t timeout_ms) {
+    uint64_t deadline = sim_now_ms() + timeout_ms;
+    char line[LINEBUF_SZ];
+    while (1) {
+        uint64_t now = sim_now_ms();
+        if (now >= deadline) return -1;
+        int r = peer_line(p, line, sizeof(line), deadline - now);
+        if (r <= 0) return r;
+    }
+}
+
+/**
+ * @brief Connects and sends HELLO after the server's WELCOME.
+ */
+static int peer_login(Peer *p, const char *name, const char *id) {
+    if (peer_open(p, name, id) != 0) return -1;
+    if (peer_expect(p, WELCOME, 1000, NULL, 0) != 1) return -1;
+    peer_send(p, HELLO "%s %s", p->name, p->id);
+    return 0;
+}
+
+/**
+ * @brief Heartbeat thread: pings every registered peer until the run ends.
+ */
+static void *keepalive_thread(void *arg) {
+    Keepalive *k = (Keepalive *)arg;
+    while (k->run->active) {
+        for (int i = 0; i < RUN_PEERS; i++) {
+            if (k->peers[i] && k->peers[i]->ping && k->peers[i]->fd >= 0) peer_send(k->peers[i], PING);
+        }
+        io_usleep(PING_EVERY_MS * 1000);
+    }
+    k->done = 1;
+    return NULL;
+}
+
+/**
+ * @brief Logs in host and guest, creates a room and joins it.
+ * @return 0 once both players received START.
+ */
+static int pair_up_timed(Run *r, Peer *w, Peer *b, const char *tc) {
+    char name[NAME_LEN], id[ID_LEN], line[LINEBUF_SZ];
+
+    snprintf(name, sizeof(name), "w%d", r->iter); snprintf(id, sizeof(id), "wid%d", r->iter);
+    if (peer_login(w, name, id) != 0 || peer_expect(w, ENTER_LOBBY, 1000, NULL, 0) != 1) return -1;
+    if (tc) peer_send(w, CREATE_ROOM " %s", tc);
+    else peer_send(w, CREATE_ROOM);
+    if (peer_expect(w, "WAITING Room ", 1000, line, sizeof(line)) != 1) return -1;
+    int room = atoi(line + 13);
+
+    snprintf(name, sizeof(name), "b%d", r->iter); snprintf(id, sizeof(id), "bid%d", r->iter);
+    if (peer_login(b, name, id) != 0 || peer_expect(b, ENTER_LOBBY, 1000, NULL, 0) != 1) return -1;
+    peer_send(b, JOIN_ROOM "%d", room);
+    if (peer_expect(b, "START ", 1000, NULL, 0) != 1) return -1;
+    if (peer_expect(w, "START ", 1000, NULL, 0) != 1) return -1;
+    return 0;
+}
+
+static int pair_up(Run *r, Peer *w, Peer *b) {
+    return pair_up_timed(r, w, b, NULL);
+}
+
+static void run_begin(Run *r, Keepalive *k, Peer *a, Peer *b, Peer *c) {
+    memset(k, 0, sizeof(*k));
+    k->run = r;
+    k->peers[0] = a; k->peers[1] = b; k->peers[2] = c;
+    a->fd = b->fd = -1;
+    if (c) c->fd = -1;
+    r->active = 1;
+    io_spawn(keepalive_thread, k);
+}
+
+/**
+ * @brief Ends a run: stops the heartbeat and drops every connection. The
+ * server then cleans up in virtual time and sim_run() returns.
+ */
+static void run_end(Run *r, Keepalive *k, Peer *a, Peer *b, Peer *c) {
+    r->active = 0;
+    while (!k->done) io_usleep(100000); /* It still references our peers */
+    peer_close(a); peer_close(b);
+    if (c) peer_close(c);
+}
+
+/* --- Scenarios --- */
+
+/**
+ * White stays idle for a random time: either it moves before the turn limit
+ * (then Black must time out TURN_TIMEOUT_SECONDS later) or it times out itself.
+ */
+static void *scn_timeout(void *arg) {
+    Run *r = (Run *)arg;
+    Peer w, b;
+    Keepalive k;
+    run_begin(r, &k, &w, &b, NULL);
+    uint64_t limit_ms = TURN_TIMEOUT_SECONDS * 1000ull;
+
+    CHECK(r, pair_up(r, &w, &b) == 0, "pairing failed");
+    uint64_t t0 = sim_now_ms();
+    unsigned idle = (rnd(&r->rng) & 1) ? rnd_range(&r->rng, 0, TURN_TIMEOUT_SECONDS - 10)
+                                       : rnd_range(&r->rng, TURN_TIMEOUT_SECONDS + 5, TURN_TIMEOUT_SECONDS + 60);
+
+    if (idle < TURN_TIMEOUT_SECONDS) {
+        CHECK(r, peer_expect(&w, YOU_TIMED_OUT, idle * 1000ull, NULL, 0) == -1, "early TOUT after %us idle", idle);
+        peer_send(&w, MOVE_COMMAND "e2e4");
+        CHECK(r, peer_expect(&w, ACCEPT_MOVE, 1000, NULL, 0) == 1, "move not accepted");
+        uint64_t t1 = sim_now_ms();
+        CHECK(r, peer_expect(&b, YOU_TIMED_OUT, limit_ms + 5000, NULL, 0) == 1, "black never timed out");
+        uint64_t el = sim_now_ms() - t1;
+        CHECK(r, el == limit_ms, "black timed out after %llu ms", (unsigned long long)el);
+        CHECK(r, peer_expect(&w, OPPONENT_TIMED_OUT, 1000, NULL, 0) == 1, "white missed OPP_TOUT");
+    } else {
+        CHECK(r, peer_expect(&w, YOU_TIMED_OUT, limit_ms + 5000, NULL, 0) == 1, "white never timed out");
+        uint64_t el = sim_now_ms() - t0;
+        CHECK(r, el == limit_ms, "white timed out after %llu ms", (unsigned long long)el);
+        CHECK(r, peer_expect(&b, OPPONENT_TIMED_OUT, 1000, NULL, 0) == 1, "black missed OPP_TOUT");
+    }
+out:
+    run_end(r, &k, &w, &b, NULL);
+    return NULL;
+}
+
+/**
+ * A 10+2 Fischer game: White thinks a random time and moves, and its clock
+ * must show the time used minus the increment; then Black, who has not moved,
+ * must lose on time exactly its 10 s later.
+ */
+static void *scn_clock(void *arg) {
+    Run *r = (Run *)arg;
+    Peer w, b;
+    Keepalive k;
+    char line[LINEBUF_SZ];
+    run_begin(r, &k, &w, &b, NULL);
+    const uint64_t base_ms = 10000, inc_ms = 2000;
+
+    CHECK(r, pair_up_timed(r, &w, &b, "10+2") == 0, "pairing failed");
+    uint64_t t0 = sim_now_ms();
+    unsigned think = rnd_range(&r->rng, 0, (unsigned)base_ms - 1);
+    io_usleep(think * 1000u);
+    peer_send(&w, MOVE_COMMAND "e2e4");
+    CHECK(r, peer_expect(&w, ACCEPT_MOVE, 1000, NULL, 0) == 1, "move not accepted");
+    uint64_t t1 = sim_now_ms();
+    CHECK(r, peer_expect(&b, "OPP_MV", 1000, NULL, 0) == 1, "move not relayed");
+    CHECK(r, peer_expect(&b, "CLK ", 1000, line, sizeof(line)) == 1, "no CLK after the move");
+    long long wl = 0, bl = 0;
+    sscanf(line + 4, "%lld %lld", &wl, &bl);
+    CHECK(r, (uint64_t)wl == base_ms - (t1 - t0) + inc_ms && (uint64_t)bl == base_ms,
+          "clocks %lld/%lld after %llu ms", wl, bl, (unsigned long long)(t1 - t0));
+
+    CHECK(r, peer_expect(&b, YOU_TIMED_OUT, base_ms + 5000, NULL, 0) == 1, "black never timed out");
+    uint64_t el = sim_now_ms() - t1;
+    CHECK(r, el == base_ms, "black timed out after %llu ms", (unsigned long long)el);
+    CHECK(r, peer_expect(&w, OPPONENT_TIMED_OUT, 1000, NULL, 0) == 1, "white missed OPP_TOUT");
+out:
+    run_end(r, &k, &w, &b, NULL);
+    return NULL;
+}
+
+/**
+ * White vanishes; Black must see WAIT_CONN after the grace period and win by
+ * OPP_EXT once the disconnect timeout expires.
+ */
+static void *scn_grace(void *arg) {
+    Run *r = (Run *)arg;
+    Peer w, b;
+    Keepalive k;
+    run_begin(r, &k, &w, &b, NULL);
+
+    CHECK(r, pair_up(r, &w, &b) == 0, "pairing failed");
+    io_usleep(rnd_range(&r->rng, 0, 10000) * 1000u);
+    if (r->iter & 1) {
+        peer_send(&w, MOVE_COMMAND "d2d4");
+        CHECK(r, peer_expect(&b, "OPP_MV", 1000, NULL, 0) == 1, "move not relayed");
+    }
+    peer_close(&w);
+    uint64_t t0 = sim_now_ms();
+
+    CHECK(r, peer_expect(&b, WAIT_FOR_RECONNECT, 10000, NULL, 0) == 1, "no WAIT_CONN");
+    uint64_t el = sim_now_ms() - t0;
+    CHECK(r, el >= DISCONNECT_GRACE_PERIOD * 1000ull && el <= (DISCONNECT_GRACE_PERIOD + 2) * 1000ull,
+          "WAIT_CONN after %llu ms", (unsigned long long)el);
+    CHECK(r, peer_expect(&b, OPPONENT_QUIT, DISCONNECT_TIMEOUT_SECONDS * 1000ull + 5000, NULL, 0) == 1, "no OPP_EXT");
+    el = sim_now_ms() - t0;
+    CHECK(r, el >= DISCONNECT_TIMEOUT_SECONDS * 1000ull && el <= (DISCONNECT_TIMEOUT_SECONDS + 2) * 1000ull,
+          "OPP_EXT after %llu ms", (unsigned long long)el);
+out:
+    run_end(r, &k, &w, &b, NULL);
+    return NULL;
+}
+
+/**
+ * White drops after one move and comes back with the same name/id, either
+ * inside the reconnect window (game resumes with history) or after it.
+ */
+static void *scn_reconnect(void *arg) {
+    Run *r = (Run *)arg;
+    Peer w, b, w2;
+    Keepalive k;
+    char line[LINEBUF_SZ];
+    run_begin(r, &k, &w, &b, &w2);
+
+    CHECK(r, pair_up(r, &w, &b) == 0, "pairing failed");
+    peer_send(&w, MOVE_COMMAND "e2e4");
+    CHECK(r, peer_expect(&b, "OPP_MV", 1000, NULL, 0) == 1, "move not relayed");
+    peer_close(&w);
+
+    unsigned away = (rnd(&r->rng) & 1) ? rnd_range(&r->rng, 1, DISCONNECT_TIMEOUT_SECONDS - 5)
+                                       : rnd_range(&r->rng, DISCONNECT_TIMEOUT_SECONDS + 5, DISCONNECT_TIMEOUT_SECONDS + 30);
+    io_usleep(away * 1000000u);
+    CHECK(r, peer_login(&w2, w.name, w.id) == 0, "reconnect handshake failed");
+
+    if (away < DISCONNECT_TIMEOUT_SECONDS) {
+        CHECK(r, peer_expect(&w2, "RESUME ", 1000, NULL, 0) == 1, "no RESUME after %us", away);
+        CHECK(r, peer_expect(&w2, "HISTORY ", 1000, line, sizeof(line)) == 1, "no HISTORY");
+        CHECK(r, strstr(line, "e2e4") != NULL, "history lost the move: %s", line);
+        CHECK(r, peer_expect(&b, "OPP_RESUME ", 1000, NULL, 0) == 1, "black not told about the resume");
+        peer_send(&b, MOVE_COMMAND "e7e5");
+        CHECK(r, peer_expect(&b, ACCEPT_MOVE, 1000, NULL, 0) == 1, "black cannot move after resume");
+        CHECK(r, peer_expect(&w2, "OPP_MV e7e5", 1000, NULL, 0) == 1, "resumed white missed the reply");
+    } else {
+        CHECK(r, peer_expect(&b, OPPONENT_QUIT, 1000, NULL, 0) == 1, "black not awarded the game");
+        CHECK(r, peer_expect(&w2, ENTER_LOBBY, 1000, NULL, 0) == 1, "late reconnect did not get a fresh session");
+    }
+out:
+    run_end(r, &k, &w, &b, &w2);
+    return NULL;
+}
+
+/**
+ * Black stops sending anything (no PING); the watchdog must cut it off after
+ * the heartbeat timeout and White must be told to wait.
+ */
+static void *scn_heartbeat(void *arg) {
+    Run *r = (Run *)arg;
+    Peer w, b;
+    Keepalive k;
+    run_begin(r, &k, &w, &b, NULL);
+
+    CHECK(r, pair_up(r, &w, &b) == 0, "pairing failed");
+    io_usleep(rnd_range(&r->rng, 0, 10000) * 1000u);
+    peer_send(&b, PING);
+    b.ping = 0;
+    uint64_t t0 = sim_now_ms();
+
+    CHECK(r, peer_wait_eof(&b, (HEARTBEAT_TIMEOUT_SECONDS + 10) * 1000ull) == 0, "silent client not dropped");
+    uint64_t el = sim_now_ms() - t0;
+    CHECK(r, el >= HEARTBEAT_TIMEOUT_SECONDS * 1000ull && el <= (HEARTBEAT_TIMEOUT_SECONDS + 2) * 1000ull,
+          "dropped after %llu ms", (unsigned long long)el);
+    CHECK(r, peer_expect(&w, WAIT_FOR_RECONNECT, 10000, NULL, 0) == 1, "white not told to wait");
+out:
+    run_end(r, &k, &w, &b, NULL);
+    return NULL;
+}
+
+/* --- Load --- */
+
+typedef struct Pair Pair;
+
+typedef struct {
+    Peer p;
+    Pair *pair;
+    int host;
+    int color;
+    Match board;            /**< Local replica validated with game.c */
+    uint64_t rng;
+} Bot;
+
+struct Pair {
+    Bot bots[2];
+    int index;
+    int room;
+};
+
+static Pair *load_pairs = NULL;
+static uint64_t load_moves = 0, load_games = 0, load_errors = 0, load_done = 0;
+static Hist load_game_len;
+
+static void board_reset(Match *m) {
+    init_board(&m->state);
+    m->turn = 0;
+    m->w_can_kingside = m->w_can_queenside = 1;
+    m->b_can_kingside = m->b_can_queenside = 1;
+    m->ep_r = m->ep_c = -1;
+}
+
+static void board_apply(Match *m, const char *mv) {
+    int r1, c1, r2, c2;
+    if (!is_move_format(mv)) return;
+    parse_move(mv, &r1, &c1, &r2, &c2);
+    apply_move(m, r1, c1, r2, c2, (strlen(mv) >= 5) ? mv[4] : 0);
+}
+
+static int pick_random_move(Bot *b, char *out) {
+    Match *m = &b->board;
+    int moves[MAX_LEGAL_MOVES][4];
+    int n = 0;
+    for (int r1 = 0; r1 < 8; r1++) for (int c1 = 0; c1 < 8; c1++) {
+        Piece p = m->state.board[r1][c1];
+        if (p == EMPTY || piece_color(p) != b->color) continue;
+        for (int r2 = 0; r2 < 8; r2++) for (int c2 = 0; c2 < 8; c2++) {
+            if (n >= MAX_LEGAL_MOVES) break;
+            if (!is_legal_move_basic(m, b->color, r1, c1, r2, c2)) continue;
+            if (move_leaves_in_check(m, b->color, r1, c1, r2, c2)) continue;
+            moves[n][0] = r1; moves[n][1] = c1; moves[n][2] = r2; moves[n][3] = c2; n++;
+        }
+    }
+    if (n == 0) return 0;
+    int *mv = moves[rnd(&b->rng) % n];
+    Piece p = m->state.board[mv[0]][mv[1]];
+    int promo = (abs(p) == 1 && (mv[2] == 0 || mv[2] == 7));
+    out[0] = 'a' + mv[1]; out[1] = '1' + (7 - mv[0]);
+    out[2] = 'a' + mv[3]; out[3] = '1' + (7 - mv[2]);
+    out[4] = promo ? 'q' : '\0'; out[5] = '\0';
+    return 1;
+}
+
+/**
+ * @brief One load-test player: pairs up, plays random moves with a virtual
+ * think time and resigns after the ply limit.
+ */
+static void *bot_thread(void *arg) {
+    Bot *b = (Bot *)arg;
+    Pair *pr = b->pair;
+    char line[LINEBUF_SZ], name[NAME_LEN], mv[8];
+    int plies = 0, ok = 0;
+    uint64_t started = 0;
+
+    snprintf(name, sizeof(name), "%s%d", b->host ? "h" : "g", pr->index);
+    if (peer_login(&b->p, name, name) != 0 || peer_expect(&b->p, ENTER_LOBBY, 1000, NULL, 0) != 1) goto out;
+    if (b->host) {
+        peer_send(&b->p, CREATE_ROOM);
+        if (peer_expect(&b->p, "WAITING Room ", 1000, line, sizeof(line)) != 1) goto out;
+        pr->room = atoi(line + 13);
+    } else {
+        while (!pr->room) io_usleep(10000);
+        peer_send(&b->p, JOIN_ROOM "%d", pr->room);
+    }
+    if (peer_expect(&b->p, "START ", 5000, line, sizeof(line)) != 1) goto out;
+    b->color = strstr(line, " white") ? 0 : 1;
+    board_reset(&b->board);
+    started = sim_now_ms();
+
+    int my_turn = (b->color == 0);
+    while (1) {
+        if (my_turn) {
+            io_usleep(rnd_range(&b->rng, 200, 3000) * 1000u);
+            if (plies >= cfg_plies) { peer_send(&b->p, RESIGN); ok = 1; break; }
+            if (!pick_random_move(b, mv)) { ok = 1; break; }
+            peer_send(&b->p, MOVE_COMMAND "%s", mv);
+            board_apply(&b->board, mv);
+            load_moves++;
+            plies++;
+            my_turn = 0;
+        }
+        if (peer_line(&b->p, line, sizeof(line), 10000) <= 0) break;
+        if (strncmp(line, "OPP_MV ", 7) == 0) { board_apply(&b->board, line + 7); plies++; my_turn = 1; }
+        else if (strncmp(line, "ERR", 3) == 0) break;
+        else if (strcmp(line, WON_BY_CHECKMATE) == 0 || strcmp(line, LOST_BY_CHECKMATE) == 0 ||
+                 strcmp(line, STALEMATE) == 0 || strcmp(line, OPPONENT_RESIGNED) == 0) { ok = 1; break; }
+    }
+    if (ok && b->host) { load_games++; hist_record_us(&load_game_len, (sim_now_ms() - started) * 1000ull); }
+out:
+    if (!ok) load_errors++;
+    peer_close(&b->p);
+    load_done++;
+    return NULL;
+}
+
+static void *scn_load(void *arg) {
+    Run *r = (Run *)arg;
+    Pair *pairs = load_pairs = calloc(cfg_pairs, sizeof(Pair));
+    if (!pairs) { fail(r, "out of memory"); return NULL; }
+    for (int i = 0; i < cfg_pairs; i++) {
+        pairs[i].index = i;
+        for (int j = 0; j < 2; j++) {
+            Bot *b = &pairs[i].bots[j];
+            b->pair = &pairs[i];
+            b->host = (j == 0);
+            b->p.fd = -1;
+            b->rng = r->rng + (uint64_t)i * 2 + j;
+            io_spawn(bot_thread, b);
+        }
+        io_usleep(rnd_range(&r->rng, 0, 50) * 1000u);
+    }
+    while (load_done < (uint64_t)cfg_pairs * 2) io_usleep(1000000);
+    if (load_errors) fail(r, "%llu players failed", (unsigned long long)load_errors);
+    return NULL;
+}
+
+/* --- Driver --- */
+
+typedef struct {
+    const char *name;
+    void *(*fn)(void *);
+    int repeat;         /**< Uses the runs= count (otherwise runs once) */
+} Scenario;
+
+static const Scenario scenarios[] = {
+    { "timeout",   scn_timeout,   1 },
+    { "clock",     scn_clock,     1 },
+    { "grace",     scn_grace,     1 },
+    { "reconnect", scn_reconnect, 1 },
+    { "heartbeat", scn_heartbeat, 1 },
+    { "load",      scn_load,      0 },
+};
+
+int main(int argc, char *argv[]) {
+    const char *which = "all";
+    int runs = 200;
+    uint64_t seed = 1;
+    int log = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "scenario=", 9) == 0) which = argv[i] + 9;
+        else if (strncmp(argv[i], "runs=", 5) == 0) runs = atoi(argv[i] + 5);
+        else if (strncmp(argv[i], "seed=", 5) == 0) seed = strtoull(argv[i] + 5, NULL, 10);
+        else if (strncmp(argv[i], "pairs=", 6) == 0) cfg_pairs = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "plies=", 6) == 0) cfg_plies = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "log=", 4) == 0) log = atoi(argv[i] + 4);
+        else { fprintf(stderr, "unknown argument %s\n", argv[i]); return 2; }
+    }
+    if (log) init_logging();
+    sim_init();
+    hist_init(&load_game_len);
+
+    int total_failed = 0, matched = 0;
+    printf("%-10s %6s %6s %12s %9s %10s  %s\n", "scenario", "runs", "failed", "virtual", "wall", "switches", "trace");
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+        const Scenario *sc = &scenarios[s];
+        if (strcmp(which, "all") != 0 && strcmp(which, sc->name) != 0) continue;
+        matched = 1;
+        int n = sc->repeat ? runs : 1, failed = 0;
+        char first_why[300] = "";
+        uint64_t v0 = sim_now_ms(), sw0 = sim_switches(), w0 = bench_now_ns();
+
+        for (int i = 0; i < n; i++) {
+            Run r;
+            memset(&r, 0, sizeof(r));
+            r.iter = i;
+            r.rng = seed * 0x9e3779b97f4a7c15ull + (uint64_t)i;
+            int rc = sim_run(sc->fn, &r);
+            free(load_pairs);
+            load_pairs = NULL;
+            if (rc != 0) {
+                fprintf(stderr, "%s run %d: every thread is blocked, giving up\n", sc->name, i);
+                return 1;
+            }
+            if (r.failed) {
+                if (!failed) snprintf(first_why, sizeof(first_why), "run %d: %s", i, r.why);
+                failed++;
+            }
+        }
+
+        double wall = (bench_now_ns() - w0) / 1e9;
+        printf("%-10s %6d %6d %11.1fs %8.2fs %10llu  %016llx\n", sc->name, n, failed,
+               (sim_now_ms() - v0) / 1000.0, wall, (unsigned long long)(sim_switches() - sw0),
+               (unsigned long long)sim_trace_hash());
+        if (failed) printf("  first failure: %s\n", first_why);
+        if (sc->fn == scn_load) {
+            printf("  games %llu, moves %llu, errors %llu\n", (unsigned long long)load_games,
+                   (unsigned long long)load_moves, (unsigned long long)load_errors);
+            hist_print(stdout, "  game length", &load_game_len);
+        }
+        total_failed += failed;
+    }
+    if (!matched) { fprintf(stderr, "unknown scenario %s\n", which); return 2; }
+    if (log) close_logging();
+    return total_failed ? 1 : 0;
+}
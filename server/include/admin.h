@@ -0,0 +1,19 @@
+/**
+ * @file admin.h
+ * @brief Operator console interface.
+ *
+ * The admin console is a line-based text interface bound to the loopback
+ * address on a separate port. It is intended for operators and benchmark
+ * tooling, never for players. Every reply is terminated by a line "END".
+ */
+
+#ifndef ADMIN_H
+#define ADMIN_H
+
+/**
+ * @brief Starts the admin console thread listening on 127.0.0.1:port.
+ * @return 0 on success, -1 if the socket could not be bound.
+ */
+int admin_start(int port);
+
+#endif /* ADMIN_H */
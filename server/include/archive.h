@@ -0,0 +1,143 @@
+/**
+ * @file archive.h
+ * @brief Append-only archive of finished games and its memory-mapped reader.
+ *
+ * When enabled (archive=DIR), every game that got an opponent is queued when it
+ * finishes and appended by a background writer (same queue design as
+ * capture.c), so game threads never touch the disk. The archive is a sequence
+ * of segments, each a data file and an index file:
+ *
+ *   games-NNNNNN.arc  "CARC" | u8 version | u8[3] reserved | u64 creation (unix s) | records
+ *   games-NNNNNN.idx  "CAIX" | u8 version | u8[3] reserved | u64 creation (unix s) | entries
+ *
+ * Record (little-endian, unaligned):
+ *   u32 length (whole record) | u32 room id | u64 started | u64 ended (unix s)
+ *   | i8 winner (-1 none) | u8 EndReason | u16 move count | u8 white len | u8 black len
+ *   | names | u16 moves[count] | u32 crc32 (everything before it)
+ * Index entry (16 bytes): u64 record offset | u32 record length | u32 ended.
+ *
+ * A move is packed as from | to << 6 | promotion << 12, squares numbered
+ * row * 8 + col as in game.c and promotion 0 none, 1 n, 2 b, 3 r, 4 q.
+ * Segments roll over at ARCHIVE_SEGMENT_BYTES. An index entry is written after
+ * its record, so on startup a torn tail is cut back to the last indexed record.
+ * The writer also maintains each segment's position index (posindex.h).
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "match.h"
+
+#define ARCHIVE_MAGIC "CARC"
+#define ARCHIVE_INDEX_MAGIC "CAIX"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SZ 16
+#define ARCHIVE_INDEX_ENTRY_SZ 16
+#define ARCHIVE_RECORD_FIXED_SZ 30  /**< Record bytes besides names, moves and crc */
+
+/**
+ * @brief One archived game, pointing into the mapped segment.
+ */
+typedef struct {
+    int room_id;
+    uint64_t started;
+    uint64_t ended;
+    int winner;
+    EndReason end_reason;
+    const char *white;          /**< Not NUL-terminated, see white_len */
+    size_t white_len;
+    const char *black;
+    size_t black_len;
+    const unsigned char *moves; /**< move_count packed u16 moves */
+    size_t move_count;
+} ArchiveGame;
+
+/**
+ * @brief A read-only mapping of one segment and its index.
+ */
+typedef struct {
+    const unsigned char *data;
+    size_t data_len;
+    const unsigned char *index;
+    size_t index_len;
+} ArchiveSegment;
+
+/* --- Writer (server) --- */
+
+/**
+ * @brief Opens (or creates) the archive directory and starts the writer.
+ * @return 0 on success, -1 if the directory or the current segment cannot be used.
+ */
+int archive_open(const char *dir);
+
+/**
+ * @brief Writes queued games, syncs the segment and stops the writer.
+ */
+void archive_close(void);
+
+/**
+ * @brief Queues a finished match. No-op when the archive is not enabled or the
+ * room never got an opponent. Called with the match lock held.
+ */
+void archive_match(const Match *m);
+
+/**
+ * @brief Queues a game that was not played here (e.g. imported from PGN).
+ * Names are cut to 255 bytes; moves must already be packed.
+ * @return 0 if queued, -1 when the archive is not open, the game is too long
+ * or memory runs out.
+ */
+int archive_append(const ArchiveGame *g);
+
+/**
+ * @brief Formats writer counters (games, bytes, batches, segments).
+ * @return Number of characters written (0 when the archive is not enabled).
+ */
+int archive_format_stats(char *buf, size_t sz);
+
+/* --- Reader --- */
+
+/**
+ * @brief Builds the path of segment n ("dir/games-NNNNNN.arc" or ".idx").
+ */
+void archive_segment_path(char *buf, size_t sz, const char *dir, int n, const char *ext);
+
+/**
+ * @brief Lists the segment numbers present in dir, ascending.
+ * @return Number of segments (at most max), or -1 if dir cannot be read.
+ */
+int archive_list_segments(const char *dir, int *out, int max);
+
+/**
+ * @brief Maps segment n of dir read-only.
+ * @return 0 on success, -1 if it is missing or not an archive segment.
+ */
+int archive_map(const char *dir, int n, ArchiveSegment *seg);
+void archive_unmap(ArchiveSegment *seg);
+
+/**
+ * @brief Number of indexed games in a mapped segment.
+ */
+size_t archive_game_count(const ArchiveSegment *seg);
+
+/**
+ * @brief Decodes game i of a mapped segment.
+ * @param verify Also check the record's crc32.
+ * @return 0 on success, -1 if the record is out of range or corrupt.
+ */
+int archive_game(const ArchiveSegment *seg, size_t i, int verify, ArchiveGame *out);
+
+/**
+ * @brief Packs a move in coordinate notation ("e2e4", "e7e8q").
+ * @return The packed move, or 0xffff if the text is not a move.
+ */
+uint16_t archive_encode_move(const char *mv);
+
+/**
+ * @brief Unpacks move i of a game into coordinate notation (out holds 6 bytes).
+ */
+void archive_decode_move(const ArchiveGame *g, size_t i, char out[6]);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,62 @@
+/**
+ * @file capture.h
+ * @brief Inbound traffic capture interface.
+ *
+ * When enabled, every inbound protocol line is recorded per connection with a
+ * monotonic timestamp into a compact binary file that replay.exe can re-drive
+ * against a server.
+ *
+ * File layout (all integers little-endian):
+ *   Header:  "CCAP" | u8 version | u8[3] reserved | u64 wall-clock start (ns since epoch)
+ *   Record:  u8 type | varint delta_us | varint conn_id [| payload]
+ *
+ * delta_us is the time since the previous record (microseconds) and type is one
+ * of CaptureRecordType. CAP_LINE carries "varint len | len bytes" (the line
+ * without its newline), CAP_ROOM carries "varint room_id". Varints are LEB128
+ * (7 bits per byte, low bits first).
+ *
+ * Room ids are assigned by the server in creation order, which depends on
+ * thread scheduling. CAP_ROOM records the id a connection's NEW received so a
+ * replay can map captured JOIN targets onto the ids of the live server.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC "CCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SZ 16
+
+/**
+ * @brief Record types stored in a capture file.
+ */
+typedef enum {
+    CAP_OPEN = 1,   /**< Connection accepted */
+    CAP_LINE = 2,   /**< One inbound line */
+    CAP_CLOSE = 3,  /**< Connection closed */
+    CAP_ROOM = 4    /**< Room id assigned to the connection's NEW */
+} CaptureRecordType;
+
+/**
+ * @brief Opens the capture file and starts the background writer thread.
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int capture_open(const char *path);
+
+/**
+ * @brief Flushes pending records, stops the writer and closes the file.
+ */
+void capture_close(void);
+
+/**
+ * @brief Records connection lifecycle events and inbound lines.
+ * No-ops when capture is not enabled.
+ */
+void capture_conn_open(uint32_t conn_id);
+void capture_line(uint32_t conn_id, const char *line);
+void capture_conn_close(uint32_t conn_id);
+void capture_room(uint32_t conn_id, int room_id);
+
+#endif /* CAPTURE_H */
@@ -12,22 +12,49 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <time.h>
 #include "config.h"
 
-/* Forward declaration */
+/* Forward declarations */
 typedef struct Match Match;
+typedef struct ServedWorker ServedWorker;
+typedef struct QueueEntry QueueEntry;
+typedef struct TourneyEntrant TourneyEntrant;
+typedef struct Watcher Watcher;
+typedef struct RttRow RttRow;
+typedef struct Retransmit Retransmit;
 
 /* --- Protocol Messages (Commands & Payloads) --- */
 #define WELCOME             "WELCOME"         /**< Server greeting message */
-#define HELLO               "HELLO "          /**< Client handshake: "HELLO <Name> <ID>" */
+#define HELLO               "HELLO "          /**< Client handshake: "HELLO <Name> <ID> [<last seen seq>]" (see retransmit.h) */
 #define PLAYER_LIMIT_REACHED "FULL\n"         /**< Rejection message when server is full */
 #define ENTER_LOBBY         "LOBBY"           /**< Client request to enter lobby state */
 #define ROOM_LIST_REQUEST   "LIST"            /**< Client request for list of active rooms */
-#define ROOM_LIST_ANSWER    "ROOMLIST %s"     /**< Server response containing room list */
-#define CREATE_ROOM         "NEW"             /**< Client request to create a new room */
+#define ROOM_LIST_ANSWER    "ROOMLIST %s"     /**< Server response containing room list: "id:host" or "id:host:base+inc" entries */
+#define LEADERBOARD_REQUEST "TOP"             /**< Client request for the leaderboard: "TOP [n]" */
+#define LEADERBOARD_ANSWER  "LEADERS %llu %s" /**< Server response: own rank (0 if unranked), then rank:name:rating entries */
+#define CREATE_ROOM         "NEW"             /**< Client request to create a new room: "NEW" (per-move budget) or "NEW <base>+<inc>[B]" (seconds, Fischer or Bronstein) */
 #define WAIT                "WAITING Room %d" /**< Server notification: Waiting for opponent in Room X */
 #define JOIN_ROOM           "JOIN "           /**< Client request to join room: "JOIN <RoomID>" */
+#define QUEUE_REQUEST       "QUEUE"           /**< Client request for automatic matchmaking: "QUEUE" or "QUEUE <base>+<inc>[B]" (time control as for NEW) */
+#define QUEUED              "QUEUED %d"       /**< Server notification: In the matchmaking queue with rating X */
+#define REMATCH_REQUEST     "REMATCH"         /**< Client request to play the last opponent again, colours swapped */
+#define REMATCH_WAIT        "REMATCH_WAIT"    /**< Server notification: Waiting for the opponent to accept the rematch */
+#define REMATCH_OFFERED     "REMATCH_OFF"     /**< Notification: Last opponent asks for a rematch */
+#define REMATCH_DECLINED    "REMATCH_DEC"     /**< Notification: Rematch is off (opponent left or window expired) */
+#define TOURNEY_REQUEST     "TOURNEY"         /**< Client request: Wait for the next game of the tournament one is registered in */
+#define TOURNEY_WAIT        "TOURNEY_WAIT %d" /**< Server notification: Waiting for the game of round X */
+#define TOURNEY_BYE         "TOURNEY_BYE %d"  /**< Notification: Point without a game in round X (bye or opponent absent) */
+#define TOURNEY_END         "TOURNEY_END %d %s" /**< Notification: Tournament over, final rank and score */
+#define WATCH_REQUEST       "WATCH "          /**< Client request to spectate a running game: "WATCH <RoomID>" */
+#define WATCH_STATE         "W_START %d %s %s %d %s" /**< Spectator notification: Room, White, Black, seconds left for the side to move, FEN */
+#define WATCH_MOVE          "W_MV %s %d"      /**< Spectator notification: Move played, seconds for the next turn */
+#define WATCH_CLOCK_SYNC    "W_CS %lld %lld"  /**< Spectator notification: White's and Black's time left in ms (see clocksync.h) */
+#define WATCH_END           "W_END %s %s"     /**< Spectator notification: Result (1-0, 0-1, 1/2-1/2 or *) and how the game ended */
+#define MUX_REQUEST         "MUX"             /**< Client request: Play several games over this connection */
+#define MUX_READY           "MUX %d"          /**< Server notification: Multiplexed, X boards at most (resumed boards follow) */
+#define MUX_LINE            "G "              /**< Prefix of a board line on a multiplexed connection: "G <board> <command>" (both ways) */
 #define START_AS_WHITE      "START %s white"  /**< Notification: Game start, playing White */
 #define START_AS_BLACK      "START %s black"  /**< Notification: Game start, playing Black */
 #define YOU_TIMED_OUT       "TOUT"            /**< Notification: You ran out of time */
@@ -39,7 +66,12 @@ typedef struct Match Match;
 #define MOVE_COMMAND        "MV"              /**< Client move command: "MV <move>" */
 #define OPPONENT_MOVE       "OPP_MV %s"       /**< Notification: Opponent made a move */
 #define ACCEPT_MOVE         "OK_MV"           /**< Confirmation: Your move was valid and accepted */
-#define TURN_TIMER_STATE    "TIME %d"         /**< Update: Remaining time for current turn */
+#define PREMOVE_COMMAND     "PMV"             /**< Client command: Move to play as soon as the opponent has moved: "PMV <move>", bare "PMV" cancels (opponent to move only) */
+#define PREMOVE_QUEUED      "OK_PMV"          /**< Confirmation: Premove queued (or cancelled) */
+#define PREMOVE_DROPPED     "PMV_DROP %s"     /**< Notification: Premove not legal after the opponent's move, dropped */
+#define TURN_TIMER_STATE    "TIME %d"         /**< Update: Seconds left for the side to move */
+#define CLOCK_STATE         "CLK %lld %lld"   /**< Update: White's and Black's time left in ms (rooms opened with NEW <base>+<inc>) */
+#define CLOCK_SYNC          "CS %lld %lld"    /**< Periodic update: White's and Black's time left in ms (see clocksync.h) */
 #define IN_CHECK            "CHK"             /**< Notification: You are in check */
 #define WON_BY_CHECKMATE    "WIN_CHKM"        /**< Notification: You won by checkmate */
 #define LOST_BY_CHECKMATE   "CHKM"            /**< Notification: You lost by checkmate */
@@ -57,6 +89,11 @@ typedef struct Match Match;
 #define OPPONENT_KICKED_OUT "OPP_KICK"        /**< Notification: Opponent kicked for protocol violation */
 #define PING                "PING"            /**< Heartbeat request */
 #define PING_RESPONSE       "PNG"             /**< Heartbeat response */
+#define SEQ_LINE            "#"               /**< Prefix of a numbered message: "#<seq> <message>" (see retransmit.h) */
+#define SEQ_REPLAY          "REPLAY %llu %llu" /**< Notification: resumed without a gap, messages <from>..<to> follow again */
+#define COMMAND_ID          '@'               /**< Prefix of a command carrying an id: "@<id> <command>" */
+#define DUPLICATE_COMMAND   "DUP %llu"        /**< Notification: command id already carried out, skipped */
+#define RTT_PROBE           "PRB "            /**< Round-trip probe "PRB <server ms>", echoed unchanged by the client (see rtt.h) */
 
 /* --- Protocol Acknowledgement Codes --- */
 /* Server -> Client Confirmations */
@@ -94,6 +131,13 @@ typedef struct Match Match;
 #define JOIN_REQ_ACK            "29" /**< ACK: Join room request received */
 #define LIST_REQ_ACK            "30" /**< ACK: Room list request received */
 #define EXIT_ACK                "31" /**< ACK: Exit/Disconnect request received */
+#define LEADERBOARD_REQ_ACK     "32" /**< ACK: Leaderboard request received */
+#define QUEUE_REQ_ACK           "33" /**< ACK: Matchmaking request received */
+#define REMATCH_ACK             "34" /**< ACK: Rematch request received */
+#define TOURNEY_ACK             "35" /**< ACK: Tournament request received */
+#define MUX_ACK                 "36" /**< ACK: Multiplexing request received */
+#define WATCH_ACK               "37" /**< ACK: Spectate request received */
+#define PREMOVE_ACK             "38" /**< ACK: Premove received */
 
 #define GENERIC_ACK             "99" /**< Fallback ACK for undefined commands */
 
@@ -103,8 +147,10 @@ typedef struct Match Match;
 typedef enum {
     STATE_HANDSHAKE,    /**< Initial connection, awaiting HELLO */
     STATE_LOBBY,        /**< Authenticated, browsing rooms */
-    STATE_WAITING,      /**< Created a room, waiting for opponent */
+    STATE_WAITING,      /**< Created a room or queued (no match yet), waiting for opponent */
     STATE_GAME,         /**< Actively playing a match */
+    STATE_MUX,          /**< Multiplexed connection driving several boards (see run_mux) */
+    STATE_WATCH,        /**< Spectating a game (see spectate.h) */
     STATE_DISCONNECTED  /**< Connection closed, pending cleanup */
 } ClientState;
 
@@ -118,30 +164,101 @@ typedef struct Client {
     int color;                      /**< 0 for White, 1 for Black */
     int paired;                     /**< Flag indicating if opponent has joined */
     Match *match;                   /**< Pointer to current match (if any) */
+    QueueEntry *queued;             /**< Matchmaking queue entry while queued (see matchmaker.h) */
+    Match *rematch;                 /**< Finished match this player holds a rematch seat in (see match.h) */
+    TourneyEntrant *tourney;        /**< Tournament entry while waiting for the next round's game (see tournament.h) */
+    Watcher *watch;                 /**< Spectator queue while watching a game (see spectate.h) */
+    struct Client *mux;             /**< Connection this board is played over, NULL for a plain session */
+    int mux_tag;                    /**< Board number on a multiplexed connection, 0 for a plain session */
     char client_addr[ADDR_LEN];     /**< String representation of client IP:Port */
+    uint32_t conn_id;               /**< Number of the current TCP connection (keys captured traffic) */
     
     /* State Management */
     ClientState state;              /**< Current FSM state */
     int error_count;                /**< Counter for protocol violations */
     int is_counted;                 /**< Flag: 1 if this client is counted in global stats */
     
+    /* Input Buffering (kept across states, handed over on hot restart) */
+    char readbuf[BUFFER_SZ];        /**< Raw bytes received but not yet split into lines */
+    int rb_start;                   /**< Next unread byte in readbuf */
+    int rb_len;                     /**< Number of valid bytes in readbuf */
+    char linebuf[LINEBUF_SZ];       /**< Line being assembled, then the last complete line */
+    size_t line_len;                /**< Bytes of the current line assembled so far */
+    int adopted;                    /**< Taken over from a previous process: skip the next state greeting */
+
     /* Concurrency & Timing */
     pthread_mutex_t lock;           /**< Mutex protecting client state */
     time_t disconnect_time;         /**< Timestamp when socket was lost (for grace period) */
     time_t last_heartbeat;          /**< Timestamp of last received data */
+
+    /* Round-trip time (see rtt.h; on the connection for boards of a multiplexed one) */
+    uint64_t rtt_probe_ms;          /**< Timestamp carried by the last probe sent (top bit set once echoed), 0 if none yet */
+    uint32_t srtt_us;               /**< Smoothed round-trip time */
+    uint32_t rttvar_us;             /**< Mean deviation of the round-trip samples (jitter) */
+    uint32_t rtt_samples;           /**< Echoes measured on this connection */
+
+    /* Non-blocking writes (see clocksync.h; on the connection for boards of a multiplexed one) */
+    char out_tail[CLOCKSYNC_LINE_SZ]; /**< Rest of a line a non-blocking write left unsent */
+    size_t out_tail_len;            /**< Bytes in out_tail, 0 if nothing is pending */
+
+    /* Sequenced sessions (see retransmit.h) */
+    Retransmit *retx;               /**< Numbered messages held for a resume, NULL for an unnumbered session */
+    uint64_t resume_mark;           /**< Reconnected, resume not sent yet: messages from this number on are only held (0: none) */
+    uint64_t last_cmd_id;           /**< Highest command id carried out */
     
     /* Registry Linkage */
+    ServedWorker *worker;           /**< Worker thread serving this session (NULL while disconnected) */
     struct Client *next_global;     /**< Next pointer for the global client registry list */
 } Client;
 
 /* --- Function Prototypes --- */
 
+/**
+ * @brief Allocates and initializes a client for a new connection.
+ */
+Client *client_create(int sock, uint32_t conn_id);
+
 /**
  * @brief Entry point for the client handling thread.
  * @param arg Pointer to the Client structure.
  */
 void *client_worker(void *arg);
 
+/**
+ * @brief Registers the client as served and spawns its worker thread.
+ * @return 0 on success, -1 if the thread cannot be started (client untouched).
+ */
+int client_start(Client *c);
+
+/**
+ * @brief Number of sessions currently served by a worker thread.
+ */
+int client_served_count(void);
+
+/**
+ * @brief Copies up to max served sessions into out.
+ * @return Number of entries written.
+ */
+size_t client_served_snapshot(Client **out, size_t max);
+
+/**
+ * @brief Copies the names of up to max served sessions past the handshake into out.
+ * @return Number of names written.
+ */
+size_t client_served_names(char (*out)[NAME_LEN], size_t max);
+
+/**
+ * @brief Copies the round-trip estimates of up to max served sessions past
+ * the handshake into out (see rtt.h).
+ * @return Number of rows written.
+ */
+size_t client_served_rtt(RttRow *out, size_t max);
+
+/**
+ * @brief Sends sig to every worker thread (to interrupt blocking reads).
+ */
+void client_signal_workers(int sig);
+
 /**
  * @brief Sends raw data to the client socket.
  */
@@ -152,6 +269,14 @@ void send_raw(int sock, const char *msg);
  */
 void send_line(int sock, const char *msg);
 
+/**
+ * @brief Sends what a non-blocking write left unsent on a connection, so the
+ * rest of a line goes out before anything else. Caller holds conn->lock.
+ * @param wait Whether to block until it is out (0: only what fits now).
+ * @return 0 once nothing is pending, -1 if some of it still is.
+ */
+int conn_flush_tail(Client *conn, int wait);
+
 /**
  * @brief Sends an error message using the protocol format.
  */
@@ -0,0 +1,47 @@
+/**
+ * @file clocksync.h
+ * @brief Periodic clock updates for every running game (server argument
+ * clocksync=<interval_ms>).
+ *
+ * Without it players only get TIME and CLK at the start of a game, after each
+ * move and on resume. With it, one thread wakes every interval and walks the
+ * room registry once: each game whose clock is running gets one line,
+ * "CS <white_ms> <black_ms>", formatted once and written to both players
+ * (with the board prefix on a multiplexed connection) and queued for its
+ * spectators as "W_CS <white_ms> <black_ms>". A tick therefore costs one
+ * format per game and at most one write per player, whatever the number of
+ * games, at a rate the operator picked.
+ *
+ * Updates are best effort: a write is tried once without blocking, and a
+ * player whose socket buffer is full, or whose connection is in the middle of
+ * another write, misses that tick (the next one carries
+ * the same information). A write that goes out only in part leaves its rest
+ * on the connection: the next write there, of any kind, sends it first, so
+ * lines are never cut and the tick never waits for a socket.
+ *
+ * CS lines are never numbered on a sequenced session (see retransmit.h), so
+ * a session that reconnected gets none until its resume has been sent: no
+ * update can arrive ahead of REPLAY or RESUME_MATCH.
+ *
+ * Off by default: older clients would take CS for an unknown message.
+ */
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stddef.h>
+
+/**
+ * @brief Starts the clock sync thread.
+ * @param interval_ms Time between two ticks (at least CLOCKSYNC_MIN_INTERVAL_MS).
+ * @return 0 on success, -1 if the interval is too short or the thread cannot be created.
+ */
+int clocksync_start(unsigned interval_ms);
+
+/**
+ * @brief Formats tick counters and walk times on one line.
+ * @return Number of characters written, 0 when the stream is off.
+ */
+int clocksync_format_stats(char *buf, size_t sz);
+
+#endif /* CLOCKSYNC_H */
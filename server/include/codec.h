@@ -0,0 +1,93 @@
+/**
+ * @file codec.h
+ * @brief Binary encoding helpers shared by the on-disk and on-wire formats.
+ *
+ * Growable buffers, LEB128 varints, CRC-32 framing, full-length writes and
+ * the monotonic clock used to time them. The journal, capture and every
+ * later persistence module encode through these, so the formats agree on
+ * byte order and checksums.
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Growable output buffer. Zero-initialise before first use; free data when done.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+    int failed;                 /**< Set once an allocation failed */
+} Buf;
+
+/**
+ * @brief Makes room for extra more bytes after len.
+ * A failure leaves the buffer as it was, so the caller may drop one record
+ * and go on; failed records that it happened.
+ * @return 0 on success, -1 (and failed set) if memory runs out.
+ */
+int buf_reserve(Buf *b, size_t extra);
+
+/**
+ * @brief Appends n bytes. Does nothing once the buffer has failed, so an
+ * encoder can append a whole record and check failed once at the end.
+ */
+void buf_put(Buf *b, const void *p, size_t n);
+
+/**
+ * @brief Appends the low width bytes of v, little-endian.
+ */
+void buf_put_le(Buf *b, uint64_t v, int width);
+
+/**
+ * @brief CRC-32 (IEEE 802.3, reflected) of n bytes.
+ */
+uint32_t crc32(const void *p, size_t n);
+
+/**
+ * @brief Stores (loads) the low width bytes of v, little-endian.
+ */
+void put_le(unsigned char *p, uint64_t v, int width);
+uint64_t get_le(const unsigned char *p, int width);
+
+/**
+ * @brief Writes v as a LEB128 varint (at most 10 bytes).
+ * @return Bytes written.
+ */
+size_t put_varint(unsigned char *buf, uint64_t v);
+
+/**
+ * @brief Reads a LEB128 varint.
+ * @return Bytes consumed, or 0 if the input ends first or the value overflows.
+ */
+size_t get_varint(const unsigned char *p, size_t avail, uint64_t *v);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC time in milliseconds (microseconds).
+ */
+uint64_t mono_ms(void);
+uint64_t mono_us(void);
+
+/**
+ * @brief Writes all len bytes to fd, retrying short writes and EINTR.
+ * @return 0 on success, -1 on error (errno set).
+ */
+int write_all(int fd, const void *p, size_t len);
+
+/**
+ * @brief Positioned variants: the whole range is written (read) at off.
+ * @return 0 on success, -1 on error or, for pread_all(), end of file.
+ */
+int pwrite_all(int fd, const void *p, size_t len, off_t off);
+int pread_all(int fd, void *p, size_t len, off_t off);
+
+/**
+ * @brief Same as write_all() for a socket, without raising SIGPIPE.
+ */
+int send_all(int fd, const void *p, size_t len);
+
+#endif /* CODEC_H */
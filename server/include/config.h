@@ -18,16 +18,92 @@
 #define BUFFER_SZ 1024          /**< Size of the raw socket read buffer */
 #define LINEBUF_SZ 256          /**< Maximum length of a single protocol line */
 #define BIG_BUFFER_SZ 4096      /**< Size for large payloads (e.g., history, room lists) */
+#define SEND_RETRY_LIMIT 200    /**< EAGAIN retries before a send is abandoned */
+#define SEND_RETRY_DELAY_US 5000 /**< Pause between EAGAIN retries */
 #define NAME_LEN 64             /**< Maximum length of a client name */
 #define ADDR_LEN 64             /**< Maximum length of a stringified IP address */
 #define ID_LEN 32               /**< Length of the unique session ID string */
 
 /* Application Logic Constants */
 #define MAX_ERRORS 3            /**< Disconnect client after this many protocol violations */
-#define TURN_TIMEOUT_SECONDS 180    /**< Max time allowed for a player to make a move */
+#define TURN_TIMEOUT_SECONDS 180    /**< Max time allowed for a player to make a move (rooms opened with a plain NEW) */
+#define CLOCK_MAX_BASE_SECONDS 10800 /**< Longest starting time per side of a NEW <base>+<inc> room */
+#define CLOCK_MAX_INCREMENT_SECONDS 180 /**< Longest increment or delay per move */
+#define WATCHDOG_INTERVAL_MS 1000   /**< Longest sleep of a match watchdog (heartbeats, disconnects) */
+#define REMATCH_WINDOW_SECONDS 30   /**< Time after a game during which its players can ask for a rematch */
 #define DISCONNECT_TIMEOUT_SECONDS 60 /**< Time before a disconnected session is destroyed */
 #define HEARTBEAT_TIMEOUT_SECONDS 15  /**< Time without data before assuming a zombie connection */
 #define RECONNECT_WINDOW 60     /**< Window allowing reconnection (often same as disconnect timeout) */
 #define DISCONNECT_GRACE_PERIOD 3 /**< Seconds to wait before notifying opponent of disconnect */
 
+/* Journal (crash recovery) */
+#define JOURNAL_SYNC_INTERVAL_MS 20     /**< Group commit window: longest an accepted event stays unsynced */
+#define JOURNAL_COMPACT_MIN_BYTES (4 * 1024 * 1024) /**< Journals smaller than this are never compacted */
+#define JOURNAL_COMPACT_RATIO 4         /**< Compact once the file is this many times the live state */
+
+/* Game archive */
+#define ARCHIVE_SEGMENT_BYTES (256 * 1024 * 1024) /**< Start a new archive segment past this size */
+#define POSINDEX_MERGE_ENTRIES (1 << 20) /**< Position runs are not merged past this many entries (16 MB) */
+#define POSINDEX_QUERY_MAX 20           /**< Games listed by an admin POS query */
+
+/* Player profiles */
+#define PROFILES_INITIAL_CAPACITY (1 << 16) /**< Slots of a new profile file (8 MB, sparse) */
+#define PROFILES_MAX_LOAD_PCT 90        /**< New names are refused past this fill level until a restart grows the file */
+#define PROFILES_INITIAL_RATING 1200    /**< Elo of a new player */
+#define PROFILES_ELO_K 32               /**< Elo K-factor */
+#define PROFILES_MIN_RATED_PLIES 2      /**< Shorter games are not rated */
+#define LEADERBOARD_MAX_LEVEL 24        /**< Skip list levels (fanout 4: enough for 2^48 players) */
+#define LEADERBOARD_TOP_DEFAULT 10      /**< Entries listed by TOP without a count */
+#define LEADERBOARD_TOP_MAX 32          /**< Most entries listed by one TOP request (fits one line) */
+
+/* Matchmaking queue */
+#define MATCHMAKER_TICK_MS 200          /**< Time between two pairing passes */
+#define MATCHMAKER_BUCKET_WIDTH 50      /**< Rating points per queue bucket */
+#define MATCHMAKER_BUCKETS 80           /**< Buckets cover ratings 0..3999 (outliers go to the end buckets) */
+#define MATCHMAKER_POOLS 16            /**< Time controls queued for at once */
+#define MATCHMAKER_WINDOW_BASE 50       /**< Rating difference accepted on entering the queue */
+#define MATCHMAKER_WINDOW_GROWTH 25     /**< Extra rating difference accepted per second of waiting */
+#define MATCHMAKER_WINDOW_MAX 400       /**< Widest rating difference ever accepted */
+#define MATCHMAKER_PAIRS_PER_TICK 1024  /**< Rooms opened by one pass at most */
+
+/* Tournaments */
+#define TOURNEY_MAX_PLAYERS 16384       /**< Entrants of one tournament at most */
+#define TOURNEY_MAX_ROUNDS 64           /**< Most rounds of a Swiss tournament */
+#define TOURNEY_NOSHOW_SECONDS 60       /**< A player not ready this long after a round starts forfeits the game */
+#define TOURNEY_SWISS_LOOKAHEAD 32      /**< Candidates a Swiss pairing tries before accepting a colour clash */
+
+/* Spectators */
+#define SPECTATE_QUEUE_LEN 256          /**< Events queued for one spectator before it is resynced */
+#define SPECTATE_MAX_RESYNCS 3          /**< Resyncs of a spectator before its connection is dropped */
+#define SPECTATE_WAIT_MS 100            /**< Longest wait for an event before a spectator's input is checked */
+
+/* Multiplexed connections */
+#define MUX_MAX_BOARDS 64               /**< Boards of one multiplexed connection at most */
+#define MUX_POLL_US 10000               /**< Read poll interval while one of the boards is waiting */
+
+/* Round-trip probes */
+#define RTT_MIN_INTERVAL_MS 250         /**< Shortest accepted rtt= interval */
+
+/* Clock sync stream */
+#define CLOCKSYNC_MIN_INTERVAL_MS 100   /**< Shortest accepted clocksync= interval */
+#define CLOCKSYNC_LINE_SZ 96            /**< Longest update line, board prefix included */
+
+/* Sequenced sessions */
+#define RETRANSMIT_MAX_MSGS 256         /**< Messages a sequenced session keeps for a resume */
+#define RETRANSMIT_MAX_BYTES (32 * 1024) /**< Bytes of messages a sequenced session keeps at most */
+
+/* Snapshots */
+#define SNAPSHOT_INTERVAL_SECONDS 60    /**< Default time between two snapshots */
+
+/* Hot standby replication */
+#define REPLICA_HEARTBEAT_MS 500        /**< Primary sends a heartbeat after this long without events */
+#define REPLICA_TIMEOUT_MS 3000         /**< Standby gives up on a primary silent for this long */
+#define REPLICA_FAILOVER_MS 2000        /**< Standby keeps retrying a lost primary this long before taking over */
+#define REPLICA_RETRY_MS 200            /**< Delay between connection attempts to the primary */
+#define REPLICA_MAX_BACKLOG (16 * 1024 * 1024) /**< Queued bytes after which a lagging standby is dropped */
+
+/* Hot restart */
+#define HANDOFF_QUIESCE_MS 5000         /**< Abort a handoff if the workers do not park within this time */
+#define HANDOFF_ACK_TIMEOUT_MS 10000    /**< Longest either side waits for the other during a handoff */
+
 #endif /* CONFIG_H */
\ No newline at end of file
@@ -0,0 +1,52 @@
+/**
+ * @file faults.h
+ * @brief Network fault injection (chaos testing builds only).
+ *
+ * Available when the server is built with `make FAULTS=1` (-DFAULT_INJECT).
+ * The fault layer stacks on top of the active IoOps table (netio.h), so every
+ * send_raw() and read_packet_wrapper() call can be disturbed the way flaky
+ * mobile links disturb real clients.
+ *
+ * A schedule is a comma separated list of key=value items:
+ *
+ *   short=P        P% of sends write only a random prefix (short write)
+ *   frag=P         P% of recvs return only part of the available bytes
+ *   delay=P/MS     P% of sends are held back up to MS milliseconds
+ *   eagain=P/N     P% of calls start a storm of N consecutive EAGAIN results on that socket
+ *   rst=P          P% of recvs abort the connection (ECONNRESET, RST on close)
+ *   stall=P/MS     P% of recvs stall for MS milliseconds before reading
+ *   from=S         start injecting S seconds after the schedule is set
+ *   until=S        stop injecting S seconds after the schedule is set (0 = never)
+ *   seed=N         seed of the fault generator
+ *
+ * Percentages may be fractional (e.g. rst=0.05).
+ */
+
+#ifndef FAULTS_H
+#define FAULTS_H
+
+#include <stddef.h>
+
+#ifdef FAULT_INJECT
+
+/**
+ * @brief Stacks the fault layer on the current transport and applies spec.
+ * @return 0 on success, -1 if the spec cannot be parsed.
+ */
+int faults_install(const char *spec);
+
+/**
+ * @brief Replaces the schedule at runtime ("OFF" disables every fault).
+ * @return 0 on success, -1 if the spec cannot be parsed or the layer is not installed.
+ */
+int faults_configure(const char *spec);
+
+/**
+ * @brief Formats the current schedule and the injected-fault counters.
+ * @return Number of characters written.
+ */
+int faults_format(char *buf, size_t sz);
+
+#endif /* FAULT_INJECT */
+
+#endif /* FAULTS_H */
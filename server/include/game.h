@@ -9,6 +9,7 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <stddef.h>
 #include <time.h>
 
 /**
@@ -52,5 +53,7 @@ int find_king(GameState *g, int color, int *rk, int *ck);
 /* Input Parsing */
 int is_move_format(const char *m);
 void parse_move(const char *mv, int *r1, int *c1, int *r2, int *c2);
+int load_fen(Match *m, const char *fen);
+int format_fen(const Match *m, char *buf, size_t sz);
 
 #endif /* GAME_H */
\ No newline at end of file
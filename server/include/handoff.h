@@ -0,0 +1,72 @@
+/**
+ * @file handoff.h
+ * @brief Zero-downtime hot restart (session handoff to a new process).
+ *
+ * A server started with handoff=PATH listens on a Unix socket for its
+ * successor. Deploying a new binary means starting it with takeover=PATH:
+ *
+ *   1. The old process freezes: the accept loop and every worker thread park
+ *      at a safe point (between two protocol lines, signalled out of blocking
+ *      reads with SIGUSR2) and the watchdogs skip their ticks.
+ *   2. It serializes every Client (including input received but not yet
+ *      processed) and every Match, and sends the state plus the listening
+ *      socket and all client sockets to the successor with SCM_RIGHTS.
+ *   3. The successor rebuilds the registries and acknowledges; the old process
+ *      flushes its journal and capture and exits without closing a connection.
+ *   4. The successor starts a worker per connected session and a watchdog per
+ *      match and resumes accepting on the inherited socket.
+ *
+ * Clients see nothing but a short pause. If the successor fails before it
+ * acknowledges, the old process thaws and keeps serving. Boards of a
+ * multiplexed connection go over as disconnected sessions, which the
+ * connection takes back when its worker restarts; boards without a game or
+ * an open room are dropped.
+ *
+ * Stream layout: u32 state_len | u32 fd_count | state, then the descriptors in
+ * batches of HANDOFF_FD_BATCH, one data byte per batch. The state starts with
+ * "CHOF" | u8 version and uses fixed-width little-endian fields.
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+
+#define HANDOFF_MAGIC "CHOF"
+#define HANDOFF_VERSION 5
+#define HANDOFF_FD_BATCH 200    /**< Descriptors per SCM_RIGHTS message (kernel limit is 253) */
+
+/**
+ * @brief Old side: starts the thread that waits for a successor on path.
+ * Must be called from the thread running the accept loop.
+ * @param listen_fd Listening socket handed to the successor.
+ * @param next_conn_id Connection counter of the accept loop (read while it is parked).
+ * @return 0 on success, -1 if the Unix socket cannot be created.
+ */
+int handoff_listen(const char *path, int listen_fd, uint32_t *next_conn_id);
+
+/**
+ * @brief New side: takes over state and sockets from the process listening on path
+ * and rebuilds the registries. Sessions are not started yet (handoff_start_sessions).
+ * Returns once the old process has exited.
+ * @return The inherited listening socket, or -1 on failure.
+ */
+int handoff_takeover(const char *path, uint32_t *next_conn_id);
+
+/**
+ * @brief New side: starts the watchdogs and worker threads of the taken over state.
+ */
+void handoff_start_sessions(void);
+
+/**
+ * @brief Parks the calling thread while a handoff is in progress.
+ * Called by the accept loop and by workers between protocol lines.
+ */
+void handoff_checkpoint(void);
+
+/**
+ * @brief Returns 1 while the process is frozen for a handoff.
+ */
+int handoff_frozen(void);
+
+#endif /* HANDOFF_H */
@@ -0,0 +1,95 @@
+/**
+ * @file journal.h
+ * @brief Write-ahead journal of match lifecycle events (crash recovery).
+ *
+ * When enabled, room creation, joins, every accepted move and the end of each
+ * game are appended to a journal file. On startup the journal is replayed and
+ * every game that was still running is rebuilt in the registry (match_restore),
+ * so its players can come back with their usual HELLO name and id. Rooms already
+ * in the registry (taken over from the previous process) are left as they are.
+ *
+ * Game threads only enqueue records. A background writer appends them in
+ * batches with one write() per batch and calls fdatasync() at most every
+ * JOURNAL_SYNC_INTERVAL_MS (group commit), so an event is durable at most that
+ * long after it was accepted. The writer keeps its own model of the live rooms
+ * and, once the file has grown JOURNAL_COMPACT_RATIO times past the live state,
+ * rewrites it as a checkpoint holding only live rooms (tmp file + rename).
+ *
+ * File layout (all integers little-endian):
+ *   Header:  "CJNL" | u8 version | u8[3] reserved | u64 wall-clock creation (ns since epoch)
+ *   Record:  u8 type | varint room_id | varint len | len bytes payload | u32 crc32
+ *
+ * The CRC covers type through payload. Replay stops at the first incomplete or
+ * corrupt record (a torn tail after a crash), which is then discarded.
+ * Payloads: JNL_CREATE and JNL_JOIN carry "name\0id", JNL_MOVE the move text,
+ * JNL_END "u8 winner+1 | u8 EndReason" and JNL_CHECKPOINT a varint next room id
+ * (room_id is 0). Rooms with per-side clocks add "\0 | u8 ClockMode | varint
+ * base ms | varint increment ms" to JNL_CREATE and "\0 | varint ms" (the
+ * mover's time left) to JNL_MOVE, so a restored game keeps its clocks as of
+ * the last move.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include "match.h"
+
+#define JOURNAL_MAGIC "CJNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SZ 16
+
+/**
+ * @brief Record types stored in a journal file.
+ */
+typedef enum {
+    JNL_CREATE = 1,     /**< Room created by its white player */
+    JNL_JOIN = 2,       /**< Black player joined */
+    JNL_MOVE = 3,       /**< Move accepted */
+    JNL_END = 4,        /**< Game finished or room closed */
+    JNL_CHECKPOINT = 5  /**< Start of a compacted journal */
+} JournalRecordType;
+
+/**
+ * @brief Replays the journal at path (if any), restores its live matches,
+ * rewrites it compacted and starts the background writer.
+ * Must be called before clients are accepted.
+ * @return Number of restored matches, or -1 if the journal cannot be written.
+ */
+int journal_open(const char *path);
+
+/**
+ * @brief Writes pending records, syncs the file and stops the writer.
+ */
+void journal_close(void);
+
+/**
+ * @brief Enqueue lifecycle events. No-ops when the journal is not enabled.
+ * Called with the match lock held (journal_create with the registry lock),
+ * so the records of one match are enqueued in the order they happened.
+ */
+void journal_create(const Match *m);
+void journal_join(const Match *m);
+void journal_move(const Match *m, const char *mv);
+void journal_end(const Match *m);
+
+/**
+ * @brief Encodes the CREATE suffix "\0 | u8 mode | varint base | varint
+ * increment" (at most 22 bytes); the replication stream uses it too.
+ * @return Bytes written.
+ */
+size_t journal_put_time_control(unsigned char *buf, const TimeControl *tc);
+
+/**
+ * @brief Reads the time control after "name\0id" of a CREATE payload.
+ * @return 1 if there is one, 0 for a room with the default per-move budget.
+ */
+int journal_get_time_control(const unsigned char *p, size_t len, TimeControl *tc);
+
+/**
+ * @brief Formats writer counters (records, bytes, batches, syncs, compactions).
+ * @return Number of characters written (0 when the journal is not enabled).
+ */
+int journal_format_stats(char *buf, size_t sz);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,73 @@
+/**
+ * @file leaderboard.h
+ * @brief Rating leaderboard: an indexable skip list over the player profiles.
+ *
+ * Every profile with at least one rated game has a node ordered by rating
+ * (highest first), then by name. Each forward link stores its span (the number
+ * of level-0 nodes it skips), so the rank of a player and the entry at a given
+ * rank are found in O(log n) like any lookup, and a TOP listing is that
+ * lookup plus a walk along level 0.
+ *
+ * The list lives in memory only. profiles_open() fills it from the mapped
+ * table, and the profile store moves a player's node whenever a rated game
+ * changes their rating, from inside the record's write section so that two
+ * games of the same player update the list in the same order as the record.
+ * One rwlock protects the list: updates at game end are the only writers.
+ */
+
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * @brief One ranked player.
+ */
+typedef struct {
+    uint64_t rank;          /**< 1 for the highest rating */
+    char name[NAME_LEN];
+    int32_t rating;
+} LeaderboardEntry;
+
+/**
+ * @brief Adds a player who is not ranked yet (first rated game, or startup scan).
+ */
+void leaderboard_insert(const char *name, int32_t rating);
+
+/**
+ * @brief Moves a ranked player from old_rating to new_rating.
+ */
+void leaderboard_move(const char *name, int32_t old_rating, int32_t new_rating);
+
+/**
+ * @brief Removes every node (profiles closed).
+ */
+void leaderboard_clear(void);
+
+/**
+ * @brief Copies up to n entries starting at rank `first` (1-based).
+ * @return Number of entries copied.
+ */
+size_t leaderboard_range(uint64_t first, LeaderboardEntry *out, size_t n);
+
+/**
+ * @brief Rank of a player currently rated `rating`.
+ * @return 1-based rank, or 0 if the player is not ranked.
+ */
+uint64_t leaderboard_rank(const char *name, int32_t rating);
+
+/**
+ * @brief Number of ranked players.
+ */
+uint64_t leaderboard_size(void);
+
+/**
+ * @brief Formats "rank:name:rating" tokens for ranks first..first+n-1,
+ * separated by spaces ("EMPTY" if there are none).
+ * @return Number of characters written.
+ */
+int leaderboard_format(uint64_t first, size_t n, char *buf, size_t sz);
+
+#endif /* LEADERBOARD_H */
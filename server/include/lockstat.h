@@ -0,0 +1,58 @@
+/**
+ * @file lockstat.h
+ * @brief Lock contention and hold-time accounting.
+ *
+ * Wraps pthread mutex acquisition to record how long threads wait for a lock
+ * and how long they keep it. Statistics are updated atomically so one LockStat
+ * can aggregate many mutexes of the same kind (e.g. all match locks).
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Aggregated statistics for one lock (or one class of locks).
+ */
+typedef struct {
+    const char *name;           /**< Label used in reports */
+    uint64_t acquisitions;      /**< Number of completed lock/unlock pairs */
+    uint64_t wait_ns_total;     /**< Total time spent blocked in lock */
+    uint64_t wait_ns_max;       /**< Longest single wait */
+    uint64_t hold_ns_total;     /**< Total time the lock was held */
+    uint64_t hold_ns_max;       /**< Longest single hold */
+} LockStat;
+
+#define LOCKSTAT_INIT(label) { (label), 0, 0, 0, 0, 0 }
+
+/**
+ * @brief Returns CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * @brief Locks the mutex and records the wait time.
+ * @return Timestamp at which the lock was obtained; pass it to lockstat_release().
+ */
+uint64_t lockstat_acquire(pthread_mutex_t *mtx, LockStat *st);
+
+/**
+ * @brief Records the hold time and unlocks the mutex.
+ */
+void lockstat_release(pthread_mutex_t *mtx, LockStat *st, uint64_t held_since);
+
+/**
+ * @brief Clears all counters of a LockStat (keeps the name).
+ */
+void lockstat_reset(LockStat *st);
+
+/**
+ * @brief Formats a one-line summary ("name acq=.. wait_avg=..us ...") into buf.
+ * @return Number of characters written (as snprintf).
+ */
+int lockstat_format(const LockStat *st, char *buf, size_t sz);
+
+#endif /* LOCKSTAT_H */
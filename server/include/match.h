@@ -9,11 +9,48 @@
 #define MATCH_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include "game.h"
 
 /* Forward declare Client to avoid circular include with client.h */
 typedef struct Client Client;
+typedef struct Watcher Watcher;
+
+/**
+ * @brief How a match ended (recorded by match_finish).
+ */
+typedef enum {
+    END_NONE = 0,       /**< Still running */
+    END_CHECKMATE,
+    END_STALEMATE,
+    END_RESIGN,
+    END_DRAW_AGREED,
+    END_TIMEOUT,        /**< Clock of the side to move ran out */
+    END_ABANDON,        /**< Player left with EXT */
+    END_DISCONNECT,     /**< Player did not reconnect in time */
+    END_KICKED,         /**< Player disconnected for protocol violations */
+    END_CANCELLED       /**< Host closed the room before anyone joined */
+} EndReason;
+
+/**
+ * @brief How the clocks of a room run (chosen with NEW).
+ */
+typedef enum {
+    TC_PER_MOVE = 0,    /**< A fresh budget of base_ms for every move (plain NEW) */
+    TC_FISCHER,         /**< base_ms per side, increment_ms added after each move */
+    TC_BRONSTEIN        /**< base_ms per side, time used on a move given back up to increment_ms */
+} ClockMode;
+
+/**
+ * @brief Time control of a room.
+ */
+typedef struct {
+    ClockMode mode;
+    int base_ms;
+    int increment_ms;
+} TimeControl;
 
 /**
  * @brief Represents a single chess match (room).
@@ -35,6 +72,8 @@ typedef struct Match {
     
     GameState state;        /**< Current board configuration */
     int finished;           /**< Flag: 1 if game has ended */
+    int winner;             /**< 0 White, 1 Black, -1 draw or no result (set when finished) */
+    EndReason end_reason;   /**< Why the game ended (set when finished) */
     
     /* Special Chess Rules State */
     int w_can_kingside;
@@ -44,40 +83,97 @@ typedef struct Match {
     int ep_r;               /**< En passant target row */
     int ep_c;               /**< En passant target col */
     int draw_offered_by;    /**< Color who offered draw, or -1 */
+    char premove[8];        /**< Move queued by the side not to move (PMV), empty if none */
+    int premove_color;      /**< Colour that queued premove */
     
     /* Timing & Lifecycle */
-    time_t last_move_time;
-    int turn_timeout_seconds;
+    TimeControl tc;
+    int64_t clock_ms[2];    /**< Time left per colour when its clock last stopped (ms) */
+    uint64_t turn_started_ms; /**< io_mono_ms() when the clock of the side to move started */
+    int clock_running;      /**< Clock of the side to move is running (game on, not paused) */
+    time_t started_at;      /**< When the opponent joined (game start), 0 while waiting */
     int refs;               /**< Reference count (Players + Watchdog) */
+    int shared_watchdog;    /**< Watched through match_watchdog_tick() by its creator, no thread of its own */
 
     /* Timer Pause Logic (for disconnects) */
-    time_t elapsed_at_pause; 
     int is_paused;
+
+    /* Rematch (after a finished game, see match_request_rematch) */
+    Client *rematch_seat[2];    /**< Players of the last game back in the lobby, by colour; each holds a reference */
+    int rematch_want[2];        /**< Colour has asked for a rematch and waits for the other */
+    time_t rematch_until;       /**< End of the rematch window, 0 once it is closed */
+
+    Watcher *watchers;          /**< Spectators (see spectate.h) */
 } Match;
 
 /* --- Lifecycle Management --- */
-Match *match_create(Client *white);
+Match *match_create(Client *white, const TimeControl *tc);
+size_t match_create_batch(Client *const *white, Client *const *black, size_t n, Match **out);
 void match_free(Match *m);
 int match_join(Match *m, Client *black);
 int match_join_by_id(int id, Client *black);
+void match_finish(Match *m, int winner, EndReason reason);
+const char *end_reason_name(EndReason reason);
+Match *match_restore(int id, const char *white_name, const char *white_id,
+                     const char *black_name, const char *black_id,
+                     char *const *moves, size_t moves_count,
+                     const TimeControl *tc, const int64_t *clock_ms);
+Match *match_alloc(int id);
+int match_replay_move(Match *m, const char *mv);
+Match *match_adopt(Match *m, const char *white_name, const char *white_id,
+                   const char *black_name, const char *black_id);
+void match_reserve_room_ids(int next_id);
+int match_next_room_id(void);
+void match_insert(Match *m);
 
 /* --- Registry Access --- */
 char *get_room_list_str();
 Match *find_open_room(int id);
+Match *match_lock_by_id(int id);
 int get_active_room_count(void);
+int match_exists(int id);
+void match_foreach(void (*fn)(Match *m, void *arg), void *arg);
+int match_lock_all(void);
+void match_unlock_all(void);
+void match_foreach_held(void (*fn)(Match *m, void *arg), void *arg);
 
 /* --- Game Flow & Events --- */
 int match_release_after_client(Client *me);
 int match_append_move(Match *m, const char *mv);
 void notify_start(Match *m);
 void *match_watchdog(void *arg);
+int match_watchdog_tick(Match *m, int *result, unsigned *wait_ms);
 
 /* --- Reconnection & Timing --- */
-Client *match_reconnect(const char *name, const char *id, int new_sock);
+Client *match_reconnect(const char *name, const char *id, int new_sock, Client *mux);
 int match_try_resume(Match *m);
 int match_get_remaining_time(Match *m); 
 
+/* --- Clocks --- */
+int time_control_parse(const char *s, TimeControl *tc);
+int time_control_format(const TimeControl *tc, char *buf, size_t sz);
+void match_set_time_control(Match *m, const TimeControl *tc);
+int64_t match_clock_left(const Match *m, int color);
+void match_clock_start(Match *m);
+void match_clock_stop(Match *m);
+void match_clock_switch(Match *m);
+void match_clock_credit(Match *m, unsigned ms);
+int match_clock_flagged(const Match *m);
+void match_flag(Match *m);
+void match_send_clock(Match *m, Client *c);
+
+/* --- Rematch --- */
+void match_leave_after_game(Client *me);
+int match_request_rematch(Client *me);
+int match_rematch_pending(Client *me);
+int match_drop_rematch(Client *me);
+int match_rematch_refs(const Match *m);
+
 /* --- Cleanup --- */
 void match_leave_by_client(Client *me);
 
+/* --- Diagnostics --- */
+int match_format_stats(char *buf, size_t sz);
+void match_reset_stats(void);
+
 #endif /* MATCH_H */
\ No newline at end of file
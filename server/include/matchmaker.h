@@ -0,0 +1,74 @@
+/**
+ * @file matchmaker.h
+ * @brief Automatic pairing of players who sent QUEUE.
+ *
+ * QUEUE takes an optional time control, written as for NEW ("QUEUE 180+2");
+ * without one the game gets the default clocks of a plain NEW. Players only
+ * meet others who asked for the same time control: each one being queued
+ * for has a pool (MATCHMAKER_POOLS at most at a time), and within a pool
+ * queued players sit in rating buckets (MATCHMAKER_BUCKET_WIDTH points
+ * wide), oldest first within a bucket. Every MATCHMAKER_TICK_MS the
+ * matchmaker thread makes one pass over each pool's buckets from the lowest
+ * rating up: players
+ * of the same bucket are paired in queue order, and a player left over
+ * looks in the next buckets for the first opponent both of them accept. A
+ * player accepts opponents within MATCHMAKER_WINDOW_BASE rating points, plus
+ * MATCHMAKER_WINDOW_GROWTH points per second spent in the queue (at most
+ * MATCHMAKER_WINDOW_MAX). A pass touches each queued player once plus a few
+ * neighbouring buckets per leftover player, so it stays linear in the queue.
+ *
+ * Each pair then goes through the usual room flow outside the queue lock:
+ * match_create() for the player who queued first (White), match_join() for
+ * the other. If the room limit is reached the pair goes back into the queue.
+ *
+ * A queued player is in STATE_WAITING with no match; c->queued points at its
+ * queue entry. The matchmaker is the only one to clear it once it has taken
+ * the player for a pair, so a worker that wants to leave the queue (EXT or
+ * disconnect) waits for that pair to be settled.
+ *
+ * The queue is not handed over on a hot restart: queued players find
+ * themselves back in the lobby of the new process.
+ */
+
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "match.h"
+
+
+/**
+ * @brief Starts the pairing thread.
+ * @return 0 on success, -1 if the thread cannot be created.
+ */
+int matchmaker_start(void);
+
+/**
+ * @brief Rating the player is matched on (their profile rating, or the
+ * initial rating when profiles are not enabled).
+ */
+int32_t matchmaker_rating(const char *name);
+
+/**
+ * @brief Puts a lobby client in the queue for a time control (NULL for the
+ * default clocks). The caller switches it to STATE_WAITING.
+ * @return 0 on success, -1 if the matchmaker is not running or the client is
+ * already queued, -2 if MATCHMAKER_POOLS other time controls are queued for.
+ */
+int matchmaker_enqueue(Client *c, int32_t rating, const TimeControl *tc);
+
+/**
+ * @brief Takes a client out of the queue, waiting if it is being paired right now.
+ * @return 0 if it was removed, 1 if it was paired (or its pairing failed) meanwhile,
+ * -1 if it was not queued.
+ */
+int matchmaker_leave(Client *c);
+
+/**
+ * @brief Formats queue counters (queued players, pairs, pass times).
+ * @return Number of characters written (0 when the matchmaker is not running).
+ */
+int matchmaker_format_stats(char *buf, size_t sz);
+
+#endif /* MATCHMAKER_H */
@@ -0,0 +1,54 @@
+/**
+ * @file netio.h
+ * @brief Transport and clock abstraction.
+ *
+ * All socket I/O, sleeping, wall-clock reads and thread creation done by the
+ * client and match modules go through this interface. By default the calls map
+ * directly onto the system calls; the simulator (sim.h) installs its own table
+ * so the same server code runs over in-memory connections and a virtual clock.
+ */
+
+#ifndef NETIO_H
+#define NETIO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @brief Table of transport and clock primitives.
+ */
+typedef struct {
+    time_t (*now)(void);                                            /**< Wall-clock seconds */
+    uint64_t (*mono_ms)(void);                                      /**< Monotonic milliseconds (game clocks) */
+    void (*sleep_us)(unsigned int usec);                            /**< Suspend the calling thread */
+    ssize_t (*send)(int fd, const void *buf, size_t len, int flags);
+    ssize_t (*recv)(int fd, void *buf, size_t len, int flags);
+    int (*close)(int fd);
+    int (*shutdown)(int fd, int how);
+    int (*spawn)(void *(*fn)(void *), void *arg);                   /**< Start a detached thread, 0 on success */
+} IoOps;
+
+/**
+ * @brief Replaces the active table. Pass NULL to restore the system calls.
+ * Must be called before any client or match thread is running.
+ */
+void io_set_ops(const IoOps *ops);
+
+/**
+ * @brief Returns the active table (used to stack a decorator on top of it).
+ */
+const IoOps *io_get_ops(void);
+
+/* --- Dispatchers used by the server modules --- */
+time_t io_time(void);
+uint64_t io_mono_ms(void);
+void io_usleep(unsigned int usec);
+ssize_t io_send(int fd, const void *buf, size_t len, int flags);
+ssize_t io_recv(int fd, void *buf, size_t len, int flags);
+int io_close(int fd);
+int io_shutdown(int fd, int how);
+int io_spawn(void *(*fn)(void *), void *arg);
+
+#endif /* NETIO_H */
@@ -0,0 +1,92 @@
+/**
+ * @file posindex.h
+ * @brief Position index over the game archive: Zobrist hash -> (game, ply).
+ *
+ * Every archive segment gets a position file next to it, games-NNNNNN.pos,
+ * listing the Zobrist hash of the starting position (ply 0) and of the
+ * position after each move of each archived game. The archive writer keeps it up to date as it appends games; the admin
+ * console (POS <fen>) probes it through mmap.
+ *
+ *   header  "CPOS" | u8 version | u8 flags | u8[2] reserved | u64 creation (unix s)
+ *   run     u32 entry count | u32 first game | u32 games | u32 crc32 (entries)
+ *           | entries sorted by hash, game, ply
+ *   entry   u64 hash | u32 game (index in the segment) | u16 ply | u16 reserved
+ *
+ * Each writer batch becomes a sorted run appended to the file. The last two
+ * runs are merged in place while the older one holds less than twice as many
+ * entries as the newer one (and the result stays under
+ * POSINDEX_MERGE_ENTRIES), so a segment has a few large runs and a logarithmic
+ * tail of small ones, and a query is one binary search per run.
+ *
+ * The file is derived data: the dirty flag is set while the writer has it
+ * open, and after a crash its runs are checked against their crc32, a torn
+ * tail is cut and the missing games are indexed again from the archive.
+ *
+ * The hash covers pieces, side to move, castling rights that are still usable
+ * (king and rook on their squares) and the en passant file when a capture is
+ * possible, so the same position reached from a FEN or from a game matches.
+ */
+
+#ifndef POSINDEX_H
+#define POSINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "archive.h"
+
+#define POSINDEX_MAGIC "CPOS"
+#define POSINDEX_VERSION 2
+#define POSINDEX_HEADER_SZ 16
+#define POSINDEX_RUN_HEADER_SZ 16
+#define POSINDEX_ENTRY_SZ 16
+#define POSINDEX_FLAG_DIRTY 0x01
+
+/**
+ * @brief Zobrist hash of the position (board, turn, castling, en passant) of m.
+ */
+uint64_t posindex_hash(const Match *m);
+
+/* --- Writer (archive writer thread) --- */
+
+/**
+ * @brief Switches the index to segment seg of dir, which holds `games` indexed
+ * games. Checks the file if it was not closed cleanly and indexes any games
+ * it is missing.
+ * @return 0 on success, -1 if the position file cannot be used (indexing stops).
+ */
+int posindex_open(const char *dir, int seg, size_t games);
+
+/**
+ * @brief Adds the positions of game number `game` of the current segment.
+ * They are written by the next posindex_flush(). A NULL g (unreadable
+ * record) only counts the game.
+ */
+void posindex_add(uint32_t game, const ArchiveGame *g);
+
+/**
+ * @brief Writes the added positions as a new run and merges small runs.
+ */
+void posindex_flush(void);
+
+/**
+ * @brief Flushes, marks the file clean and closes it.
+ */
+void posindex_close(void);
+
+/**
+ * @brief Formats index counters (positions, games, runs, merges, reindexed games).
+ * @return Number of characters written (0 when the index is not open).
+ */
+int posindex_format_stats(char *buf, size_t sz);
+
+/* --- Queries --- */
+
+/**
+ * @brief Lists archived games that reached the position given as FEN: the
+ * number of occurrences, then up to POSINDEX_QUERY_MAX of them, one per line.
+ * @return Number of characters written, 0 when the index is not open, -1 if
+ * the FEN is malformed.
+ */
+int posindex_query(const char *fen, char *buf, size_t sz);
+
+#endif /* POSINDEX_H */
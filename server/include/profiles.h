@@ -0,0 +1,89 @@
+/**
+ * @file profiles.h
+ * @brief Persistent player profiles and Elo ratings in a memory-mapped file.
+ *
+ * When enabled (profiles=FILE), every name seen in a HELLO gets a record that
+ * outlives the session: games, wins, draws, losses, rating and last seen.
+ * The file is an open-addressing hash table (linear probing on a 64-bit FNV-1a
+ * hash of the name) mapped MAP_SHARED, so the kernel writes it back and a
+ * restarted or taken-over server maps the same records.
+ *
+ *   header  "CPRF" | u8 version | u8[3] reserved | u32 slot size | u64 capacity
+ *           | u64 used slots | u64 creation (unix s) | padding to PROFILES_SLOT_SZ
+ *   slots   capacity x PlayerSlot (native byte order)
+ *
+ * There is no lock on the table. A slot is claimed with a compare-and-swap on
+ * its state and published once its name is written; records are never removed.
+ * Each record carries a sequence counter, odd while a writer updates it, so
+ * rating updates at game end only ever wait for a writer of the same record and
+ * readers retry instead of blocking. The table is grown (rewritten at twice
+ * the size) on open once it is more than half full; a table that fills up while
+ * running stops taking new names until the next restart.
+ *
+ * Rated games: finished games with an opponent and at least
+ * PROFILES_MIN_RATED_PLIES moves. Checkmate, resignation, timeout and
+ * abandoning count as a win and a loss, stalemate and agreed draws as draws;
+ * cancelled rooms are not counted. Ratings use Elo with K = PROFILES_ELO_K.
+ * Players with at least one rated game are ranked on the leaderboard
+ * (leaderboard.h), which is rebuilt from the table on open.
+ */
+
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "match.h"
+#include "config.h"
+
+#define PROFILES_MAGIC "CPRF"
+#define PROFILES_VERSION 1
+#define PROFILES_SLOT_SZ 128
+
+/**
+ * @brief Snapshot of one player's record.
+ */
+typedef struct {
+    char name[NAME_LEN];
+    uint32_t games, wins, draws, losses;
+    int32_t rating;
+    int64_t last_seen;      /**< Unix time of the last HELLO */
+} PlayerProfile;
+
+/**
+ * @brief Maps (or creates) the profile file, growing it if it is over half full.
+ * Call before clients are accepted.
+ * @return 0 on success, -1 if the file cannot be used.
+ */
+int profiles_open(const char *path);
+
+/**
+ * @brief Syncs and unmaps the file.
+ */
+void profiles_close(void);
+
+/**
+ * @brief Handshake: creates the player's record if needed and stamps last seen.
+ * No-op when profiles are not enabled.
+ */
+void profiles_seen(const char *name);
+
+/**
+ * @brief Rates a finished match and updates both records. Called with the
+ * match lock held; no-op when profiles are not enabled or the game is unrated.
+ */
+void profiles_record_game(const Match *m);
+
+/**
+ * @brief Reads a consistent copy of a player's record.
+ * @return 0 if found, -1 if unknown or profiles are not enabled.
+ */
+int profiles_get(const char *name, PlayerProfile *out);
+
+/**
+ * @brief Formats table counters (capacity, used slots, lookups, rated games).
+ * @return Number of characters written (0 when profiles are not enabled).
+ */
+int profiles_format_stats(char *buf, size_t sz);
+
+#endif /* PROFILES_H */
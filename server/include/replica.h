@@ -0,0 +1,82 @@
+/**
+ * @file replica.h
+ * @brief Hot-standby replication of match state to a second server process.
+ *
+ * A primary started with replica=PORT accepts one standby on that port. The
+ * standby (started with standby=HOST:PORT) first receives every live match,
+ * then a stream of events: rooms created and joined, moves, game ends and
+ * players disconnecting or coming back. It applies them through the rules
+ * engine to matches of its own, so it holds the same registry as the primary
+ * without serving anyone.
+ *
+ * When the primary is gone (connection closed, or silent for
+ * REPLICA_TIMEOUT_MS) and cannot be reached again within REPLICA_FAILOVER_MS,
+ * the standby promotes itself: its matches are registered with every player
+ * disconnected, and the server starts up normally and binds the game port.
+ * Players resume with their usual HELLO name and id. A reconnect within the
+ * failover window (e.g. a hot restart of the primary) is a fresh sync instead.
+ *
+ * Events are enqueued under the match lock (room creation under the registry
+ * lock), so a standby attached while holding match_lock_all() sees every event
+ * exactly once: either in the initial state or in the stream.
+ *
+ * Stream records: u8 type | varint room_id | varint len | payload. CREATE and
+ * JOIN carry "name\0id", MOVE the move text, END nothing, DISCONNECT
+ * "u8 color | varint seconds since", RECONNECT "u8 color", SYNCED a varint
+ * next room id (closes the initial state), HEARTBEAT nothing. Rooms with
+ * per-side clocks extend CREATE and MOVE as in the journal (see journal.h).
+ */
+
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include <stddef.h>
+#include <netinet/in.h>
+#include "match.h"
+
+/**
+ * @brief Record types of the replication stream (1-4 as in the journal).
+ */
+typedef enum {
+    RPL_CREATE = 1,
+    RPL_JOIN = 2,
+    RPL_MOVE = 3,
+    RPL_END = 4,
+    RPL_DISCONNECT = 6,
+    RPL_RECONNECT = 7,
+    RPL_SYNCED = 8,
+    RPL_HEARTBEAT = 9
+} ReplicaRecordType;
+
+/**
+ * @brief Primary: starts accepting a standby on ip:port.
+ * Call once the registry is populated and before clients are accepted.
+ * @return 0 on success, -1 if the port cannot be bound.
+ */
+int replica_start(struct in_addr ip, int port);
+
+/**
+ * @brief Standby: follows the primary at "host:port" and returns once it has
+ * taken over (the replicated matches are then registered).
+ * @return 0 after promotion, -1 on invalid arguments.
+ */
+int replica_follow(const char *primary);
+
+/**
+ * @brief Enqueue events for the attached standby. No-ops without one.
+ * Called with the match lock held (replica_create with the registry lock).
+ */
+void replica_create(const Match *m);
+void replica_join(const Match *m);
+void replica_move(const Match *m, const char *mv);
+void replica_end(const Match *m);
+void replica_disconnect(const Match *m, int color);
+void replica_reconnect(const Match *m, int color);
+
+/**
+ * @brief Formats replication counters (role, standby, records, bytes, resyncs).
+ * @return Number of characters written (0 when replication is not enabled).
+ */
+int replica_format_stats(char *buf, size_t sz);
+
+#endif /* REPLICA_H */
@@ -0,0 +1,96 @@
+/**
+ * @file retransmit.h
+ * @brief Sequence-numbered output and gap-free resume (HELLO <name> <id> <last_seen>).
+ *
+ * A client that sends a third HELLO field gets its protocol messages
+ * numbered: "#<seq> <message>", seq counting from 1 per session. ACK codes,
+ * PNG, probes and clock sync updates stay unnumbered; they only matter at
+ * the moment they arrive. The last RETRANSMIT_MAX_MSGS messages (at most
+ * RETRANSMIT_MAX_BYTES) are kept with the session, including those sent
+ * while it is disconnected.
+ *
+ * On a reconnect, last_seen is the highest number the client received. If
+ * every later message is still held, the server answers "REPLAY <from> <to>"
+ * and sends them again, unchanged, instead of RESUME_MATCH, HISTORY and the
+ * clock; only the clock is sent afresh. Otherwise the session resumes as it
+ * always did, and the messages it missed are not sent at all. Until the resume has been sent, messages for the session are
+ * only held and clock sync updates are skipped, so nothing new overtakes the
+ * replay.
+ *
+ * Inbound, any line may start with "@<id> " (ids increasing per session).
+ * A command whose id is not above the last one seen is a retry of a command
+ * already carried out: it is answered "DUP <id>" and skipped. Its replies
+ * are in the retransmit buffer if the client missed them.
+ *
+ * Sequence state and the held messages are handed over on a hot restart.
+ */
+
+#ifndef RETRANSMIT_H
+#define RETRANSMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Retransmit Retransmit;
+
+/**
+ * @brief Allocates an empty buffer whose next message is numbered next_seq.
+ * @return The buffer, or NULL if memory runs out.
+ */
+Retransmit *retransmit_create(uint64_t next_seq);
+
+void retransmit_free(Retransmit *r);
+
+/**
+ * @brief Numbers a message, keeps it and writes the numbered line into out
+ * (newline terminated), dropping the oldest held messages past the limits.
+ * @return Length of the line in out.
+ */
+size_t retransmit_push(Retransmit *r, const char *payload, char *out, size_t out_sz);
+
+/**
+ * @brief Number the next message will get.
+ */
+uint64_t retransmit_next_seq(const Retransmit *r);
+
+/**
+ * @brief Whether every message numbered above last_seen is still held.
+ */
+int retransmit_covers(const Retransmit *r, uint64_t last_seen);
+
+/**
+ * @brief Writes every held message numbered above last_seen to sock.
+ * Caller holds the session lock.
+ * @return Number of messages written.
+ */
+size_t retransmit_replay(const Retransmit *r, uint64_t last_seen, int sock);
+
+/**
+ * @brief Number of held messages, and the i-th oldest one (for a handoff).
+ */
+size_t retransmit_held(const Retransmit *r);
+const char *retransmit_line(const Retransmit *r, size_t i, size_t *len);
+
+/**
+ * @brief Puts back a numbered line taken from retransmit_line(), oldest first.
+ * @return 0 on success, -1 if the line is not numbered or memory runs out.
+ */
+int retransmit_restore(Retransmit *r, const char *line, size_t len);
+
+/**
+ * @brief Counts a reconnect: gap-free resume (1) or full resume (0).
+ */
+void retransmit_count_resume(int gap_free);
+
+/**
+ * @brief Counts a retried command skipped as a duplicate.
+ */
+void retransmit_count_duplicate(void);
+
+/**
+ * @brief Formats the counters on one line.
+ * @return Number of characters written.
+ */
+int retransmit_format_stats(char *buf, size_t sz);
+
+#endif /* RETRANSMIT_H */
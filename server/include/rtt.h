@@ -0,0 +1,98 @@
+/**
+ * @file rtt.h
+ * @brief Round-trip time probes and clock lag compensation.
+ *
+ * With probes enabled (server argument rtt=<interval_ms>), the match watchdog
+ * sends each player in a game "PRB <t>" at most once per interval, t being
+ * the server's monotonic clock in ms. The client echoes the line unchanged;
+ * read_packet_wrapper() consumes the echo like a PING and feeds the sample
+ * into a smoothed RTT and its mean deviation (jitter), kept per connection
+ * the way TCP does (RFC 6298: gains 1/8 and 1/4). Only the echo of the last
+ * probe sent counts, so a stale or made up echo is ignored; an unanswered
+ * probe is replaced only after two intervals. Boards of a
+ * multiplexed connection share its estimate: probes go to the connection,
+ * unprefixed.
+ *
+ * With lag compensation on as well (lagcomp=<max_ms>), a move is credited
+ * the estimated one-way delay, half the smoothed RTT, capped at max_ms and
+ * at the time the move actually took: a distant player is not charged for
+ * the time their move spent on the wire. The watchdog grants the same grace
+ * before flagging the side to move. A client can only inflate its own
+ * estimate by delaying its echoes, so the cap bounds what it can gain.
+ *
+ * Probes are off by default: older clients would take PRB for an unknown
+ * message. Estimates are not handed over on a hot restart; the new process
+ * measures them again.
+ */
+
+#ifndef RTT_H
+#define RTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+typedef struct Client Client;
+
+/**
+ * @brief One connection's estimate, as listed by the admin RTT command.
+ */
+typedef struct RttRow {
+    char name[NAME_LEN];
+    char addr[ADDR_LEN];
+    uint32_t conn_id;
+    uint32_t srtt_us;       /**< Smoothed round-trip time */
+    uint32_t rttvar_us;     /**< Mean deviation of the samples */
+    uint32_t samples;
+} RttRow;
+
+/**
+ * @brief Sets the probe interval (0 disables probes) and the largest
+ * per-move lag credit (0 disables lag compensation). Called before serving.
+ * @return 0 on success, -1 if the interval is below RTT_MIN_INTERVAL_MS
+ * (probes and lag compensation then stay off).
+ */
+int rtt_configure(unsigned probe_interval_ms, unsigned lagcomp_max_ms);
+
+/**
+ * @brief Probe interval in ms, 0 while probes are off.
+ */
+unsigned rtt_probe_interval_ms(void);
+
+/**
+ * @brief Sends a probe to the connection a player is served over, unless
+ * probes are off or the last one was sent less than an interval ago (two
+ * intervals while it is still unanswered, so a path slower than the
+ * interval still gets its echoes counted).
+ */
+void rtt_probe(Client *c);
+
+/**
+ * @brief Consumes a probe echo read on connection c.
+ * @return 1 if line is a probe echo (matching or not), 0 otherwise.
+ */
+int rtt_on_echo(Client *c, const char *line);
+
+/**
+ * @brief Forgets a connection's estimate (the player came back on a new one).
+ */
+void rtt_reset(Client *c);
+
+/**
+ * @brief Time a move of this player is credited for network delay, in ms
+ * (0 without lag compensation or before the first sample).
+ */
+unsigned rtt_lag_credit_ms(const Client *c);
+
+/**
+ * @brief Counts a credit actually granted to a move.
+ */
+void rtt_count_credit(unsigned ms);
+
+/**
+ * @brief Formats the probe counters on one line.
+ * @return Number of characters written.
+ */
+int rtt_format_stats(char *buf, size_t sz);
+
+#endif /* RTT_H */
@@ -0,0 +1,67 @@
+/**
+ * @file sim.h
+ * @brief Deterministic simulation of the transport and clock.
+ *
+ * The simulator installs an IoOps table (see netio.h) in which sockets are
+ * in-memory byte pipes and time is virtual. Server threads still exist, but a
+ * baton scheduler lets exactly one of them run at a time: a thread keeps the
+ * baton until it blocks in recv or sleep, then hands it to the next runnable
+ * thread in creation order. The virtual clock only advances when every thread
+ * is blocked, jumping straight to the earliest wake-up. A run is therefore a
+ * pure function of the scenario, and minutes of protocol timeouts elapse in
+ * microseconds of real time.
+ *
+ * Server code must not block on a mutex held by a thread that is parked in
+ * recv or sleep; the client and match modules never do I/O waits under a lock.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SIM_FD_BASE 1000            /**< Simulated descriptors never collide with real ones */
+#define SIM_EPOCH 1700000000        /**< Wall-clock seconds reported at virtual time zero */
+
+/**
+ * @brief Installs the simulated transport and resets the virtual clock.
+ */
+void sim_init(void);
+
+/**
+ * @brief Runs fn as the first simulated thread and waits until every
+ * simulated thread (including the ones it spawned) has exited.
+ * @return 0 on a clean finish, -1 if all threads blocked with nothing to wake them.
+ */
+int sim_run(void *(*fn)(void *), void *arg);
+
+/**
+ * @brief Creates a connected pair of in-memory endpoints.
+ * @return 0 on success, -1 on allocation failure.
+ */
+int sim_socketpair(int fds[2]);
+
+/**
+ * @brief recv() that gives up after timeout_ms of virtual time (errno ETIMEDOUT).
+ */
+ssize_t sim_recv_timeout(int fd, void *buf, size_t len, uint64_t timeout_ms);
+
+/**
+ * @brief Current virtual time in milliseconds since sim_init().
+ */
+uint64_t sim_now_ms(void);
+
+/**
+ * @brief FNV-1a hash over every byte sent through the simulator, in order.
+ * Two runs of the same scenario must produce the same value.
+ */
+uint64_t sim_trace_hash(void);
+
+/**
+ * @brief Number of baton hand-offs since sim_init().
+ */
+uint64_t sim_switches(void);
+
+#endif /* SIM_H */
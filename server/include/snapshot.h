@@ -0,0 +1,70 @@
+/**
+ * @file snapshot.h
+ * @brief Periodic copy-on-write snapshots of all live matches.
+ *
+ * A snapshot costs the server one fork(): the registry and every match are
+ * locked only for the duration of the fork, then the child (which owns a
+ * frozen copy-on-write image of the process) encodes every unfinished match
+ * and its players into a tmp file, syncs it and renames it over the snapshot,
+ * while the parent keeps serving. At startup the snapshot is mapped with mmap
+ * and the matches are rebuilt directly from the stored positions, without
+ * replaying moves. Players come back through the usual reconnect path.
+ *
+ * Snapshots complement the journal: when journal= is given it is the more
+ * recent record and the snapshot is not loaded.
+ *
+ * File layout (all integers little-endian):
+ *   Header:  "CSNP" | u8 version | u8[3] reserved | u64 wall-clock time (ns since epoch)
+ *            | u32 next room id | u32 match count
+ *   Match:   u32 id | u8 flags | i8 ep_r | i8 ep_c | i8 draw_offered_by
+ *            | u8 clock mode | u32 base (ms) | u32 increment (ms)
+ *            | u32 white time left (ms) | u32 black time left (ms)
+ *            | u8[32] board, two squares per byte (piece + 6), row-major
+ *            | str white | str white_id | [str black | str black_id]
+ *            | u16 move count | str move...
+ *   Trailer: u32 crc32 of everything before it
+ * Strings are u8 length + bytes. Flags: SNAP_F_* below.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+
+#define SNAPSHOT_MAGIC "CSNP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_SZ 24
+
+#define SNAP_F_BLACK  0x01  /**< Room has a black player */
+#define SNAP_F_WK     0x02  /**< Castling rights */
+#define SNAP_F_WQ     0x04
+#define SNAP_F_BK     0x08
+#define SNAP_F_BQ     0x10
+#define SNAP_F_BLACK_TO_MOVE 0x20
+
+/**
+ * @brief Rebuilds the matches stored in the snapshot at path, if there is one.
+ * Must be called before clients are served.
+ * @return Number of restored matches (0 if there is no snapshot), -1 if the file is corrupt.
+ */
+int snapshot_load(const char *path);
+
+/**
+ * @brief Starts the thread taking a snapshot to path every interval_s seconds.
+ * @return 0 on success, -1 if the thread cannot be created.
+ */
+int snapshot_start(const char *path, int interval_s);
+
+/**
+ * @brief Takes a snapshot now and waits for the child to finish.
+ * @return 0 on success, -1 on failure or when snapshots are not enabled.
+ */
+int snapshot_take(void);
+
+/**
+ * @brief Formats snapshot counters (taken, failed, fork pause, write time, size).
+ * @return Number of characters written (0 when snapshots are not enabled).
+ */
+int snapshot_format_stats(char *buf, size_t sz);
+
+#endif /* SNAPSHOT_H */
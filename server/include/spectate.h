@@ -0,0 +1,71 @@
+/**
+ * @file spectate.h
+ * @brief Spectators of running games (WATCH <room>).
+ *
+ * A spectator first gets the position (W_START: players, clock, FEN), then
+ * every move (W_MV) and the result (W_END). Each event is formatted once into
+ * a reference-counted buffer, and a pointer to it is queued on every
+ * spectator of the match; the spectator's own worker thread writes its queue
+ * out (spectate_pump()). The player who makes the move only pays for one
+ * format and one pointer push per spectator, never for a socket write.
+ *
+ * A spectator whose queue is full (SPECTATE_QUEUE_LEN events behind) is
+ * resynced: its queue is dropped and replaced by a fresh W_START. After
+ * SPECTATE_MAX_RESYNCS resyncs its connection is shut down.
+ *
+ * Spectators are not handed over on a hot restart: they find themselves back
+ * in the lobby of the new process.
+ */
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <stddef.h>
+
+typedef struct Client Client;
+typedef struct Match Match;
+
+/**
+ * @brief Starts watching a running game; the snapshot is queued at once.
+ * The caller switches the client to STATE_WATCH.
+ * @return 0 on success, -1 if no game is running in that room.
+ */
+int spectate_watch(Client *c, int room_id);
+
+/**
+ * @brief Writes out the spectator's queued events, waiting up to wait_ms for
+ * one if the queue is empty.
+ * @return Number of events written, or -1 once the watch is over (the match
+ * is gone or the spectator was dropped).
+ */
+int spectate_pump(Client *c, int wait_ms);
+
+/**
+ * @brief Stops watching (EXT, disconnect or end of the watch).
+ */
+void spectate_leave(Client *c);
+
+/**
+ * @brief Queues an event line on every spectator of the match.
+ * Caller must hold m->lock.
+ */
+void spectate_event(Match *m, const char *fmt, ...);
+
+/**
+ * @brief Queues a fresh W_START on every spectator (a rematch started).
+ * Caller must hold m->lock.
+ */
+void spectate_restart(Match *m);
+
+/**
+ * @brief Ends the watch of every spectator of a match about to be freed.
+ */
+void spectate_close(Match *m);
+
+/**
+ * @brief Formats the spectator counters (watchers, events, resyncs, drops).
+ * @return Number of characters written.
+ */
+int spectate_format_stats(char *buf, size_t sz);
+
+#endif /* SPECTATE_H */
@@ -0,0 +1,17 @@
+/**
+ * @file stats.h
+ * @brief Relaxed atomic counters behind the admin statistics commands.
+ *
+ * Counters are plain uint64_t statics bumped from any thread; a report reads
+ * each one atomically but not the set as a whole.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#define STAT_ADD(counter, v) __atomic_fetch_add(&(counter), (v), __ATOMIC_RELAXED)
+#define STAT_INC(counter) STAT_ADD(counter, 1)
+#define STAT_SET(counter, v) __atomic_store_n(&(counter), (v), __ATOMIC_RELAXED)
+#define STAT_GET(counter) ((unsigned long long)__atomic_load_n(&(counter), __ATOMIC_RELAXED))
+
+#endif /* STATS_H */
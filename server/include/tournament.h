@@ -0,0 +1,124 @@
+/**
+ * @file tournament.h
+ * @brief Swiss and round robin tournaments run by the operator.
+ *
+ * The admin console opens a tournament (TOURNEY NEW), registers players by
+ * name (TOURNEY ADD) and starts it. Registered players take their seat by
+ * sending TOURNEY from the lobby: like a queued player they are then in
+ * STATE_WAITING with c->tourney pointing at their entry, and the tournament
+ * thread seats them when their game of the round can start. After each game
+ * the player goes straight back to waiting for the next round.
+ *
+ * Pairings of a round are computed at once when the previous round is over:
+ *  - Swiss (Dutch style): players sorted by score, then rating; each score
+ *    group is split in halves and the top half meets the bottom half, skipping
+ *    opponents already met and preferring opponents due the other colour.
+ *    Players left over float down to the next group. A pass sorts once and
+ *    tries a bounded number of candidates per player, so thousands of players
+ *    are paired in milliseconds.
+ *  - Round robin: circle method over the seeds (rating order at start).
+ * Colours go to the player due that colour (more games with the other colour,
+ * or the other colour last); ties alternate by board. An odd player out gets a
+ * bye (a point), never twice in a Swiss while someone else has not had one.
+ *
+ * The games of a round are created in batches with match_create_batch(): one
+ * registry lock for all of them and no watchdog thread per game. The
+ * tournament thread runs the watchdog checks of every live board once a second,
+ * or sooner when a flag is due (match_watchdog_tick()), and collects the results as games end. A player who
+ * is not waiting TOURNEY_NOSHOW_SECONDS after the round started loses that
+ * game by forfeit. The next round is paired as soon as every game is over.
+ *
+ * One tournament runs at a time. Tournaments are neither journaled nor handed
+ * over on a hot restart: games in progress continue as ordinary games.
+ */
+
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+typedef struct Client Client;
+
+/**
+ * @brief Tournament pairing system.
+ */
+typedef enum {
+    TOURNEY_SWISS,
+    TOURNEY_ROUND_ROBIN
+} TourneyKind;
+
+/**
+ * @brief One line of the standings.
+ */
+typedef struct {
+    int rank;
+    char name[NAME_LEN];
+    int score;              /**< Half points */
+    int buchholz;           /**< Half points of the opponents met (Swiss tie-break, 0 otherwise) */
+    int32_t rating;         /**< Rating at registration */
+} TourneyStanding;
+
+/**
+ * @brief Starts the tournament thread.
+ * @return 0 on success, -1 if the thread cannot be created.
+ */
+int tourney_start(void);
+
+/**
+ * @brief Opens registration for a new tournament (the finished one is dropped).
+ * @param rounds Swiss rounds (ignored for round robin, which plays everyone once).
+ * @return 0 on success, -1 if a tournament is still running or has games in progress.
+ */
+int tourney_create(TourneyKind kind, int rounds);
+
+/**
+ * @brief Registers a player while registration is open.
+ * @return 0 if registered, 1 if already registered, -1 if not open or full.
+ */
+int tourney_register(const char *name, int32_t rating);
+
+/**
+ * @brief Pairs the first round.
+ * @return 0 on success, -1 if registration is not open or fewer than two players registered.
+ */
+int tourney_begin(void);
+
+/**
+ * @brief Ends the running tournament. Waiting players go back to the lobby,
+ * games in progress are played out.
+ * @return 0 on success, -1 if no tournament is running.
+ */
+int tourney_stop(void);
+
+/**
+ * @brief Puts a registered player in the waiting room of the running
+ * tournament and sends it TOURNEY_WAIT; the caller switches it to
+ * STATE_WAITING. Called on TOURNEY and after a game on a tournament board.
+ * TOURNEY_END is not sent from here: the tournament sends it to every
+ * entrant it can reach when it ends.
+ * @return Current round (>= 1), or -1 if no tournament is running or the
+ * player is not registered in it (or waits on another connection).
+ */
+int tourney_ready(Client *c);
+
+/**
+ * @brief Takes a player out of the waiting room (EXT or disconnect).
+ * @return 0 if it left, 1 if it was seated meanwhile, -1 if it was not waiting.
+ */
+int tourney_leave(Client *c);
+
+/**
+ * @brief Copies the first n lines of the current standings.
+ * @return Number of lines copied.
+ */
+size_t tourney_standings(TourneyStanding *out, size_t n);
+
+/**
+ * @brief Formats the tournament state and counters (pairing and seating times).
+ * @return Number of characters written.
+ */
+int tourney_format_stats(char *buf, size_t sz);
+
+#endif /* TOURNAMENT_H */
@@ -0,0 +1,391 @@
+/**
+ * @file admin.c
+ * @brief Loopback operator console.
+ *
+ * A single background thread accepts one operator connection at a time and
+ * executes line commands against the server registries. Commands are listed
+ * in the admin_commands table; each handler writes its reply with
+ * admin_reply() and the dispatcher terminates it with "END".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "admin.h"
+#include "client.h"
+#include "match.h"
+#include "logging.h"
+#include "faults.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "replica.h"
+#include "archive.h"
+#include "posindex.h"
+#include "profiles.h"
+#include "leaderboard.h"
+#include "matchmaker.h"
+#include "tournament.h"
+#include "spectate.h"
+#include "rtt.h"
+#include "clocksync.h"
+#include "retransmit.h"
+#include "config.h"
+
+static int admin_sock = -1;
+
+/**
+ * @brief Formats and sends one reply line to the operator.
+ */
+static void admin_reply(int fd, const char *fmt, ...) {
+    char buf[BIG_BUFFER_SZ];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(buf) - 1) n = sizeof(buf) - 2;
+    if (n == 0 || buf[n - 1] != '\n') buf[n++] = '\n';
+    send(fd, buf, n, MSG_NOSIGNAL);
+}
+
+/* --- Command Handlers --- */
+
+static void cmd_help(int fd, const char *args);
+
+static void cmd_stats(int fd, const char *args) {
+    if (strcmp(args, "RESET") == 0) {
+        match_reset_stats();
+        admin_reply(fd, "OK");
+        return;
+    }
+    char buf[BIG_BUFFER_SZ];
+    admin_reply(fd, "players=%d", get_online_players());
+    if (match_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+}
+
+static void cmd_journal(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    if (journal_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    else admin_reply(fd, "journal disabled");
+}
+
+static void cmd_snapshot(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    if (snapshot_format_stats(buf, sizeof(buf)) == 0) { admin_reply(fd, "snapshots disabled"); return; }
+    if (strcmp(args, "NOW") == 0) {
+        admin_reply(fd, "%s", snapshot_take() == 0 ? "snapshot written" : "snapshot failed");
+        snapshot_format_stats(buf, sizeof(buf));
+    }
+    admin_reply(fd, "%s", buf);
+}
+
+static void cmd_archive(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    if (archive_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    else admin_reply(fd, "archive disabled");
+    if (posindex_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+}
+
+static void cmd_player(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    if (profiles_format_stats(buf, sizeof(buf)) == 0) { admin_reply(fd, "profiles disabled"); return; }
+    if (args[0] == '\0') { admin_reply(fd, "%s", buf); return; }
+
+    PlayerProfile p;
+    if (profiles_get(args, &p) != 0) { admin_reply(fd, "ERR unknown player %s", args); return; }
+    char seen[32] = "never";
+    time_t t = (time_t)p.last_seen;
+    struct tm tm;
+    if (p.last_seen && localtime_r(&t, &tm)) strftime(seen, sizeof(seen), "%Y-%m-%d %H:%M:%S", &tm);
+    admin_reply(fd, "%s rating=%d rank=%llu games=%u wins=%u draws=%u losses=%u last_seen=%s",
+                p.name, p.rating, (unsigned long long)leaderboard_rank(p.name, p.rating),
+                p.games, p.wins, p.draws, p.losses, seen);
+}
+
+static void cmd_top(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    if (profiles_format_stats(buf, sizeof(buf)) == 0) { admin_reply(fd, "profiles disabled"); return; }
+    int n = 0;
+    unsigned long long first = 1;
+    sscanf(args, "%d %llu", &n, &first);
+    if (n <= 0) n = LEADERBOARD_TOP_DEFAULT;
+    if (n > LEADERBOARD_TOP_MAX) n = LEADERBOARD_TOP_MAX;
+
+    LeaderboardEntry e[LEADERBOARD_TOP_MAX];
+    size_t count = leaderboard_range(first, e, (size_t)n);
+    admin_reply(fd, "ranked=%llu", (unsigned long long)leaderboard_size());
+    for (size_t i = 0; i < count; i++) {
+        PlayerProfile p;
+        if (profiles_get(e[i].name, &p) != 0) continue;
+        admin_reply(fd, "%4llu %-20s %5d  games=%u wins=%u draws=%u losses=%u", (unsigned long long)e[i].rank,
+                    e[i].name, e[i].rating, p.games, p.wins, p.draws, p.losses);
+    }
+}
+
+static void cmd_queue(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    if (matchmaker_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    else admin_reply(fd, "matchmaking disabled");
+}
+
+/**
+ * @brief Registers the named players, or every logged-in player for "*".
+ */
+static void tourney_add(int fd, const char *args) {
+    int added = 0, known = 0, refused = 0;
+    if (strcmp(args, "*") == 0) {
+        char (*names)[NAME_LEN] = malloc(TOURNEY_MAX_PLAYERS * sizeof(*names));
+        if (!names) { admin_reply(fd, "ERR out of memory"); return; }
+        size_t n = client_served_names(names, TOURNEY_MAX_PLAYERS);
+        for (size_t i = 0; i < n; i++) {
+            int rc = tourney_register(names[i], matchmaker_rating(names[i]));
+            if (rc == 0) added++; else if (rc > 0) known++; else refused++;
+        }
+        free(names);
+    } else {
+        char name[NAME_LEN];
+        int used = 0;
+        while (sscanf(args, "%63s%n", name, &used) == 1) {
+            args += used;
+            int rc = tourney_register(name, matchmaker_rating(name));
+            if (rc == 0) added++; else if (rc > 0) known++; else refused++;
+        }
+    }
+    admin_reply(fd, "registered=%d already=%d refused=%d", added, known, refused);
+}
+
+static void cmd_tourney(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    if (tourney_format_stats(buf, sizeof(buf)) == 0) { admin_reply(fd, "tournaments disabled"); return; }
+
+    char sub[16] = "", kind[16] = "";
+    int n = 0, used = 0;
+    sscanf(args, "%15s%n", sub, &used);
+    const char *rest = args + used;
+    while (*rest == ' ') rest++;
+
+    if (sub[0] == '\0') admin_reply(fd, "%s", buf);
+    else if (strcmp(sub, "NEW") == 0) {
+        sscanf(rest, "%15s %d", kind, &n);
+        int rr = strcmp(kind, "RR") == 0;
+        if (!rr && (strcmp(kind, "SWISS") != 0 || n <= 0)) admin_reply(fd, "ERR usage: TOURNEY NEW SWISS <rounds> | TOURNEY NEW RR");
+        else if (tourney_create(rr ? TOURNEY_ROUND_ROBIN : TOURNEY_SWISS, n) != 0) admin_reply(fd, "ERR a tournament is still running");
+        else admin_reply(fd, "OK");
+    }
+    else if (strcmp(sub, "ADD") == 0) tourney_add(fd, rest);
+    else if (strcmp(sub, "START") == 0) {
+        if (tourney_begin() != 0) admin_reply(fd, "ERR registration not open or fewer than two players");
+        else if (tourney_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    }
+    else if (strcmp(sub, "STOP") == 0) admin_reply(fd, "%s", tourney_stop() == 0 ? "OK" : "ERR no tournament running");
+    else if (strcmp(sub, "TOP") == 0) {
+        n = atoi(rest);
+        if (n <= 0) n = LEADERBOARD_TOP_DEFAULT;
+        if (n > LEADERBOARD_TOP_MAX) n = LEADERBOARD_TOP_MAX;
+        TourneyStanding st[LEADERBOARD_TOP_MAX];
+        size_t count = tourney_standings(st, (size_t)n);
+        for (size_t i = 0; i < count; i++) {
+            admin_reply(fd, "%4d %-20s %3d.%d  buchholz=%d.%d rating=%d", st[i].rank, st[i].name,
+                        st[i].score / 2, (st[i].score % 2) * 5, st[i].buchholz / 2, (st[i].buchholz % 2) * 5,
+                        st[i].rating);
+        }
+    }
+    else admin_reply(fd, "ERR unknown subcommand %s", sub);
+}
+
+static void cmd_spectate(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    spectate_format_stats(buf, sizeof(buf));
+    admin_reply(fd, "%s", buf);
+}
+
+/**
+ * @brief Probe counters, then one line per connection with its estimate.
+ */
+static void cmd_rtt(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    rtt_format_stats(buf, sizeof(buf));
+    admin_reply(fd, "%s", buf);
+    int served = client_served_count();
+    if (served <= 0) return;
+    RttRow *rows = malloc((size_t)served * sizeof(RttRow));
+    if (!rows) { admin_reply(fd, "ERR out of memory"); return; }
+    size_t n = client_served_rtt(rows, (size_t)served);
+    for (size_t i = 0; i < n; i++) {
+        admin_reply(fd, "%-20s conn=%u addr=%s srtt_us=%u rttvar_us=%u samples=%u", rows[i].name[0] ? rows[i].name : "-",
+                    rows[i].conn_id, rows[i].addr, rows[i].srtt_us, rows[i].rttvar_us, rows[i].samples);
+    }
+    free(rows);
+}
+
+static void cmd_clocksync(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    if (clocksync_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    else admin_reply(fd, "clock sync disabled");
+}
+
+static void cmd_retransmit(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    retransmit_format_stats(buf, sizeof(buf));
+    admin_reply(fd, "%s", buf);
+}
+
+static void cmd_pos(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    int n = posindex_query(args, buf, sizeof(buf));
+    if (n < 0) admin_reply(fd, "ERR malformed FEN");
+    else if (n == 0) admin_reply(fd, "position index disabled");
+    else admin_reply(fd, "%s", buf);
+}
+
+static void cmd_replica(int fd, const char *args) {
+    (void)args;
+    char buf[BIG_BUFFER_SZ];
+    if (replica_format_stats(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+    else admin_reply(fd, "replication disabled");
+}
+
+#ifdef FAULT_INJECT
+static void cmd_faults(int fd, const char *args) {
+    char buf[BIG_BUFFER_SZ];
+    if (args[0] && faults_configure(args) != 0) {
+        admin_reply(fd, "ERR invalid schedule");
+        return;
+    }
+    if (faults_format(buf, sizeof(buf)) > 0) admin_reply(fd, "%s", buf);
+}
+#endif
+
+typedef struct {
+    const char *name;
+    void (*handler)(int fd, const char *args);
+    const char *help;
+} AdminCommand;
+
+static const AdminCommand admin_commands[] = {
+    { "HELP",  cmd_help,  "HELP - list commands" },
+    { "STATS", cmd_stats, "STATS [RESET] - player/room counters and lock hold times" },
+    { "JOURNAL", cmd_journal, "JOURNAL - journal writer counters" },
+    { "ARCHIVE", cmd_archive, "ARCHIVE - game archive writer and position index counters" },
+    { "PLAYER", cmd_player, "PLAYER [name] - profile counters, or one player's rating and record" },
+    { "TOP", cmd_top, "TOP [n] [from] - leaderboard: n players by rating, starting at rank from" },
+    { "QUEUE", cmd_queue, "QUEUE - matchmaking queue length, pairs and pass times" },
+    { "TOURNEY", cmd_tourney, "TOURNEY [NEW SWISS <rounds>|NEW RR|ADD <names>|ADD *|START|STOP|TOP [n]] - tournament state, setup and standings" },
+    { "SPECTATE", cmd_spectate, "SPECTATE - spectators, fan-out events, resyncs and drops" },
+    { "RTT", cmd_rtt, "RTT - probe counters and each connection's round-trip time and jitter" },
+    { "CLOCKSYNC", cmd_clocksync, "CLOCKSYNC - clock sync ticks, updates sent and skipped, walk times" },
+    { "RETRANSMIT", cmd_retransmit, "RETRANSMIT - sequenced sessions, held messages, resumes and duplicate commands" },
+    { "POS", cmd_pos, "POS <fen> - archived games that reached this position" },
+    { "REPLICA", cmd_replica, "REPLICA - replication role and stream counters" },
+    { "SNAPSHOT", cmd_snapshot, "SNAPSHOT [NOW] - snapshot counters, or take one immediately" },
+#ifdef FAULT_INJECT
+    { "FAULTS", cmd_faults, "FAULTS [spec|OFF] - show or replace the fault injection schedule" },
+#endif
+};
+
+#define ADMIN_COMMAND_COUNT (sizeof(admin_commands) / sizeof(admin_commands[0]))
+
+static void cmd_help(int fd, const char *args) {
+    (void)args;
+    for (size_t i = 0; i < ADMIN_COMMAND_COUNT; i++) admin_reply(fd, "%s", admin_commands[i].help);
+    admin_reply(fd, "QUIT - close the console");
+}
+
+/**
+ * @brief Executes one command line.
+ * @return 0 if the session should be closed, 1 otherwise.
+ */
+static int admin_dispatch(int fd, char *line) {
+    trim_crlf(line);
+    if (line[0] == '\0') return 1;
+    if (strcmp(line, "QUIT") == 0) return 0;
+
+    char *args = strchr(line, ' ');
+    if (args) *args++ = '\0';
+    else args = line + strlen(line);
+
+    for (size_t i = 0; i < ADMIN_COMMAND_COUNT; i++) {
+        if (strcmp(line, admin_commands[i].name) == 0) {
+            admin_commands[i].handler(fd, args);
+            admin_reply(fd, "END");
+            return 1;
+        }
+    }
+    admin_reply(fd, "ERR unknown command %s", line);
+    admin_reply(fd, "END");
+    return 1;
+}
+
+/**
+ * @brief Serves one operator connection until QUIT or EOF.
+ */
+static void admin_session(int fd) {
+    char buf[BUFFER_SZ];
+    char line[LINEBUF_SZ];
+    size_t lp = 0;
+    while (1) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        for (ssize_t i = 0; i < n; i++) {
+            if (lp + 1 < sizeof(line)) line[lp++] = buf[i];
+            if (buf[i] != '\n') continue;
+            line[lp] = '\0';
+            lp = 0;
+            if (!admin_dispatch(fd, line)) return;
+        }
+    }
+}
+
+static void *admin_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(admin_sock, NULL, NULL);
+        if (fd < 0) continue;
+        log_printf("[ADMIN] Operator connected.\n");
+        admin_session(fd);
+        close(fd);
+        log_printf("[ADMIN] Operator disconnected.\n");
+    }
+    return NULL;
+}
+
+int admin_start(int port) {
+    admin_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (admin_sock < 0) return -1;
+    int opt = 1;
+    setsockopt(admin_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(admin_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(admin_sock, 4) < 0) {
+        close(admin_sock);
+        admin_sock = -1;
+        return -1;
+    }
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, admin_thread, NULL) != 0) {
+        close(admin_sock);
+        admin_sock = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    log_printf("Admin console listening on 127.0.0.1:%d\n", port);
+    return 0;
+}
@@ -0,0 +1,461 @@
+/**
+ * @file archive.c
+ * @brief Finished-game archive: background segment writer and mmap reader.
+ *
+ * Game threads pack the finished game into a complete record (names, result,
+ * 16-bit moves) under the match lock and enqueue it; nothing else happens on
+ * their side. The writer drains the queue in batches, fills in the checksums,
+ * appends the records with one write() and then their index entries with
+ * another, so an index entry never points past the data that was written.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "codec.h"
+#include "posindex.h"
+#include "client.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+/**
+ * Queued game, record stored inline (crc filled in by the writer).
+ */
+typedef struct ArchiveNode {
+    struct ArchiveNode *next;
+    uint32_t len;
+    uint32_t ended;
+    unsigned char data[];
+} ArchiveNode;
+
+static ArchiveNode *head = NULL;
+static ArchiveNode *tail = NULL;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_tid;
+static volatile int archive_running = 0;
+static char archive_dir[480];
+
+/* Current segment (owned by the writer once it runs) */
+static int seg_no = 0;
+static int data_fd = -1;
+static int index_fd = -1;
+static uint64_t data_bytes = 0;
+static size_t seg_games = 0;    /**< Indexed games in the current segment */
+
+/* Writer counters (updated atomically) */
+static uint64_t n_games, n_bytes, n_batches, n_segments, n_write_errors;
+
+/* --- Moves --- */
+
+uint16_t archive_encode_move(const char *mv) {
+    static const char promos[] = "nbrq";
+    if (!is_move_format(mv)) return 0xffff;
+    int r1, c1, r2, c2, promo = 0;
+    parse_move(mv, &r1, &c1, &r2, &c2);
+    if (mv[4]) {
+        const char *p = strchr(promos, mv[4] | 0x20);
+        if (!p) return 0xffff;
+        promo = (int)(p - promos) + 1;
+    }
+    return (uint16_t)((r1 * 8 + c1) | (r2 * 8 + c2) << 6 | promo << 12);
+}
+
+void archive_decode_move(const ArchiveGame *g, size_t i, char out[6]) {
+    unsigned v = (unsigned)get_le(g->moves + 2 * i, 2);
+    unsigned from = v & 63, to = (v >> 6) & 63, promo = (v >> 12) & 7;
+    out[0] = (char)('a' + from % 8);
+    out[1] = (char)('1' + 7 - from / 8);
+    out[2] = (char)('a' + to % 8);
+    out[3] = (char)('1' + 7 - to / 8);
+    out[4] = (promo >= 1 && promo <= 4) ? "nbrq"[promo - 1] : '\0';
+    out[5] = '\0';
+}
+
+/* --- Segments --- */
+
+void archive_segment_path(char *buf, size_t sz, const char *dir, int n, const char *ext) {
+    snprintf(buf, sz, "%s/games-%06d.%s", dir, n, ext);
+}
+
+static int parse_segment_name(const char *name) {
+    int n = 0, len = 0;
+    if (sscanf(name, "games-%6d.arc%n", &n, &len) == 1 && name[len] == '\0' && n > 0) return n;
+    return 0;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+int archive_list_segments(const char *dir, int *out, int max) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL && n < max) {
+        int no = parse_segment_name(e->d_name);
+        if (no > 0) out[n++] = no;
+    }
+    closedir(d);
+    qsort(out, (size_t)n, sizeof(int), cmp_int);
+    return n;
+}
+
+/**
+ * @brief Highest segment number in dir (0 if there is none, -1 if dir cannot be read).
+ */
+static int newest_segment(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    int last = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        int no = parse_segment_name(e->d_name);
+        if (no > last) last = no;
+    }
+    closedir(d);
+    return last;
+}
+
+static void write_header(int fd, const char *magic) {
+    unsigned char h[ARCHIVE_HEADER_SZ] = { 0 };
+    memcpy(h, magic, 4);
+    h[4] = ARCHIVE_VERSION;
+    put_le(h + 8, (uint64_t)time(NULL), 8);
+    write_all(fd, h, sizeof(h));
+}
+
+static int check_header(int fd, const char *magic) {
+    unsigned char h[ARCHIVE_HEADER_SZ];
+    if (pread(fd, h, sizeof(h), 0) != (ssize_t)sizeof(h)) return -1;
+    return (memcmp(h, magic, 4) == 0 && h[4] == ARCHIVE_VERSION) ? 0 : -1;
+}
+
+/**
+ * @brief Opens segment n for appending, creating it if needed. An existing
+ * segment is cut back to its last indexed record (a torn tail after a crash).
+ */
+static int open_segment(int n) {
+    char dpath[512], ipath[512];
+    archive_segment_path(dpath, sizeof(dpath), archive_dir, n, "arc");
+    archive_segment_path(ipath, sizeof(ipath), archive_dir, n, "idx");
+    int dfd = open(dpath, O_RDWR | O_CREAT, 0644);
+    int ifd = open(ipath, O_RDWR | O_CREAT, 0644);
+    if (dfd < 0 || ifd < 0) goto fail;
+
+    struct stat ds, is;
+    off_t entries = 0;
+    if (fstat(dfd, &ds) != 0 || fstat(ifd, &is) != 0) goto fail;
+    if (ds.st_size == 0 || is.st_size == 0) {
+        if (ftruncate(dfd, 0) != 0 || ftruncate(ifd, 0) != 0) goto fail;
+        write_header(dfd, ARCHIVE_MAGIC);
+        write_header(ifd, ARCHIVE_INDEX_MAGIC);
+        data_bytes = ARCHIVE_HEADER_SZ;
+    } else {
+        if (check_header(dfd, ARCHIVE_MAGIC) != 0 || check_header(ifd, ARCHIVE_INDEX_MAGIC) != 0) {
+            log_printf("[ARCHIVE] %s is not a version %d archive segment, refusing to append\n", dpath, ARCHIVE_VERSION);
+            goto fail;
+        }
+        entries = (is.st_size - ARCHIVE_HEADER_SZ) / ARCHIVE_INDEX_ENTRY_SZ;
+        data_bytes = ARCHIVE_HEADER_SZ;
+        if (entries > 0) {
+            unsigned char e[ARCHIVE_INDEX_ENTRY_SZ];
+            if (pread(ifd, e, sizeof(e), ARCHIVE_HEADER_SZ + (entries - 1) * ARCHIVE_INDEX_ENTRY_SZ) != (ssize_t)sizeof(e)) goto fail;
+            data_bytes = get_le(e, 8) + get_le(e + 8, 4);
+        }
+        if ((uint64_t)ds.st_size < data_bytes) {
+            log_printf("[ARCHIVE] %s is shorter than its index, refusing to append\n", dpath);
+            goto fail;
+        }
+        if ((uint64_t)ds.st_size > data_bytes || is.st_size != ARCHIVE_HEADER_SZ + entries * ARCHIVE_INDEX_ENTRY_SZ) {
+            log_printf("[ARCHIVE] Cutting unindexed tail of %s at %llu bytes\n", dpath, (unsigned long long)data_bytes);
+            if (ftruncate(dfd, (off_t)data_bytes) != 0 || ftruncate(ifd, ARCHIVE_HEADER_SZ + entries * ARCHIVE_INDEX_ENTRY_SZ) != 0) goto fail;
+        }
+    }
+    lseek(dfd, 0, SEEK_END);
+    lseek(ifd, 0, SEEK_END);
+    if (data_fd >= 0) { fdatasync(data_fd); fdatasync(index_fd); close(data_fd); close(index_fd); }
+    data_fd = dfd;
+    index_fd = ifd;
+    seg_no = n;
+    seg_games = (size_t)entries;
+    STAT_ADD(n_segments, 1);
+    if (posindex_open(archive_dir, n, seg_games) != 0) log_printf("[ARCHIVE] Position index of segment %d disabled\n", n);
+    return 0;
+
+fail:
+    if (dfd >= 0) close(dfd);
+    if (ifd >= 0) close(ifd);
+    return -1;
+}
+
+/* --- Writer --- */
+
+static int decode_record(const unsigned char *r, uint64_t len, ArchiveGame *out);
+
+/**
+ * @brief Appends one batch to the current segment (rolling over first if it is full).
+ * The caller's buffers hold the records and their index entries relative to offset 0.
+ */
+static void flush_batch(Buf *data, Buf *index) {
+    if (data->len == 0) return;
+    if (data_bytes + data->len > ARCHIVE_SEGMENT_BYTES && data_bytes > ARCHIVE_HEADER_SZ) {
+        if (open_segment(seg_no + 1) != 0) {
+            if (STAT_ADD(n_write_errors, 1) == 0) log_printf("[ARCHIVE] Cannot start segment %d: %s\n", seg_no + 1, strerror(errno));
+            return;
+        }
+    }
+    for (size_t off = 0; off < index->len; off += ARCHIVE_INDEX_ENTRY_SZ)
+        put_le(index->data + off, get_le(index->data + off, 8) + data_bytes, 8);
+
+    if (write_all(data_fd, data->data, data->len) != 0 || write_all(index_fd, index->data, index->len) != 0) {
+        if (STAT_ADD(n_write_errors, 1) == 0) log_printf("[ARCHIVE] Write failed: %s\n", strerror(errno));
+        /* Resync with what is on disk, a half-written batch is cut back on the next open */
+        open_segment(seg_no);
+        return;
+    }
+    data_bytes += data->len;
+    STAT_ADD(n_bytes, data->len);
+    STAT_ADD(n_batches, 1);
+
+    /* Index the positions of the games just written */
+    size_t k = 0;
+    for (size_t off = 0; off < data->len; off += get_le(data->data + off, 4), k++) {
+        ArchiveGame g;
+        if (decode_record(data->data + off, get_le(data->data + off, 4), &g) != 0) memset(&g, 0, sizeof(g));
+        posindex_add((uint32_t)(seg_games + k), &g);
+    }
+    posindex_flush();
+    seg_games += k;
+}
+
+static void *archive_writer_func(void *arg) {
+    (void)arg;
+    Buf data = { 0 }, index = { 0 };
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (head == NULL && archive_running) pthread_cond_wait(&queue_cond, &queue_lock);
+        ArchiveNode *batch = head;
+        head = tail = NULL;
+        int stopping = !archive_running;
+        pthread_mutex_unlock(&queue_lock);
+
+        data.len = index.len = 0;
+        uint64_t count = 0;
+        while (batch) {
+            if (buf_reserve(&data, batch->len) == 0 && buf_reserve(&index, ARCHIVE_INDEX_ENTRY_SZ) == 0) {
+                put_le(batch->data + batch->len - 4, crc32(batch->data, batch->len - 4), 4);
+                put_le(index.data + index.len, data.len, 8);
+                put_le(index.data + index.len + 8, batch->len, 4);
+                put_le(index.data + index.len + 12, batch->ended, 4);
+                index.len += ARCHIVE_INDEX_ENTRY_SZ;
+                memcpy(data.data + data.len, batch->data, batch->len);
+                data.len += batch->len;
+                count++;
+            }
+            ArchiveNode *done = batch;
+            batch = batch->next;
+            free(done);
+        }
+        flush_batch(&data, &index);
+        STAT_ADD(n_games, count);
+
+        if (stopping && head == NULL) break;
+    }
+    free(data.data);
+    free(index.data);
+    return NULL;
+}
+
+int archive_open(const char *dir) {
+    if (archive_running) return 0;
+    snprintf(archive_dir, sizeof(archive_dir), "%s", dir);
+    if (mkdir(archive_dir, 0755) != 0 && errno != EEXIST) return -1;
+
+    int last = newest_segment(archive_dir);
+    if (last < 0) return -1;
+    if (open_segment(last > 0 ? last : 1) != 0) return -1;
+
+    archive_running = 1;
+    if (pthread_create(&writer_tid, NULL, archive_writer_func, NULL) != 0) {
+        archive_running = 0;
+        return -1;
+    }
+    log_printf("[ARCHIVE] Appending finished games to %s (segment %d, %llu bytes)\n",
+               archive_dir, seg_no, (unsigned long long)data_bytes);
+    return 0;
+}
+
+void archive_close(void) {
+    if (!archive_running) return;
+    pthread_mutex_lock(&queue_lock);
+    archive_running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_tid, NULL);
+    posindex_close();
+    fdatasync(data_fd);
+    fdatasync(index_fd);
+    close(data_fd);
+    close(index_fd);
+    data_fd = index_fd = -1;
+}
+
+/**
+ * @brief Allocates a queue node and fills in everything before the moves.
+ * @return The node (moves and crc still to be written), or NULL on allocation failure.
+ */
+static ArchiveNode *new_record(uint32_t room, uint64_t started, uint64_t ended, int winner, EndReason reason,
+                               const char *white, size_t wl, const char *black, size_t bl, size_t moves) {
+    if (wl > 255) wl = 255;
+    if (bl > 255) bl = 255;
+    size_t len = ARCHIVE_RECORD_FIXED_SZ + wl + bl + 2 * moves + 4;
+    ArchiveNode *node = malloc(sizeof(ArchiveNode) + len);
+    if (!node) return NULL;
+    node->next = NULL;
+    node->len = (uint32_t)len;
+    node->ended = (uint32_t)ended;
+
+    unsigned char *p = node->data;
+    put_le(p, len, 4);
+    put_le(p + 4, room, 4);
+    put_le(p + 8, started, 8);
+    put_le(p + 16, ended, 8);
+    p[24] = (unsigned char)(int8_t)winner;
+    p[25] = (unsigned char)reason;
+    put_le(p + 26, moves, 2);
+    p[28] = (unsigned char)wl;
+    p[29] = (unsigned char)bl;
+    p += ARCHIVE_RECORD_FIXED_SZ;
+    memcpy(p, white, wl);
+    memcpy(p + wl, black, bl);
+    return node;
+}
+
+static void enqueue(ArchiveNode *node) {
+    pthread_mutex_lock(&queue_lock);
+    if (tail) { tail->next = node; tail = node; }
+    else { head = tail = node; }
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void archive_match(const Match *m) {
+    if (!archive_running || !m->black) return;
+
+    const char *white = m->white ? m->white->name : "";
+    const char *black = m->black->name;
+    size_t wl = strnlen(white, 255), bl = strnlen(black, 255);
+    size_t moves = m->moves_count > 0xffff ? 0xffff : m->moves_count;
+
+    ArchiveNode *node = new_record((uint32_t)m->id, (uint64_t)m->started_at, (uint64_t)io_time(),
+                                   m->winner, m->end_reason, white, wl, black, bl, moves);
+    if (!node) return;
+    unsigned char *p = node->data + ARCHIVE_RECORD_FIXED_SZ + wl + bl;
+    for (size_t i = 0; i < moves; i++, p += 2) put_le(p, archive_encode_move(m->moves[i]), 2);
+    enqueue(node);
+}
+
+int archive_append(const ArchiveGame *g) {
+    if (!archive_running || g->move_count > 0xffff) return -1;
+    ArchiveNode *node = new_record((uint32_t)g->room_id, g->started, g->ended, g->winner, g->end_reason,
+                                   g->white, g->white_len, g->black, g->black_len, g->move_count);
+    if (!node) return -1;
+    size_t wl = g->white_len > 255 ? 255 : g->white_len, bl = g->black_len > 255 ? 255 : g->black_len;
+    memcpy(node->data + ARCHIVE_RECORD_FIXED_SZ + wl + bl, g->moves, 2 * g->move_count);
+    enqueue(node);
+    return 0;
+}
+
+int archive_format_stats(char *buf, size_t sz) {
+    if (!archive_running) return 0;
+    return snprintf(buf, sz, "dir=%s segment=%d games=%llu bytes=%llu batches=%llu segments_opened=%llu write_errors=%llu\n",
+                    archive_dir, seg_no, STAT_GET(n_games), STAT_GET(n_bytes), STAT_GET(n_batches),
+                    STAT_GET(n_segments), STAT_GET(n_write_errors));
+}
+
+/* --- Reader --- */
+
+static const unsigned char *map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < ARCHIVE_HEADER_SZ) { close(fd); return NULL; }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+    *len = (size_t)st.st_size;
+    return p;
+}
+
+int archive_map(const char *dir, int n, ArchiveSegment *seg) {
+    char path[512];
+    memset(seg, 0, sizeof(*seg));
+    archive_segment_path(path, sizeof(path), dir, n, "arc");
+    seg->data = map_file(path, &seg->data_len);
+    archive_segment_path(path, sizeof(path), dir, n, "idx");
+    seg->index = map_file(path, &seg->index_len);
+    if (!seg->data || !seg->index || memcmp(seg->data, ARCHIVE_MAGIC, 4) != 0 || seg->data[4] != ARCHIVE_VERSION
+        || memcmp(seg->index, ARCHIVE_INDEX_MAGIC, 4) != 0 || seg->index[4] != ARCHIVE_VERSION) {
+        archive_unmap(seg);
+        return -1;
+    }
+    return 0;
+}
+
+void archive_unmap(ArchiveSegment *seg) {
+    if (seg->data) munmap((void *)seg->data, seg->data_len);
+    if (seg->index) munmap((void *)seg->index, seg->index_len);
+    memset(seg, 0, sizeof(*seg));
+}
+
+size_t archive_game_count(const ArchiveSegment *seg) {
+    return seg->index ? (seg->index_len - ARCHIVE_HEADER_SZ) / ARCHIVE_INDEX_ENTRY_SZ : 0;
+}
+
+/**
+ * @brief Decodes one record of len bytes (the crc is not checked).
+ */
+static int decode_record(const unsigned char *r, uint64_t len, ArchiveGame *out) {
+    if (len < ARCHIVE_RECORD_FIXED_SZ + 4 || get_le(r, 4) != len) return -1;
+    out->room_id = (int)get_le(r + 4, 4);
+    out->started = get_le(r + 8, 8);
+    out->ended = get_le(r + 16, 8);
+    out->winner = (int8_t)r[24];
+    out->end_reason = (EndReason)r[25];
+    out->move_count = (size_t)get_le(r + 26, 2);
+    out->white_len = r[28];
+    out->black_len = r[29];
+    if (ARCHIVE_RECORD_FIXED_SZ + out->white_len + out->black_len + 2 * out->move_count + 4 != len) return -1;
+    out->white = (const char *)r + ARCHIVE_RECORD_FIXED_SZ;
+    out->black = out->white + out->white_len;
+    out->moves = (const unsigned char *)out->black + out->black_len;
+    return 0;
+}
+
+int archive_game(const ArchiveSegment *seg, size_t i, int verify, ArchiveGame *out) {
+    if (i >= archive_game_count(seg)) return -1;
+    const unsigned char *e = seg->index + ARCHIVE_HEADER_SZ + i * ARCHIVE_INDEX_ENTRY_SZ;
+    uint64_t off = get_le(e, 8), len = get_le(e + 8, 4);
+    if (len < ARCHIVE_RECORD_FIXED_SZ + 4 || off + len > seg->data_len) return -1;
+    const unsigned char *r = seg->data + off;
+    if (decode_record(r, len, out) != 0) return -1;
+    if (verify && crc32(r, (size_t)len - 4) != (uint32_t)get_le(r + len - 4, 4)) return -1;
+    return 0;
+}
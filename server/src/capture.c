@@ -0,0 +1,159 @@
+/**
+ * @file capture.c
+ * @brief Binary capture of inbound traffic.
+ *
+ * Client threads only timestamp and enqueue records; a background writer
+ * thread (same design as the logging subsystem) drains the queue in batches,
+ * encodes them and appends them to the capture file. Timestamps are taken
+ * under the queue lock, so record order and time order always agree and
+ * deltas are never negative.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "capture.h"
+#include "codec.h"
+#include "logging.h"
+
+/**
+ * Queued record, payload stored inline.
+ */
+typedef struct CaptureNode {
+    struct CaptureNode *next;
+    uint64_t ts_ns;
+    uint32_t conn_id;
+    uint8_t type;
+    uint32_t len;           /**< Payload length (CAP_LINE) or room id (CAP_ROOM) */
+    char data[];
+} CaptureNode;
+
+static CaptureNode *head = NULL;
+static CaptureNode *tail = NULL;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_tid;
+static volatile int capture_running = 0;
+static FILE *capture_fp = NULL;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Background thread: encodes queued records and appends them to the file.
+ */
+static void *capture_writer_func(void *arg) {
+    (void)arg;
+    uint64_t last_ts = 0;
+    int first = 1;
+    unsigned char hdr[32];
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (head == NULL && capture_running) pthread_cond_wait(&queue_cond, &queue_lock);
+        if (!capture_running && head == NULL) { pthread_mutex_unlock(&queue_lock); break; }
+        CaptureNode *batch = head;
+        head = tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        while (batch) {
+            if (first) { last_ts = batch->ts_ns; first = 0; }
+            size_t n = 0;
+            hdr[n++] = batch->type;
+            n += put_varint(hdr + n, (batch->ts_ns - last_ts) / 1000);
+            n += put_varint(hdr + n, batch->conn_id);
+            if (batch->type == CAP_LINE || batch->type == CAP_ROOM) n += put_varint(hdr + n, batch->len);
+            /* Keep the microsecond remainder so rounding does not drift over long captures */
+            last_ts += ((batch->ts_ns - last_ts) / 1000) * 1000;
+            fwrite(hdr, 1, n, capture_fp);
+            if (batch->type == CAP_LINE) fwrite(batch->data, 1, batch->len, capture_fp);
+
+            CaptureNode *done = batch;
+            batch = batch->next;
+            free(done);
+        }
+        fflush(capture_fp);
+    }
+    return NULL;
+}
+
+int capture_open(const char *path) {
+    if (capture_running) return 0;
+    capture_fp = fopen(path, "wb");
+    if (!capture_fp) return -1;
+
+    unsigned char hdr[CAPTURE_HEADER_SZ] = { 0 };
+    memcpy(hdr, CAPTURE_MAGIC, 4);
+    hdr[4] = CAPTURE_VERSION;
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t wall_ns = (uint64_t)wall.tv_sec * 1000000000ull + (uint64_t)wall.tv_nsec;
+    for (int i = 0; i < 8; i++) hdr[8 + i] = (unsigned char)(wall_ns >> (8 * i));
+    fwrite(hdr, 1, sizeof(hdr), capture_fp);
+
+    capture_running = 1;
+    if (pthread_create(&writer_tid, NULL, capture_writer_func, NULL) != 0) {
+        capture_running = 0;
+        fclose(capture_fp);
+        capture_fp = NULL;
+        return -1;
+    }
+    log_printf("Capturing inbound traffic to %s\n", path);
+    return 0;
+}
+
+void capture_close(void) {
+    if (!capture_running) return;
+    pthread_mutex_lock(&queue_lock);
+    capture_running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_tid, NULL);
+    fclose(capture_fp);
+    capture_fp = NULL;
+}
+
+/**
+ * @brief Timestamps and enqueues one record.
+ */
+static void capture_push(uint8_t type, uint32_t conn_id, const char *data, size_t len) {
+    if (!capture_running) return;
+    CaptureNode *node = malloc(sizeof(CaptureNode) + (data ? len : 0));
+    if (!node) return;
+    node->next = NULL;
+    node->conn_id = conn_id;
+    node->type = type;
+    node->len = (uint32_t)len;
+    if (data && len) memcpy(node->data, data, len);
+
+    pthread_mutex_lock(&queue_lock);
+    node->ts_ns = mono_ns();
+    if (tail) { tail->next = node; tail = node; }
+    else { head = tail = node; }
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void capture_conn_open(uint32_t conn_id) {
+    capture_push(CAP_OPEN, conn_id, NULL, 0);
+}
+
+void capture_line(uint32_t conn_id, const char *line) {
+    if (!capture_running) return;
+    capture_push(CAP_LINE, conn_id, line, strlen(line));
+}
+
+void capture_conn_close(uint32_t conn_id) {
+    capture_push(CAP_CLOSE, conn_id, NULL, 0);
+}
+
+void capture_room(uint32_t conn_id, int room_id) {
+    /* The id travels in the length field, there is no payload */
+    capture_push(CAP_ROOM, conn_id, NULL, (size_t)room_id);
+}
@@ -15,6 +15,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <ctype.h> 
@@ -22,6 +23,16 @@
 #include "match.h"
 #include "game.h"
 #include "logging.h"
+#include "capture.h"
+#include "profiles.h"
+#include "leaderboard.h"
+#include "matchmaker.h"
+#include "tournament.h"
+#include "spectate.h"
+#include "rtt.h"
+#include "retransmit.h"
+#include "netio.h"
+#include "handoff.h"
 #include "config.h"
 
 extern int max_players;
@@ -80,15 +91,160 @@ int try_reserve_slot(void) {
     return success;
 }
 
+/**
+ * Registry of worker threads. One node per thread; a reconnect moves the node
+ * from the temporary Client to the persisted session it resumes.
+ * Protected by served_lock.
+ */
+struct ServedWorker {
+    struct ServedWorker *next;
+    Client *client;             /**< Session being served, NULL once the worker is exiting */
+    pthread_t tid;
+    int has_tid;                /**< tid is valid (set by the thread itself) */
+};
+
+static ServedWorker *served_list = NULL;
+static int served_count = 0;
+static pthread_mutex_t served_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void served_remove(ServedWorker *w) {
+    pthread_mutex_lock(&served_lock);
+    for (ServedWorker **pp = &served_list; *pp; pp = &(*pp)->next) {
+        if (*pp == w) { *pp = w->next; served_count--; break; }
+    }
+    pthread_mutex_unlock(&served_lock);
+}
+
+/**
+ * @brief Moves the worker of `from` to `to` (reconnect onto a persisted session).
+ */
+static void served_transfer(Client *from, Client *to) {
+    pthread_mutex_lock(&served_lock);
+    to->worker = from->worker;
+    if (to->worker) to->worker->client = to;
+    from->worker = NULL;
+    pthread_mutex_unlock(&served_lock);
+}
+
+int client_start(Client *c) {
+    ServedWorker *w = calloc(1, sizeof(ServedWorker));
+    if (!w) return -1;
+    w->client = c;
+
+    pthread_mutex_lock(&served_lock);
+    c->worker = w;
+    w->next = served_list;
+    served_list = w;
+    served_count++;
+    pthread_mutex_unlock(&served_lock);
+
+    if (io_spawn(client_worker, c) != 0) {
+        served_remove(w);
+        c->worker = NULL;
+        free(w);
+        return -1;
+    }
+    return 0;
+}
+
+int client_served_count(void) {
+    pthread_mutex_lock(&served_lock);
+    int n = served_count;
+    pthread_mutex_unlock(&served_lock);
+    return n;
+}
+
+size_t client_served_snapshot(Client **out, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&served_lock);
+    for (ServedWorker *w = served_list; w && n < max; w = w->next) {
+        if (w->client) out[n++] = w->client;
+    }
+    pthread_mutex_unlock(&served_lock);
+    return n;
+}
+
+size_t client_served_names(char (*out)[NAME_LEN], size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&served_lock);
+    for (ServedWorker *w = served_list; w && n < max; w = w->next) {
+        if (w->client && w->client->state != STATE_HANDSHAKE && w->client->name[0])
+            memcpy(out[n++], w->client->name, NAME_LEN);
+    }
+    pthread_mutex_unlock(&served_lock);
+    return n;
+}
+
+size_t client_served_rtt(RttRow *out, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&served_lock);
+    for (ServedWorker *w = served_list; w && n < max; w = w->next) {
+        Client *c = w->client;
+        if (!c || c->state == STATE_HANDSHAKE) continue;
+        RttRow *r = &out[n++];
+        memcpy(r->name, c->name, NAME_LEN);
+        memcpy(r->addr, c->client_addr, ADDR_LEN);
+        r->conn_id = c->conn_id;
+        r->srtt_us = __atomic_load_n(&c->srtt_us, __ATOMIC_RELAXED);
+        r->rttvar_us = __atomic_load_n(&c->rttvar_us, __ATOMIC_RELAXED);
+        r->samples = __atomic_load_n(&c->rtt_samples, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&served_lock);
+    return n;
+}
+
+void client_signal_workers(int sig) {
+    pthread_mutex_lock(&served_lock);
+    for (ServedWorker *w = served_list; w; w = w->next) {
+        if (w->has_tid) pthread_kill(w->tid, sig);
+    }
+    pthread_mutex_unlock(&served_lock);
+}
+
+/**
+ * @brief Allocates a Client for a freshly accepted connection.
+ * @param sock Connected socket (or simulated endpoint).
+ * @param conn_id Connection number used to key captured traffic.
+ * @return The new client in STATE_HANDSHAKE, or NULL on allocation failure.
+ */
+Client *client_create(int sock, uint32_t conn_id) {
+    Client *c = calloc(1, sizeof(Client));
+    if (!c) return NULL;
+    c->sock = sock;
+    c->color = -1;
+    c->paired = 0;
+    c->match = NULL;
+    c->error_count = 0;
+    c->is_counted = 0;
+    c->state = STATE_HANDSHAKE;
+    c->conn_id = conn_id;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
 /* --- Protocol Helpers --- */
 
 /**
  * @brief Sends raw bytes to a socket, ignoring SIGPIPE.
+ * Keeps writing after short writes and retries EINTR/EAGAIN (bounded), so a
+ * protocol line is never truncated mid-way.
  * @param sock The file descriptor of the socket.
  * @param msg The null-terminated string to send.
  */
 void send_raw(int sock, const char *msg) {
-    if (sock > 0) send(sock, msg, strlen(msg), MSG_NOSIGNAL);
+    if (sock <= 0) return;
+    size_t len = strlen(msg), off = 0;
+    int retries = 0;
+    while (off < len) {
+        ssize_t n = io_send(sock, msg + off, len - off, MSG_NOSIGNAL);
+        if (n > 0) { off += n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && retries++ < SEND_RETRY_LIMIT) {
+            io_usleep(SEND_RETRY_DELAY_US);
+            continue;
+        }
+        return;
+    }
 }
 
 /**
@@ -103,41 +259,71 @@ void send_line(int sock, const char *msg) {
     send_raw(sock, tmp);
 }
 
+int conn_flush_tail(Client *conn, int wait) {
+    if (!conn->out_tail_len) return 0;
+    if (wait) {
+        send_raw(conn->sock, conn->out_tail);
+        conn->out_tail_len = 0;
+        return 0;
+    }
+    ssize_t n = io_send(conn->sock, conn->out_tail, conn->out_tail_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n <= 0) return -1;
+    conn->out_tail_len -= (size_t)n;
+    memmove(conn->out_tail, conn->out_tail + n, conn->out_tail_len + 1);
+    return conn->out_tail_len ? -1 : 0;
+}
+
 /**
  * @brief Formats and sends a protocol message to the client.
  * This function performs thread-safe socket writing and logs the communication.
+ * A board of a multiplexed connection writes through its connection, with its
+ * board number in front. A sequenced session numbers the message and keeps
+ * it for a resume, even while disconnected (see retransmit.h).
  *
  * @param c Pointer to the Client structure.
  * @param fmt Printf-style format string.
  * @param ... Arguments for the format string.
  */
 void send_protocol_msg(Client *c, const char *fmt, ...) {
-    if (!c || c->sock <= 0) return;
+    if (!c || (c->sock <= 0 && !c->retx)) return;
     char payload[BIG_BUFFER_SZ];
     va_list ap;
     va_start(ap, fmt);
     vsnprintf(payload, sizeof(payload), fmt, ap);
     va_end(ap);
 
-    char out[BIG_BUFFER_SZ + 2];
-    snprintf(out, sizeof(out), "%s\n", payload);
-
-    pthread_mutex_lock(&c->lock);
-    send_raw(c->sock, out);
-    pthread_mutex_unlock(&c->lock);
+    char out[BIG_BUFFER_SZ + 32];
+    Client *conn = c->mux ? c->mux : c;
+    pthread_mutex_lock(&conn->lock);
+    conn_flush_tail(conn, 1);
+    if (c->retx) {
+        /* Numbered under the lock, so the numbers follow the order on the wire */
+        retransmit_push(c->retx, payload, out, sizeof(out));
+        if (!c->resume_mark) send_raw(c->sock, out);
+    } else {
+        if (c->mux) snprintf(out, sizeof(out), MUX_LINE "%d %s\n", c->mux_tag, payload);
+        else snprintf(out, sizeof(out), "%s\n", payload);
+        send_raw(conn->sock, out);
+    }
+    pthread_mutex_unlock(&conn->lock);
     
     log_printf("SENT -> %s (sock %d) : %s", c->name[0] ? c->name : "unknown", c->sock, out);
 }
 
 /**
  * @brief Sends a short acknowledgement code to the client.
+ * Takes the client lock like send_protocol_msg, so a partially written line
+ * from another thread can never be interleaved with the ACK.
  *
  * @param c Pointer to the Client structure.
  * @param ack_code The protocol ACK code.
  */
 void send_short_ack(Client *c, const char *ack_code) {
     if (!c || c->sock <= 0) return;
+    pthread_mutex_lock(&c->lock);
+    conn_flush_tail(c, 1);
     send_line(c->sock, ack_code);
+    pthread_mutex_unlock(&c->lock);
 }
 
 /**
@@ -170,7 +356,7 @@ int handle_protocol_error(Client *me, const char *msg) {
                 if (opp && opp->sock > 0) {
                     send_protocol_msg(opp, OPPONENT_KICKED_OUT);
                 }
-                me->match->finished = 1; 
+                match_finish(me->match, (me->match->white == me) ? 1 : 0, END_KICKED);
             }
             pthread_mutex_unlock(&me->match->lock);
         }
@@ -195,6 +381,12 @@ void trim_crlf(char *s) {
  * @return String literal representing the ACK code.
  */
 const char *ack_code_for_received(const char *cmd) {
+    /* Board of a multiplexed connection: acknowledged like the command it carries */
+    if (strncmp(cmd, MUX_LINE, 2) == 0) {
+        const char *inner = strchr(cmd + 2, ' ');
+        return inner ? ack_code_for_received(inner + 1) : GENERIC_ACK;
+    }
+
     /* Handshake */
     if (strncmp(cmd, HELLO, 5) == 0)             return HELLO_ACK;
     
@@ -203,9 +395,16 @@ const char *ack_code_for_received(const char *cmd) {
     if (strncmp(cmd, ROOM_LIST_REQUEST, 4) == 0) return LIST_REQ_ACK;
     if (strncmp(cmd, CREATE_ROOM, 3) == 0)       return NEW_ROOM_ACK;
     if (strncmp(cmd, JOIN_ROOM, 4) == 0)         return JOIN_REQ_ACK;
+    if (strncmp(cmd, LEADERBOARD_REQUEST, 3) == 0) return LEADERBOARD_REQ_ACK;
+    if (strncmp(cmd, QUEUE_REQUEST, 5) == 0)     return QUEUE_REQ_ACK;
+    if (strncmp(cmd, REMATCH_REQUEST, 7) == 0)   return REMATCH_ACK;
+    if (strncmp(cmd, TOURNEY_REQUEST, 7) == 0)   return TOURNEY_ACK;
+    if (strncmp(cmd, MUX_REQUEST, 3) == 0)       return MUX_ACK;
+    if (strncmp(cmd, WATCH_REQUEST, 6) == 0)     return WATCH_ACK;
     
     /* Gameplay Commands */
     if (strncmp(cmd, MOVE_COMMAND, 2) == 0)      return MOVE_COMMAND_ACK;
+    if (strncmp(cmd, PREMOVE_COMMAND, 3) == 0)   return PREMOVE_ACK;
     if (strncmp(cmd, RESIGN, 3) == 0)            return RESIGN_ACK_CS;
     if (strncmp(cmd, DRAW_OFFER, 7) == 0)        return DRAW_OFFER_ACK_CS;
     if (strncmp(cmd, ACCEPT_DRAW, 7) == 0)       return ACCEPT_DRAW_ACK;
@@ -219,46 +418,66 @@ const char *ack_code_for_received(const char *cmd) {
 
 /**
  * @brief Wrapper for reading packets that handles fragmentation and buffering.
- * * This function reads from the socket into a persistence buffer, extracts complete lines,
- * and handles automatic PING/PONG responses and ACK consumption.
+ * * This function reads from the socket into the client's persistent buffer, extracts complete
+ * lines, and handles automatic PING/PONG responses and ACK consumption. Bytes following a
+ * line stay buffered in the Client, so lines arriving together are never lost on a state change.
+ * Entry is also the point where a worker parks during a hot restart handoff.
  *
- * @param me Client structure.
- * @param readbuf Raw buffer for recv calls.
- * @param b_start Pointer to current start index in readbuf.
- * @param b_len Pointer to current length of valid data in readbuf.
- * @param lp Pointer to current length of linebuf.
- * @param linebuf Buffer to assemble the current line.
- * @param linebuf_sz Size of linebuf.
+ * @param me Client structure; the line is returned in me->linebuf.
  * @param recv_flags Flags for recv (e.g., MSG_DONTWAIT).
  * @return 1 on successful line read, 0 on disconnect, -1 on fatal error, -2 on would block/retry.
  */
-int read_packet_wrapper(Client *me, char *readbuf, int *b_start, int *b_len, size_t *lp, char *linebuf, size_t linebuf_sz, int recv_flags) {
+int read_packet_wrapper(Client *me, int recv_flags) {
+    handoff_checkpoint();
     while (1) {
-        if (*b_start >= *b_len) {
-            *b_start = 0;
-            *b_len = recv(me->sock, readbuf, BUFFER_SZ, recv_flags);
-            if (*b_len < 0) {
+        if (me->rb_start >= me->rb_len) {
+            me->rb_start = 0;
+            me->rb_len = 0;
+            int n = io_recv(me->sock, me->readbuf, BUFFER_SZ, recv_flags);
+            if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return -2;
                 return -1; 
             }
-            if (*b_len == 0) return 0;
-            me->last_heartbeat = time(NULL);
+            if (n == 0) return 0;
+            me->rb_len = n;
+            me->last_heartbeat = io_time();
         }
 
-        while (*b_start < *b_len) {
-            char c = readbuf[(*b_start)++];
-            if (*lp + 1 < linebuf_sz) linebuf[(*lp)++] = c;
+        char *linebuf = me->linebuf;
+        while (me->rb_start < me->rb_len) {
+            char c = me->readbuf[me->rb_start++];
+            if (me->line_len + 1 < sizeof(me->linebuf)) linebuf[me->line_len++] = c;
             if (c == '\n') {
-                linebuf[*lp] = '\0';
+                linebuf[me->line_len] = '\0';
                 trim_crlf(linebuf);
-                *lp = 0; 
+                me->line_len = 0; 
                 if (strlen(linebuf) == 0) continue;
+                capture_line(me->conn_id, linebuf);
+
+                // Command ids: a retry of a command already carried out is skipped
+                if (linebuf[0] == COMMAND_ID) {
+                    char *end;
+                    unsigned long long cid = strtoull(linebuf + 1, &end, 10);
+                    if (end != linebuf + 1 && *end == ' ') {
+                        if (cid <= me->last_cmd_id) {
+                            char dup[48];
+                            snprintf(dup, sizeof(dup), DUPLICATE_COMMAND, cid);
+                            send_short_ack(me, dup);
+                            retransmit_count_duplicate();
+                            continue;
+                        }
+                        me->last_cmd_id = cid;
+                        memmove(linebuf, end + 1, strlen(end + 1) + 1);
+                        if (linebuf[0] == '\0') continue;
+                    }
+                }
                 
                 // PING handling
                 if (strcmp(linebuf, PING) == 0) {
-                    send_line(me->sock, PING_RESPONSE);
+                    send_short_ack(me, PING_RESPONSE);
                     continue; 
                 }
+                if (rtt_on_echo(me, linebuf)) continue;
 
                 // Handle Client ACKs (2-digit codes)
                 // We consume them here to prevent them from being treated as unknown commands.
@@ -285,9 +504,80 @@ int read_packet_wrapper(Client *me, char *readbuf, int *b_start, int *b_len, siz
  */
 void reject_connection(int sock) {
     const char *msg = PLAYER_LIMIT_REACHED;
-    send(sock, msg, strlen(msg), MSG_NOSIGNAL);
-    usleep(300000); // wait for the message to be sent entirely before closing
-    close(sock);
+    io_send(sock, msg, strlen(msg), MSG_NOSIGNAL);
+    io_usleep(300000); // wait for the message to be sent entirely before closing
+    io_close(sock);
+}
+
+/**
+ * @brief Puts a session taken back after a disconnect where it was: waiting
+ * for an opponent, or in its game with the move history and the turn timer.
+ */
+static void resume_session(Client *me) {
+    match_try_resume(me->match);
+    if (me->match && !me->paired) {
+        me->state = STATE_WAITING;
+        send_protocol_msg(me, WAIT, me->match->id);
+    } else {
+        me->state = STATE_GAME;
+        Client *opp = (me->match->white == me) ? me->match->black : me->match->white;
+        send_protocol_msg(me, RESUME_MATCH, (opp&&opp->name[0])?opp->name:"Unknown", (me->color==0)?"white":"black");
+        if (opp) send_protocol_msg(opp, OPPONENT_RETURNED, me->name, (me->color==0)?"black":"white");
+        if (me->match && me->match->moves_count > 0) {
+            char history[BIG_BUFFER_SZ] = "";
+            for(size_t j=0; j<me->match->moves_count; j++) {
+                strcat(history, me->match->moves[j]);
+                strcat(history, " ");
+            }
+            send_protocol_msg(me, MATCH_HISTORY, history);
+        }
+        pthread_mutex_lock(&me->match->lock);
+        match_send_clock(me->match, me);
+        match_send_clock(me->match, opp);
+        pthread_mutex_unlock(&me->match->lock);
+    }
+}
+
+/**
+ * @brief Resumes a session taken back by HELLO. A sequenced client whose
+ * missed messages are all still held gets them again after REPLAY, then the
+ * clock; any other client gets the full resume_session(), which sends the
+ * whole game again, so messages held while it was pending are not sent.
+ * @param sequenced Whether HELLO carried a last seen number.
+ */
+static void resume_sequenced(Client *me, int sequenced, uint64_t last_seen) {
+    int gap_free = 0;
+    pthread_mutex_lock(&me->lock);
+    conn_flush_tail(me, 1);
+    if (!sequenced) {
+        /* The client no longer numbers: whatever was held means nothing to it */
+        retransmit_free(me->retx);
+        me->retx = NULL;
+    } else if (!me->retx) {
+        me->retx = retransmit_create(1);
+    } else if (retransmit_covers(me->retx, last_seen)) {
+        uint64_t to = retransmit_next_seq(me->retx) - 1;
+        char line[64];
+        snprintf(line, sizeof(line), SEQ_REPLAY, (unsigned long long)last_seen + 1, (unsigned long long)to);
+        send_line(me->sock, line);
+        retransmit_replay(me->retx, last_seen, me->sock);
+        gap_free = 1;
+    }
+    /* Otherwise what was held while the resume was pending is dropped: the full resume supersedes it */
+    me->resume_mark = 0;
+    pthread_mutex_unlock(&me->lock);
+    retransmit_count_resume(gap_free);
+
+    if (!gap_free) { resume_session(me); return; }
+    match_try_resume(me->match);
+    me->state = me->paired ? STATE_GAME : STATE_WAITING;
+    if (!me->paired) return;
+    Client *opp = (me->match->white == me) ? me->match->black : me->match->white;
+    if (opp) send_protocol_msg(opp, OPPONENT_RETURNED, me->name, (me->color==0)?"black":"white");
+    pthread_mutex_lock(&me->match->lock);
+    match_send_clock(me->match, me);
+    match_send_clock(me->match, opp);
+    pthread_mutex_unlock(&me->match->lock);
 }
 
 /**
@@ -300,52 +590,40 @@ void reject_connection(int sock) {
  */
 int run_handshake(Client **me_ptr) {
     Client *me = *me_ptr;
-    char readbuf[BUFFER_SZ]; char linebuf[LINEBUF_SZ]; size_t lp = 0;
-    int b_start = 0, b_len = 0; 
+    char *linebuf = me->linebuf;
 
-    send_protocol_msg(me, WELCOME);
+    if (me->adopted) me->adopted = 0;
+    else send_protocol_msg(me, WELCOME);
 
     while (me->state == STATE_HANDSHAKE) {
-        int res = read_packet_wrapper(me, readbuf, &b_start, &b_len, &lp, linebuf, sizeof(linebuf), 0);
+        int res = read_packet_wrapper(me, 0);
         if (res == 0 || res == -1) return 0;
         if (res == -2) continue; 
 
         if (strncmp(linebuf, HELLO, 6) == 0) {
             char name[NAME_LEN]; char id[ID_LEN];
-            int args = sscanf(linebuf + 6, "%63s %31s", name, id);
+            unsigned long long last_seen = 0;
+            int args = sscanf(linebuf + 6, "%63s %31s %llu", name, id, &last_seen);
             if (args < 1) continue; 
             if (args < 2) strncpy(id, "unknown", sizeof(id));
+            profiles_seen(name);
 
-            Client *old_session = match_reconnect(name, id, me->sock);
+            Client *old_session = match_reconnect(name, id, me->sock, NULL);
             if (old_session) {
+                old_session->conn_id = me->conn_id; /* The session now lives on this connection */
+                /* So do this worker and any input pipelined after HELLO */
+                memcpy(old_session->readbuf, me->readbuf, sizeof(me->readbuf));
+                old_session->rb_start = me->rb_start; old_session->rb_len = me->rb_len;
+                old_session->line_len = 0;
+                if (me->last_cmd_id > old_session->last_cmd_id) old_session->last_cmd_id = me->last_cmd_id;
+                served_transfer(me, old_session);
                 pthread_mutex_destroy(&me->lock);
+                retransmit_free(me->retx);
                 free(me);
                 me = old_session;
                 *me_ptr = me;
                 send_short_ack(me, HELLO_ACK);
-                match_try_resume(me->match);
-                if (me->match && !me->paired) {
-                    me->state = STATE_WAITING;
-                    send_protocol_msg(me, WAIT, me->match->id);
-                } else {
-                    me->state = STATE_GAME;
-                    Client *opp = (me->match->white == me) ? me->match->black : me->match->white;
-                    send_protocol_msg(me, RESUME_MATCH, (opp&&opp->name[0])?opp->name:"Unknown", (me->color==0)?"white":"black");
-                    if (opp && opp->sock > 0) send_protocol_msg(opp, OPPONENT_RETURNED, me->name, (me->color==0)?"black":"white");
-                    if (me->match && me->match->moves_count > 0) {
-                        char history[BIG_BUFFER_SZ] = "";
-                        for(size_t j=0; j<me->match->moves_count; j++) {
-                            strcat(history, me->match->moves[j]);
-                            strcat(history, " ");
-                        }
-                        send_protocol_msg(me, MATCH_HISTORY, history);
-                    }
-                    pthread_mutex_lock(&me->match->lock);
-                    int rem = match_get_remaining_time(me->match);
-                    pthread_mutex_unlock(&me->match->lock);
-                    send_protocol_msg(me, TURN_TIMER_STATE, rem);
-                    if (opp && opp->sock > 0) send_protocol_msg(opp, TURN_TIMER_STATE, rem);
-                }
+                resume_sequenced(me, args == 3, last_seen);
                 return 1;
             }
 
@@ -357,6 +635,11 @@ int run_handshake(Client **me_ptr) {
             snprintf(me->name, sizeof(me->name), "%s", name);
             snprintf(me->id, sizeof(me->id), "%s", id);
             send_short_ack(me, HELLO_ACK);
+            if (args == 3) {
+                pthread_mutex_lock(&me->lock);
+                me->retx = retransmit_create(1);
+                pthread_mutex_unlock(&me->lock);
+            }
             me->state = STATE_LOBBY;
             return 1;
         } else {
@@ -366,166 +649,501 @@ int run_handshake(Client **me_ptr) {
     return 1;
 }
 
+/**
+ * @brief Handles REMATCH from the lobby or from a just finished game.
+ */
+static void request_rematch(Client *me) {
+    int r = match_request_rematch(me);
+    if (r < 0) send_error(me, "No rematch available");
+    else if (r == 0) me->state = STATE_WAITING;
+    else { notify_start(me->match); me->state = STATE_GAME; }
+}
+
+/**
+ * @brief Leaves a finished game: back to the waiting room for the next round
+ * after a tournament board, to the lobby otherwise.
+ */
+static void leave_finished_game(Client *me) {
+    /* Set at creation and never changed */
+    int board = me->match && me->match->shared_watchdog;
+    match_leave_after_game(me);
+    me->state = (board && tourney_ready(me) > 0) ? STATE_WAITING : STATE_LOBBY;
+}
+
+/**
+ * @brief Enters the lobby: clears the game fields and sends LOBBY.
+ */
+static void lobby_enter(Client *me) {
+    me->match = NULL; me->paired = 0; me->color = -1;
+    if (me->adopted) me->adopted = 0;
+    else send_protocol_msg(me, ENTER_LOBBY);
+}
+
+/**
+ * @brief Handles one lobby command (me->linebuf).
+ * Allows clients to list rooms, create new rooms, join existing ones, queue
+ * for matchmaking, wait for their tournament game, ask their last opponent
+ * for a rematch, watch a game or switch the connection to multiplexed boards
+ * (the last two on plain sessions only). Anything but
+ * a listing gives up the rematch seat.
+ * @return 0 if the session ends (EXT or too many errors), 1 otherwise.
+ */
+static int lobby_command(Client *me) {
+    char *linebuf = me->linebuf;
+    if (strcmp(linebuf, ROOM_LIST_REQUEST) == 0) {
+        char *l = get_room_list_str();
+        if (l) { send_protocol_msg(me, ROOM_LIST_ANSWER, l); free(l); }
+    } 
+    else if (strncmp(linebuf, LEADERBOARD_REQUEST, 3) == 0 && (linebuf[3] == '\0' || linebuf[3] == ' ')) {
+        int n = linebuf[3] ? atoi(linebuf + 4) : 0;
+        if (n <= 0) n = LEADERBOARD_TOP_DEFAULT;
+        char list[BIG_BUFFER_SZ - 64];
+        leaderboard_format(1, (size_t)n, list, sizeof(list));
+        PlayerProfile p;
+        uint64_t rank = profiles_get(me->name, &p) == 0 ? leaderboard_rank(p.name, p.rating) : 0;
+        send_protocol_msg(me, LEADERBOARD_ANSWER, (unsigned long long)rank, list);
+    }
+    else if (strcmp(linebuf, REMATCH_REQUEST) == 0) request_rematch(me);
+    else if (strncmp(linebuf, CREATE_ROOM, 3) == 0 && (linebuf[3] == '\0' || linebuf[3] == ' ')) {
+        TimeControl tc;
+        int timed = (linebuf[3] != '\0');
+        if (timed && time_control_parse(linebuf + 4, &tc) != 0) {
+            if (handle_protocol_error(me, "Bad time control")) return 0;
+            return 1;
+        }
+        match_drop_rematch(me);
+        if (max_rooms > 0 && get_active_room_count() >= max_rooms) {
+            send_error(me, "Server room limit reached");
+        } else {
+            Match *m = match_create(me, timed ? &tc : NULL);
+            if (!m) send_error(me, "Server internal limit reached");
+            else {
+                me->match = m; me->color = 0;
+                capture_room(me->conn_id, m->id);
+                send_protocol_msg(me, WAIT, m->id);
+                me->state = STATE_WAITING;
+            }
+        }
+    }
+    else if (strncmp(linebuf, QUEUE_REQUEST, 5) == 0 && (linebuf[5] == '\0' || linebuf[5] == ' ')) {
+        TimeControl tc;
+        int timed = (linebuf[5] != '\0');
+        if (timed && time_control_parse(linebuf + 6, &tc) != 0) {
+            if (handle_protocol_error(me, "Bad time control")) return 0;
+            return 1;
+        }
+        match_drop_rematch(me);
+        int32_t rating = matchmaker_rating(me->name);
+        /* QUEUED goes out first: the pairing thread may send START right after enqueue */
+        send_protocol_msg(me, QUEUED, rating);
+        int rc = matchmaker_enqueue(me, rating, timed ? &tc : NULL);
+        if (rc == 0) me->state = STATE_WAITING;
+        else send_error(me, rc == -2 ? "Too many time controls in the queue" : "Matchmaking unavailable");
+    }
+    else if (strcmp(linebuf, TOURNEY_REQUEST) == 0) {
+        match_drop_rematch(me);
+        if (tourney_ready(me) > 0) me->state = STATE_WAITING;
+        else send_error(me, "Not registered in a running tournament");
+    }
+    else if (strncmp(linebuf, JOIN_ROOM, 5) == 0) {
+        match_drop_rematch(me);
+        int id = atoi(linebuf + 5);
+        if (match_join_by_id(id, me) == 0) {
+            Match *m = me->match; 
+            me->color = 1; me->paired = 1; 
+            if (m->white) m->white->paired = 1; 
+            notify_start(m);
+            me->state = STATE_GAME;
+        } else send_error(me, "Room full or closed");
+    }
+    else if (!me->mux && strncmp(linebuf, WATCH_REQUEST, 6) == 0) {
+        match_drop_rematch(me);
+        if (spectate_watch(me, atoi(linebuf + 6)) == 0) me->state = STATE_WATCH;
+        else send_error(me, "No game running in that room");
+    }
+    else if (!me->mux && strcmp(linebuf, MUX_REQUEST) == 0) {
+        match_drop_rematch(me);
+        me->state = STATE_MUX;
+    }
+    else if (strcmp(linebuf, EXIT) == 0) return 0;
+    else if (handle_protocol_error(me, "Unknown command")) return 0;
+    return 1;
+}
+
 /**
  * @brief Handles the lobby state.
- * Allows clients to list rooms, create new rooms, or join existing ones.
  */
 int run_lobby(Client *me) {
-    char readbuf[BUFFER_SZ]; char linebuf[LINEBUF_SZ]; size_t lp = 0;
-    int b_start = 0, b_len = 0; 
-    me->match = NULL; me->paired = 0; me->color = -1;
-    send_protocol_msg(me, ENTER_LOBBY);
+    lobby_enter(me);
     while (me->state == STATE_LOBBY) {
-        int res = read_packet_wrapper(me, readbuf, &b_start, &b_len, &lp, linebuf, sizeof(linebuf), 0);
+        int res = read_packet_wrapper(me, 0);
         if (res == 0 || res == -1) return 0;
         if (res == -2) continue;
-        if (strcmp(linebuf, ROOM_LIST_REQUEST) == 0) {
-            char *l = get_room_list_str();
-            if (l) { send_protocol_msg(me, ROOM_LIST_ANSWER, l); free(l); }
-        } 
-        else if (strcmp(linebuf, CREATE_ROOM) == 0) {
-            if (max_rooms > 0 && get_active_room_count() >= max_rooms) {
-                send_error(me, "Server room limit reached");
-            } else {
-                Match *m = match_create(me);
-                if (!m) send_error(me, "Server internal limit reached");
-                else {
-                    me->match = m; me->color = 0;
-                    send_protocol_msg(me, WAIT, m->id);
-                    me->state = STATE_WAITING;
-                }
-            }
-        }
-        else if (strncmp(linebuf, JOIN_ROOM, 5) == 0) {
-            int id = atoi(linebuf + 5);
-            if (match_join_by_id(id, me) == 0) {
-                Match *m = me->match; 
-                me->color = 1; me->paired = 1; 
-                if (m->white) m->white->paired = 1; 
-                notify_start(m);
-                me->state = STATE_GAME;
-            } else send_error(me, "Room full or closed");
-        }
-        else if (strcmp(linebuf, EXIT) == 0) return 0;
-        else if (handle_protocol_error(me, "Unknown command")) return 0;
+        if (!lobby_command(me)) return 0;
     }
     return 1;
 }
 
 /**
- * @brief Handles the waiting state for a room host.
- * Waits for an opponent to join or for the host to cancel creation.
+ * @brief Moves a waiting player on once its wait is over: into the game
+ * found meanwhile, or back to the lobby if the rematch was declined or it was
+ * dropped from the queue or the tournament without a game.
+ * @return 1 if the state changed, 0 if still waiting.
+ */
+static int waiting_update(Client *me) {
+    if (me->paired && me->match) { me->rematch = NULL; me->state = STATE_GAME; return 1; }
+    if (me->rematch && !match_rematch_pending(me)) {
+        match_drop_rematch(me);
+        send_protocol_msg(me, REMATCH_DECLINED);
+        me->state = STATE_LOBBY; return 1;
+    }
+    /* Dropped from the queue or the tournament without a game (pairing failed, tournament over, or a hot restart) */
+    if (!me->match && !me->rematch && !__atomic_load_n(&me->queued, __ATOMIC_ACQUIRE)
+        && !__atomic_load_n(&me->tourney, __ATOMIC_ACQUIRE)) { me->state = STATE_LOBBY; return 1; }
+    return 0;
+}
+
+/**
+ * @brief Handles EXT while waiting: closes the room, or leaves the queue,
+ * the tournament or the rematch, and goes back to the lobby. A player paired
+ * while leaving stays, and its game starts instead.
+ */
+static void waiting_exit(Client *me) {
+    if (matchmaker_leave(me) > 0 || tourney_leave(me) > 0 || me->paired || match_drop_rematch(me) > 0) return;
+    if (me->match) {
+        Match *m = me->match; pthread_mutex_lock(&m->lock);
+        match_finish(m, -1, END_CANCELLED); m->white = NULL; m->refs--; int last = (m->refs <= 0);
+        pthread_mutex_unlock(&m->lock); if (last) match_free(m);
+        me->match = NULL; me->color = -1;
+    }
+    me->state = STATE_LOBBY;
+}
+
+/**
+ * @brief Handles the waiting state for a room host, a queued player, a
+ * player who asked for a rematch or a tournament player between rounds.
+ * Waits for an opponent to join, be found or accept, or for the player to cancel.
  */
 int run_waiting(Client *me) {
-    char readbuf[BUFFER_SZ]; char linebuf[LINEBUF_SZ]; size_t lp = 0;
-    int b_start = 0, b_len = 0; 
+    char *linebuf = me->linebuf;
+    me->adopted = 0;
     while (me->state == STATE_WAITING) {
-        if (me->paired && me->match) { me->state = STATE_GAME; return 1; }
-        int res = read_packet_wrapper(me, readbuf, &b_start, &b_len, &lp, linebuf, sizeof(linebuf), MSG_DONTWAIT);
-        if (res > 0 && strstr(linebuf, EXIT)) {
-            if (me->match) {
-                Match *m = me->match; pthread_mutex_lock(&m->lock);
-                m->finished = 1; m->white = NULL; m->refs--; int last = (m->refs <= 0);
-                pthread_mutex_unlock(&m->lock); if (last) match_free(m);
-                me->match = NULL; me->color = -1;
-            }
-            me->state = STATE_LOBBY; return 1;
-        } 
-        else if (res == 0 || res == -1) return 0;
-        usleep(100000); 
+        if (waiting_update(me)) return 1;
+        int res = read_packet_wrapper(me, MSG_DONTWAIT);
+        if (res > 0 && strstr(linebuf, EXIT)) { waiting_exit(me); continue; }
+        else if (res == 0 || res == -1) { matchmaker_leave(me); tourney_leave(me); return 0; }
+        io_usleep(100000); 
+    }
+    return 1;
+}
+
+/**
+ * @brief Plays a move of the side to move: validates it, applies it, passes
+ * the clock, notifies both players and ends the game on mate or stalemate.
+ * With lag compensation the mover is first credited its network delay.
+ * A move that arrives after the player's flag fell loses on time instead.
+ * Caller must hold m->lock.
+ * @return 1 if the move was played (or lost on time), 0 if it is illegal.
+ */
+static int apply_player_move(Match *m, Client *me, const char *mv) {
+    if (match_clock_flagged(m)) { match_flag(m); return 1; }
+    int r1, c1, r2, c2;
+    if (!is_move_format(mv) || (parse_move(mv, &r1, &c1, &r2, &c2), 0) ||
+        !in_bounds(r1, c1) || !in_bounds(r2, c2) ||
+        !is_legal_move_basic(m, me->color, r1, c1, r2, c2) ||
+        move_leaves_in_check(m, me->color, r1, c1, r2, c2))
+        return 0;
+    char promo = (strlen(mv) >= 5) ? mv[4] : 0;
+    apply_move(m, r1, c1, r2, c2, promo);
+    match_clock_credit(m, rtt_lag_credit_ms(me));
+    match_clock_switch(m);
+    match_append_move(m, mv);
+    send_protocol_msg(me, ACCEPT_MOVE);
+    Client *opp = (me == m->white) ? m->black : m->white;
+    if (opp) send_protocol_msg(opp, OPPONENT_MOVE, mv);
+    match_send_clock(m, me);
+    match_send_clock(m, opp);
+    int opp_col = 1 - me->color;
+    int in_chk = is_in_check(&m->state, opp_col);
+    int has_mv = has_any_legal_move(m, opp_col);
+    if (in_chk && !has_mv) {
+        match_finish(m, me->color, END_CHECKMATE); send_protocol_msg(me, WON_BY_CHECKMATE);
+        if (opp) send_protocol_msg(opp, LOST_BY_CHECKMATE);
+    } else if (!in_chk && !has_mv) {
+        match_finish(m, -1, END_STALEMATE); send_protocol_msg(me, STALEMATE);
+        if (opp) send_protocol_msg(opp, STALEMATE);
+    } else if (in_chk && opp) send_protocol_msg(opp, IN_CHECK);
+    return 1;
+}
+
+/**
+ * @brief Plays a player's move, then the opponent's premove (PMV) if one is
+ * queued: it is checked against the new position at once, without waiting
+ * for the opponent's next read. An illegal premove is dropped (PMV_DROP).
+ * Caller must hold the match lock.
+ * @return 1 if the player's move was played, 0 if it is illegal.
+ */
+static int play_move(Client *me, const char *mv) {
+    Match *m = me->match;
+    if (!apply_player_move(m, me, mv)) return 0;
+    if (m->finished || !m->premove[0]) return 1;
+    char pre[sizeof(m->premove)];
+    memcpy(pre, m->premove, sizeof(pre));
+    m->premove[0] = '\0';
+    if (m->premove_color == me->color) return 1;   /* Never replay a player's own premove for it */
+    Client *opp = (me == m->white) ? m->black : m->white;
+    if (!opp || opp->sock <= 0) return 1;   /* Not played for a player who is away */
+    if (!apply_player_move(m, opp, pre)) send_protocol_msg(opp, PREMOVE_DROPPED, pre);
+    return 1;
+}
+
+/**
+ * @brief Handles one command of a player in a game (me->linebuf): moves,
+ * premoves, resignations, draw offers and game termination.
+ * @return 0 if the player is kicked for protocol violations, 1 otherwise.
+ */
+static int game_command(Client *me) {
+    char *linebuf = me->linebuf; Match *myMatch = me->match;
+    pthread_mutex_lock(&myMatch->lock);
+    if (myMatch->finished) {
+        pthread_mutex_unlock(&myMatch->lock);
+        leave_finished_game(me);
+        if (me->state == STATE_LOBBY && strcmp(linebuf, REMATCH_REQUEST) == 0) request_rematch(me);
+        return 1;
+    }
+    if (strncmp(linebuf, PREMOVE_COMMAND, 3) == 0) {
+        char *mv = linebuf + 3; if (*mv == ' ') mv++;
+        if (myMatch->turn == me->color) {
+            /* The opponent's move arrived first: the premove is just a move, and there is none to cancel */
+            int ok = *mv && play_move(me, mv);
+            pthread_mutex_unlock(&myMatch->lock);
+            if (!ok && handle_protocol_error(me, *mv ? "Illegal Move" : "No premove to cancel")) return 0;
+        } else if (*mv && !is_move_format(mv)) {
+            pthread_mutex_unlock(&myMatch->lock);
+            if (handle_protocol_error(me, "Illegal Move")) return 0;
+        } else {
+            /* Only the side not to move gets here: queue, or cancel with a bare PMV */
+            snprintf(myMatch->premove, sizeof(myMatch->premove), "%s", mv);
+            myMatch->premove_color = me->color;
+            send_protocol_msg(me, PREMOVE_QUEUED);
+            pthread_mutex_unlock(&myMatch->lock);
+        }
+    }
+    else if (strncmp(linebuf, MOVE_COMMAND, 2) == 0) {
+        if (myMatch->turn != me->color) {
+            pthread_mutex_unlock(&myMatch->lock);
+            if (handle_protocol_error(me, "Not your turn")) return 0;
+        } else {
+            int ok = play_move(me, linebuf + 2);
+            pthread_mutex_unlock(&myMatch->lock);
+            if (!ok && handle_protocol_error(me, "Illegal Move")) return 0;
+        }
+    }
+    else if (strncmp(linebuf, RESIGN, 3) == 0) {
+        match_finish(myMatch, 1 - me->color, END_RESIGN); send_protocol_msg(me, YOU_RESIGNED);
+        Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
+        if (opp) send_protocol_msg(opp, OPPONENT_RESIGNED);
+        pthread_mutex_unlock(&myMatch->lock);
+    }
+    else if (strncmp(linebuf, DRAW_OFFER, 7) == 0) {
+         Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
+         if (opp) send_protocol_msg(opp, DRAW_OFFER);
+         myMatch->draw_offered_by = me->color;
+         pthread_mutex_unlock(&myMatch->lock);
+    }
+    else if (strncmp(linebuf, ACCEPT_DRAW, 7) == 0) {
+         Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
+         match_finish(myMatch, -1, END_DRAW_AGREED); send_protocol_msg(me, DRAW_ACCEPTED);
+         if (opp) send_protocol_msg(opp, DRAW_ACCEPTED);
+         pthread_mutex_unlock(&myMatch->lock);
     }
+    else if (strncmp(linebuf, DECLINE_DRAW, 7) == 0) {
+         Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
+         if (opp) send_protocol_msg(opp, DRAW_DECLINED);
+         myMatch->draw_offered_by = -1;
+         pthread_mutex_unlock(&myMatch->lock);
+    }
+    else if (strncmp(linebuf, EXIT, 3) == 0) {
+        match_finish(myMatch, 1 - me->color, END_ABANDON);
+        Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
+        if (opp) send_protocol_msg(opp, OPPONENT_QUIT);
+        pthread_mutex_unlock(&myMatch->lock);
+    }
+    else { pthread_mutex_unlock(&myMatch->lock); if (handle_protocol_error(me, "Unknown command")) return 0; }
+    if (myMatch && myMatch->finished) leave_finished_game(me);
     return 1;
 }
 
 /**
  * @brief Handles the main gameplay state.
- * Processes moves, resignations, draw offers, and game termination.
  */
 int run_game(Client *me) {
-    char readbuf[BUFFER_SZ]; char linebuf[LINEBUF_SZ]; size_t lp = 0;
-    int b_start = 0, b_len = 0; Match *myMatch = me->match;
+    me->adopted = 0;
     while (me->state == STATE_GAME) {
-        int res = read_packet_wrapper(me, readbuf, &b_start, &b_len, &lp, linebuf, sizeof(linebuf), 0);
+        int res = read_packet_wrapper(me, 0);
         if (res == 0 || res == -1) return 0;
         if (res == -2) continue; 
-        pthread_mutex_lock(&myMatch->lock);
-        if (myMatch->finished) {
-            pthread_mutex_unlock(&myMatch->lock);
-            match_leave_by_client(me);
-            me->state = STATE_LOBBY; return 1;
+        if (!game_command(me)) return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Handles a spectator: relays the events of the watched game until it
+ * is gone, the spectator is dropped or it sends EXT.
+ */
+int run_watch(Client *me) {
+    char *linebuf = me->linebuf;
+    me->adopted = 0;
+    while (me->state == STATE_WATCH) {
+        if (spectate_pump(me, SPECTATE_WAIT_MS) < 0) { spectate_leave(me); me->state = STATE_LOBBY; return 1; }
+        int res = read_packet_wrapper(me, MSG_DONTWAIT);
+        if (res > 0 && strcmp(linebuf, EXIT) == 0) { spectate_leave(me); me->state = STATE_LOBBY; return 1; }
+        else if (res == 0 || res == -1) { spectate_leave(me); return 0; }
+    }
+    return 1;
+}
+
+/* --- Multiplexed connections --- */
+
+/**
+ * @brief Opens a board on a multiplexed connection, in the lobby. A board is
+ * a session of its own (same name and id as the connection) that writes
+ * through the connection; it counts as a player.
+ * @return The board, or NULL if the server is full.
+ */
+static Client *board_open(Client *conn, int tag) {
+    if (!try_reserve_slot()) return NULL;
+    Client *b = client_create(conn->sock, conn->conn_id);
+    if (!b) { decrement_player_count(); return NULL; }
+    b->is_counted = 1;
+    memcpy(b->name, conn->name, sizeof(b->name));
+    memcpy(b->id, conn->id, sizeof(b->id));
+    memcpy(b->client_addr, conn->client_addr, sizeof(b->client_addr));
+    b->mux = conn;
+    b->mux_tag = tag;
+    b->last_heartbeat = conn->last_heartbeat;
+    b->state = STATE_LOBBY;
+    lobby_enter(b);
+    return b;
+}
+
+/**
+ * @brief Closes a board like client_worker() ends a session: a game in
+ * progress (or an open room) is kept for a reconnect, anything else is freed.
+ */
+static void board_close(Client *b) {
+    matchmaker_leave(b);
+    tourney_leave(b);
+    match_drop_rematch(b);
+    int persisted = match_release_after_client(b);
+    if (!persisted) {
+        if (b->is_counted) decrement_player_count();
+        pthread_mutex_destroy(&b->lock);
+        retransmit_free(b->retx);
+        free(b);
+    }
+}
+
+/**
+ * @brief Takes back the boards this player left on an earlier multiplexed
+ * connection (dropped, or handed over on a hot restart), under their old
+ * numbers where still free.
+ */
+static void boards_resume(Client *conn, Client **boards) {
+    while (1) {
+        int tag = 1;
+        while (tag <= MUX_MAX_BOARDS && boards[tag - 1]) tag++;
+        if (tag > MUX_MAX_BOARDS) break;
+        Client *b = match_reconnect(conn->name, conn->id, conn->sock, conn);
+        if (!b) break;
+        if (b->mux_tag >= 1 && b->mux_tag <= MUX_MAX_BOARDS && !boards[b->mux_tag - 1]) tag = b->mux_tag;
+        b->mux_tag = tag;
+        b->conn_id = conn->conn_id;
+        /* Boards are not numbered (see retransmit.h) */
+        pthread_mutex_lock(&b->lock);
+        retransmit_free(b->retx);
+        b->retx = NULL;
+        b->resume_mark = 0;
+        pthread_mutex_unlock(&b->lock);
+        boards[tag - 1] = b;
+        resume_session(b);
+    }
+}
+
+/**
+ * @brief Plays one line on a board, in whatever state the board is.
+ * @return 0 if the board is closed (EXT from its lobby, or kicked), 1 otherwise.
+ */
+static int board_command(Client *b) {
+    if (b->state == STATE_WAITING && waiting_update(b) && b->state == STATE_LOBBY) lobby_enter(b);
+    ClientState prev = b->state;
+    int alive = 1;
+    switch (b->state) {
+        case STATE_LOBBY: alive = lobby_command(b); break;
+        case STATE_WAITING: if (strstr(b->linebuf, EXIT)) waiting_exit(b); break;
+        case STATE_GAME: alive = game_command(b); break;
+        default: break;
+    }
+    if (alive && b->state == STATE_LOBBY && prev != STATE_LOBBY) lobby_enter(b);
+    return alive;
+}
+
+/**
+ * @brief Handles a multiplexed connection.
+ * Every line is "G <board> <command>" and is played on that board, which goes
+ * through lobby, waiting and game states like a connection of its own; replies
+ * carry the same prefix. A board opens with its first line and closes with EXT
+ * from its lobby. EXT on the connection itself goes back to the lobby once all
+ * boards are closed. One worker thread serves all boards: reads block unless
+ * a board is waiting, which is polled every MUX_POLL_US.
+ */
+int run_mux(Client *me) {
+    char *linebuf = me->linebuf;
+    Client *boards[MUX_MAX_BOARDS] = { 0 };
+    int alive = 1;
+    if (me->adopted) me->adopted = 0;
+    else send_protocol_msg(me, MUX_READY, MUX_MAX_BOARDS);
+    boards_resume(me, boards);
+
+    while (me->state == STATE_MUX) {
+        int waiting = 0, open = 0;
+        for (int i = 0; i < MUX_MAX_BOARDS; i++) {
+            Client *b = boards[i];
+            if (!b) continue;
+            open++;
+            if (b->state != STATE_WAITING) continue;
+            if (waiting_update(b) && b->state == STATE_LOBBY) lobby_enter(b);
+            waiting += (b->state == STATE_WAITING);
         }
-        if (strncmp(linebuf, MOVE_COMMAND, 2) == 0) {
-            if (myMatch->turn != me->color) {
-                pthread_mutex_unlock(&myMatch->lock);
-                if (handle_protocol_error(me, "Not your turn")) return 0;
-            } else {
-                char *mv = linebuf + 2; int r1, c1, r2, c2;
-                if (!is_move_format(mv) || (parse_move(mv, &r1, &c1, &r2, &c2), 0) || 
-                    !in_bounds(r1, c1) || !in_bounds(r2, c2) ||
-                    !is_legal_move_basic(myMatch, me->color, r1, c1, r2, c2) ||
-                    move_leaves_in_check(myMatch, me->color, r1, c1, r2, c2)) 
-                {
-                    pthread_mutex_unlock(&myMatch->lock);
-                    if (handle_protocol_error(me, "Illegal Move")) return 0;
-                } else {
-                    char promo = (strlen(mv) >= 5) ? mv[4] : 0;
-                    apply_move(myMatch, r1, c1, r2, c2, promo);
-                    match_append_move(myMatch, mv);
-                    send_protocol_msg(me, ACCEPT_MOVE);
-                    Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-                    if (opp && opp->sock > 0) send_protocol_msg(opp, OPPONENT_MOVE, mv);
-                    int t = myMatch->turn_timeout_seconds;
-                    send_protocol_msg(me, TURN_TIMER_STATE, t);
-                    if (opp && opp->sock > 0) send_protocol_msg(opp, TURN_TIMER_STATE, t);
-                    int opp_col = 1 - me->color;
-                    int in_chk = is_in_check(&myMatch->state, opp_col);
-                    int has_mv = has_any_legal_move(myMatch, opp_col);
-                    if (in_chk && !has_mv) {
-                        myMatch->finished = 1; send_protocol_msg(me, WON_BY_CHECKMATE);
-                        if (opp && opp->sock > 0) send_protocol_msg(opp, LOST_BY_CHECKMATE);
-                    } else if (!in_chk && !has_mv) {
-                        myMatch->finished = 1; send_protocol_msg(me, STALEMATE);
-                        if (opp && opp->sock > 0) send_protocol_msg(opp, STALEMATE);
-                    } else if (in_chk && opp && opp->sock > 0) send_protocol_msg(opp, IN_CHECK);
-                    if (!myMatch->finished) { myMatch->turn = 1 - myMatch->turn; myMatch->last_move_time = time(NULL); }
-                }
-                pthread_mutex_unlock(&myMatch->lock);
+
+        int res = read_packet_wrapper(me, waiting ? MSG_DONTWAIT : 0);
+        if (res == 0 || res == -1) { alive = 0; break; }
+        if (res == -2) { if (waiting) io_usleep(MUX_POLL_US); continue; }
+
+        if (strncmp(linebuf, MUX_LINE, 2) != 0) {
+            if (strcmp(linebuf, EXIT) == 0) {
+                if (open) send_error(me, "Close all boards first");
+                else me->state = STATE_LOBBY;
             }
+            else if (handle_protocol_error(me, "Unknown command")) { alive = 0; break; }
+            continue;
         }
-        else if (strncmp(linebuf, RESIGN, 3) == 0) {
-            myMatch->finished = 1; send_protocol_msg(me, YOU_RESIGNED);
-            Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-            if (opp && opp->sock > 0) send_protocol_msg(opp, OPPONENT_RESIGNED);
-            pthread_mutex_unlock(&myMatch->lock);
-        }
-        else if (strncmp(linebuf, DRAW_OFFER, 7) == 0) {
-             Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-             if (opp && opp->sock > 0) send_protocol_msg(opp, DRAW_OFFER);
-             myMatch->draw_offered_by = me->color;
-             pthread_mutex_unlock(&myMatch->lock);
-        }
-        else if (strncmp(linebuf, ACCEPT_DRAW, 7) == 0) {
-             Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-             myMatch->finished = 1; send_protocol_msg(me, DRAW_ACCEPTED);
-             if (opp && opp->sock > 0) send_protocol_msg(opp, DRAW_ACCEPTED);
-             pthread_mutex_unlock(&myMatch->lock);
+        char *cmd;
+        long tag = strtol(linebuf + 2, &cmd, 10);
+        while (*cmd == ' ') cmd++;
+        if (tag < 1 || tag > MUX_MAX_BOARDS || *cmd == '\0') {
+            if (handle_protocol_error(me, "Invalid board")) { alive = 0; break; }
+            continue;
         }
-        else if (strncmp(linebuf, DECLINE_DRAW, 7) == 0) {
-             Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-             if (opp && opp->sock > 0) send_protocol_msg(opp, DRAW_DECLINED);
-             myMatch->draw_offered_by = -1;
-             pthread_mutex_unlock(&myMatch->lock);
-        }
-        else if (strncmp(linebuf, EXIT, 3) == 0) {
-            myMatch->finished = 1;
-            Client *opp = (me == myMatch->white) ? myMatch->black : myMatch->white;
-            if (opp) send_protocol_msg(opp, OPPONENT_QUIT);
-            pthread_mutex_unlock(&myMatch->lock);
-        }
-        else { pthread_mutex_unlock(&myMatch->lock); if (handle_protocol_error(me, "Unknown command")) return 0; }
-        if (myMatch && myMatch->finished) { match_leave_by_client(me); me->state = STATE_LOBBY; return 1; }
+        Client *b = boards[tag - 1];
+        if (!b && !(b = boards[tag - 1] = board_open(me, (int)tag))) { send_error(me, "Server full"); continue; }
+        snprintf(b->linebuf, sizeof(b->linebuf), "%s", cmd);
+        if (!board_command(b)) { board_close(b); boards[tag - 1] = NULL; }
     }
-    return 1;
+
+    for (int i = 0; i < MUX_MAX_BOARDS; i++) if (boards[i]) board_close(boards[i]);
+    return alive;
 }
 
 /**
@@ -535,8 +1153,14 @@ int run_game(Client *me) {
  */
 void *client_worker(void *arg) {
     Client *me = (Client *)arg;
+    ServedWorker *self = me->worker;
+    if (self) {
+        pthread_mutex_lock(&served_lock);
+        self->tid = pthread_self(); self->has_tid = 1;
+        pthread_mutex_unlock(&served_lock);
+    }
     log_printf("[CLIENT %p] Worker started. Sock=%d.\n", me, me->sock);
-    me->last_heartbeat = time(NULL);
+    me->last_heartbeat = io_time();
     while (me->state != STATE_DISCONNECTED) {
         int keep_alive = 0;
         switch (me->state) {
@@ -544,16 +1168,26 @@ void *client_worker(void *arg) {
             case STATE_LOBBY: keep_alive = run_lobby(me); break;
             case STATE_WAITING: keep_alive = run_waiting(me); break;
             case STATE_GAME: keep_alive = run_game(me); break;
+            case STATE_MUX: keep_alive = run_mux(me); break;
+            case STATE_WATCH: keep_alive = run_watch(me); break;
             default: keep_alive = 0; break;
         }
         if (!keep_alive) me->state = STATE_DISCONNECTED;
     }
     int sock_to_close = me->sock;
+    pthread_mutex_lock(&served_lock);
+    if (self) self->client = NULL;
+    me->worker = NULL;
+    pthread_mutex_unlock(&served_lock);
+    capture_conn_close(me->conn_id);
+    match_drop_rematch(me);
     int persisted = match_release_after_client(me);
     if (!persisted) {
-        if (sock_to_close > 0) close(sock_to_close);
-        if (me) { if (me->is_counted) decrement_player_count(); pthread_mutex_destroy(&me->lock); }
+        if (sock_to_close > 0) io_close(sock_to_close);
+        if (me) { if (me->is_counted) decrement_player_count(); pthread_mutex_destroy(&me->lock); retransmit_free(me->retx); }
         free(me);
-    } else if (sock_to_close > 0) close(sock_to_close);
+    } else if (sock_to_close > 0) io_close(sock_to_close);
+    /* Leave the registry last, so a handoff never sees a half torn down session */
+    if (self) { served_remove(self); free(self); }
     return NULL;
 }
\ No newline at end of file
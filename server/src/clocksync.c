@@ -0,0 +1,111 @@
+/**
+ * @file clocksync.c
+ * @brief Clock sync thread (see clocksync.h).
+ *
+ * A tick runs under match_foreach(): the registry lock for the whole walk and
+ * each match's lock while its line goes out. Writes never wait for a socket,
+ * so the walk holds the registry for one format and two non-blocking sends
+ * per game.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "clocksync.h"
+#include "client.h"
+#include "match.h"
+#include "spectate.h"
+#include "handoff.h"
+#include "lockstat.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+static unsigned interval = 0;
+
+/* Counters (updated atomically) */
+static uint64_t n_ticks, n_games, n_sent, n_skipped, n_partial;
+static uint64_t tick_ns_last, tick_ns_max;
+
+/**
+ * @brief Writes one update to a player without waiting for its socket.
+ * The connection lock keeps it from landing inside another message; it is
+ * only tried, since its holder may be blocked on the same socket. What a
+ * short write leaves is kept on the connection and sent ahead of its next
+ * line; until it is out, further updates are skipped.
+ */
+static void try_send(Client *c, const char *payload) {
+    if (!c || c->sock <= 0) return;
+    char line[CLOCKSYNC_LINE_SZ];
+    Client *conn = c->mux ? c->mux : c;
+    int len = c->mux ? snprintf(line, sizeof(line), MUX_LINE "%d %s\n", c->mux_tag, payload)
+                     : snprintf(line, sizeof(line), "%s\n", payload);
+    if (len < 0 || (size_t)len >= sizeof(line)) return;
+
+    /* A connection busy with another write is as full as one that refuses this */
+    if (pthread_mutex_trylock(&conn->lock) != 0) { STAT_ADD(n_skipped, 1); return; }
+    /* Unnumbered: nothing may reach a resuming session ahead of its resume */
+    if (c->resume_mark) { pthread_mutex_unlock(&conn->lock); STAT_ADD(n_skipped, 1); return; }
+    ssize_t n = conn_flush_tail(conn, 0) == 0
+              ? io_send(conn->sock, line, (size_t)len, MSG_NOSIGNAL | MSG_DONTWAIT) : -1;
+    if (n == len) STAT_ADD(n_sent, 1);
+    else if (n > 0) {
+        conn->out_tail_len = (size_t)(len - n);
+        memcpy(conn->out_tail, line + n, conn->out_tail_len + 1);
+        STAT_ADD(n_partial, 1);
+        STAT_ADD(n_sent, 1);
+    } else STAT_ADD(n_skipped, 1);
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/**
+ * @brief Sends the clocks of one game. Called with m->lock held.
+ */
+static void sync_match(Match *m, void *arg) {
+    (void)arg;
+    if (m->finished || !m->black || !m->clock_running) return;
+    int64_t w = match_clock_left(m, 0), b = match_clock_left(m, 1);
+    if (w < 0) w = 0;
+    if (b < 0) b = 0;
+    char payload[48];
+    snprintf(payload, sizeof(payload), CLOCK_SYNC, (long long)w, (long long)b);
+    try_send(m->white, payload);
+    try_send(m->black, payload);
+    spectate_event(m, WATCH_CLOCK_SYNC, (long long)w, (long long)b);
+    STAT_ADD(n_games, 1);
+}
+
+static void *clocksync_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        io_usleep(interval * 1000u);
+        /* The successor process runs its own stream */
+        if (handoff_frozen()) continue;
+        uint64_t t0 = monotonic_ns();
+        match_foreach(sync_match, NULL);
+        uint64_t ns = monotonic_ns() - t0;
+        __atomic_store_n(&tick_ns_last, ns, __ATOMIC_RELAXED);
+        if (ns > __atomic_load_n(&tick_ns_max, __ATOMIC_RELAXED)) __atomic_store_n(&tick_ns_max, ns, __ATOMIC_RELAXED);
+        STAT_ADD(n_ticks, 1);
+    }
+    return NULL;
+}
+
+int clocksync_start(unsigned interval_ms) {
+    if (interval_ms < CLOCKSYNC_MIN_INTERVAL_MS) return -1;
+    interval = interval_ms;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, clocksync_thread, NULL) != 0) { interval = 0; return -1; }
+    pthread_detach(tid);
+    return 0;
+}
+
+int clocksync_format_stats(char *buf, size_t sz) {
+    if (!interval) return 0;
+    return snprintf(buf, sz, "interval_ms=%u ticks=%llu games=%llu sent=%llu skipped=%llu partial=%llu tick_us_last=%.1f tick_us_max=%.1f\n",
+                    interval, STAT_GET(n_ticks), STAT_GET(n_games), STAT_GET(n_sent), STAT_GET(n_skipped),
+                    STAT_GET(n_partial), STAT_GET(tick_ns_last) / 1000.0, STAT_GET(tick_ns_max) / 1000.0);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file codec.c
+ * @brief Binary encoding helpers (see codec.h).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "codec.h"
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+uint32_t crc32(const void *data, size_t n) {
+    pthread_once(&crc_once, crc_init);
+    const unsigned char *p = data;
+    uint32_t c = 0xffffffffu;
+    while (n--) c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+int buf_reserve(Buf *b, size_t extra) {
+    if (b->len + extra <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) cap *= 2;
+    unsigned char *p = realloc(b->data, cap);
+    if (!p) { b->failed = 1; return -1; }
+    b->data = p; b->cap = cap;
+    return 0;
+}
+
+void buf_put(Buf *b, const void *p, size_t n) {
+    if (b->failed || buf_reserve(b, n) != 0) return;
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+void buf_put_le(Buf *b, uint64_t v, int width) {
+    unsigned char tmp[8];
+    put_le(tmp, v, width);
+    buf_put(b, tmp, (size_t)width);
+}
+
+void put_le(unsigned char *p, uint64_t v, int width) {
+    for (int i = 0; i < width; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+uint64_t get_le(const unsigned char *p, int width) {
+    uint64_t v = 0;
+    for (int i = 0; i < width; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+size_t put_varint(unsigned char *buf, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) { buf[n++] = (unsigned char)(v | 0x80); v >>= 7; }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+size_t get_varint(const unsigned char *p, size_t avail, uint64_t *v) {
+    *v = 0;
+    for (size_t i = 0; i < avail && i < 10; i++) {
+        *v |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+uint64_t mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+uint64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000ull;
+}
+
+int write_all(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) { if (errno == EINTR) continue; return -1; }
+        p += n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+int pwrite_all(int fd, const void *data, size_t len, off_t off) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n < 0) { if (errno == EINTR) continue; return -1; }
+        p += n; len -= (size_t)n; off += n;
+    }
+    return 0;
+}
+
+int pread_all(int fd, void *data, size_t len, off_t off) {
+    unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n; len -= (size_t)n; off += n;
+    }
+    return 0;
+}
+
+int send_all(int fd, const void *data, size_t len) {
+    const unsigned char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) { if (errno == EINTR) continue; return -1; }
+        p += n; len -= (size_t)n;
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * @file faults.c
+ * @brief Fault-injecting IoOps decorator (built only with -DFAULT_INJECT).
+ *
+ * Decisions come from a counter-based generator (splitmix64), so a schedule
+ * with a fixed seed injects the same sequence of faults for the same sequence
+ * of calls. The schedule lives in one of two slots and is swapped with an
+ * atomic pointer store, so reconfiguring from the admin console never blocks
+ * the I/O paths.
+ */
+
+#ifdef FAULT_INJECT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "faults.h"
+#include "netio.h"
+#include "logging.h"
+#include "stats.h"
+
+#define FAULT_MAX_FD 65536      /**< EAGAIN storms are tracked for descriptors below this */
+
+/**
+ * @brief One parsed schedule.
+ */
+typedef struct {
+    double short_pct, frag_pct, delay_pct, eagain_pct, rst_pct, stall_pct;
+    unsigned delay_ms, eagain_len, stall_ms;
+    unsigned from_s, until_s;
+    uint64_t seed;
+    time_t set_at;              /**< io time at which the schedule was applied */
+    char text[256];             /**< Spec as given, for reports */
+} FaultSpec;
+
+static FaultSpec slots[2];
+static FaultSpec *spec = NULL;
+static const IoOps *base = NULL;
+static uint64_t rng_counter = 0;
+static unsigned short storm_left[FAULT_MAX_FD];
+
+/* Injection counters (updated atomically) */
+static uint64_t n_short, n_frag, n_delay, n_eagain, n_rst, n_stall;
+
+static uint64_t next_random(const FaultSpec *s) {
+    uint64_t z = s->seed + __atomic_add_fetch(&rng_counter, 0x9e3779b97f4a7c15ull, __ATOMIC_RELAXED);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static int roll(const FaultSpec *s, double pct) {
+    if (pct <= 0) return 0;
+    return (double)(next_random(s) >> 11) * (1.0 / 9007199254740992.0) * 100.0 < pct;
+}
+
+/**
+ * @brief Returns the schedule if injection is active right now, NULL otherwise.
+ */
+static const FaultSpec *active_spec(void) {
+    const FaultSpec *s = __atomic_load_n(&spec, __ATOMIC_ACQUIRE);
+    if (!s) return NULL;
+    time_t age = base->now() - s->set_at;
+    if (age < (time_t)s->from_s) return NULL;
+    if (s->until_s && age >= (time_t)s->until_s) return NULL;
+    return s;
+}
+
+/**
+ * @brief Continues or starts an EAGAIN storm on fd.
+ * @return 1 if this call must fail with EAGAIN.
+ */
+static int in_storm(const FaultSpec *s, int fd) {
+    if (fd < 0 || fd >= FAULT_MAX_FD) return 0;
+    if (storm_left[fd] > 0) { storm_left[fd]--; STAT_INC(n_eagain); return 1; }
+    if (s->eagain_len && roll(s, s->eagain_pct)) {
+        storm_left[fd] = (unsigned short)(s->eagain_len - 1);
+        STAT_INC(n_eagain);
+        return 1;
+    }
+    return 0;
+}
+
+static ssize_t fault_send(int fd, const void *buf, size_t len, int flags) {
+    const FaultSpec *s = active_spec();
+    if (s) {
+        if (in_storm(s, fd)) { errno = EAGAIN; return -1; }
+        if (s->delay_ms && roll(s, s->delay_pct)) {
+            STAT_INC(n_delay);
+            base->sleep_us((unsigned)(next_random(s) % s->delay_ms + 1) * 1000u);
+        }
+        if (len > 1 && roll(s, s->short_pct)) {
+            STAT_INC(n_short);
+            len = 1 + next_random(s) % (len - 1);
+        }
+    }
+    return base->send(fd, buf, len, flags);
+}
+
+static ssize_t fault_recv(int fd, void *buf, size_t len, int flags) {
+    const FaultSpec *s = active_spec();
+    if (s) {
+        if (in_storm(s, fd)) { errno = EAGAIN; return -1; }
+        if (roll(s, s->rst_pct)) {
+            /* Zero linger turns the worker's close() into a RST */
+            struct linger lg = { 1, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            STAT_INC(n_rst);
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (s->stall_ms && roll(s, s->stall_pct)) {
+            STAT_INC(n_stall);
+            base->sleep_us(s->stall_ms * 1000u);
+        }
+        if (len > 1 && roll(s, s->frag_pct)) {
+            STAT_INC(n_frag);
+            len = 1 + next_random(s) % (len / 2 ? len / 2 : 1);
+        }
+    }
+    return base->recv(fd, buf, len, flags);
+}
+
+static time_t fault_now(void) { return base->now(); }
+static uint64_t fault_mono_ms(void) { return base->mono_ms(); }
+static void fault_sleep_us(unsigned int usec) { base->sleep_us(usec); }
+static int fault_close(int fd) { return base->close(fd); }
+static int fault_shutdown(int fd, int how) { return base->shutdown(fd, how); }
+static int fault_spawn(void *(*fn)(void *), void *arg) { return base->spawn(fn, arg); }
+
+static const IoOps fault_ops = {
+    fault_now, fault_mono_ms, fault_sleep_us, fault_send, fault_recv, fault_close, fault_shutdown, fault_spawn
+};
+
+/**
+ * @brief Parses "P" or "P/N" into a percentage and an optional integer.
+ */
+static int parse_rate(const char *v, double *pct, unsigned *arg) {
+    char *end;
+    *pct = strtod(v, &end);
+    if (end == v || *pct < 0 || *pct > 100) return -1;
+    if (*end == '/' && arg) {
+        *arg = (unsigned)strtoul(end + 1, &end, 10);
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+static int parse_spec(const char *text, FaultSpec *out) {
+    memset(out, 0, sizeof(*out));
+    out->seed = 1;
+    snprintf(out->text, sizeof(out->text), "%s", text);
+    if (strcmp(text, "OFF") == 0) return 0;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", text);
+    for (char *save = NULL, *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *v = strchr(item, '=');
+        if (!v) return -1;
+        *v++ = '\0';
+        int rc = 0;
+        if (strcmp(item, "short") == 0) rc = parse_rate(v, &out->short_pct, NULL);
+        else if (strcmp(item, "frag") == 0) rc = parse_rate(v, &out->frag_pct, NULL);
+        else if (strcmp(item, "delay") == 0) rc = parse_rate(v, &out->delay_pct, &out->delay_ms);
+        else if (strcmp(item, "eagain") == 0) rc = parse_rate(v, &out->eagain_pct, &out->eagain_len);
+        else if (strcmp(item, "rst") == 0) rc = parse_rate(v, &out->rst_pct, NULL);
+        else if (strcmp(item, "stall") == 0) rc = parse_rate(v, &out->stall_pct, &out->stall_ms);
+        else if (strcmp(item, "from") == 0) out->from_s = (unsigned)atoi(v);
+        else if (strcmp(item, "until") == 0) out->until_s = (unsigned)atoi(v);
+        else if (strcmp(item, "seed") == 0) out->seed = strtoull(v, NULL, 10);
+        else return -1;
+        if (rc != 0) return -1;
+    }
+    if (out->eagain_pct > 0 && out->eagain_len == 0) out->eagain_len = 1;
+    if (out->eagain_len > 0xffff) out->eagain_len = 0xffff;
+    return 0;
+}
+
+int faults_configure(const char *text) {
+    if (!base) return -1;
+    FaultSpec *cur = __atomic_load_n(&spec, __ATOMIC_ACQUIRE);
+    FaultSpec *next = (cur == &slots[0]) ? &slots[1] : &slots[0];
+    if (parse_spec(text, next) != 0) return -1;
+    next->set_at = base->now();
+    __atomic_store_n(&spec, next, __ATOMIC_RELEASE);
+    log_printf("[FAULTS] Schedule set: %s\n", next->text);
+    return 0;
+}
+
+int faults_install(const char *text) {
+    if (!base) {
+        base = io_get_ops();
+        io_set_ops(&fault_ops);
+    }
+    return faults_configure(text);
+}
+
+int faults_format(char *buf, size_t sz) {
+    const FaultSpec *s = __atomic_load_n(&spec, __ATOMIC_ACQUIRE);
+    return snprintf(buf, sz, "schedule=%s active=%d\n"
+                    "short_writes=%llu frag_reads=%llu delays=%llu eagain=%llu resets=%llu stalls=%llu\n",
+                    s ? s->text : "none", active_spec() != NULL,
+                    STAT_GET(n_short), STAT_GET(n_frag), STAT_GET(n_delay),
+                    STAT_GET(n_eagain), STAT_GET(n_rst), STAT_GET(n_stall));
+}
+
+#endif /* FAULT_INJECT */
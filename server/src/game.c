@@ -400,4 +400,102 @@ void parse_move(const char *m, int *r1, int *c1, int *r2, int *c2) {
     *r1 = 7 - (m[1] - '1');
     *c2 = m[2] - 'a';
     *r2 = 7 - (m[3] - '1');
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Loads a position in Forsyth-Edwards Notation into a match.
+ * Sets the board, side to move, castling rights and en passant target; the
+ * move counters are accepted but ignored.
+ * @return 0 on success, -1 if the FEN is malformed.
+ */
+int load_fen(Match *m, const char *fen) {
+    static const char symbols[] = "pnbrqk";
+    GameState g;
+    int r = 0, c = 0;
+    const char *s = fen;
+
+    memset(&g, 0, sizeof(g));
+    for (; *s && *s != ' '; s++) {
+        if (*s == '/') {
+            if (c != 8 || ++r > 7) return -1;
+            c = 0;
+        } else if (*s >= '1' && *s <= '8') {
+            c += *s - '0';
+            if (c > 8) return -1;
+        } else {
+            const char *k = strchr(symbols, (*s >= 'A' && *s <= 'Z') ? *s - 'A' + 'a' : *s);
+            if (!k || !*k || c > 7) return -1;
+            Piece p = (Piece)(k - symbols + 1);
+            g.board[r][c++] = (*s >= 'A' && *s <= 'Z') ? p : -p;
+        }
+    }
+    if (r != 7 || c != 8 || *s != ' ') return -1;
+
+    s++;
+    if (*s != 'w' && *s != 'b') return -1;
+    int turn = (*s == 'w') ? 0 : 1;
+    if (*++s != ' ') return -1;
+
+    int wk = 0, wq = 0, bk = 0, bq = 0;
+    for (s++; *s && *s != ' '; s++) {
+        if (*s == 'K') wk = 1;
+        else if (*s == 'Q') wq = 1;
+        else if (*s == 'k') bk = 1;
+        else if (*s == 'q') bq = 1;
+        else if (*s != '-') return -1;
+    }
+
+    int ep_r = -1, ep_c = -1;
+    if (*s == ' ') {
+        s++;
+        if (s[0] >= 'a' && s[0] <= 'h' && s[1] >= '1' && s[1] <= '8') {
+            ep_c = s[0] - 'a';
+            ep_r = 7 - (s[1] - '1');
+        } else if (s[0] != '-') return -1;
+    }
+
+    m->state = g;
+    m->turn = turn;
+    m->w_can_kingside = wk; m->w_can_queenside = wq;
+    m->b_can_kingside = bk; m->b_can_queenside = bq;
+    m->ep_r = ep_r; m->ep_c = ep_c;
+    return 0;
+}
+
+/**
+ * @brief Writes the position of a match in Forsyth-Edwards Notation (the
+ * halfmove clock is not tracked and written as 0).
+ * @return Number of characters written.
+ */
+int format_fen(const Match *m, char *buf, size_t sz) {
+    static const char symbols[] = " pnbrqk";
+    char out[96];
+    size_t n = 0;
+    for (int r = 0; r < 8; r++) {
+        int empty = 0;
+        for (int c = 0; c < 8; c++) {
+            Piece p = m->state.board[r][c];
+            if (p == EMPTY) { empty++; continue; }
+            if (empty) { out[n++] = (char)('0' + empty); empty = 0; }
+            char s = symbols[p > 0 ? p : -p];
+            out[n++] = (p > 0) ? (char)(s - 'a' + 'A') : s;
+        }
+        if (empty) out[n++] = (char)('0' + empty);
+        if (r < 7) out[n++] = '/';
+    }
+    out[n] = '\0';
+
+    char castling[5];
+    size_t k = 0;
+    if (m->w_can_kingside) castling[k++] = 'K';
+    if (m->w_can_queenside) castling[k++] = 'Q';
+    if (m->b_can_kingside) castling[k++] = 'k';
+    if (m->b_can_queenside) castling[k++] = 'q';
+    if (k == 0) castling[k++] = '-';
+    castling[k] = '\0';
+
+    char ep[3] = "-";
+    if (m->ep_r >= 0 && m->ep_c >= 0) { ep[0] = (char)('a' + m->ep_c); ep[1] = (char)('1' + 7 - m->ep_r); ep[2] = '\0'; }
+
+    return snprintf(buf, sz, "%s %c %s %s 0 %zu", out, m->turn == 0 ? 'w' : 'b', castling, ep, m->moves_count / 2 + 1);
+}
@@ -0,0 +1,686 @@
+/**
+ * @file handoff.c
+ * @brief Hot restart: freezing, serializing and passing live sessions to a successor.
+ *
+ * Freezing relies on the fact that a worker only touches its session between
+ * returning from read_packet_wrapper() and calling it again. Workers park at
+ * the entry of that function (handoff_checkpoint), so once every served worker
+ * and the accept loop are parked, Clients and Matches stop changing and their
+ * read buffers hold exactly the input nobody has processed yet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "handoff.h"
+#include "codec.h"
+#include "client.h"
+#include "match.h"
+#include "journal.h"
+#include "capture.h"
+#include "archive.h"
+#include "profiles.h"
+#include "retransmit.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+
+static int frozen = 0;
+static int parked = 0;
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;     /**< Parked threads wait here */
+static pthread_cond_t parked_cond = PTHREAD_COND_INITIALIZER;   /**< The handoff thread waits here */
+
+/* Old side */
+static int handoff_sock = -1;
+static int server_sock = -1;
+static uint32_t *conn_counter = NULL;
+static pthread_t acceptor_tid;
+static pthread_t handoff_tid;
+static char handoff_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/* New side: state taken over but not started yet */
+static Client **adopted_clients = NULL;
+static size_t adopted_client_count = 0;
+static Match **adopted_matches = NULL;
+static size_t adopted_match_count = 0;
+
+/**
+ * Bounds-checked reader over the received state.
+ */
+typedef struct {
+    const unsigned char *p;
+    size_t len, off;
+    int bad;
+} Reader;
+
+/* --- Encoding --- */
+
+#define put_u8(b, v)  buf_put_le((b), (uint64_t)(uint8_t)(v), 1)
+#define put_i32(b, v) buf_put_le((b), (uint64_t)(uint32_t)(int32_t)(v), 4)
+#define put_i64(b, v) buf_put_le((b), (uint64_t)(int64_t)(v), 8)
+
+static void put_blob(Buf *b, const void *p, size_t n) {
+    put_i32(b, n);
+    buf_put(b, p, n);
+}
+
+static void put_str(Buf *b, const char *s) {
+    put_blob(b, s, strlen(s));
+}
+
+static uint64_t get_u64(Reader *r, int width) {
+    if (r->bad || r->len - r->off < (size_t)width) { r->bad = 1; return 0; }
+    uint64_t v = 0;
+    for (int i = 0; i < width; i++) v |= (uint64_t)r->p[r->off + i] << (8 * i);
+    r->off += (size_t)width;
+    return v;
+}
+
+#define get_u8(r)  ((uint8_t)get_u64((r), 1))
+#define get_i32(r) ((int32_t)(uint32_t)get_u64((r), 4))
+#define get_i64(r) ((int64_t)get_u64((r), 8))
+
+/**
+ * @brief Reads a length-prefixed blob into dst (cap bytes).
+ * @return The blob length, or -1 if it does not fit or the input is short.
+ */
+static int get_blob(Reader *r, void *dst, size_t cap) {
+    int32_t n = get_i32(r);
+    if (r->bad || n < 0 || (size_t)n > cap || r->len - r->off < (size_t)n) { r->bad = 1; return -1; }
+    memcpy(dst, r->p + r->off, (size_t)n);
+    r->off += (size_t)n;
+    return n;
+}
+
+static void get_str(Reader *r, char *dst, size_t cap) {
+    int n = get_blob(r, dst, cap - 1);
+    dst[n > 0 ? n : 0] = '\0';
+}
+
+/* --- Freezing --- */
+
+static void wake_handler(int sig) {
+    (void)sig; /* Only interrupts blocking calls (installed without SA_RESTART) */
+}
+
+int handoff_frozen(void) {
+    return __atomic_load_n(&frozen, __ATOMIC_ACQUIRE);
+}
+
+void handoff_checkpoint(void) {
+    if (!handoff_frozen()) return;
+    pthread_mutex_lock(&park_lock);
+    parked++;
+    pthread_cond_broadcast(&parked_cond);
+    while (frozen) pthread_cond_wait(&park_cond, &park_lock);
+    parked--;
+    pthread_mutex_unlock(&park_lock);
+}
+
+static void thaw(void) {
+    pthread_mutex_lock(&park_lock);
+    __atomic_store_n(&frozen, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&park_cond);
+    pthread_mutex_unlock(&park_lock);
+}
+
+/**
+ * @brief Freezes the process: waits until the accept loop and every worker are parked.
+ * Threads blocked in recv/accept/sleep are interrupted with SIGUSR2, repeatedly,
+ * since a signal can land just before a thread enters the blocking call.
+ * @return 0 once frozen, -1 (and thawed) after HANDOFF_QUIESCE_MS.
+ */
+static int freeze(void) {
+    uint64_t deadline = mono_ms() + HANDOFF_QUIESCE_MS;
+
+    pthread_mutex_lock(&park_lock);
+    __atomic_store_n(&frozen, 1, __ATOMIC_RELEASE);
+    while (parked < client_served_count() + 1) {
+        pthread_mutex_unlock(&park_lock);
+        if (mono_ms() >= deadline) { thaw(); return -1; }
+        client_signal_workers(SIGUSR2);
+        pthread_kill(acceptor_tid, SIGUSR2);
+        pthread_mutex_lock(&park_lock);
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 10 * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&parked_cond, &park_lock, &ts);
+    }
+    pthread_mutex_unlock(&park_lock);
+    return 0;
+}
+
+/* --- Serialization (old side, frozen) --- */
+
+/**
+ * Everything reachable that has to move: served sessions, the players of
+ * every match (disconnected ones included) and the matches themselves.
+ */
+typedef struct {
+    Client **clients;
+    size_t n_clients, cap_clients;
+    Match **matches;
+    size_t n_matches, cap_matches;
+    int failed;
+} Inventory;
+
+static void inventory_add_client(Inventory *inv, Client *c) {
+    if (!c || inv->failed) return;
+    if (inv->n_clients == inv->cap_clients) {
+        size_t cap = inv->cap_clients ? inv->cap_clients * 2 : 256;
+        Client **p = realloc(inv->clients, cap * sizeof(Client *));
+        if (!p) { inv->failed = 1; return; }
+        inv->clients = p; inv->cap_clients = cap;
+    }
+    inv->clients[inv->n_clients++] = c;
+}
+
+static void collect_match(Match *m, void *arg) {
+    Inventory *inv = arg;
+    if (inv->failed) return;
+    if (inv->n_matches == inv->cap_matches) {
+        size_t cap = inv->cap_matches ? inv->cap_matches * 2 : 256;
+        Match **p = realloc(inv->matches, cap * sizeof(Match *));
+        if (!p) { inv->failed = 1; return; }
+        inv->matches = p; inv->cap_matches = cap;
+    }
+    inv->matches[inv->n_matches++] = m;
+    inventory_add_client(inv, m->white);
+    inventory_add_client(inv, m->black);
+}
+
+static int cmp_ptr(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(Client *const *)a, y = (uintptr_t)*(Client *const *)b;
+    return (x > y) - (x < y);
+}
+
+static int client_index(const Inventory *inv, const Client *c) {
+    if (!c) return -1;
+    Client *const *hit = bsearch(&c, inv->clients, inv->n_clients, sizeof(Client *), cmp_ptr);
+    return hit ? (int)(hit - inv->clients) : -1;
+}
+
+/**
+ * @brief Encodes a session. A board travels as disconnected from now on: its
+ * socket is its connection's, which takes it back (see run_mux).
+ */
+static void put_client(Buf *b, const Client *c, int fd_index) {
+    put_i32(b, c->conn_id);
+    put_i32(b, fd_index);
+    put_str(b, c->name);
+    put_str(b, c->id);
+    put_str(b, c->client_addr);
+    put_i32(b, c->color);
+    put_u8(b, c->paired);
+    put_u8(b, c->state);
+    put_i32(b, c->error_count);
+    put_u8(b, c->is_counted);
+    put_i64(b, c->mux ? io_time() : c->disconnect_time);
+    put_i64(b, c->last_heartbeat);
+    put_i32(b, c->mux_tag);
+    put_i32(b, c->match ? c->match->id : 0);
+    put_blob(b, c->readbuf + c->rb_start, c->rb_len > c->rb_start ? (size_t)(c->rb_len - c->rb_start) : 0);
+    put_blob(b, c->linebuf, c->line_len);
+    put_i64(b, (int64_t)c->last_cmd_id);
+    put_u8(b, c->retx != NULL);
+    if (c->retx) {
+        size_t held = retransmit_held(c->retx);
+        put_i64(b, (int64_t)retransmit_next_seq(c->retx));
+        put_i32(b, (int32_t)held);
+        for (size_t i = 0; i < held; i++) {
+            size_t len;
+            const char *line = retransmit_line(c->retx, i, &len);
+            put_blob(b, line, len);
+        }
+    }
+}
+
+static void put_match(Buf *b, const Inventory *inv, const Match *m) {
+    put_i32(b, m->id);
+    put_i32(b, client_index(inv, m->white));
+    put_i32(b, client_index(inv, m->black));
+    put_i32(b, m->turn);
+    put_u8(b, m->finished);
+    put_i32(b, m->winner);
+    put_u8(b, m->end_reason);
+    for (int r = 0; r < 8; r++) for (int c = 0; c < 8; c++) put_u8(b, (int8_t)m->state.board[r][c]);
+    put_u8(b, m->w_can_kingside); put_u8(b, m->w_can_queenside);
+    put_u8(b, m->b_can_kingside); put_u8(b, m->b_can_queenside);
+    put_i32(b, m->ep_r); put_i32(b, m->ep_c);
+    put_i32(b, m->draw_offered_by);
+    put_str(b, m->premove);
+    put_i64(b, m->started_at);
+    put_u8(b, m->tc.mode);
+    put_i32(b, m->tc.base_ms);
+    put_i32(b, m->tc.increment_ms);
+    /* Same host, but the successor's monotonic clock need not match: hand over the time used */
+    put_i64(b, m->clock_ms[0]);
+    put_i64(b, m->clock_ms[1]);
+    put_u8(b, m->clock_running);
+    put_i64(b, m->clock_running ? (int64_t)(io_mono_ms() - m->turn_started_ms) : 0);
+    put_i32(b, m->refs - match_rematch_refs(m)); /* Rematch seats are not handed over */
+    put_u8(b, m->is_paused);
+    put_i32(b, m->moves_count);
+    for (size_t i = 0; i < m->moves_count; i++) put_str(b, m->moves[i]);
+}
+
+/**
+ * @brief Encodes the frozen process. fds[0] is the listening socket, followed
+ * by the socket of every connected client in client order.
+ */
+static int serialize(Buf *b, int **fds_out, size_t *nfds_out) {
+    Inventory inv = { 0 };
+    int served = client_served_count();
+    Client **snap = malloc((size_t)(served > 0 ? served : 1) * sizeof(Client *));
+    if (!snap) return -1;
+    size_t n = client_served_snapshot(snap, (size_t)served);
+    for (size_t i = 0; i < n; i++) inventory_add_client(&inv, snap[i]);
+    free(snap);
+    match_foreach(collect_match, &inv);
+    if (inv.failed) { free(inv.clients); free(inv.matches); return -1; }
+
+    /* A player with a live worker shows up twice */
+    qsort(inv.clients, inv.n_clients, sizeof(Client *), cmp_ptr);
+    size_t u = 0;
+    for (size_t i = 0; i < inv.n_clients; i++) {
+        if (u == 0 || inv.clients[u - 1] != inv.clients[i]) inv.clients[u++] = inv.clients[i];
+    }
+    inv.n_clients = u;
+
+    int *fds = malloc((inv.n_clients + 1) * sizeof(int));
+    if (!fds) { free(inv.clients); free(inv.matches); return -1; }
+    size_t nfds = 0;
+    fds[nfds++] = server_sock;
+
+    buf_put(b, HANDOFF_MAGIC, 4);
+    put_u8(b, HANDOFF_VERSION);
+    put_i32(b, match_next_room_id());
+    put_i32(b, *conn_counter);
+    put_i32(b, inv.n_clients);
+    put_i32(b, inv.n_matches);
+    for (size_t i = 0; i < inv.n_clients; i++) {
+        Client *c = inv.clients[i];
+        int fd_index = -1;
+        if (c->sock > 0 && !c->mux) {
+            /* The successor knows nothing of a half-sent line: finish it here */
+            pthread_mutex_lock(&c->lock);
+            conn_flush_tail(c, 1);
+            pthread_mutex_unlock(&c->lock);
+            fd_index = (int)nfds; fds[nfds++] = c->sock;
+        }
+        put_client(b, c, fd_index);
+    }
+    for (size_t i = 0; i < inv.n_matches; i++) put_match(b, &inv, inv.matches[i]);
+
+    free(inv.clients);
+    free(inv.matches);
+    if (b->failed) { free(fds); return -1; }
+    *fds_out = fds;
+    *nfds_out = nfds;
+    return 0;
+}
+
+/* --- Transport --- */
+
+static int read_all(int fd, void *p, size_t len) {
+    unsigned char *c = p;
+    while (len > 0) {
+        ssize_t n = recv(fd, c, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        c += n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_fds(int s, const int *fds, size_t n) {
+    char byte = 'F';
+    struct iovec iov = { &byte, 1 };
+    union { char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FD_BATCH)]; struct cmsghdr align; } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&u, 0, sizeof(u));
+    msg.msg_iov = &iov; msg.msg_iovlen = 1;
+    msg.msg_control = u.buf; msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * n);
+    while (sendmsg(s, &msg, MSG_NOSIGNAL) < 0) if (errno != EINTR) return -1;
+    return 0;
+}
+
+/**
+ * @brief Receives one batch of descriptors.
+ * @return Number of descriptors stored (at most max), or -1.
+ */
+static int recv_fds(int s, int *fds, size_t max) {
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union { char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FD_BATCH)]; struct cmsghdr align; } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov; msg.msg_iovlen = 1;
+    msg.msg_control = u.buf; msg.msg_controllen = sizeof(u.buf);
+    ssize_t r;
+    while ((r = recvmsg(s, &msg, 0)) < 0) if (errno != EINTR) return -1;
+    if (r == 0 || (msg.msg_flags & MSG_CTRUNC)) return -1;
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) return -1;
+    size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (n > max) return -1;
+    memcpy(fds, CMSG_DATA(cm), n * sizeof(int));
+    return (int)n;
+}
+
+/**
+ * @brief Sends the frozen state and waits for the successor's acknowledgement.
+ */
+static int hand_over(int s) {
+    Buf b = { 0 };
+    int *fds = NULL;
+    size_t nfds = 0;
+    if (serialize(&b, &fds, &nfds) != 0) { free(b.data); return -1; }
+
+    unsigned char hdr[8];
+    for (int i = 0; i < 4; i++) { hdr[i] = (unsigned char)(b.len >> (8 * i)); hdr[4 + i] = (unsigned char)(nfds >> (8 * i)); }
+    int rc = send_all(s, hdr, sizeof(hdr));
+    if (rc == 0) rc = send_all(s, b.data, b.len);
+    for (size_t i = 0; rc == 0 && i < nfds; i += HANDOFF_FD_BATCH)
+        rc = send_fds(s, fds + i, (nfds - i < HANDOFF_FD_BATCH) ? nfds - i : HANDOFF_FD_BATCH);
+    log_printf("[HANDOFF] Sent %zu bytes of state and %zu sockets\n", b.len, nfds);
+    free(b.data);
+    free(fds);
+    if (rc != 0) return -1;
+
+    struct timeval tv = { HANDOFF_ACK_TIMEOUT_MS / 1000, (HANDOFF_ACK_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char ack = 0;
+    if (read_all(s, &ack, 1) != 0 || ack != 'K') return -1;
+    return 0;
+}
+
+static void *handoff_thread_func(void *arg) {
+    (void)arg;
+    while (1) {
+        int s = accept(handoff_sock, NULL, NULL);
+        if (s < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            log_printf("[HANDOFF] accept failed: %s\n", strerror(errno));
+            return NULL;
+        }
+
+        uint64_t t0 = mono_ms();
+        log_printf("[HANDOFF] Successor connected, freezing\n");
+        if (freeze() != 0) {
+            log_printf("[HANDOFF] Workers did not park within %d ms, handoff aborted\n", HANDOFF_QUIESCE_MS);
+            close(s);
+            continue;
+        }
+        if (hand_over(s) != 0) {
+            log_printf("[HANDOFF] Successor failed, resuming service\n");
+            thaw();
+            close(s);
+            continue;
+        }
+
+        /* The successor owns every session now; leave without touching a socket */
+        log_printf("[HANDOFF] Handed over after %llu ms frozen, exiting\n", (unsigned long long)(mono_ms() - t0));
+        journal_close();
+        archive_close();
+        profiles_close();
+        capture_close();
+        close_logging();
+        _exit(0);
+    }
+}
+
+int handoff_listen(const char *path, int listen_fd, uint32_t *next_conn_id) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    snprintf(handoff_path, sizeof(handoff_path), "%s", path);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = wake_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    handoff_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handoff_sock < 0) return -1;
+    unlink(path);
+    if (bind(handoff_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(handoff_sock, 1) < 0) {
+        close(handoff_sock);
+        handoff_sock = -1;
+        return -1;
+    }
+
+    server_sock = listen_fd;
+    conn_counter = next_conn_id;
+    acceptor_tid = pthread_self();
+    if (pthread_create(&handoff_tid, NULL, handoff_thread_func, NULL) != 0) {
+        close(handoff_sock);
+        handoff_sock = -1;
+        return -1;
+    }
+    pthread_detach(handoff_tid);
+    log_printf("[HANDOFF] Waiting for successors on %s\n", path);
+    return 0;
+}
+
+/* --- Rebuilding (new side) --- */
+
+static int cmp_match_id(const void *a, const void *b) {
+    int x = (*(Match *const *)a)->id, y = (*(Match *const *)b)->id;
+    return (x > y) - (x < y);
+}
+
+static Match *lookup_match(int id) {
+    Match key = { .id = id }, *kp = &key;
+    Match **hit = bsearch(&kp, adopted_matches, adopted_match_count, sizeof(Match *), cmp_match_id);
+    return hit ? *hit : NULL;
+}
+
+static Client *read_client(Reader *r, const int *fds, size_t nfds, int *match_id) {
+    uint32_t conn_id = (uint32_t)get_i32(r);
+    int fd_index = get_i32(r);
+    int sock = (fd_index > 0 && (size_t)fd_index < nfds) ? fds[fd_index] : -1;
+    Client *c = client_create(sock, conn_id);
+    if (!c) { r->bad = 1; return NULL; }
+    get_str(r, c->name, sizeof(c->name));
+    get_str(r, c->id, sizeof(c->id));
+    get_str(r, c->client_addr, sizeof(c->client_addr));
+    c->color = get_i32(r);
+    c->paired = get_u8(r);
+    c->state = (ClientState)get_u8(r);
+    c->error_count = get_i32(r);
+    c->is_counted = get_u8(r);
+    c->disconnect_time = (time_t)get_i64(r);
+    c->last_heartbeat = (time_t)get_i64(r);
+    c->mux_tag = get_i32(r);
+    *match_id = get_i32(r);
+    int pending = get_blob(r, c->readbuf, sizeof(c->readbuf));
+    c->rb_start = 0;
+    c->rb_len = pending > 0 ? pending : 0;
+    int partial = get_blob(r, c->linebuf, sizeof(c->linebuf) - 1);
+    c->line_len = partial > 0 ? (size_t)partial : 0;
+    c->last_cmd_id = (uint64_t)get_i64(r);
+    if (get_u8(r)) {
+        /* Without memory the session goes on unnumbered and resumes in full */
+        c->retx = retransmit_create((uint64_t)get_i64(r));
+        int held = get_i32(r);
+        char line[BIG_BUFFER_SZ + 32];
+        for (int i = 0; i < held && !r->bad; i++) {
+            int n = get_blob(r, line, sizeof(line));
+            if (n > 0 && c->retx) retransmit_restore(c->retx, line, (size_t)n);
+        }
+    }
+    c->adopted = (sock > 0);
+    if (c->is_counted) increment_player_count();
+    return c;
+}
+
+static Match *read_match(Reader *r) {
+    Match *m = calloc(1, sizeof(Match));
+    if (!m) { r->bad = 1; return NULL; }
+    pthread_mutex_init(&m->lock, NULL);
+    m->id = get_i32(r);
+    int w = get_i32(r), b = get_i32(r);
+    m->white = (w >= 0 && (size_t)w < adopted_client_count) ? adopted_clients[w] : NULL;
+    m->black = (b >= 0 && (size_t)b < adopted_client_count) ? adopted_clients[b] : NULL;
+    m->turn = get_i32(r);
+    m->finished = get_u8(r);
+    m->winner = get_i32(r);
+    m->end_reason = (EndReason)get_u8(r);
+    for (int row = 0; row < 8; row++) for (int col = 0; col < 8; col++) m->state.board[row][col] = (Piece)(int8_t)get_u8(r);
+    m->w_can_kingside = get_u8(r); m->w_can_queenside = get_u8(r);
+    m->b_can_kingside = get_u8(r); m->b_can_queenside = get_u8(r);
+    m->ep_r = get_i32(r); m->ep_c = get_i32(r);
+    m->draw_offered_by = get_i32(r);
+    get_str(r, m->premove, sizeof(m->premove));
+    m->premove_color = 1 - m->turn; /* Only the side not to move holds one */
+    m->started_at = (time_t)get_i64(r);
+    m->tc.mode = (ClockMode)get_u8(r);
+    m->tc.base_ms = get_i32(r);
+    m->tc.increment_ms = get_i32(r);
+    m->clock_ms[0] = get_i64(r);
+    m->clock_ms[1] = get_i64(r);
+    m->clock_running = get_u8(r);
+    m->turn_started_ms = io_mono_ms() - (uint64_t)get_i64(r);
+    m->refs = get_i32(r);
+    m->is_paused = get_u8(r);
+    int n = get_i32(r);
+    for (int i = 0; i < n && !r->bad; i++) {
+        char mv[LINEBUF_SZ];
+        get_str(r, mv, sizeof(mv));
+        if (!r->bad && match_append_move(m, mv) != 0) r->bad = 1;
+    }
+    return m;
+}
+
+/**
+ * @brief Rebuilds clients and matches from the received state.
+ */
+static int rebuild(const unsigned char *data, size_t len, const int *fds, size_t nfds, uint32_t *next_conn_id) {
+    Reader r = { data, len, 0, 0 };
+    if (len < 5 || memcmp(data, HANDOFF_MAGIC, 4) != 0 || data[4] != HANDOFF_VERSION) return -1;
+    r.off = 5;
+    int next_room = get_i32(&r);
+    *next_conn_id = (uint32_t)get_i32(&r);
+    int n_clients = get_i32(&r), n_matches = get_i32(&r);
+    if (r.bad || n_clients < 0 || n_matches < 0) return -1;
+
+    adopted_clients = calloc((size_t)n_clients + 1, sizeof(Client *));
+    adopted_matches = calloc((size_t)n_matches + 1, sizeof(Match *));
+    int *match_ids = calloc((size_t)n_clients + 1, sizeof(int));
+    if (!adopted_clients || !adopted_matches || !match_ids) { free(match_ids); return -1; }
+
+    for (int i = 0; i < n_clients && !r.bad; i++) {
+        Client *c = read_client(&r, fds, nfds, &match_ids[i]);
+        if (c) adopted_clients[adopted_client_count++] = c;
+    }
+    for (int i = 0; i < n_matches && !r.bad; i++) {
+        Match *m = read_match(&r);
+        if (m) adopted_matches[adopted_match_count++] = m;
+    }
+    if (r.bad) { free(match_ids); return -1; }
+
+    qsort(adopted_matches, adopted_match_count, sizeof(Match *), cmp_match_id);
+    for (size_t i = 0; i < adopted_client_count; i++) adopted_clients[i]->match = lookup_match(match_ids[i]);
+    for (size_t i = 0; i < adopted_match_count; i++) match_insert(adopted_matches[i]);
+    match_reserve_room_ids(next_room);
+    free(match_ids);
+    return 0;
+}
+
+int handoff_takeover(const char *path, uint32_t *next_conn_id) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        log_printf("[HANDOFF] Cannot reach %s: %s\n", path, strerror(errno));
+        close(s);
+        return -1;
+    }
+
+    uint64_t t0 = mono_ms();
+    unsigned char hdr[8];
+    if (read_all(s, hdr, sizeof(hdr)) != 0) { close(s); return -1; }
+    size_t len = 0, nfds = 0;
+    for (int i = 0; i < 4; i++) { len |= (size_t)hdr[i] << (8 * i); nfds |= (size_t)hdr[4 + i] << (8 * i); }
+    if (nfds == 0 || len > (1u << 30) || nfds > (1u << 24)) { close(s); return -1; }
+
+    unsigned char *data = malloc(len);
+    int *fds = malloc(nfds * sizeof(int));
+    int rc = (data && fds) ? read_all(s, data, len) : -1;
+    size_t got = 0;
+    while (rc == 0 && got < nfds) {
+        int n = recv_fds(s, fds + got, nfds - got);
+        if (n <= 0) rc = -1;
+        else got += (size_t)n;
+    }
+    if (rc == 0) rc = rebuild(data, len, fds, got, next_conn_id);
+    free(data);
+    if (rc != 0) {
+        log_printf("[HANDOFF] Takeover from %s failed, the old process keeps serving\n", path);
+        for (size_t i = 0; i < got; i++) close(fds[i]);
+        free(fds);
+        close(s);
+        return -1;
+    }
+    int listen_fd = fds[0];
+    free(fds);
+
+    /* Acknowledge, then wait for the old process to flush its files and exit */
+    char ack = 'K';
+    send_all(s, &ack, 1);
+    struct pollfd pfd = { s, POLLIN, 0 };
+    if (poll(&pfd, 1, HANDOFF_ACK_TIMEOUT_MS) <= 0) log_printf("[HANDOFF] Old process did not exit in time\n");
+    close(s);
+
+    log_printf("[HANDOFF] Took over %zu sessions and %zu matches in %llu ms\n",
+               adopted_client_count, adopted_match_count, (unsigned long long)(mono_ms() - t0));
+    return listen_fd;
+}
+
+void handoff_start_sessions(void) {
+    for (size_t i = 0; i < adopted_match_count; i++) {
+        if (io_spawn(match_watchdog, adopted_matches[i]) != 0) adopted_matches[i]->refs--;
+    }
+    for (size_t i = 0; i < adopted_client_count; i++) {
+        Client *c = adopted_clients[i];
+        if (c->sock <= 0) continue; /* Disconnected session, waits for a reconnect */
+        if (client_start(c) != 0) {
+            log_printf("[HANDOFF] Cannot start worker for %s, closing its connection\n", c->name);
+            io_close(c->sock);
+            c->sock = -1;
+            c->disconnect_time = io_time();
+        }
+    }
+    free(adopted_clients);
+    free(adopted_matches);
+    adopted_clients = NULL;
+    adopted_matches = NULL;
+    adopted_client_count = adopted_match_count = 0;
+}
@@ -0,0 +1,500 @@
+/**
+ * @file journal.c
+ * @brief Write-ahead journal of match lifecycle events.
+ *
+ * Game threads timestamp nothing and block on nothing: they only enqueue a
+ * record. The writer thread (same queue design as capture.c) encodes whole
+ * batches into one buffer, appends it with a single write() and syncs the file
+ * at most every JOURNAL_SYNC_INTERVAL_MS. It also applies every record to its
+ * own model of the live rooms, which is what replay rebuilds at startup and
+ * what compaction writes out, so neither needs the server's locks.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "codec.h"
+#include "client.h"
+#include "logging.h"
+#include "config.h"
+#include "stats.h"
+
+#define JROOM_BUCKETS 4096
+#define JMOVE_LEN 8             /**< Stored move text, "e7e8q" plus padding */
+
+/**
+ * Queued record, payload stored inline.
+ */
+typedef struct JournalNode {
+    struct JournalNode *next;
+    uint8_t type;
+    int room_id;
+    uint32_t len;
+    unsigned char data[];
+} JournalNode;
+
+/**
+ * Writer-side model of one live room.
+ */
+typedef struct JRoom {
+    struct JRoom *next;         /**< Hash chain */
+    int id;
+    char white[NAME_LEN], white_id[ID_LEN];
+    char black[NAME_LEN], black_id[ID_LEN];
+    int has_black;
+    int timed;                  /**< Per-side clocks (tc and clock_ms are set) */
+    TimeControl tc;
+    int64_t clock_ms[2];        /**< Time left per colour after its last move */
+    char (*moves)[JMOVE_LEN];
+    size_t moves_count, moves_cap;
+    size_t bytes;               /**< Encoded size of this room's records */
+} JRoom;
+
+static JournalNode *head = NULL;
+static JournalNode *tail = NULL;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;
+static pthread_t writer_tid;
+static volatile int journal_running = 0;
+static int journal_fd = -1;
+static char journal_path[512];
+
+/* Model (owned by journal_open, then by the writer thread) */
+static JRoom *rooms[JROOM_BUCKETS];
+static int room_count = 0;
+static int model_next_id = 1;
+static size_t live_bytes = 0;
+static size_t file_bytes = 0;
+
+/* Writer counters (updated atomically) */
+static uint64_t n_records, n_batches, n_bytes, n_syncs, n_compactions, n_write_errors;
+
+/* --- Encoding --- */
+
+/**
+ * @brief Appends one framed record to b.
+ * @return Encoded size, or 0 on allocation failure.
+ */
+static size_t encode_record(Buf *b, uint8_t type, int room_id, const void *payload, size_t len) {
+    if (buf_reserve(b, 1 + 10 + 10 + len + 4) != 0) return 0;
+    unsigned char *start = b->data + b->len;
+    size_t n = 0;
+    start[n++] = type;
+    n += put_varint(start + n, (uint64_t)room_id);
+    n += put_varint(start + n, len);
+    if (len) memcpy(start + n, payload, len);
+    n += len;
+    uint32_t crc = crc32(start, n);
+    for (int i = 0; i < 4; i++) start[n++] = (unsigned char)(crc >> (8 * i));
+    b->len += n;
+    return n;
+}
+
+/* --- Model --- */
+
+static JRoom **room_slot(int id) {
+    JRoom **pp = &rooms[(unsigned)id % JROOM_BUCKETS];
+    while (*pp && (*pp)->id != id) pp = &(*pp)->next;
+    return pp;
+}
+
+static void split_identity(const unsigned char *p, size_t len, char *name, size_t name_sz, char *id, size_t id_sz) {
+    const unsigned char *nul = memchr(p, '\0', len);
+    size_t name_len = nul ? (size_t)(nul - p) : len;
+    snprintf(name, name_sz, "%.*s", (int)name_len, (const char *)p);
+    if (nul) snprintf(id, id_sz, "%.*s", (int)(len - name_len - 1), (const char *)nul + 1);
+    else snprintf(id, id_sz, "unknown");
+}
+
+size_t journal_put_time_control(unsigned char *buf, const TimeControl *tc) {
+    size_t n = 0;
+    buf[n++] = '\0';
+    buf[n++] = (unsigned char)tc->mode;
+    n += put_varint(buf + n, (uint64_t)tc->base_ms);
+    return n + put_varint(buf + n, (uint64_t)tc->increment_ms);
+}
+
+int journal_get_time_control(const unsigned char *p, size_t len, TimeControl *tc) {
+    const unsigned char *a = memchr(p, '\0', len);
+    const unsigned char *b = a ? memchr(a + 1, '\0', len - (size_t)(a + 1 - p)) : NULL;
+    if (!b || (size_t)(b - p) + 2 > len) return 0;
+    size_t off = (size_t)(b - p) + 2, k;
+    uint64_t base, inc;
+    if (!(k = get_varint(p + off, len - off, &base)) || !get_varint(p + off + k, len - off - k, &inc)) return 0;
+    tc->mode = (ClockMode)b[1];
+    tc->base_ms = (int)base;
+    tc->increment_ms = (int)inc;
+    return tc->mode != TC_PER_MOVE;
+}
+
+/**
+ * @brief Applies one record to the model (replay and writer share this).
+ * @param size Encoded size of the record, for the compaction accounting.
+ */
+static void model_apply(uint8_t type, int id, const unsigned char *p, size_t len, size_t size) {
+    file_bytes += size;
+    if (type == JNL_CHECKPOINT) {
+        uint64_t next;
+        if (get_varint(p, len, &next) && (int)next > model_next_id) model_next_id = (int)next;
+        return;
+    }
+
+    JRoom **pp = room_slot(id);
+    JRoom *r = *pp;
+    if (type == JNL_CREATE) {
+        if (!r) {
+            r = calloc(1, sizeof(JRoom));
+            if (!r) return;
+            r->id = id;
+            r->next = rooms[(unsigned)id % JROOM_BUCKETS];
+            rooms[(unsigned)id % JROOM_BUCKETS] = r;
+            room_count++;
+        }
+        split_identity(p, len, r->white, sizeof(r->white), r->white_id, sizeof(r->white_id));
+        r->timed = journal_get_time_control(p, len, &r->tc);
+        if (r->timed) r->clock_ms[0] = r->clock_ms[1] = r->tc.base_ms;
+        if (id >= model_next_id) model_next_id = id + 1;
+    } else if (!r) {
+        return; /* Room ended before a compaction or never journaled */
+    } else if (type == JNL_JOIN) {
+        split_identity(p, len, r->black, sizeof(r->black), r->black_id, sizeof(r->black_id));
+        r->has_black = 1;
+    } else if (type == JNL_MOVE) {
+        if (r->moves_count == r->moves_cap) {
+            size_t cap = r->moves_cap ? r->moves_cap * 2 : 64;
+            char (*tmp)[JMOVE_LEN] = realloc(r->moves, cap * JMOVE_LEN);
+            if (!tmp) return;
+            r->moves = tmp; r->moves_cap = cap;
+        }
+        snprintf(r->moves[r->moves_count++], JMOVE_LEN, "%.*s", (int)len, (const char *)p);
+        const unsigned char *nul = memchr(p, '\0', len);
+        uint64_t left;
+        if (r->timed && nul && get_varint(nul + 1, len - (size_t)(nul + 1 - p), &left))
+            r->clock_ms[(r->moves_count - 1) & 1] = (int64_t)left;
+    } else if (type == JNL_END) {
+        *pp = r->next;
+        live_bytes -= r->bytes;
+        room_count--;
+        free(r->moves);
+        free(r);
+        return;
+    }
+    r->bytes += size;
+    live_bytes += size;
+}
+
+/**
+ * @brief Encodes every live room of the model into b (the compacted journal body).
+ */
+static int encode_model(Buf *b) {
+    unsigned char tmp[NAME_LEN + ID_LEN + 32];
+    unsigned char vb[10];
+
+    if (encode_record(b, JNL_CHECKPOINT, 0, vb, put_varint(vb, (uint64_t)model_next_id)) == 0) return -1;
+    live_bytes = 0;
+    for (int i = 0; i < JROOM_BUCKETS; i++) {
+        for (JRoom *r = rooms[i]; r; r = r->next) {
+            size_t n = (size_t)snprintf((char *)tmp, sizeof(tmp), "%s", r->white) + 1;
+            n += (size_t)snprintf((char *)tmp + n, sizeof(tmp) - n, "%s", r->white_id);
+            if (r->timed) n += journal_put_time_control(tmp + n, &r->tc);
+            size_t sz = encode_record(b, JNL_CREATE, r->id, tmp, n);
+            if (r->has_black) {
+                n = (size_t)snprintf((char *)tmp, sizeof(tmp), "%s", r->black) + 1;
+                n += (size_t)snprintf((char *)tmp + n, sizeof(tmp) - n, "%s", r->black_id);
+                sz += encode_record(b, JNL_JOIN, r->id, tmp, n);
+            }
+            for (size_t k = 0; k < r->moves_count; k++) {
+                n = (size_t)snprintf((char *)tmp, sizeof(tmp), "%s", r->moves[k]);
+                /* Only each side's last move needs its clock */
+                if (r->timed && k + 2 >= r->moves_count) { tmp[n++] = '\0'; n += put_varint(tmp + n, (uint64_t)r->clock_ms[k & 1]); }
+                sz += encode_record(b, JNL_MOVE, r->id, tmp, n);
+            }
+            if (sz == 0 || b->data == NULL) return -1;
+            r->bytes = sz;
+            live_bytes += sz;
+        }
+    }
+    return 0;
+}
+
+/* --- File handling --- */
+
+/**
+ * @brief Replaces the journal with a checkpoint of the live rooms.
+ * Written to "<path>.tmp", synced, then renamed over the journal, so a crash
+ * at any point leaves either the old or the new file intact.
+ */
+static int compact(void) {
+    char tmp_path[sizeof(journal_path) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", journal_path);
+
+    Buf b = { 0 };
+    if (buf_reserve(&b, JOURNAL_HEADER_SZ) != 0) return -1;
+    memset(b.data, 0, JOURNAL_HEADER_SZ);
+    memcpy(b.data, JOURNAL_MAGIC, 4);
+    b.data[4] = JOURNAL_VERSION;
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    uint64_t wall_ns = (uint64_t)wall.tv_sec * 1000000000ull + (uint64_t)wall.tv_nsec;
+    for (int i = 0; i < 8; i++) b.data[8 + i] = (unsigned char)(wall_ns >> (8 * i));
+    b.len = JOURNAL_HEADER_SZ;
+    if (encode_model(&b) != 0) { free(b.data); return -1; }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { free(b.data); return -1; }
+    int rc = write_all(fd, b.data, b.len);
+    if (rc == 0) rc = fdatasync(fd);
+    close(fd);
+    if (rc == 0) rc = rename(tmp_path, journal_path);
+    if (rc != 0) { unlink(tmp_path); free(b.data); return -1; }
+
+    /* Make the rename itself durable */
+    char dir[sizeof(journal_path)];
+    snprintf(dir, sizeof(dir), "%s", journal_path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *(slash == dir ? slash + 1 : slash) = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+    int dfd = open(dir, O_RDONLY);
+    if (dfd >= 0) { fsync(dfd); close(dfd); }
+
+    int nfd = open(journal_path, O_WRONLY | O_APPEND);
+    if (nfd < 0) { free(b.data); return -1; }
+    if (journal_fd >= 0) close(journal_fd);
+    journal_fd = nfd;
+    file_bytes = b.len;
+    free(b.data);
+    STAT_ADD(n_compactions, 1);
+    return 0;
+}
+
+/**
+ * @brief Loads an existing journal into the model.
+ * @return Number of records replayed, or -1 if the file is not a journal.
+ */
+static long replay_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size < JOURNAL_HEADER_SZ) { fclose(fp); return 0; }
+    unsigned char *data = malloc((size_t)st.st_size);
+    size_t size = data ? fread(data, 1, (size_t)st.st_size, fp) : 0;
+    fclose(fp);
+    if (!data) return -1;
+    if (size < JOURNAL_HEADER_SZ || memcmp(data, JOURNAL_MAGIC, 4) != 0 || data[4] != JOURNAL_VERSION) {
+        log_printf("[JOURNAL] %s is not a version %d journal, refusing to overwrite it\n", path, JOURNAL_VERSION);
+        free(data);
+        return -1;
+    }
+
+    long records = 0;
+    size_t off = JOURNAL_HEADER_SZ;
+    file_bytes = JOURNAL_HEADER_SZ;
+    while (off < size) {
+        size_t pos = off + 1, k;
+        uint64_t id, len;
+        if ((k = get_varint(data + pos, size - pos, &id)) == 0) break;
+        pos += k;
+        if ((k = get_varint(data + pos, size - pos, &len)) == 0) break;
+        pos += k;
+        if (len > size - pos || size - pos - len < 4) break;
+        const unsigned char *c = data + pos + len;
+        uint32_t crc = (uint32_t)c[0] | (uint32_t)c[1] << 8 | (uint32_t)c[2] << 16 | (uint32_t)c[3] << 24;
+        if (crc32(data + off, pos + len - off) != crc) break;
+        model_apply(data[off], (int)id, data + pos, (size_t)len, pos + len + 4 - off);
+        off = pos + len + 4;
+        records++;
+    }
+    if (off < size) log_printf("[JOURNAL] Discarding %zu bytes of torn or corrupt tail at offset %zu\n", size - off, off);
+    free(data);
+    return records;
+}
+
+/* --- Writer --- */
+
+static void *journal_writer_func(void *arg) {
+    (void)arg;
+    Buf out = { 0 };
+    int dirty = 0;
+    uint64_t last_sync = mono_ms();
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (head == NULL && journal_running) {
+            if (!dirty) { pthread_cond_wait(&queue_cond, &queue_lock); continue; }
+            uint64_t due = last_sync + JOURNAL_SYNC_INTERVAL_MS;
+            struct timespec dl = { (time_t)(due / 1000), (long)(due % 1000) * 1000000L };
+            if (pthread_cond_timedwait(&queue_cond, &queue_lock, &dl) == ETIMEDOUT) break;
+        }
+        JournalNode *batch = head;
+        head = tail = NULL;
+        int stopping = !journal_running;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (batch) {
+            uint64_t count = 0;
+            out.len = 0;
+            while (batch) {
+                size_t sz = encode_record(&out, batch->type, batch->room_id, batch->data, batch->len);
+                if (sz > 0) model_apply(batch->type, batch->room_id, batch->data, batch->len, sz);
+                count++;
+                JournalNode *done = batch;
+                batch = batch->next;
+                free(done);
+            }
+            if (write_all(journal_fd, out.data, out.len) != 0) {
+                if (STAT_ADD(n_write_errors, 1) == 0) log_printf("[JOURNAL] Write failed: %s\n", strerror(errno));
+            }
+            STAT_ADD(n_records, count);
+            STAT_ADD(n_batches, 1);
+            STAT_ADD(n_bytes, out.len);
+            dirty = 1;
+        }
+
+        if (dirty && (stopping || mono_ms() - last_sync >= JOURNAL_SYNC_INTERVAL_MS)) {
+            fdatasync(journal_fd);
+            STAT_ADD(n_syncs, 1);
+            last_sync = mono_ms();
+            dirty = 0;
+        }
+
+        if (file_bytes >= JOURNAL_COMPACT_MIN_BYTES && file_bytes > live_bytes * JOURNAL_COMPACT_RATIO) {
+            size_t before = file_bytes;
+            if (compact() == 0) log_printf("[JOURNAL] Compacted %zu -> %zu bytes (%d live rooms)\n", before, file_bytes, room_count);
+            else log_printf("[JOURNAL] Compaction failed: %s\n", strerror(errno));
+        }
+
+        if (stopping && head == NULL) break;
+    }
+    free(out.data);
+    return NULL;
+}
+
+int journal_open(const char *path) {
+    if (journal_running) return 0;
+    snprintf(journal_path, sizeof(journal_path), "%s", path);
+
+    uint64_t t0 = mono_ms();
+    long records = replay_file(journal_path);
+    if (records < 0) return -1;
+
+    int restored = 0;
+    for (int i = 0; i < JROOM_BUCKETS; i++) {
+        for (JRoom *r = rooms[i]; r; r = r->next) {
+            if (match_exists(r->id)) continue; /* Already taken over from the previous process */
+            char **moves = malloc((r->moves_count + 1) * sizeof(char *));
+            if (!moves) continue;
+            for (size_t k = 0; k < r->moves_count; k++) moves[k] = r->moves[k];
+            Match *m = match_restore(r->id, r->white, r->white_id,
+                                     r->has_black ? r->black : NULL, r->black_id,
+                                     moves, r->moves_count,
+                                     r->timed ? &r->tc : NULL, r->timed ? r->clock_ms : NULL);
+            free(moves);
+            if (!m) continue;
+            r->moves_count = m->moves_count; /* Drop anything the rules engine rejected */
+            restored++;
+        }
+    }
+    match_reserve_room_ids(model_next_id);
+
+    if (compact() != 0) {
+        log_printf("[JOURNAL] Cannot write %s: %s\n", journal_path, strerror(errno));
+        return -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    journal_running = 1;
+    if (pthread_create(&writer_tid, NULL, journal_writer_func, NULL) != 0) {
+        journal_running = 0;
+        close(journal_fd);
+        journal_fd = -1;
+        return -1;
+    }
+    log_printf("[JOURNAL] %s: replayed %ld records, restored %d matches in %llu ms\n",
+               journal_path, records, restored, (unsigned long long)(mono_ms() - t0));
+    return restored;
+}
+
+void journal_close(void) {
+    if (!journal_running) return;
+    pthread_mutex_lock(&queue_lock);
+    journal_running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_tid, NULL);
+    close(journal_fd);
+    journal_fd = -1;
+}
+
+/**
+ * @brief Enqueues one record for the writer.
+ */
+static void journal_push(uint8_t type, int room_id, const void *data, size_t len) {
+    if (!journal_running) return;
+    JournalNode *node = malloc(sizeof(JournalNode) + len);
+    if (!node) return;
+    node->next = NULL;
+    node->type = type;
+    node->room_id = room_id;
+    node->len = (uint32_t)len;
+    if (len) memcpy(node->data, data, len);
+
+    pthread_mutex_lock(&queue_lock);
+    if (tail) { tail->next = node; tail = node; }
+    else { head = tail = node; }
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void push_identity(uint8_t type, int room_id, const Client *c, const TimeControl *tc) {
+    unsigned char buf[NAME_LEN + ID_LEN + 32];
+    size_t n = (size_t)snprintf((char *)buf, sizeof(buf), "%s", c->name) + 1;
+    n += (size_t)snprintf((char *)buf + n, sizeof(buf) - n, "%s", c->id);
+    if (tc) n += journal_put_time_control(buf + n, tc);
+    journal_push(type, room_id, buf, n);
+}
+
+void journal_create(const Match *m) {
+    if (journal_running && m->white) push_identity(JNL_CREATE, m->id, m->white, m->tc.mode != TC_PER_MOVE ? &m->tc : NULL);
+}
+
+void journal_join(const Match *m) {
+    if (journal_running && m->black) push_identity(JNL_JOIN, m->id, m->black, NULL);
+}
+
+void journal_move(const Match *m, const char *mv) {
+    if (!journal_running) return;
+    unsigned char buf[JMOVE_LEN + 12];
+    size_t n = (size_t)snprintf((char *)buf, sizeof(buf), "%s", mv);
+    if (m->tc.mode != TC_PER_MOVE && m->moves_count > 0) {
+        int64_t left = m->clock_ms[(m->moves_count - 1) & 1];
+        buf[n++] = '\0';
+        n += put_varint(buf + n, left > 0 ? (uint64_t)left : 0);
+    }
+    journal_push(JNL_MOVE, m->id, buf, n);
+}
+
+void journal_end(const Match *m) {
+    unsigned char p[2] = { (unsigned char)(m->winner + 1), (unsigned char)m->end_reason };
+    journal_push(JNL_END, m->id, p, sizeof(p));
+}
+
+int journal_format_stats(char *buf, size_t sz) {
+    if (!journal_running) return 0;
+    return snprintf(buf, sz, "path=%s records=%llu batches=%llu bytes=%llu syncs=%llu compactions=%llu write_errors=%llu\n",
+                    journal_path, STAT_GET(n_records), STAT_GET(n_batches), STAT_GET(n_bytes),
+                    STAT_GET(n_syncs), STAT_GET(n_compactions), STAT_GET(n_write_errors));
+}
@@ -0,0 +1,241 @@
+/**
+ * @file leaderboard.c
+ * @brief Indexable skip list of ranked players (see leaderboard.h).
+ *
+ * Nodes get a random height with a fanout of 4. A link's span counts the
+ * level-0 nodes between its two ends; a link that ends the level spans the
+ * rest of the list. A rating change unlinks the node and links it again at its
+ * new place, so game end never allocates.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "leaderboard.h"
+#include "config.h"
+
+typedef struct LbNode LbNode;
+
+typedef struct {
+    LbNode *next;
+    uint64_t span;          /**< Level-0 steps to next (to the end of the list when next is NULL) */
+} LbLink;
+
+struct LbNode {
+    int32_t rating;
+    char name[NAME_LEN];
+    int level;
+    LbLink link[];
+};
+
+static pthread_rwlock_t lb_lock = PTHREAD_RWLOCK_INITIALIZER;
+static LbNode *head = NULL;
+static int level = 1;
+static uint64_t length = 0;
+static uint64_t rng_state = 0;
+
+static LbNode *node_alloc(int lvl, int32_t rating, const char *name) {
+    LbNode *n = calloc(1, sizeof(LbNode) + (size_t)lvl * sizeof(LbLink));
+    if (!n) return NULL;
+    n->rating = rating;
+    n->level = lvl;
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    return n;
+}
+
+/** Called with the write lock held. */
+static int ensure_head(void) {
+    if (head) return 0;
+    head = node_alloc(LEADERBOARD_MAX_LEVEL, 0, "");
+    if (!head) return -1;
+    rng_state = (uint64_t)time(NULL) ^ (uint64_t)(uintptr_t)head ^ 0x9e3779b97f4a7c15ull;
+    return 0;
+}
+
+/**
+ * @brief Orders a node against (rating, name): <0 if it ranks higher, 0 if it
+ * is that player.
+ */
+static int cmp(const LbNode *n, int32_t rating, const char *name) {
+    if (n->rating != rating) return n->rating > rating ? -1 : 1;
+    return strncmp(n->name, name, NAME_LEN);
+}
+
+static int random_level(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    uint64_t r = rng_state;
+    int lvl = 1;
+    while (lvl < LEADERBOARD_MAX_LEVEL && (r & 3) == 0) { lvl++; r >>= 2; }
+    return lvl;
+}
+
+/**
+ * @brief Links n at its place. Called with the write lock held.
+ */
+static void link_node(LbNode *n) {
+    LbNode *update[LEADERBOARD_MAX_LEVEL];
+    uint64_t rank[LEADERBOARD_MAX_LEVEL];
+    LbNode *x = head;
+    for (int i = level - 1; i >= 0; i--) {
+        rank[i] = i == level - 1 ? 0 : rank[i + 1];
+        while (x->link[i].next && cmp(x->link[i].next, n->rating, n->name) < 0) {
+            rank[i] += x->link[i].span;
+            x = x->link[i].next;
+        }
+        update[i] = x;
+    }
+    if (n->level > level) {
+        for (int i = level; i < n->level; i++) {
+            rank[i] = 0;
+            update[i] = head;
+            head->link[i].span = length;
+        }
+        level = n->level;
+    }
+    for (int i = 0; i < n->level; i++) {
+        n->link[i].next = update[i]->link[i].next;
+        update[i]->link[i].next = n;
+        n->link[i].span = update[i]->link[i].span - (rank[0] - rank[i]);
+        update[i]->link[i].span = rank[0] - rank[i] + 1;
+    }
+    for (int i = n->level; i < level; i++) update[i]->link[i].span++;
+    length++;
+}
+
+/**
+ * @brief Unlinks the node of (rating, name). Called with the write lock held.
+ * @return The node, or NULL if there is none.
+ */
+static LbNode *unlink_node(int32_t rating, const char *name) {
+    LbNode *update[LEADERBOARD_MAX_LEVEL];
+    LbNode *x = head;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->link[i].next && cmp(x->link[i].next, rating, name) < 0) x = x->link[i].next;
+        update[i] = x;
+    }
+    x = x->link[0].next;
+    if (!x || cmp(x, rating, name) != 0) return NULL;
+    for (int i = 0; i < level; i++) {
+        if (update[i]->link[i].next == x) {
+            update[i]->link[i].span += x->link[i].span - 1;
+            update[i]->link[i].next = x->link[i].next;
+        } else {
+            update[i]->link[i].span--;
+        }
+    }
+    while (level > 1 && !head->link[level - 1].next) level--;
+    length--;
+    return x;
+}
+
+/**
+ * @brief Node at 1-based rank r. Called with the lock held.
+ */
+static LbNode *node_at(uint64_t r) {
+    LbNode *x = head;
+    uint64_t traversed = 0;
+    for (int i = level - 1; i >= 0; i--) {
+        while (x->link[i].next && traversed + x->link[i].span <= r) {
+            traversed += x->link[i].span;
+            x = x->link[i].next;
+        }
+        if (traversed == r) return x;
+    }
+    return NULL;
+}
+
+void leaderboard_insert(const char *name, int32_t rating) {
+    pthread_rwlock_wrlock(&lb_lock);
+    if (ensure_head() == 0) {
+        LbNode *n = node_alloc(random_level(), rating, name);
+        if (n) link_node(n);
+    }
+    pthread_rwlock_unlock(&lb_lock);
+}
+
+void leaderboard_move(const char *name, int32_t old_rating, int32_t new_rating) {
+    pthread_rwlock_wrlock(&lb_lock);
+    if (ensure_head() == 0) {
+        LbNode *n = unlink_node(old_rating, name);
+        if (!n) n = node_alloc(random_level(), new_rating, name);
+        if (n) {
+            n->rating = new_rating;
+            link_node(n);
+        }
+    }
+    pthread_rwlock_unlock(&lb_lock);
+}
+
+void leaderboard_clear(void) {
+    pthread_rwlock_wrlock(&lb_lock);
+    if (head) {
+        LbNode *x = head->link[0].next;
+        while (x) {
+            LbNode *next = x->link[0].next;
+            free(x);
+            x = next;
+        }
+        memset(head->link, 0, LEADERBOARD_MAX_LEVEL * sizeof(LbLink));
+    }
+    level = 1;
+    length = 0;
+    pthread_rwlock_unlock(&lb_lock);
+}
+
+size_t leaderboard_range(uint64_t first, LeaderboardEntry *out, size_t n) {
+    size_t count = 0;
+    if (first == 0) first = 1;
+    pthread_rwlock_rdlock(&lb_lock);
+    LbNode *x = head ? node_at(first) : NULL;
+    for (; x && count < n; x = x->link[0].next, count++) {
+        out[count].rank = first + count;
+        out[count].rating = x->rating;
+        memcpy(out[count].name, x->name, sizeof(out[count].name));
+    }
+    pthread_rwlock_unlock(&lb_lock);
+    return count;
+}
+
+uint64_t leaderboard_rank(const char *name, int32_t rating) {
+    uint64_t r = 0, found = 0;
+    pthread_rwlock_rdlock(&lb_lock);
+    LbNode *x = head;
+    for (int i = level - 1; x && i >= 0; i--) {
+        while (x->link[i].next && cmp(x->link[i].next, rating, name) <= 0) {
+            r += x->link[i].span;
+            x = x->link[i].next;
+        }
+        if (x != head && cmp(x, rating, name) == 0) { found = r; break; }
+    }
+    pthread_rwlock_unlock(&lb_lock);
+    return found;
+}
+
+uint64_t leaderboard_size(void) {
+    pthread_rwlock_rdlock(&lb_lock);
+    uint64_t n = length;
+    pthread_rwlock_unlock(&lb_lock);
+    return n;
+}
+
+int leaderboard_format(uint64_t first, size_t n, char *buf, size_t sz) {
+    LeaderboardEntry e[LEADERBOARD_TOP_MAX];
+    if (n > LEADERBOARD_TOP_MAX) n = LEADERBOARD_TOP_MAX;
+    size_t count = leaderboard_range(first, e, n);
+    if (count == 0) return snprintf(buf, sz, "EMPTY");
+
+    size_t off = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < count && off < sz; i++) {
+        int w = snprintf(buf + off, sz - off, "%s%llu:%s:%d", i ? " " : "",
+                         (unsigned long long)e[i].rank, e[i].name, e[i].rating);
+        if (w < 0 || (size_t)w >= sz - off) break;
+        off += (size_t)w;
+    }
+    return (int)off;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file lockstat.c
+ * @brief Lock wait/hold time accounting.
+ *
+ * All counters are updated with atomic builtins, so the accounting itself
+ * never takes an additional lock and is safe to share between mutexes.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+#include "lockstat.h"
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Raises *slot to value if value is larger (lock-free).
+ */
+static void atomic_max(uint64_t *slot, uint64_t value) {
+    uint64_t cur = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    while (value > cur && !__atomic_compare_exchange_n(slot, &cur, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* cur reloaded by the failed CAS */
+    }
+}
+
+uint64_t lockstat_acquire(pthread_mutex_t *mtx, LockStat *st) {
+    uint64_t start = monotonic_ns();
+    pthread_mutex_lock(mtx);
+    uint64_t got = monotonic_ns();
+    __atomic_fetch_add(&st->wait_ns_total, got - start, __ATOMIC_RELAXED);
+    atomic_max(&st->wait_ns_max, got - start);
+    return got;
+}
+
+void lockstat_release(pthread_mutex_t *mtx, LockStat *st, uint64_t held_since) {
+    uint64_t held = monotonic_ns() - held_since;
+    __atomic_fetch_add(&st->acquisitions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->hold_ns_total, held, __ATOMIC_RELAXED);
+    atomic_max(&st->hold_ns_max, held);
+    pthread_mutex_unlock(mtx);
+}
+
+void lockstat_reset(LockStat *st) {
+    __atomic_store_n(&st->acquisitions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->wait_ns_total, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->wait_ns_max, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->hold_ns_total, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->hold_ns_max, 0, __ATOMIC_RELAXED);
+}
+
+int lockstat_format(const LockStat *st, char *buf, size_t sz) {
+    uint64_t n = __atomic_load_n(&st->acquisitions, __ATOMIC_RELAXED);
+    uint64_t wait = __atomic_load_n(&st->wait_ns_total, __ATOMIC_RELAXED);
+    uint64_t hold = __atomic_load_n(&st->hold_ns_total, __ATOMIC_RELAXED);
+    return snprintf(buf, sz, "%-16s acq=%llu wait_avg=%.1fus wait_max=%.1fus hold_avg=%.1fus hold_max=%.1fus",
+                    st->name, (unsigned long long)n,
+                    n ? wait / 1000.0 / n : 0.0, __atomic_load_n(&st->wait_ns_max, __ATOMIC_RELAXED) / 1000.0,
+                    n ? hold / 1000.0 / n : 0.0, __atomic_load_n(&st->hold_ns_max, __ATOMIC_RELAXED) / 1000.0);
+}
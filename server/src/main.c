@@ -17,6 +17,20 @@
 #include "match.h"
 #include "game.h"
 #include "logging.h"
+#include "admin.h"
+#include "capture.h"
+#include "journal.h"
+#include "handoff.h"
+#include "snapshot.h"
+#include "replica.h"
+#include "archive.h"
+#include "profiles.h"
+#include "matchmaker.h"
+#include "tournament.h"
+#include "rtt.h"
+#include "clocksync.h"
+#include "netio.h"
+#include "faults.h"
 #include "config.h"
 
 #define BACKLOG 10
@@ -30,16 +44,39 @@ int max_players = -1;
  *
  * Steps:
  * 1. Initializes logging subsystem.
- * 2. Parses command line arguments for IP, Port, and Limits.
- * 3. Binds and listens on the TCP socket.
- * 4. Enters an infinite loop to accept incoming connections.
- * 5. Spawns a dedicated thread for each client.
+ * 2. Parses command line arguments for IP, Port, Limits, admin console port, capture file,
+ *    journal file, snapshot file and interval, game archive, player profiles, hot restart sockets,
+ *    replication, round-trip probes and lag compensation, the clock sync interval, and (in
+ *    FAULTS=1 builds) the fault injection schedule.
+ * 3. As a standby (standby=), mirrors the primary until it is gone, then carries on
+ *    as the primary with the replicated matches.
+ * 4. Binds and listens on the TCP socket, or takes it and all live sessions over
+ *    from a running server (takeover=).
+ * 5. Restores the games still running in the journal, or else in the snapshot.
+ * 6. Starts the matchmaking queue and the tournament driver, and the loopback admin console,
+ *    replication, snapshots, the clock sync stream and the handoff listener if requested.
+ * 7. Enters an infinite loop to accept incoming connections.
+ * 8. Spawns a dedicated thread for each client.
  */
 int main(int argc, char *argv[]) {
     init_logging();
     struct in_addr bind_addr;
     bind_addr.s_addr = htonl(INADDR_ANY);
     int port = DEFAULT_PORT;
+    int admin_port = 0;
+    const char *capture_path = NULL;
+    const char *fault_spec = NULL;
+    const char *journal_path = NULL;
+    const char *handoff_path = NULL;
+    const char *takeover_path = NULL;
+    const char *snapshot_path = NULL;
+    int snapshot_interval = SNAPSHOT_INTERVAL_SECONDS;
+    int replica_port = 0;
+    const char *standby_of = NULL;
+    const char *archive_dir = NULL;
+    const char *profiles_path = NULL;
+    unsigned rtt_interval = 0, lagcomp = 0, clocksync_interval = 0;
+    uint32_t next_conn_id = 0;
 
     /* Parse Command Line Arguments */
     for (int i = 1; i < argc; i++) {
@@ -52,54 +89,95 @@ int main(int argc, char *argv[]) {
         else if (strncmp(argv[i], "port=", 5) == 0) port = atoi(argv[i] + 5);
         else if (strncmp(argv[i], "rooms=", 6) == 0) max_rooms = atoi(argv[i] + 6);
         else if (strncmp(argv[i], "players=", 8) == 0) max_players = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "admin=", 6) == 0) admin_port = atoi(argv[i] + 6);
+        else if (strncmp(argv[i], "capture=", 8) == 0) capture_path = argv[i] + 8;
+        else if (strncmp(argv[i], "faults=", 7) == 0) fault_spec = argv[i] + 7;
+        else if (strncmp(argv[i], "journal=", 8) == 0) journal_path = argv[i] + 8;
+        else if (strncmp(argv[i], "handoff=", 8) == 0) handoff_path = argv[i] + 8;
+        else if (strncmp(argv[i], "takeover=", 9) == 0) takeover_path = argv[i] + 9;
+        else if (strncmp(argv[i], "snapshot=", 9) == 0) snapshot_path = argv[i] + 9;
+        else if (strncmp(argv[i], "snapshot_interval=", 18) == 0) snapshot_interval = atoi(argv[i] + 18);
+        else if (strncmp(argv[i], "replica=", 8) == 0) replica_port = atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "standby=", 8) == 0) standby_of = argv[i] + 8;
+        else if (strncmp(argv[i], "archive=", 8) == 0) archive_dir = argv[i] + 8;
+        else if (strncmp(argv[i], "profiles=", 9) == 0) profiles_path = argv[i] + 9;
+        else if (strncmp(argv[i], "rtt=", 4) == 0) rtt_interval = (unsigned)atoi(argv[i] + 4);
+        else if (strncmp(argv[i], "lagcomp=", 8) == 0) lagcomp = (unsigned)atoi(argv[i] + 8);
+        else if (strncmp(argv[i], "clocksync=", 10) == 0) clocksync_interval = (unsigned)atoi(argv[i] + 10);
     }
-    
-    /* Socket Setup */
-    int srv = socket(AF_INET, SOCK_STREAM, 0);
-    int opt = 1;
-    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (rtt_configure(rtt_interval, lagcomp) != 0) log_printf("Round-trip probes unavailable (interval at least %d ms)\n", RTT_MIN_INTERVAL_MS);
+    else if (lagcomp && !rtt_interval) log_printf("lagcomp= has no effect without round-trip probes (rtt=)\n");
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    addr.sin_addr = bind_addr;
+    /* Hot Standby (returns once the primary is gone and this process took over) */
+    if (standby_of && replica_follow(standby_of) != 0) { log_printf("Invalid standby address %s (expected host:port)\n", standby_of); return 1; }
 
-    if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) < 0) return 1;
-    if (listen(srv, BACKLOG) < 0) return 1;
+    /* Socket Setup (inherited together with the live sessions on takeover) */
+    int srv;
+    if (takeover_path) {
+        srv = handoff_takeover(takeover_path, &next_conn_id);
+        if (srv < 0) return 1;
+    } else {
+        srv = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr = bind_addr;
+
+        if (bind(srv, (struct sockaddr *)&addr, sizeof(addr)) < 0) return 1;
+        if (listen(srv, BACKLOG) < 0) return 1;
+    }
+
+    /* Crash Recovery (before any client is served) */
+    if (journal_path && journal_open(journal_path) < 0) { log_printf("Cannot use journal %s\n", journal_path); return 1; }
+    else if (!journal_path && !takeover_path && snapshot_path && snapshot_load(snapshot_path) < 0) { log_printf("Cannot use snapshot %s\n", snapshot_path); return 1; }
+    if (takeover_path) handoff_start_sessions();
 
     log_printf("Server listening on port %d - Max Rooms: %d, Max Players: %d (-1: unlimited)\n", port, max_rooms, max_players);
+    if (admin_port > 0 && admin_start(admin_port) != 0) log_printf("Admin console unavailable on port %d\n", admin_port);
+    if (capture_path && capture_open(capture_path) != 0) log_printf("Cannot open capture file %s\n", capture_path);
+    if (archive_dir && archive_open(archive_dir) != 0) log_printf("Cannot open game archive %s\n", archive_dir);
+    if (profiles_path && profiles_open(profiles_path) != 0) log_printf("Cannot open player profiles %s\n", profiles_path);
+    if (matchmaker_start() != 0) log_printf("Matchmaking unavailable\n");
+    if (tourney_start() != 0) log_printf("Tournaments unavailable\n");
+    if (clocksync_interval && clocksync_start(clocksync_interval) != 0) log_printf("Clock sync unavailable (interval at least %d ms)\n", CLOCKSYNC_MIN_INTERVAL_MS);
+    if (replica_port > 0 && replica_start(bind_addr, replica_port) != 0) log_printf("Replication unavailable on port %d\n", replica_port);
+    if (snapshot_path && snapshot_start(snapshot_path, snapshot_interval) != 0) log_printf("Cannot start snapshots to %s\n", snapshot_path);
+    if (handoff_path && handoff_listen(handoff_path, srv, &next_conn_id) != 0) log_printf("Hot restart unavailable on %s\n", handoff_path);
+#ifdef FAULT_INJECT
+    if (fault_spec && faults_install(fault_spec) != 0) { log_printf("Invalid fault schedule %s\n", fault_spec); return 1; }
+#else
+    if (fault_spec) log_printf("Built without FAULT_INJECT (make FAULTS=1), ignoring faults=%s\n", fault_spec);
+#endif
 
     /* Connection Acceptance Loop */
     while (1) {
+        handoff_checkpoint();
         struct sockaddr_in cliaddr;
         socklen_t clilen = sizeof(cliaddr);
         int csock = accept(srv, (struct sockaddr *)&cliaddr, &clilen);
         if (csock < 0) continue;
 
-        /* Allocate Client Structure */
-        Client *c = calloc(1, sizeof(Client));
+        /* Allocate and Initialize Client State */
+        Client *c = client_create(csock, ++next_conn_id);
         if (!c) { close(csock); continue; }
 
-        /* Initialize Client State */
-        c->sock = csock;
-        c->color = -1;
-        c->paired = 0;
-        c->match = NULL;
-        c->error_count = 0;
-        c->is_counted = 0;
-        c->state = STATE_HANDSHAKE;
-        pthread_mutex_init(&c->lock, NULL);
-
         char addrbuf[ADDR_LEN];
         inet_ntop(AF_INET, &cliaddr.sin_addr, addrbuf, sizeof(addrbuf));
         snprintf(c->client_addr, sizeof(c->client_addr), "%s:%u", addrbuf, ntohs(cliaddr.sin_port));
 
+        capture_conn_open(c->conn_id);
+
         /* Spawn Worker Thread */
-        pthread_t tid;
-        if (pthread_create(&tid, NULL, client_worker, c) != 0) { close(csock); free(c); }
-        else pthread_detach(tid);
+        if (client_start(c) != 0) { capture_conn_close(c->conn_id); close(csock); pthread_mutex_destroy(&c->lock); free(c); }
     }
+    capture_close();
+    journal_close();
+    archive_close();
+    profiles_close();
     close_logging();
     return 0;
 }
\ No newline at end of file
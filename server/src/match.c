@@ -4,6 +4,12 @@
  *
  * This file handles creation and destruction of matches, player joining, and the
  * "Watchdog" thread which enforces time limits and handles disconnection grace periods.
+ *
+ * Clocks count milliseconds on io_mono_ms(). Only the side to move has a
+ * running clock; clock_ms[] holds what each side had left when its clock last
+ * stopped, so the time left is computed on demand and nothing ticks. The
+ * watchdog sleeps exactly until the next flag that can fall (see
+ * match_watchdog_tick()) instead of polling once a second.
  */
 
 #include <stdio.h>
@@ -18,7 +24,18 @@
 #include "client.h"
 #include "game.h"
 #include "logging.h"
+#include "lockstat.h"
+#include "netio.h"
+#include "journal.h"
+#include "replica.h"
+#include "archive.h"
+#include "profiles.h"
+#include "handoff.h"
+#include "spectate.h"
+#include "rtt.h"
+#include "retransmit.h"
 #include "config.h"
+#include "stats.h"
 
 extern int max_rooms;
 
@@ -28,38 +45,151 @@ static int next_room_id = 1;
 static int current_room_count = 0;
 static pthread_mutex_t room_registry_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Lock accounting for the paths that degrade first under reconnect storms */
+static LockStat registry_stat = LOCKSTAT_INIT("registry");
+static LockStat reconnect_stat = LOCKSTAT_INIT("match.reconnect");
+static LockStat resume_stat = LOCKSTAT_INIT("match.resume");
+static LockStat watchdog_stat = LOCKSTAT_INIT("match.watchdog");
+static uint64_t registry_held_since; /* Only written while holding room_registry_lock */
+
+/* Reconnection counters (updated atomically) */
+static uint64_t stat_reconnect_lookups = 0;
+static uint64_t stat_reconnect_hits = 0;
+static uint64_t stat_resumes = 0;
+static uint64_t stat_pauses = 0;
+static uint64_t stat_dc_forfeits = 0;
+static uint64_t stat_rematches = 0;
+
+static void registry_lock(void) {
+    registry_held_since = lockstat_acquire(&room_registry_lock, &registry_stat);
+}
+
+static void registry_unlock(void) {
+    lockstat_release(&room_registry_lock, &registry_stat, registry_held_since);
+}
+
 /**
  * @brief Returns the current number of active rooms in a thread-safe manner.
  */
 int get_active_room_count(void) {
     int count;
 
-    pthread_mutex_lock(&room_registry_lock);
+    registry_lock();
     count = current_room_count;
-    pthread_mutex_unlock(&room_registry_lock);
+    registry_unlock();
 
     return count;
 }
 
 /**
  * @brief Adds a match to the global registry list.
+ * The room is journaled before it becomes visible, so its creation always
+ * precedes any join in the journal.
  */
 void register_room(Match *m) {
-    pthread_mutex_lock(&room_registry_lock);
+    registry_lock();
 
     m->id = next_room_id++;
+    journal_create(m);
+    replica_create(m);
+    m->next = global_room_list;
+    global_room_list = m;
+    current_room_count++;
+
+    registry_unlock();
+}
+
+/**
+ * @brief Makes sure newly created rooms get ids of at least next_id
+ * (ids restored from a journal are never handed out again).
+ */
+void match_reserve_room_ids(int next_id) {
+    registry_lock();
+    if (next_room_id < next_id) next_room_id = next_id;
+    registry_unlock();
+}
+
+/**
+ * @brief Returns the id the next created room will get.
+ */
+int match_next_room_id(void) {
+    registry_lock();
+    int id = next_room_id;
+    registry_unlock();
+    return id;
+}
+
+/**
+ * @brief Adds a fully built match to the registry under its existing id.
+ * Does not journal it and does not start its watchdog.
+ */
+void match_insert(Match *m) {
+    registry_lock();
     m->next = global_room_list;
     global_room_list = m;
     current_room_count++;
+    if (next_room_id <= m->id) next_room_id = m->id + 1;
+    registry_unlock();
+}
+
+/**
+ * @brief Checks whether a room with the given id is registered.
+ */
+int match_exists(int id) {
+    registry_lock();
+    Match *curr = global_room_list;
+    while (curr && curr->id != id) curr = curr->next;
+    registry_unlock();
+    return curr != NULL;
+}
+
+/**
+ * @brief Calls fn for every registered match, holding the registry lock
+ * throughout and the match's lock during each call.
+ */
+void match_foreach(void (*fn)(Match *m, void *arg), void *arg) {
+    registry_lock();
+    for (Match *curr = global_room_list; curr; curr = curr->next) {
+        pthread_mutex_lock(&curr->lock);
+        fn(curr, arg);
+        pthread_mutex_unlock(&curr->lock);
+    }
+    registry_unlock();
+}
+
+/**
+ * @brief Locks the registry and every registered match, freezing all match state.
+ * Nothing else ever holds two match locks, so taking them in list order is safe.
+ * @return Number of registered matches.
+ */
+int match_lock_all(void) {
+    int n = 0;
+    registry_lock();
+    for (Match *curr = global_room_list; curr; curr = curr->next, n++) pthread_mutex_lock(&curr->lock);
+    return n;
+}
+
+/**
+ * @brief Releases what match_lock_all() took.
+ */
+void match_unlock_all(void) {
+    for (Match *curr = global_room_list; curr; curr = curr->next) pthread_mutex_unlock(&curr->lock);
+    registry_unlock();
+}
 
-    pthread_mutex_unlock(&room_registry_lock);
+/**
+ * @brief Calls fn for every registered match without locking anything.
+ * Only for callers that hold match_lock_all(), or a forked copy of such a caller.
+ */
+void match_foreach_held(void (*fn)(Match *m, void *arg), void *arg) {
+    for (Match *curr = global_room_list; curr; curr = curr->next) fn(curr, arg);
 }
 
 /**
  * @brief Removes a match from the global registry list.
  */
 void unregister_room(Match *m) {
-    pthread_mutex_lock(&room_registry_lock);
+    registry_lock();
 
     Match **curr = &global_room_list;
     while (*curr) {
@@ -71,7 +201,7 @@ void unregister_room(Match *m) {
         curr = &(*curr)->next;
     }
 
-    pthread_mutex_unlock(&room_registry_lock);
+    registry_unlock();
 }
 
 /**
@@ -101,6 +231,334 @@ void match_leave_by_client(Client *me) {
     if (last) match_free(m);
 }
 
+/* --- Clocks --- */
+
+static const TimeControl default_tc = { TC_PER_MOVE, TURN_TIMEOUT_SECONDS * 1000, 0 };
+
+/**
+ * @brief Parses a NEW time control: "<base>[+<inc>][B]" in seconds, e.g.
+ * "180+2" (Fischer) or "300+3B" (Bronstein delay). No increment is sudden death.
+ * @return 0 on success, -1 if malformed or out of range.
+ */
+int time_control_parse(const char *s, TimeControl *tc) {
+    char *end;
+    long base = strtol(s, &end, 10), inc = 0;
+    if (end == s || base < 1 || base > CLOCK_MAX_BASE_SECONDS) return -1;
+    if (*end == '+') {
+        const char *p = end + 1;
+        inc = strtol(p, &end, 10);
+        if (end == p || inc < 0 || inc > CLOCK_MAX_INCREMENT_SECONDS) return -1;
+    }
+    tc->mode = TC_FISCHER;
+    if (*end == 'B' || *end == 'b') { tc->mode = TC_BRONSTEIN; end++; }
+    if (*end != '\0') return -1;
+    tc->base_ms = (int)base * 1000;
+    tc->increment_ms = (int)inc * 1000;
+    return 0;
+}
+
+/**
+ * @brief Formats a time control as NEW takes it ("180+2", "300+3B"), or
+ * "180/mv" for a per-move budget.
+ * @return Number of characters written.
+ */
+int time_control_format(const TimeControl *tc, char *buf, size_t sz) {
+    if (tc->mode == TC_PER_MOVE) return snprintf(buf, sz, "%d/mv", tc->base_ms / 1000);
+    return snprintf(buf, sz, "%d+%d%s", tc->base_ms / 1000, tc->increment_ms / 1000,
+                    tc->mode == TC_BRONSTEIN ? "B" : "");
+}
+
+/**
+ * @brief Sets the time control (NULL for the default) and both clocks to its
+ * starting time, stopped. Caller must hold m->lock if the match is shared.
+ */
+void match_set_time_control(Match *m, const TimeControl *tc) {
+    m->tc = tc ? *tc : default_tc;
+    m->clock_ms[0] = m->clock_ms[1] = m->tc.base_ms;
+    m->clock_running = 0;
+}
+
+/**
+ * @brief Time left on a colour's clock right now, in ms (negative once flagged).
+ */
+int64_t match_clock_left(const Match *m, int color) {
+    int64_t left = m->clock_ms[color];
+    if (m->clock_running && color == m->turn) left -= (int64_t)(io_mono_ms() - m->turn_started_ms);
+    return left;
+}
+
+/**
+ * @brief Starts the clock of the side to move (game start, resume).
+ * Caller must hold m->lock.
+ */
+void match_clock_start(Match *m) {
+    if (m->clock_running) return;
+    m->turn_started_ms = io_mono_ms();
+    m->clock_running = 1;
+}
+
+/**
+ * @brief Stops the clock of the side to move (pause, end of game).
+ * Caller must hold m->lock.
+ */
+void match_clock_stop(Match *m) {
+    if (!m->clock_running) return;
+    m->clock_ms[m->turn] = match_clock_left(m, m->turn);
+    m->clock_running = 0;
+}
+
+/**
+ * @brief Ends the turn after a move: charges the mover the time used, adds
+ * its increment, passes the turn and starts the opponent's clock (unless the
+ * game is paused). Caller must hold m->lock.
+ */
+void match_clock_switch(Match *m) {
+    uint64_t now = io_mono_ms();
+    int64_t used = m->clock_running ? (int64_t)(now - m->turn_started_ms) : 0;
+    int64_t left = m->clock_ms[m->turn] - used;
+    if (m->tc.mode == TC_FISCHER) left += m->tc.increment_ms;
+    else if (m->tc.mode == TC_BRONSTEIN) left += (used < m->tc.increment_ms) ? used : m->tc.increment_ms;
+    m->clock_ms[m->turn] = left;
+    m->turn = 1 - m->turn;
+    if (m->tc.mode == TC_PER_MOVE) m->clock_ms[m->turn] = m->tc.base_ms;
+    m->turn_started_ms = now;
+}
+
+/**
+ * @brief Gives the side to move back up to ms of the time used this turn
+ * (network delay of its move, see rtt.h). Caller must hold m->lock.
+ */
+void match_clock_credit(Match *m, unsigned ms) {
+    if (!m->clock_running || ms == 0) return;
+    uint64_t used = io_mono_ms() - m->turn_started_ms;
+    if (ms > used) ms = (unsigned)used;
+    m->turn_started_ms += ms;
+    rtt_count_credit(ms);
+}
+
+/**
+ * @brief Lag credit of the side to move (see rtt.h).
+ */
+static unsigned mover_grace_ms(const Match *m) {
+    return rtt_lag_credit_ms(m->turn == 0 ? m->white : m->black);
+}
+
+/**
+ * @brief Whether the side to move has run out of time, including the lag
+ * credit its move would still get.
+ */
+int match_clock_flagged(const Match *m) {
+    return m->clock_running && match_clock_left(m, m->turn) + mover_grace_ms(m) <= 0;
+}
+
+/**
+ * @brief Sends the clocks to a player: TIME (whole seconds left for the side
+ * to move) and, in rooms with per-side clocks, CLK with both in ms.
+ * Caller must hold m->lock.
+ */
+void match_send_clock(Match *m, Client *c) {
+    if (!c || c->sock <= 0) return;
+    send_protocol_msg(c, TURN_TIMER_STATE, match_get_remaining_time(m));
+    if (m->tc.mode != TC_PER_MOVE) {
+        int64_t w = match_clock_left(m, 0), b = match_clock_left(m, 1);
+        send_protocol_msg(c, CLOCK_STATE, (long long)(w < 0 ? 0 : w), (long long)(b < 0 ? 0 : b));
+    }
+}
+
+/* --- Rematch --- */
+
+/**
+ * @brief Whether the players of a finished match can still agree on a rematch:
+ * the window is open and each colour is still in the game or in a seat.
+ * Caller must hold m->lock.
+ */
+static int rematch_open(const Match *m) {
+    return m->finished && m->rematch_until != 0 && io_time() <= m->rematch_until
+        && (m->white || m->rematch_seat[0]) && (m->black || m->rematch_seat[1]);
+}
+
+static int seat_of(const Match *m, const Client *me) {
+    if (m->rematch_seat[0] == me) return 0;
+    if (m->rematch_seat[1] == me) return 1;
+    return -1;
+}
+
+/**
+ * @brief Leaves a finished match on the way back to the lobby. While the
+ * rematch window is open the player keeps its reference as a rematch seat
+ * (me->rematch) instead of dropping it, so the room can be played again.
+ */
+void match_leave_after_game(Client *me) {
+    if (!me || !me->match) return;
+    Match *m = me->match;
+
+    pthread_mutex_lock(&m->lock);
+    int color = (m->white == me) ? 0 : (m->black == me) ? 1 : -1;
+    int keep = color >= 0 && rematch_open(m);
+    if (color == 0) m->white = NULL;
+    else if (color == 1) m->black = NULL;
+    if (keep) m->rematch_seat[color] = me;
+    else if (m->refs > 0) m->refs--;
+    int last = (m->refs <= 0);
+    pthread_mutex_unlock(&m->lock);
+
+    me->match = NULL;
+    me->paired = 0;
+    me->color = -1;
+    me->rematch = keep ? m : NULL;
+    if (last) match_free(m);
+}
+
+/**
+ * @brief Starts the next game of a room in place: same Match, watchdog,
+ * registry entry and move array, colours swapped. Caller must hold m->lock.
+ */
+static void rematch_start(Match *m, Client *white, Client *black) {
+    for (size_t i = 0; i < m->moves_count; ++i) free(m->moves[i]);
+    m->moves_count = 0;
+
+    init_board(&m->state);
+    m->turn = 0;
+    m->w_can_kingside = 1; m->w_can_queenside = 1;
+    m->b_can_kingside = 1; m->b_can_queenside = 1;
+    m->ep_r = -1; m->ep_c = -1;
+    m->draw_offered_by = -1;
+    m->premove[0] = '\0';
+    m->finished = 0;
+    m->winner = -1;
+    m->end_reason = END_NONE;
+    m->is_paused = 0;
+    match_set_time_control(m, &m->tc);
+    m->rematch_seat[0] = m->rematch_seat[1] = NULL;
+    m->rematch_want[0] = m->rematch_want[1] = 0;
+    m->rematch_until = 0;
+
+    /* The seats' references become the players' */
+    m->white = white; m->black = black;
+    white->match = m; white->color = 0;
+    black->match = m; black->color = 1;
+    match_clock_start(m);
+    m->started_at = io_time();
+    journal_create(m);
+    journal_join(m);
+    replica_create(m);
+    replica_join(m);
+    white->paired = 1; black->paired = 1;
+    spectate_restart(m);
+    STAT_INC(stat_rematches);
+}
+
+/**
+ * @brief REMATCH from a player holding a rematch seat. The first player to ask
+ * waits for the other (who is told with REMATCH_OFFERED); the second starts the game.
+ * @return 1 if the game started (caller sends START), 0 if the player now waits
+ * for the opponent (REMATCH_WAIT already sent), -1 if no rematch is possible any more (the seat is dropped).
+ */
+int match_request_rematch(Client *me) {
+    Match *m = me ? me->rematch : NULL;
+    if (!m) return -1;
+
+    pthread_mutex_lock(&m->lock);
+    int color = seat_of(m, me);
+    if (color < 0 || !rematch_open(m)) {
+        pthread_mutex_unlock(&m->lock);
+        match_drop_rematch(me);
+        return -1;
+    }
+    Client *opp = m->rematch_seat[1 - color] ? m->rematch_seat[1 - color] : (color == 0 ? m->black : m->white);
+    if (!m->rematch_want[1 - color]) {
+        m->rematch_want[color] = 1;
+        /* Sent under the lock so it cannot overtake the START of an accepted rematch */
+        send_protocol_msg(me, REMATCH_WAIT);
+        if (opp) send_protocol_msg(opp, REMATCH_OFFERED);
+        pthread_mutex_unlock(&m->lock);
+        return 0;
+    }
+    if (color == 0) rematch_start(m, opp, me);
+    else rematch_start(m, me, opp);
+    log_printf("[MATCH] Room %d rematch: %s (white) vs %s (black).\n", m->id, m->white->name, m->black->name);
+    pthread_mutex_unlock(&m->lock);
+    me->rematch = NULL;
+    return 1;
+}
+
+/**
+ * @brief For a player waiting on REMATCH: whether to keep waiting.
+ * @return 1 while the opponent may still accept (or once the game has started,
+ * which the caller sees through me->paired), 0 once the rematch is off.
+ */
+int match_rematch_pending(Client *me) {
+    Match *m = me ? me->rematch : NULL;
+    if (!m) return 0;
+    pthread_mutex_lock(&m->lock);
+    int pending = seat_of(m, me) < 0 || rematch_open(m);
+    pthread_mutex_unlock(&m->lock);
+    return pending;
+}
+
+/**
+ * @brief Gives up the player's rematch seat (any other lobby action, exit or
+ * disconnect). This closes the window for the opponent too.
+ * @return 1 if the rematch had already started (the player is in the game), 0 otherwise.
+ */
+int match_drop_rematch(Client *me) {
+    Match *m = me ? me->rematch : NULL;
+    if (!m) return 0;
+
+    pthread_mutex_lock(&m->lock);
+    int color = seat_of(m, me);
+    if (color < 0) {
+        /* The opponent started the game: our reference is the player's now */
+        pthread_mutex_unlock(&m->lock);
+        me->rematch = NULL;
+        return 1;
+    }
+    m->rematch_seat[color] = NULL;
+    m->rematch_want[color] = 0;
+    m->rematch_until = 0;
+    if (m->refs > 0) m->refs--;
+    int last = (m->refs <= 0);
+    pthread_mutex_unlock(&m->lock);
+
+    me->rematch = NULL;
+    if (last) match_free(m);
+    return 0;
+}
+
+/**
+ * @brief Number of references held by rematch seats (not handed over on a hot restart).
+ */
+int match_rematch_refs(const Match *m) {
+    return (m->rematch_seat[0] != NULL) + (m->rematch_seat[1] != NULL);
+}
+
+/**
+ * @brief Seats black in m. Caller must hold m->lock.
+ * @return 0 on success, -1 if the room is full or over.
+ */
+static int join_locked(Match *m, Client *black) {
+    if (m->black != NULL || m->finished) return -1;
+    m->black = black;
+    black->match = m;
+    match_clock_start(m);
+    m->started_at = io_time();
+    journal_join(m);
+    replica_join(m);
+    return 0;
+}
+
+/**
+ * @brief Joins a match the caller already holds a pointer to (as the black player).
+ * @return 0 on success, -1 if the room is full or over.
+ */
+int match_join(Match *m, Client *black) {
+    pthread_mutex_lock(&m->lock);
+    int rc = join_locked(m, black);
+    if (rc == 0) m->refs++;
+    pthread_mutex_unlock(&m->lock);
+    return rc;
+}
+
 /**
  * @brief Attempts to join a match by its ID (as the black player).
  * @param id The Room ID to join.
@@ -108,7 +566,7 @@ void match_leave_by_client(Client *me) {
  * @return 0 on success, -1 if room not found or full.
  */
 int match_join_by_id(int id, Client *black) {
-    pthread_mutex_lock(&room_registry_lock);
+    registry_lock();
     Match *curr = global_room_list;
     Match *target = NULL;
 
@@ -117,32 +575,42 @@ int match_join_by_id(int id, Client *black) {
         curr = curr->next;
     }
 
-    pthread_mutex_unlock(&room_registry_lock);
+    registry_unlock();
 
     if (!target) return -1; 
 
     pthread_mutex_lock(&target->lock);
-    if (target->black != NULL || target->finished) {
+    if (join_locked(target, black) != 0) {
         target->refs--;
         pthread_mutex_unlock(&target->lock);
         return -1; 
     }
-    target->black = black;
-    black->match = target; 
-    target->last_move_time = time(NULL);
     pthread_mutex_unlock(&target->lock);
     return 0;
 }
 
+/**
+ * @brief Finds a match by room ID and locks it.
+ * @return The match with m->lock held, or NULL if there is no such room.
+ */
+Match *match_lock_by_id(int id) {
+    registry_lock();
+    Match *m = global_room_list;
+    while (m && m->id != id) m = m->next;
+    if (m) pthread_mutex_lock(&m->lock);
+    registry_unlock();
+    return m;
+}
+
 /**
  * @brief Generates a string listing all available (open) rooms.
  * @return A dynamically allocated string containing the list. Caller must free.
  */
 char *get_room_list_str() {
-    pthread_mutex_lock(&room_registry_lock);
+    registry_lock();
 
     char *buf = malloc(BIG_BUFFER_SZ);
-    if (!buf) { pthread_mutex_unlock(&room_registry_lock); return NULL; }
+    if (!buf) { registry_unlock(); return NULL; }
 
     char *ptr = buf;
     char *end = buf + BIG_BUFFER_SZ;
@@ -155,7 +623,9 @@ char *get_room_list_str() {
         if (curr->black == NULL && !curr->finished) {
             int remaining = end - ptr;
             if (remaining > 1) {
-                int written = snprintf(ptr, remaining, "%d:%s ", curr->id, curr->white->name);
+                char tc[32] = "";
+                if (curr->tc.mode != TC_PER_MOVE) { tc[0] = ':'; time_control_format(&curr->tc, tc + 1, sizeof(tc) - 1); }
+                int written = snprintf(ptr, remaining, "%d:%s%s ", curr->id, curr->white->name, tc);
                 if (written > 0 && written < remaining) ptr += written;
             }
             count++;
@@ -165,7 +635,7 @@ char *get_room_list_str() {
     }
 
     if (count == 0) snprintf(buf, BIG_BUFFER_SZ, "EMPTY");
-    pthread_mutex_unlock(&room_registry_lock);
+    registry_unlock();
     return buf;
 }
 
@@ -173,9 +643,10 @@ char *get_room_list_str() {
  * @brief Creates a new match hosted by the given client.
  * Starts the watchdog thread for the match.
  * @param white The hosting client.
+ * @param tc Time control, NULL for the default per-move budget.
  * @return Pointer to the new Match, or NULL on failure.
  */
-Match *match_create(Client *white) {
+Match *match_create(Client *white, const TimeControl *tc) {
     Match *m = calloc(1, sizeof(Match));
     if (!m) return NULL;
 
@@ -188,6 +659,8 @@ Match *match_create(Client *white) {
     m->moves = NULL;
     m->moves_count = 0;
     m->finished = 0;   
+    m->winner = -1;
+    m->end_reason = END_NONE;
     m->draw_offered_by = -1;
     m->w_can_kingside = 1;
     m->w_can_queenside = 1;
@@ -197,18 +670,237 @@ Match *match_create(Client *white) {
     m->ep_c = -1;
 
     init_board(&m->state); 
-    m->last_move_time = 0;
-    m->turn_timeout_seconds = TURN_TIMEOUT_SECONDS;
-    m->elapsed_at_pause = 0;
+    match_set_time_control(m, tc);
     m->is_paused = 0;
     m->refs = 2;
 
     register_room(m);
 
-    pthread_t wt;
-    if (pthread_create(&wt, NULL, match_watchdog, m) == 0) pthread_detach(wt);
-    else m->refs = 1; 
+    if (io_spawn(match_watchdog, m) != 0) m->refs = 1; 
+
+    return m;
+}
+
+/**
+ * @brief Creates n started games at once (white[i] against black[i]), e.g. a
+ * tournament round.
+ *
+ * Unlike match_create() followed by a join, the registry lock is taken once
+ * for the whole batch and no watchdog thread is started: each match keeps the
+ * watchdog reference for the caller, who must call match_watchdog_tick() on it
+ * again after at most the wait it reports, until it returns 1. Sets match and colour on both players; the
+ * caller marks them paired and sends START.
+ * @return Number of matches created (out[0..n-1]); fewer than n only if memory runs out.
+ */
+size_t match_create_batch(Client *const *white, Client *const *black, size_t n, Match **out) {
+    size_t made = 0;
+    time_t now = io_time();
+    for (; made < n; made++) {
+        Match *m = match_alloc(0);
+        if (!m) break;
+        m->white = white[made]; m->black = black[made];
+        m->white->match = m; m->white->color = 0;
+        m->black->match = m; m->black->color = 1;
+        match_clock_start(m);
+        m->started_at = now;
+        m->refs = 3;
+        m->shared_watchdog = 1;
+        out[made] = m;
+    }
+
+    registry_lock();
+    for (size_t i = 0; i < made; i++) {
+        Match *m = out[i];
+        m->id = next_room_id++;
+        journal_create(m);
+        journal_join(m);
+        replica_create(m);
+        replica_join(m);
+        m->next = global_room_list;
+        global_room_list = m;
+    }
+    current_room_count += (int)made;
+    registry_unlock();
+    return made;
+}
+
+/**
+ * @brief Short name of how a game ended (archive listings, spectators).
+ */
+const char *end_reason_name(EndReason reason) {
+    static const char *names[] = {
+        "none", "checkmate", "stalemate", "resign", "draw_agreed",
+        "timeout", "abandon", "disconnect", "kicked", "cancelled"
+    };
+    return (unsigned)reason <= END_CANCELLED ? names[reason] : "unknown";
+}
+
+/**
+ * @brief Ends the game: records the result and journals the end.
+ * Caller must hold m->lock. Later calls keep the first result.
+ * @param winner 0 White, 1 Black, -1 draw or no result.
+ */
+void match_finish(Match *m, int winner, EndReason reason) {
+    if (m->finished) return;
+    match_clock_stop(m);
+    m->finished = 1;
+    m->premove[0] = '\0';
+    m->winner = winner;
+    m->end_reason = reason;
+    journal_end(m);
+    replica_end(m);
+    archive_match(m);
+    profiles_record_game(m);
+    spectate_event(m, WATCH_END, winner == 0 ? "1-0" : winner == 1 ? "0-1" : reason == END_CANCELLED ? "*" : "1/2-1/2",
+                   end_reason_name(reason));
+    /* Games between two players can be played again in the same room (which needs its own watchdog) */
+    if (!m->shared_watchdog && m->white && m->black && m->started_at && reason != END_CANCELLED && reason != END_DISCONNECT && reason != END_KICKED)
+        m->rematch_until = io_time() + REMATCH_WINDOW_SECONDS;
+}
+
+/**
+ * @brief Appends a move to the in-memory history only.
+ */
+static int history_push(Match *m, const char *mv) {
+    if (m->moves_count + 1 > m->moves_cap) {
+        size_t newcap = (m->moves_cap == 0) ? 8 : m->moves_cap * 2;
+        char **tmp = realloc(m->moves, newcap * sizeof(char *));
+        if (!tmp) return -1;
+        m->moves = tmp; m->moves_cap = newcap;
+    }
+
+    m->moves[m->moves_count++] = strdup(mv);
+    return 0;
+}
+
+/**
+ * @brief Creates a disconnected player session for a restored match.
+ */
+static Client *restore_client(Match *m, const char *name, const char *id, int color) {
+    Client *c = client_create(-1, 0);
+    if (!c) return NULL;
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    snprintf(c->id, sizeof(c->id), "%s", id);
+    c->match = m;
+    c->color = color;
+    c->state = STATE_DISCONNECTED;
+    c->disconnect_time = io_time();
+    c->is_counted = 1;
+    increment_player_count();
+    return c;
+}
+
+/**
+ * @brief Frees a restored session that never joined the registry.
+ */
+static void discard_restored_client(Client *c) {
+    if (!c) return;
+    decrement_player_count();
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+/**
+ * @brief Allocates an unregistered match in the initial position.
+ * @return The match, or NULL on allocation failure.
+ */
+Match *match_alloc(int id) {
+    Match *m = calloc(1, sizeof(Match));
+    if (!m) return NULL;
+
+    pthread_mutex_init(&m->lock, NULL);
+    m->id = id;
+    m->winner = -1;
+    m->end_reason = END_NONE;
+    m->draw_offered_by = -1;
+    m->w_can_kingside = 1; m->w_can_queenside = 1;
+    m->b_can_kingside = 1; m->b_can_queenside = 1;
+    m->ep_r = -1; m->ep_c = -1;
+    init_board(&m->state);
+    match_set_time_control(m, NULL);
+    return m;
+}
+
+/**
+ * @brief Applies a recorded move through the rules engine and appends it to the history.
+ * @return 0 on success, -1 if the move is malformed or not legal in the current position.
+ */
+int match_replay_move(Match *m, const char *mv) {
+    int r1, c1, r2, c2;
+    if (!is_move_format(mv)) return -1;
+    parse_move(mv, &r1, &c1, &r2, &c2);
+    if (!is_legal_move_basic(m, m->turn, r1, c1, r2, c2) || move_leaves_in_check(m, m->turn, r1, c1, r2, c2)) return -1;
+    apply_move(m, r1, c1, r2, c2, (strlen(mv) >= 5) ? mv[4] : 0);
+    if (history_push(m, mv) != 0) return -1;
+    m->turn = 1 - m->turn;
+    return 0;
+}
+
+/**
+ * @brief Rebuilds a live match (e.g. from the journal) under its original id.
+ *
+ * The moves are replayed through the rules engine; replay stops at the first
+ * move that is not legal in the rebuilt position. Both players start out
+ * disconnected, so they resume through match_reconnect() with their HELLO name
+ * and id and get the usual DISCONNECT_TIMEOUT_SECONDS to do so. A paired match
+ * stays paused until both are back and the current turn starts over.
+ *
+ * @param black_name NULL for a room still waiting for its opponent.
+ * @param tc Time control, NULL for the default.
+ * @param clock_ms Time left per colour, NULL for the starting time.
+ * @return The registered match, or NULL on allocation failure.
+ */
+Match *match_restore(int id, const char *white_name, const char *white_id,
+                     const char *black_name, const char *black_id,
+                     char *const *moves, size_t moves_count,
+                     const TimeControl *tc, const int64_t *clock_ms) {
+    Match *m = match_alloc(id);
+    if (!m) return NULL;
+    match_set_time_control(m, tc);
+    if (clock_ms && black_name) { m->clock_ms[0] = clock_ms[0]; m->clock_ms[1] = clock_ms[1]; }
 
+    for (size_t i = 0; i < moves_count; i++) {
+        if (match_replay_move(m, moves[i]) != 0) {
+            log_printf("[MATCH] Restore of match %d stopped at illegal move %zu (%s).\n", id, i + 1, moves[i]);
+            break;
+        }
+    }
+
+    return match_adopt(m, white_name, white_id, black_name, black_id);
+}
+
+/**
+ * @brief Registers a rebuilt match (board, flags and history already set) under
+ * its id, with both players disconnected as described for match_restore().
+ * A paired match is paused with its clocks stopped; they run on from clock_ms.
+ * @return The registered match, or NULL on allocation failure (m is freed).
+ */
+Match *match_adopt(Match *m, const char *white_name, const char *white_id,
+                   const char *black_name, const char *black_id) {
+    int id = m->id;
+    m->white = restore_client(m, white_name, white_id, 0);
+    if (black_name) {
+        m->black = restore_client(m, black_name, black_id, 1);
+        if (m->black) { m->white->paired = 1; m->black->paired = 1; }
+        m->is_paused = 1;
+        if (!m->started_at) m->started_at = io_time(); /* Real start time is not recorded */
+    }
+    if (!m->white || (black_name && !m->black)) {
+        log_printf("[MATCH] Restore of match %d failed (out of memory).\n", id);
+        discard_restored_client(m->white);
+        discard_restored_client(m->black);
+        for (size_t i = 0; i < m->moves_count; i++) free(m->moves[i]);
+        free(m->moves);
+        pthread_mutex_destroy(&m->lock);
+        free(m);
+        return NULL;
+    }
+    m->refs = black_name ? 3 : 2;
+
+    match_insert(m);
+
+    if (io_spawn(match_watchdog, m) != 0) m->refs--;
+    log_printf("[MATCH] Restored match %d (%s vs %s, %zu moves).\n", id, white_name, black_name ? black_name : "-", m->moves_count);
     return m;
 }
 
@@ -220,12 +912,17 @@ void match_free(Match *m) {
     if (!m) return;
 
     unregister_room(m);
+    /* Out of the registry, so no spectator can join any more */
+    pthread_mutex_lock(&m->lock);
+    spectate_close(m);
+    pthread_mutex_unlock(&m->lock);
 
     for (size_t i = 0; i < m->moves_count; ++i) free(m->moves[i]);
     free(m->moves);
 
-    if (m->white && m->white->sock > 0) close(m->white->sock);
-    if (m->black && m->black->sock > 0) close(m->black->sock);
+    /* A board's socket belongs to its multiplexed connection */
+    if (m->white && m->white->sock > 0 && !m->white->mux) io_close(m->white->sock);
+    if (m->black && m->black->sock > 0 && !m->black->mux) io_close(m->black->sock);
 
     pthread_mutex_destroy(&m->lock);
     free(m);
@@ -256,11 +953,21 @@ int match_release_after_client(Client *me) {
     }
 
     log_printf("[MATCH] Client %p (%s) disconnected. Entering grace period.\n", me, me->name);
-    me->sock = -1; me->disconnect_time = time(NULL);
+    me->sock = -1; me->mux = NULL; me->disconnect_time = io_time();
+    replica_disconnect(m, (me == m->white) ? 0 : 1);
     pthread_mutex_unlock(&m->lock);
     return 1; 
 }
 
+/**
+ * @brief Whether a disconnected player can be taken back by name and ID.
+ * Boards of a multiplexed connection only come back on a multiplexed one.
+ */
+static int reconnectable(const Client *c, const char *name, const char *id, const Client *mux) {
+    return c && c->sock == -1 && (c->mux_tag != 0) == (mux != NULL)
+        && strcmp(c->name, name) == 0 && strcmp(c->id, id) == 0;
+}
+
 /**
  * @brief Attempts to reconnect a client to an existing active session.
  * * Searches all active matches for a disconnected player with matching Name and ID.
@@ -268,34 +975,43 @@ int match_release_after_client(Client *me) {
  * @param name The player's name.
  * @param id The player's unique session ID.
  * @param new_sock The new socket file descriptor.
+ * @param mux Multiplexed connection taking back one of its boards, NULL for a plain reconnect.
  * @return Pointer to the existing Client struct if found, NULL otherwise.
  */
-Client *match_reconnect(const char *name, const char *id, int new_sock) {
-    pthread_mutex_lock(&room_registry_lock);
+Client *match_reconnect(const char *name, const char *id, int new_sock, Client *mux) {
+    STAT_INC(stat_reconnect_lookups);
+    registry_lock();
     Match *curr = global_room_list;
 
     while (curr) {
-        pthread_mutex_lock(&curr->lock);
+        uint64_t held = lockstat_acquire(&curr->lock, &reconnect_stat);
         if (!curr->finished) {
             Client *target = NULL;
 
-            if (curr->white && strcmp(curr->white->name, name) == 0 && strcmp(curr->white->id, id) == 0 && curr->white->sock == -1) 
-                target = curr->white;
-            else if (curr->black && strcmp(curr->black->name, name) == 0 && strcmp(curr->black->id, id) == 0 && curr->black->sock == -1) 
-                target = curr->black;
+            if (reconnectable(curr->white, name, id, mux)) target = curr->white;
+            else if (reconnectable(curr->black, name, id, mux)) target = curr->black;
 
             if (target) {
+                target->mux = mux; /* Before the socket, so nothing is sent to it unprefixed */
+                pthread_mutex_lock(&target->lock);
+                /* A sequenced session holds its messages until its resume is out */
+                if (target->retx && !mux) target->resume_mark = retransmit_next_seq(target->retx);
                 target->sock = new_sock; target->disconnect_time = 0;
-                target->last_heartbeat = time(NULL);
+                target->out_tail_len = 0; /* The rest of a line cut on the old socket */
+                pthread_mutex_unlock(&target->lock);
+                target->last_heartbeat = io_time();
+                rtt_reset(target);
+                replica_reconnect(curr, (target == curr->white) ? 0 : 1);
                 log_printf("[MATCH] Client %p (%s) RECONNECTED to match %d.\n", target, name, curr->id);
-                pthread_mutex_unlock(&curr->lock); pthread_mutex_unlock(&room_registry_lock);
+                lockstat_release(&curr->lock, &reconnect_stat, held); registry_unlock();
+                STAT_INC(stat_reconnect_hits);
                 return target;
             }
         }
-        pthread_mutex_unlock(&curr->lock);
+        lockstat_release(&curr->lock, &reconnect_stat, held);
         curr = curr->next;
     }
-    pthread_mutex_unlock(&room_registry_lock);
+    registry_unlock();
     return NULL;
 }
 
@@ -308,43 +1024,37 @@ int match_try_resume(Match *m) {
 
     if (!m) return 0;
 
-    pthread_mutex_lock(&m->lock);
+    uint64_t held = lockstat_acquire(&m->lock, &resume_stat);
     if (m->is_paused && m->white && m->white->sock > 0 && m->black && m->black->sock > 0) {
-        m->last_move_time = time(NULL) - m->elapsed_at_pause;
-        m->elapsed_at_pause = 0; m->is_paused = 0; resumed = 1;
+        match_clock_start(m);
+        m->is_paused = 0; resumed = 1;
+        STAT_INC(stat_resumes);
         log_printf("[MATCH] Match %d resumed. Timer restored.\n", m->id);
     }
 
-    pthread_mutex_unlock(&m->lock);
+    lockstat_release(&m->lock, &resume_stat, held);
     return resumed;
 }
 
 /**
- * @brief Calculates remaining time for the current turn.
+ * @brief Calculates the time left for the side to move, in whole seconds (rounded up).
  */
 int match_get_remaining_time(Match *m) {
     if (m->finished) return 0;
-    if (m->is_paused) { int left = m->turn_timeout_seconds - m->elapsed_at_pause; return (left < 0) ? 0 : left; }
-    if (m->last_move_time == 0) return m->turn_timeout_seconds;
-
-    int elapsed = time(NULL) - m->last_move_time;
-    int left = m->turn_timeout_seconds - elapsed; return (left < 0) ? 0 : left;
+    int64_t left = match_clock_left(m, m->turn);
+    return (left <= 0) ? 0 : (int)((left + 999) / 1000);
 }
 
 /**
- * @brief Appends a move string to the match history log.
+ * @brief Appends a move string to the match history log and the journal.
+ * Caller must hold m->lock.
  */
 int match_append_move(Match *m, const char *mv) {
     if (!m || !mv) return -1;
-
-    if (m->moves_count + 1 > m->moves_cap) {
-        size_t newcap = (m->moves_cap == 0) ? 8 : m->moves_cap * 2;
-        char **tmp = realloc(m->moves, newcap * sizeof(char *));
-        if (!tmp) return -1;
-        m->moves = tmp; m->moves_cap = newcap;
-    }
-
-    m->moves[m->moves_count++] = strdup(mv);
+    if (history_push(m, mv) != 0) return -1;
+    journal_move(m, mv);
+    replica_move(m, mv);
+    spectate_event(m, WATCH_MOVE, mv, match_get_remaining_time(m));
     return 0;
 }
 
@@ -352,78 +1062,184 @@ int match_append_move(Match *m, const char *mv) {
  * @brief Sends START notification to both players.
  */
 void notify_start(Match *m) {
-    if (!m || !m->white || !m->black) return;
-    send_protocol_msg(m->white, START_AS_WHITE, m->black->name);
-    send_protocol_msg(m->black, START_AS_BLACK, m->white->name);
-    int t = m->turn_timeout_seconds;
-    send_protocol_msg(m->white, TURN_TIMER_STATE, t);
-    send_protocol_msg(m->black, TURN_TIMER_STATE, t);
+    if (!m) return;
+    pthread_mutex_lock(&m->lock);
+    if (m->white && m->black) {
+        send_protocol_msg(m->white, START_AS_WHITE, m->black->name);
+        send_protocol_msg(m->black, START_AS_BLACK, m->white->name);
+        match_send_clock(m, m->white);
+        match_send_clock(m, m->black);
+    }
+    pthread_mutex_unlock(&m->lock);
 }
 
 /**
- * @brief Background thread that monitors match health.
- * * Performs the following checks every second:
- * 1. Turn Timeout: Forfeits game if player takes too long.
- * 2. Grace Period: Pauses game if a player disconnects temporarily.
- * 3. Heartbeat: Detects zombie connections.
- * 4. Final Disconnect: Forfeits game if a disconnected player fails to return in time.
+ * @brief When data last arrived from a player (a board hears through its connection).
  */
-void *match_watchdog(void *arg) {
-    Match *m = (Match *)arg;
-    if (!m) return NULL;
-    while (1) {
-        sleep(1); pthread_mutex_lock(&m->lock);
+static time_t last_heard(const Client *c) {
+    return c->mux ? c->mux->last_heartbeat : c->last_heartbeat;
+}
 
-        if (m->finished) {
-            m->refs--; int last = (m->refs <= 0);
-            pthread_mutex_unlock(&m->lock); if (last) match_free(m); 
-            break; 
-        }
+/**
+ * @brief Ends the game on time: the side to move loses. Caller must hold m->lock.
+ */
+void match_flag(Match *m) {
+    Client *inactive = (m->turn == 0) ? m->white : m->black;
+    Client *winner = (m->turn == 0) ? m->black : m->white;
+    match_finish(m, 1 - m->turn, END_TIMEOUT);
+    if (inactive) send_protocol_msg(inactive, YOU_TIMED_OUT);
+    if (winner) send_protocol_msg(winner, OPPONENT_TIMED_OUT);
+}
 
-        time_t now = time(NULL);
+/**
+ * @brief Longest the watchdog may sleep without missing a flag: until the
+ * side to move runs out, and no longer than the opponent's time left, since a
+ * move can start that clock at any moment. Never longer than the probe
+ * interval while probes are on. Caller must hold m->lock.
+ */
+static unsigned next_check_ms(const Match *m) {
+    int64_t wait = WATCHDOG_INTERVAL_MS;
+    unsigned probe = rtt_probe_interval_ms();
+    if (probe && probe < wait && !m->finished) wait = probe;
+    if (m->clock_running && !m->finished) {
+        int64_t mine = match_clock_left(m, m->turn) + mover_grace_ms(m);
+        int64_t theirs = (m->tc.mode == TC_PER_MOVE) ? m->tc.base_ms : m->clock_ms[1 - m->turn];
+        if (mine < wait) wait = mine;
+        if (theirs < wait) wait = theirs;
+    }
+    return wait < 1 ? 1 : (unsigned)wait;
+}
 
-        if (!m->is_paused && m->last_move_time != 0 && (now - m->last_move_time) >= m->turn_timeout_seconds) {
-            Client *inactive = (m->turn == 0) ? m->white : m->black;
-            Client *winner = (m->turn == 0) ? m->black : m->white;
-            m->finished = 1; 
-            if (inactive && inactive->sock > 0) send_line(inactive->sock, YOU_TIMED_OUT);
-            if (winner && winner->sock > 0) send_line(winner->sock, OPPONENT_TIMED_OUT);
-            pthread_mutex_unlock(&m->lock); continue; 
-        }
+/**
+ * @brief One watchdog pass over a match (see match_watchdog()).
+ * @param result If not NULL, receives m->winner once the game is over.
+ * @param wait_ms If not NULL and the match still needs watching, lowered to
+ * the time until its next pass is due.
+ * @return 1 once the game is over and the watchdog's reference has been
+ * dropped (m may be freed), 0 while the match still needs watching.
+ */
+int match_watchdog_tick(Match *m, int *result, unsigned *wait_ms) {
+    uint64_t held = lockstat_acquire(&m->lock, &watchdog_stat);
 
-        if (m->white && m->white->sock == -1 && !m->is_paused) {
-            if (now - m->white->disconnect_time > DISCONNECT_GRACE_PERIOD) {
-                if (m->last_move_time > 0) { m->elapsed_at_pause = now - m->last_move_time; m->last_move_time = 0; }
-                m->is_paused = 1;
-                if (m->black && m->black->sock > 0) send_protocol_msg(m->black, WAIT_FOR_RECONNECT);
-            }
-        }
+    /* State is being handed to a successor process, which runs its own watchdog */
+    if (handoff_frozen()) { lockstat_release(&m->lock, &watchdog_stat, held); return 0; }
 
-        if (m->black && m->black->sock == -1 && !m->is_paused) {
-            if (now - m->black->disconnect_time > DISCONNECT_GRACE_PERIOD) {
-                if (m->last_move_time > 0) { m->elapsed_at_pause = now - m->last_move_time; m->last_move_time = 0; }
-                m->is_paused = 1;
-                if (m->white && m->white->sock > 0) send_protocol_msg(m->white, WAIT_FOR_RECONNECT);
-            }
-        }
+    if (m->finished) {
+        /* Kept alive for a rematch, which reuses this thread */
+        if (rematch_open(m)) { lockstat_release(&m->lock, &watchdog_stat, held); return 0; }
+        m->rematch_until = 0;
+        if (result) *result = m->winner;
+        m->refs--; int last = (m->refs <= 0);
+        lockstat_release(&m->lock, &watchdog_stat, held); if (last) match_free(m); 
+        return 1; 
+    }
 
-        if (m->white && m->white->sock > 0 && (now - m->white->last_heartbeat > HEARTBEAT_TIMEOUT_SECONDS)) {
-            shutdown(m->white->sock, SHUT_RDWR); m->white->disconnect_time = now;
-        }
-        if (m->black && m->black->sock > 0 && (now - m->black->last_heartbeat > HEARTBEAT_TIMEOUT_SECONDS)) {
-            shutdown(m->black->sock, SHUT_RDWR); m->black->disconnect_time = now;
+    time_t now = io_time();
+
+    if (match_clock_flagged(m)) {
+        match_flag(m);
+        lockstat_release(&m->lock, &watchdog_stat, held); return 0; 
+    }
+
+    if (m->white && m->white->sock == -1 && !m->is_paused) {
+        if (now - m->white->disconnect_time > DISCONNECT_GRACE_PERIOD) {
+            match_clock_stop(m);
+            m->is_paused = 1; STAT_INC(stat_pauses);
+            if (m->black) send_protocol_msg(m->black, WAIT_FOR_RECONNECT);
         }
+    }
 
-        int w_dc = (m->white && m->white->sock == -1 && (now - m->white->disconnect_time > DISCONNECT_TIMEOUT_SECONDS));
-        int b_dc = (m->black && m->black->sock == -1 && (now - m->black->disconnect_time > DISCONNECT_TIMEOUT_SECONDS));
-        if (w_dc || b_dc) {
-            m->finished = 1; Client *winner = w_dc ? m->black : m->white; 
-            if (winner && winner->sock > 0) send_line(winner->sock, OPPONENT_QUIT);
-            if (w_dc) { decrement_player_count(); m->refs--; }
-            if (b_dc) { decrement_player_count(); m->refs--; }
-            pthread_mutex_unlock(&m->lock); continue;
+    if (m->black && m->black->sock == -1 && !m->is_paused) {
+        if (now - m->black->disconnect_time > DISCONNECT_GRACE_PERIOD) {
+            match_clock_stop(m);
+            m->is_paused = 1; STAT_INC(stat_pauses);
+            if (m->white) send_protocol_msg(m->white, WAIT_FOR_RECONNECT);
         }
-        pthread_mutex_unlock(&m->lock);
+    }
+
+    if (m->white && m->white->sock > 0 && (now - last_heard(m->white) > HEARTBEAT_TIMEOUT_SECONDS)) {
+        io_shutdown(m->white->sock, SHUT_RDWR); m->white->disconnect_time = now;
+    }
+    if (m->black && m->black->sock > 0 && (now - last_heard(m->black) > HEARTBEAT_TIMEOUT_SECONDS)) {
+        io_shutdown(m->black->sock, SHUT_RDWR); m->black->disconnect_time = now;
+    }
+
+    int w_dc = (m->white && m->white->sock == -1 && (now - m->white->disconnect_time > DISCONNECT_TIMEOUT_SECONDS));
+    int b_dc = (m->black && m->black->sock == -1 && (now - m->black->disconnect_time > DISCONNECT_TIMEOUT_SECONDS));
+    if (w_dc || b_dc) {
+        match_finish(m, (w_dc && b_dc) ? -1 : (w_dc ? 1 : 0), END_DISCONNECT);
+        Client *winner = w_dc ? m->black : m->white; STAT_INC(stat_dc_forfeits);
+        if (winner) send_protocol_msg(winner, OPPONENT_QUIT);
+        if (w_dc) { decrement_player_count(); m->refs--; }
+        if (b_dc) { decrement_player_count(); m->refs--; }
+    }
+    if (!m->finished && m->black) { rtt_probe(m->white); rtt_probe(m->black); }
+    if (wait_ms) { unsigned w = next_check_ms(m); if (w < *wait_ms) *wait_ms = w; }
+    lockstat_release(&m->lock, &watchdog_stat, held);
+    return 0;
+}
+
+/**
+ * @brief Background thread that monitors match health.
+ * * Performs the following checks at least every WATCHDOG_INTERVAL_MS:
+ * 1. Flag: Forfeits game when the side to move runs out of time (woken exactly then).
+ * 2. Grace Period: Pauses game if a player disconnects temporarily.
+ * 3. Heartbeat: Detects zombie connections.
+ * 4. Final Disconnect: Forfeits game if a disconnected player fails to return in time.
+ * 5. Round trip: Probes the players' connections when due (see rtt.h).
+ */
+void *match_watchdog(void *arg) {
+    Match *m = (Match *)arg;
+    if (!m) return NULL;
+    unsigned wait_ms = WATCHDOG_INTERVAL_MS;
+    while (1) {
+        io_usleep(wait_ms * 1000u);
+        wait_ms = WATCHDOG_INTERVAL_MS;
+        if (match_watchdog_tick(m, NULL, &wait_ms)) break;
     }
     return NULL;
+}
+
+/**
+ * @brief Formats reconnection counters and lock statistics, one item per line.
+ * @return Number of characters in buf, at most sz - 1.
+ */
+int match_format_stats(char *buf, size_t sz) {
+    LockStat *locks[] = { &registry_stat, &reconnect_stat, &resume_stat, &watchdog_stat };
+    size_t off = 0;
+    int n = snprintf(buf, sz, "rooms=%d reconnect_lookups=%llu reconnect_hits=%llu resumes=%llu pauses=%llu dc_forfeits=%llu rematches=%llu\n",
+                     get_active_room_count(),
+                     (unsigned long long)__atomic_load_n(&stat_reconnect_lookups, __ATOMIC_RELAXED),
+                     (unsigned long long)__atomic_load_n(&stat_reconnect_hits, __ATOMIC_RELAXED),
+                     (unsigned long long)__atomic_load_n(&stat_resumes, __ATOMIC_RELAXED),
+                     (unsigned long long)__atomic_load_n(&stat_pauses, __ATOMIC_RELAXED),
+                     (unsigned long long)__atomic_load_n(&stat_dc_forfeits, __ATOMIC_RELAXED),
+                     (unsigned long long)__atomic_load_n(&stat_rematches, __ATOMIC_RELAXED));
+    if (n < 0) return n;
+    off = n;
+    for (size_t i = 0; i < sizeof(locks) / sizeof(locks[0]) && off < sz; i++) {
+        n = lockstat_format(locks[i], buf + off, sz - off);
+        if (n < 0) break;
+        off += n;
+        if (off + 1 < sz) { buf[off++] = '\n'; buf[off] = '\0'; }
+    }
+    /* Truncated: report what is in buf, so a caller can chain on the result */
+    if (sz > 0 && off >= sz) off = sz - 1;
+    return (int)off;
+}
+
+/**
+ * @brief Resets reconnection counters and lock statistics (e.g. between benchmark phases).
+ */
+void match_reset_stats(void) {
+    lockstat_reset(&registry_stat);
+    lockstat_reset(&reconnect_stat);
+    lockstat_reset(&resume_stat);
+    lockstat_reset(&watchdog_stat);
+    __atomic_store_n(&stat_reconnect_lookups, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_reconnect_hits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_resumes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_pauses, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_dc_forfeits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat_rematches, 0, __ATOMIC_RELAXED);
 }
\ No newline at end of file
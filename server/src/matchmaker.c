@@ -0,0 +1,310 @@
+/**
+ * @file matchmaker.c
+ * @brief Matchmaking queue and pairing thread (see matchmaker.h).
+ *
+ * One mutex protects the buckets and every c->queued pointer. A pass only
+ * moves entries from the buckets to a local pair list; rooms are created
+ * after the lock is released, so QUEUE and EXT never wait for a room to be
+ * journaled or for a watchdog thread to start.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "matchmaker.h"
+#include "client.h"
+#include "match.h"
+#include "profiles.h"
+#include "capture.h"
+#include "handoff.h"
+#include "lockstat.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+extern int max_rooms;
+
+/**
+ * One queued player.
+ */
+typedef struct QueueEntry {
+    Client *client;
+    int32_t rating;
+    int pool;                   /**< Index in pools[], kept while taken for a pair */
+    int bucket;                 /**< Bucket index, -1 while taken for a pair */
+    time_t since;               /**< When the player queued (kept when a pair is put back) */
+    struct QueueEntry *prev, *next;
+} QueueEntry;
+
+typedef struct {
+    QueueEntry *head, *tail;
+} Bucket;
+
+/**
+ * Players asking for one time control, in rating buckets.
+ */
+typedef struct {
+    TimeControl tc;
+    int timed;                  /**< 0: the default clocks of a plain NEW */
+    size_t members;             /**< Entries of this pool, queued or taken; 0: free for another time control */
+    Bucket buckets[MATCHMAKER_BUCKETS];
+} Pool;
+
+typedef struct {
+    QueueEntry *white, *black;
+} Pair;
+
+static Pool pools[MATCHMAKER_POOLS];
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mm_settled = PTHREAD_COND_INITIALIZER;   /**< A taken entry was released */
+static volatile int mm_running = 0;
+static Pair pairs[MATCHMAKER_PAIRS_PER_TICK];
+
+/* Counters (updated atomically) */
+static uint64_t n_queued, n_enqueued, n_left, n_pairs, n_requeued, n_failed, n_passes;
+static uint64_t wait_s_total, pass_ns_last, pass_ns_max;
+
+static int bucket_of(int32_t rating) {
+    int b = rating / MATCHMAKER_BUCKET_WIDTH;
+    if (b < 0) return 0;
+    return b >= MATCHMAKER_BUCKETS ? MATCHMAKER_BUCKETS - 1 : b;
+}
+
+/**
+ * @brief Pool for a time control (NULL for the default clocks), taking a free
+ * one if none is queued for it yet. Called with mm_lock held.
+ * @return Pool index, or -1 if every pool is in use.
+ */
+static int pool_for(const TimeControl *tc) {
+    int free_pool = -1;
+    for (int i = 0; i < MATCHMAKER_POOLS; i++) {
+        Pool *p = &pools[i];
+        if (!p->members) { if (free_pool < 0) free_pool = i; continue; }
+        if (p->timed == (tc != NULL) && (!tc || memcmp(&p->tc, tc, sizeof(*tc)) == 0)) return i;
+    }
+    if (free_pool >= 0) {
+        pools[free_pool].timed = (tc != NULL);
+        if (tc) pools[free_pool].tc = *tc;
+    }
+    return free_pool;
+}
+
+/** Called with mm_lock held. */
+static void bucket_push(QueueEntry *e) {
+    Bucket *bk = &pools[e->pool].buckets[e->bucket = bucket_of(e->rating)];
+    e->next = NULL;
+    e->prev = bk->tail;
+    if (bk->tail) bk->tail->next = e;
+    else bk->head = e;
+    bk->tail = e;
+    STAT_ADD(n_queued, 1);
+}
+
+/** Called with mm_lock held. */
+static void bucket_unlink(QueueEntry *e) {
+    Bucket *bk = &pools[e->pool].buckets[e->bucket];
+    if (e->prev) e->prev->next = e->next;
+    else bk->head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else bk->tail = e->prev;
+    e->prev = e->next = NULL;
+    e->bucket = -1;
+    STAT_ADD(n_queued, (uint64_t)-1);
+}
+
+/**
+ * @brief Rating difference a player accepts after waiting since `since`.
+ */
+static int32_t window(const QueueEntry *e, time_t now) {
+    long w = MATCHMAKER_WINDOW_BASE + (long)MATCHMAKER_WINDOW_GROWTH * (now > e->since ? now - e->since : 0);
+    return (int32_t)(w > MATCHMAKER_WINDOW_MAX ? MATCHMAKER_WINDOW_MAX : w);
+}
+
+/**
+ * @brief First opponent for e that both accept: later entries of its own
+ * bucket, then the buckets above it up to the edge of e's window, all in
+ * e's pool. Lower buckets were already searched by their own players.
+ */
+static QueueEntry *find_opponent(QueueEntry *e, time_t now) {
+    Bucket *buckets = pools[e->pool].buckets;
+    int32_t we = window(e, now);
+    int last = e->bucket + we / MATCHMAKER_BUCKET_WIDTH + 1;
+    if (last >= MATCHMAKER_BUCKETS) last = MATCHMAKER_BUCKETS - 1;
+    for (int j = e->bucket; j <= last; j++) {
+        for (QueueEntry *x = (j == e->bucket) ? e->next : buckets[j].head; x; x = x->next) {
+            int32_t wx = window(x, now), diff = abs(x->rating - e->rating);
+            if (diff <= we && diff <= wx) return x;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief One pairing pass. Called with mm_lock held.
+ * @return Number of pairs taken out of the queue.
+ */
+static size_t pair_pass(time_t now) {
+    size_t np = 0;
+    for (int k = 0; k < MATCHMAKER_POOLS; k++) {
+        if (!pools[k].members) continue;
+        for (int b = 0; b < MATCHMAKER_BUCKETS && np < MATCHMAKER_PAIRS_PER_TICK; b++) {
+            QueueEntry *e = pools[k].buckets[b].head;
+            while (e && np < MATCHMAKER_PAIRS_PER_TICK) {
+                QueueEntry *f = find_opponent(e, now);
+                if (!f) { e = e->next; continue; }
+                QueueEntry *next = (e->next == f) ? f->next : e->next;
+                bucket_unlink(e);
+                bucket_unlink(f);
+                /* Whoever queued first plays White */
+                int e_first = e->since <= f->since;
+                pairs[np].white = e_first ? e : f;
+                pairs[np].black = e_first ? f : e;
+                np++;
+                e = next;
+            }
+        }
+    }
+    return np;
+}
+
+/**
+ * @brief Hands a taken entry back to its worker: frees it and wakes matchmaker_leave().
+ * The client's match and pairing must be set before.
+ */
+static void settle(QueueEntry *e) {
+    pthread_mutex_lock(&mm_lock);
+    pools[e->pool].members--;
+    __atomic_store_n(&e->client->queued, NULL, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&mm_settled);
+    pthread_mutex_unlock(&mm_lock);
+    free(e);
+}
+
+static void requeue(QueueEntry *e) {
+    pthread_mutex_lock(&mm_lock);
+    bucket_push(e);
+    pthread_cond_broadcast(&mm_settled);
+    pthread_mutex_unlock(&mm_lock);
+    STAT_ADD(n_requeued, 1);
+}
+
+/**
+ * @brief Opens a room for a pair through the regular create/join flow.
+ */
+static void start_pair(Pair *p, time_t now) {
+    Client *w = p->white->client, *b = p->black->client;
+    if (max_rooms > 0 && get_active_room_count() >= max_rooms) {
+        requeue(p->white);
+        requeue(p->black);
+        return;
+    }
+    const Pool *pool = &pools[p->white->pool];
+    Match *m = match_create(w, pool->timed ? &pool->tc : NULL);
+    if (!m) {
+        STAT_ADD(n_failed, 1);
+        send_error(w, "Server internal limit reached");
+        send_error(b, "Server internal limit reached");
+        settle(p->white);
+        settle(p->black);
+        return;
+    }
+    w->match = m; w->color = 0;
+    capture_room(w->conn_id, m->id);
+    if (match_join(m, b) != 0) {
+        /* Someone joined the room by id first: White plays them instead */
+        settle(p->white);
+        requeue(p->black);
+        return;
+    }
+    b->color = 1; b->paired = 1; w->paired = 1;
+    notify_start(m);
+    STAT_ADD(n_pairs, 1);
+    STAT_ADD(wait_s_total, (uint64_t)((now - p->white->since) + (now - p->black->since)));
+    settle(p->white);
+    settle(p->black);
+}
+
+static void *matchmaker_thread(void *arg) {
+    (void)arg;
+    while (1) {
+        io_usleep(MATCHMAKER_TICK_MS * 1000);
+        /* The successor process has its own (empty) queue */
+        if (handoff_frozen()) continue;
+        if (max_rooms > 0 && get_active_room_count() >= max_rooms) continue;
+
+        time_t now = io_time();
+        uint64_t t0 = monotonic_ns();
+        pthread_mutex_lock(&mm_lock);
+        size_t np = pair_pass(now);
+        pthread_mutex_unlock(&mm_lock);
+        uint64_t ns = monotonic_ns() - t0;
+        __atomic_store_n(&pass_ns_last, ns, __ATOMIC_RELAXED);
+        if (ns > __atomic_load_n(&pass_ns_max, __ATOMIC_RELAXED)) __atomic_store_n(&pass_ns_max, ns, __ATOMIC_RELAXED);
+        STAT_ADD(n_passes, 1);
+
+        for (size_t i = 0; i < np; i++) start_pair(&pairs[i], now);
+    }
+    return NULL;
+}
+
+int matchmaker_start(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, matchmaker_thread, NULL) != 0) return -1;
+    pthread_detach(tid);
+    mm_running = 1;
+    return 0;
+}
+
+int32_t matchmaker_rating(const char *name) {
+    PlayerProfile p;
+    return profiles_get(name, &p) == 0 ? p.rating : PROFILES_INITIAL_RATING;
+}
+
+int matchmaker_enqueue(Client *c, int32_t rating, const TimeControl *tc) {
+    if (!mm_running) return -1;
+    QueueEntry *e = calloc(1, sizeof(QueueEntry));
+    if (!e) return -1;
+    e->client = c;
+    e->rating = rating;
+    e->since = io_time();
+
+    pthread_mutex_lock(&mm_lock);
+    if (c->queued) { pthread_mutex_unlock(&mm_lock); free(e); return -1; }
+    if ((e->pool = pool_for(tc)) < 0) { pthread_mutex_unlock(&mm_lock); free(e); return -2; }
+    pools[e->pool].members++;
+    bucket_push(e);
+    c->queued = e;
+    pthread_mutex_unlock(&mm_lock);
+    STAT_ADD(n_enqueued, 1);
+    return 0;
+}
+
+int matchmaker_leave(Client *c) {
+    pthread_mutex_lock(&mm_lock);
+    if (!c->queued) { pthread_mutex_unlock(&mm_lock); return -1; }
+    while (c->queued && c->queued->bucket < 0) pthread_cond_wait(&mm_settled, &mm_lock);
+    QueueEntry *e = c->queued;
+    if (e) {
+        bucket_unlink(e);
+        pools[e->pool].members--;
+        c->queued = NULL;
+    }
+    pthread_mutex_unlock(&mm_lock);
+    if (!e) return 1;
+    free(e);
+    STAT_ADD(n_left, 1);
+    return 0;
+}
+
+int matchmaker_format_stats(char *buf, size_t sz) {
+    if (!mm_running) return 0;
+    unsigned long long pairs_done = STAT_GET(n_pairs);
+    return snprintf(buf, sz, "queued=%llu enqueued=%llu left=%llu pairs=%llu requeued=%llu failed=%llu avg_wait_s=%.1f\n"
+                    "passes=%llu last_pass_us=%.1f max_pass_us=%.1f\n",
+                    STAT_GET(n_queued), STAT_GET(n_enqueued), STAT_GET(n_left), pairs_done, STAT_GET(n_requeued),
+                    STAT_GET(n_failed), pairs_done ? STAT_GET(wait_s_total) / (2.0 * pairs_done) : 0.0,
+                    STAT_GET(n_passes), STAT_GET(pass_ns_last) / 1000.0, STAT_GET(pass_ns_max) / 1000.0);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file netio.c
+ * @brief Default (system call) transport and clock, plus the dispatchers.
+ */
+
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "netio.h"
+
+static time_t sys_now(void) {
+    return time(NULL);
+}
+
+static uint64_t sys_mono_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ull + (uint64_t)ts.tv_nsec / 1000000ull;
+}
+
+static void sys_sleep_us(unsigned int usec) {
+    usleep(usec);
+}
+
+static int sys_spawn(void *(*fn)(void *), void *arg) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, fn, arg) != 0) return -1;
+    pthread_detach(tid);
+    return 0;
+}
+
+static const IoOps sys_ops = {
+    sys_now, sys_mono_ms, sys_sleep_us, send, recv, close, shutdown, sys_spawn
+};
+
+static const IoOps *ops = &sys_ops;
+
+void io_set_ops(const IoOps *new_ops) {
+    ops = new_ops ? new_ops : &sys_ops;
+}
+
+const IoOps *io_get_ops(void) {
+    return ops;
+}
+
+time_t io_time(void) { return ops->now(); }
+uint64_t io_mono_ms(void) { return ops->mono_ms(); }
+void io_usleep(unsigned int usec) { ops->sleep_us(usec); }
+ssize_t io_send(int fd, const void *buf, size_t len, int flags) { return ops->send(fd, buf, len, flags); }
+ssize_t io_recv(int fd, void *buf, size_t len, int flags) { return ops->recv(fd, buf, len, flags); }
+int io_close(int fd) { return ops->close(fd); }
+int io_shutdown(int fd, int how) { return ops->shutdown(fd, how); }
+int io_spawn(void *(*fn)(void *), void *arg) { return ops->spawn(fn, arg); }
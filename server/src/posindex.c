@@ -0,0 +1,508 @@
+/**
+ * @file posindex.c
+ * @brief Position index over the game archive: writer and mmap queries.
+ *
+ * Owned by the archive writer thread: it replays every game it has written
+ * through game.c, hashes the position after each move and flushes the batch
+ * as one sorted run (format in posindex.h). Queries run on admin threads and
+ * map the position files read-only; the rwlock keeps them out while the
+ * writer appends to or rewrites the tail of the current file.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "posindex.h"
+#include "codec.h"
+#include "game.h"
+#include "logging.h"
+#include "config.h"
+#include "stats.h"
+
+/** Changing the seed changes every hash: bump POSINDEX_VERSION with it. */
+#define ZOBRIST_SEED 0x4b49562d55505331ull
+#define CATCH_UP_BATCH 4096     /**< Games per run when indexing missing games */
+
+/**
+ * Position waiting for the next run.
+ */
+typedef struct {
+    uint64_t hash;
+    uint32_t game;
+    uint16_t ply;
+} PosEntry;
+
+/**
+ * Run of the current file (header values and where it starts).
+ */
+typedef struct {
+    off_t off;
+    uint32_t count, first, games;
+} PosRun;
+
+static pthread_rwlock_t file_lock = PTHREAD_RWLOCK_INITIALIZER;
+static volatile int posindex_running = 0;
+static char pos_dir[480];
+static volatile int pos_seg = 0;
+static int pos_fd = -1;
+static PosRun *runs;
+static size_t nruns, cap_runs;
+static uint32_t covered;            /**< Games of the segment held by the runs */
+static PosEntry *pending;
+static size_t npending, cap_pending;
+static uint32_t pending_games;
+static Match *start_pos;
+static uint64_t start_key;          /**< Hash of start_pos */
+
+/* Index counters (updated atomically) */
+static uint64_t n_positions, n_games, n_runs, n_merges, n_reindexed, n_errors;
+
+static uint64_t piece_keys[12][64];
+static uint64_t castle_keys[4];
+static uint64_t ep_keys[8];
+static uint64_t side_key;
+static pthread_once_t keys_once = PTHREAD_ONCE_INIT;
+
+static uint64_t splitmix64(uint64_t *s) {
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void keys_init(void) {
+    uint64_t s = ZOBRIST_SEED;
+    for (int p = 0; p < 12; p++)
+        for (int sq = 0; sq < 64; sq++) piece_keys[p][sq] = splitmix64(&s);
+    for (int i = 0; i < 4; i++) castle_keys[i] = splitmix64(&s);
+    for (int i = 0; i < 8; i++) ep_keys[i] = splitmix64(&s);
+    side_key = splitmix64(&s);
+}
+
+/* --- Hashing --- */
+
+uint64_t posindex_hash(const Match *m) {
+    pthread_once(&keys_once, keys_init);
+    const GameState *g = &m->state;
+    uint64_t h = 0;
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) {
+            Piece p = g->board[r][c];
+            if (p != EMPTY) h ^= piece_keys[p > 0 ? p - 1 : 5 - p][r * 8 + c];
+        }
+    }
+    if (m->turn) h ^= side_key;
+
+    /* Rights only count while king and rook stand on their squares (a captured
+     * rook does not clear them in the engine, but does in a FEN) */
+    if (m->w_can_kingside && g->board[7][4] == WKING && g->board[7][7] == WROOK) h ^= castle_keys[0];
+    if (m->w_can_queenside && g->board[7][4] == WKING && g->board[7][0] == WROOK) h ^= castle_keys[1];
+    if (m->b_can_kingside && g->board[0][4] == BKING && g->board[0][7] == BROOK) h ^= castle_keys[2];
+    if (m->b_can_queenside && g->board[0][4] == BKING && g->board[0][0] == BROOK) h ^= castle_keys[3];
+
+    /* En passant only when the side to move has a pawn that can take */
+    if (m->ep_r >= 0 && m->ep_c >= 0) {
+        int from_r = m->turn == 0 ? m->ep_r + 1 : m->ep_r - 1;
+        Piece pawn = m->turn == 0 ? WPAWN : BPAWN;
+        if (from_r >= 0 && from_r < 8 && ((m->ep_c > 0 && g->board[from_r][m->ep_c - 1] == pawn)
+                                          || (m->ep_c < 7 && g->board[from_r][m->ep_c + 1] == pawn)))
+            h ^= ep_keys[m->ep_c];
+    }
+    return h;
+}
+
+/* --- Runs --- */
+
+static int cmp_entry(const void *a, const void *b) {
+    const PosEntry *x = a, *y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->game != y->game) return x->game < y->game ? -1 : 1;
+    return (x->ply > y->ply) - (x->ply < y->ply);
+}
+
+static int cmp_raw(const unsigned char *a, const unsigned char *b) {
+    uint64_t x = get_le(a, 8), y = get_le(b, 8);
+    if (x != y) return x < y ? -1 : 1;
+    x = get_le(a + 8, 4) << 16 | get_le(a + 12, 2);
+    y = get_le(b + 8, 4) << 16 | get_le(b + 12, 2);
+    return (x > y) - (x < y);
+}
+
+static off_t file_end(void) {
+    if (nruns == 0) return POSINDEX_HEADER_SZ;
+    const PosRun *r = &runs[nruns - 1];
+    return r->off + POSINDEX_RUN_HEADER_SZ + (off_t)r->count * POSINDEX_ENTRY_SZ;
+}
+
+static int push_run(off_t off, uint32_t count, uint32_t first, uint32_t games) {
+    if (nruns == cap_runs) {
+        size_t cap = cap_runs ? cap_runs * 2 : 64;
+        PosRun *p = realloc(runs, cap * sizeof(PosRun));
+        if (!p) return -1;
+        runs = p; cap_runs = cap;
+    }
+    runs[nruns++] = (PosRun){ off, count, first, games };
+    return 0;
+}
+
+static void put_run_header(unsigned char *h, uint32_t count, uint32_t first, uint32_t games, uint32_t crc) {
+    put_le(h, count, 4);
+    put_le(h + 4, first, 4);
+    put_le(h + 8, games, 4);
+    put_le(h + 12, crc, 4);
+}
+
+static void set_dirty(int dirty) {
+    unsigned char flags = dirty ? POSINDEX_FLAG_DIRTY : 0;
+    if (!dirty) fdatasync(pos_fd);
+    pwrite_all(pos_fd, &flags, 1, 5);
+    fdatasync(pos_fd);
+}
+
+/**
+ * @brief Merges the last two runs into one, rewriting the tail of the file.
+ */
+static int merge_tail(void) {
+    PosRun *a = &runs[nruns - 2], *b = &runs[nruns - 1];
+    size_t n = (size_t)a->count + b->count;
+    unsigned char *in = malloc(n * POSINDEX_ENTRY_SZ);
+    unsigned char *out = malloc(POSINDEX_RUN_HEADER_SZ + n * POSINDEX_ENTRY_SZ);
+    int rc = -1;
+    if (!in || !out) goto done;
+
+    unsigned char *ina = in, *inb = in + (size_t)a->count * POSINDEX_ENTRY_SZ;
+    if (pread_all(pos_fd, ina, (size_t)a->count * POSINDEX_ENTRY_SZ, a->off + POSINDEX_RUN_HEADER_SZ) != 0
+        || pread_all(pos_fd, inb, (size_t)b->count * POSINDEX_ENTRY_SZ, b->off + POSINDEX_RUN_HEADER_SZ) != 0) goto done;
+
+    unsigned char *o = out + POSINDEX_RUN_HEADER_SZ;
+    const unsigned char *enda = inb, *endb = in + n * POSINDEX_ENTRY_SZ;
+    while (ina < enda || inb < endb) {
+        if (inb >= endb || (ina < enda && cmp_raw(ina, inb) <= 0)) { memcpy(o, ina, POSINDEX_ENTRY_SZ); ina += POSINDEX_ENTRY_SZ; }
+        else { memcpy(o, inb, POSINDEX_ENTRY_SZ); inb += POSINDEX_ENTRY_SZ; }
+        o += POSINDEX_ENTRY_SZ;
+    }
+    uint32_t games = a->games + b->games;
+    put_run_header(out, (uint32_t)n, a->first, games,
+                   crc32(out + POSINDEX_RUN_HEADER_SZ, n * POSINDEX_ENTRY_SZ));
+
+    pthread_rwlock_wrlock(&file_lock);
+    if (pwrite_all(pos_fd, out, POSINDEX_RUN_HEADER_SZ + n * POSINDEX_ENTRY_SZ, a->off) == 0
+        && ftruncate(pos_fd, a->off + POSINDEX_RUN_HEADER_SZ + (off_t)(n * POSINDEX_ENTRY_SZ)) == 0) rc = 0;
+    pthread_rwlock_unlock(&file_lock);
+    if (rc == 0) {
+        a->count = (uint32_t)n;
+        a->games = games;
+        nruns--;
+        STAT_ADD(n_merges, 1);
+    }
+
+done:
+    free(in);
+    free(out);
+    return rc;
+}
+
+void posindex_flush(void) {
+    if (!posindex_running || pending_games == 0) return;
+
+    qsort(pending, npending, sizeof(PosEntry), cmp_entry);
+    size_t len = POSINDEX_RUN_HEADER_SZ + npending * POSINDEX_ENTRY_SZ;
+    unsigned char *run = malloc(len);
+    if (!run) goto fail;
+    unsigned char *e = run + POSINDEX_RUN_HEADER_SZ;
+    for (size_t i = 0; i < npending; i++, e += POSINDEX_ENTRY_SZ) {
+        put_le(e, pending[i].hash, 8);
+        put_le(e + 8, pending[i].game, 4);
+        put_le(e + 12, pending[i].ply, 2);
+        put_le(e + 14, 0, 2);
+    }
+    put_run_header(run, (uint32_t)npending, covered, pending_games,
+                   crc32(run + POSINDEX_RUN_HEADER_SZ, npending * POSINDEX_ENTRY_SZ));
+
+    off_t off = file_end();
+    pthread_rwlock_wrlock(&file_lock);
+    int rc = pwrite_all(pos_fd, run, len, off);
+    pthread_rwlock_unlock(&file_lock);
+    free(run);
+    if (rc != 0 || push_run(off, (uint32_t)npending, covered, pending_games) != 0) goto fail;
+
+    covered += pending_games;
+    STAT_ADD(n_positions, npending);
+    STAT_ADD(n_games, pending_games);
+    STAT_ADD(n_runs, 1);
+    npending = 0;
+    pending_games = 0;
+
+    while (nruns >= 2) {
+        const PosRun *a = &runs[nruns - 2], *b = &runs[nruns - 1];
+        if (a->count >= 2 * (uint64_t)b->count || (uint64_t)a->count + b->count > POSINDEX_MERGE_ENTRIES) break;
+        if (merge_tail() != 0) break;
+    }
+    return;
+
+fail:
+    /* Leave the file as it is; the games are indexed again on the next open */
+    if (STAT_ADD(n_errors, 1) == 0) log_printf("[POSINDEX] Cannot write to segment %d's position file: %s\n", pos_seg, strerror(errno));
+    npending = 0;
+    pending_games = 0;
+    posindex_running = 0;
+}
+
+void posindex_add(uint32_t game, const ArchiveGame *g) {
+    if (!posindex_running || game != covered + pending_games) return;
+    size_t plies = g ? g->move_count : 0;
+
+    if (npending + plies + 1 > cap_pending) {
+        size_t cap = cap_pending ? cap_pending : 4096;
+        while (cap < npending + plies + 1) cap *= 2;
+        PosEntry *p = realloc(pending, cap * sizeof(PosEntry));
+        if (!p) return;
+        pending = p; cap_pending = cap;
+    }
+
+    if (g) {
+        /* Ply 0, so the position a game started from matches it too */
+        Match m = *start_pos;
+        pending[npending++] = (PosEntry){ start_key, game, 0 };
+        for (size_t i = 0; i < plies; i++) {
+            char mv[6];
+            int r1, c1, r2, c2;
+            archive_decode_move(g, i, mv);
+            parse_move(mv, &r1, &c1, &r2, &c2);
+            if (m.state.board[r1][c1] == EMPTY) break;
+            apply_move(&m, r1, c1, r2, c2, mv[4]);
+            m.turn = 1 - m.turn;
+            pending[npending++] = (PosEntry){ posindex_hash(&m), game, (uint16_t)(i + 1) };
+        }
+    }
+    pending_games++;
+}
+
+/* --- Opening a segment --- */
+
+/**
+ * @brief Reads the run headers of the open file. A dirty file has every run
+ * checked as well; the file is cut at the first run that does not hold up.
+ */
+static int load_runs(int dirty) {
+    struct stat st;
+    if (fstat(pos_fd, &st) != 0) return -1;
+    off_t off = POSINDEX_HEADER_SZ;
+    unsigned char *buf = NULL;
+    size_t cap = 0;
+    nruns = 0;
+    covered = 0;
+    while (off + POSINDEX_RUN_HEADER_SZ <= st.st_size) {
+        unsigned char h[POSINDEX_RUN_HEADER_SZ];
+        if (pread_all(pos_fd, h, sizeof(h), off) != 0) break;
+        uint32_t count = (uint32_t)get_le(h, 4), first = (uint32_t)get_le(h + 4, 4), games = (uint32_t)get_le(h + 8, 4);
+        size_t bytes = (size_t)count * POSINDEX_ENTRY_SZ;
+        if (first != covered || off + POSINDEX_RUN_HEADER_SZ + (off_t)bytes > st.st_size) break;
+        if (dirty) {
+            if (bytes > cap) {
+                unsigned char *p = realloc(buf, bytes);
+                if (!p) break;
+                buf = p; cap = bytes;
+            }
+            if (pread_all(pos_fd, buf, bytes, off + POSINDEX_RUN_HEADER_SZ) != 0 || crc32(buf, bytes) != (uint32_t)get_le(h + 12, 4)) break;
+        }
+        if (push_run(off, count, first, games) != 0) break;
+        covered += games;
+        off += POSINDEX_RUN_HEADER_SZ + (off_t)bytes;
+    }
+    free(buf);
+    if (off != st.st_size) {
+        log_printf("[POSINDEX] Cutting damaged tail of segment %d's position file at %lld bytes\n", pos_seg, (long long)off);
+        if (ftruncate(pos_fd, off) != 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Indexes games [covered, games) from the archive segment itself.
+ */
+static void catch_up(size_t games) {
+    ArchiveSegment seg;
+    if (archive_map(pos_dir, pos_seg, &seg) != 0) return;
+    size_t from = covered;
+    for (size_t i = from; i < games && posindex_running; i++) {
+        ArchiveGame g;
+        posindex_add((uint32_t)i, archive_game(&seg, i, 0, &g) == 0 ? &g : NULL);
+        if (pending_games == CATCH_UP_BATCH) posindex_flush();
+    }
+    posindex_flush();
+    archive_unmap(&seg);
+    STAT_ADD(n_reindexed, covered - from);
+    log_printf("[POSINDEX] Indexed %u games of segment %d missing from its position file\n", covered - (uint32_t)from, pos_seg);
+}
+
+static void close_file(void) {
+    if (pos_fd < 0) return;
+    posindex_flush();
+    if (posindex_running) set_dirty(0);
+    close(pos_fd);
+    pos_fd = -1;
+    posindex_running = 0;
+}
+
+int posindex_open(const char *dir, int seg, size_t games) {
+    pthread_once(&keys_once, keys_init);
+    if (!start_pos) {
+        if (!(start_pos = match_alloc(0))) return -1;
+        start_key = posindex_hash(start_pos);
+    }
+    close_file();
+
+    char path[512];
+    snprintf(pos_dir, sizeof(pos_dir), "%s", dir);
+    archive_segment_path(path, sizeof(path), dir, seg, "pos");
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    unsigned char h[POSINDEX_HEADER_SZ];
+    int fresh = pread(fd, h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h, POSINDEX_MAGIC, 4) != 0 || h[4] != POSINDEX_VERSION;
+    if (fresh) {
+        memset(h, 0, sizeof(h));
+        memcpy(h, POSINDEX_MAGIC, 4);
+        h[4] = POSINDEX_VERSION;
+        put_le(h + 8, (uint64_t)time(NULL), 8);
+        if (ftruncate(fd, 0) != 0 || pwrite_all(fd, h, sizeof(h), 0) != 0) { close(fd); return -1; }
+    }
+
+    pthread_rwlock_wrlock(&file_lock);
+    pos_fd = fd;
+    pos_seg = seg;
+    npending = 0;
+    pending_games = 0;
+    int rc = load_runs(!fresh && (h[5] & POSINDEX_FLAG_DIRTY));
+    /* Runs past the archive's end (its tail was cut after a crash) are dropped */
+    while (rc == 0 && nruns > 0 && covered > games) {
+        covered -= runs[--nruns].games;
+        if (ftruncate(pos_fd, file_end()) != 0) rc = -1;
+    }
+    pthread_rwlock_unlock(&file_lock);
+    if (rc != 0) { close(fd); pos_fd = -1; return -1; }
+
+    set_dirty(1);
+    posindex_running = 1;
+    if (covered < games) catch_up(games);
+    return 0;
+}
+
+void posindex_close(void) {
+    close_file();
+}
+
+int posindex_format_stats(char *buf, size_t sz) {
+    if (!posindex_running) return 0;
+    return snprintf(buf, sz, "posindex segment=%d positions=%llu games=%llu runs_written=%llu merges=%llu reindexed=%llu write_errors=%llu\n",
+                    pos_seg, STAT_GET(n_positions), STAT_GET(n_games), STAT_GET(n_runs), STAT_GET(n_merges),
+                    STAT_GET(n_reindexed), STAT_GET(n_errors));
+}
+
+/* --- Queries --- */
+
+typedef struct {
+    int seg;
+    uint32_t game;
+    uint16_t ply;
+} PosHit;
+
+/**
+ * @brief Counts the entries for hash in a mapped position file, recording up to
+ * max - *nhits of them.
+ */
+static uint64_t probe_file(const unsigned char *p, size_t len, int seg, uint64_t hash, PosHit *hits, size_t *nhits, size_t max) {
+    uint64_t found = 0;
+    size_t off = POSINDEX_HEADER_SZ;
+    while (off + POSINDEX_RUN_HEADER_SZ <= len) {
+        size_t count = (size_t)get_le(p + off, 4);
+        const unsigned char *e = p + off + POSINDEX_RUN_HEADER_SZ;
+        if (count > (len - off - POSINDEX_RUN_HEADER_SZ) / POSINDEX_ENTRY_SZ) break;
+
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (get_le(e + mid * POSINDEX_ENTRY_SZ, 8) < hash) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < count && get_le(e + lo * POSINDEX_ENTRY_SZ, 8) == hash; lo++) {
+            if (*nhits < max) {
+                const unsigned char *x = e + lo * POSINDEX_ENTRY_SZ;
+                hits[(*nhits)++] = (PosHit){ seg, (uint32_t)get_le(x + 8, 4), (uint16_t)get_le(x + 12, 2) };
+            }
+            found++;
+        }
+        off += POSINDEX_RUN_HEADER_SZ + count * POSINDEX_ENTRY_SZ;
+    }
+    return found;
+}
+
+int posindex_query(const char *fen, char *buf, size_t sz) {
+    if (!posindex_running) return 0;
+    Match m = *start_pos;
+    if (load_fen(&m, fen) != 0) return -1;
+    uint64_t hash = posindex_hash(&m);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    PosHit hits[POSINDEX_QUERY_MAX];
+    size_t nhits = 0;
+    uint64_t total = 0;
+    int searched = 0;
+
+    pthread_rwlock_rdlock(&file_lock);
+    for (int seg = 1; seg <= pos_seg; seg++) {
+        char path[512];
+        archive_segment_path(path, sizeof(path), pos_dir, seg, "pos");
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) continue;
+        struct stat st;
+        void *p = (fstat(fd, &st) == 0 && st.st_size >= POSINDEX_HEADER_SZ)
+                      ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (p == MAP_FAILED) continue;
+        if (memcmp(p, POSINDEX_MAGIC, 4) == 0 && ((unsigned char *)p)[4] == POSINDEX_VERSION) {
+            total += probe_file(p, (size_t)st.st_size, seg, hash, hits, &nhits, POSINDEX_QUERY_MAX);
+            searched++;
+        }
+        munmap(p, (size_t)st.st_size);
+    }
+    pthread_rwlock_unlock(&file_lock);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ms = (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6;
+    int n = snprintf(buf, sz, "position %016llx: %llu occurrences in %d segments (%.3f ms)\n",
+                     (unsigned long long)hash, (unsigned long long)total, searched, ms);
+
+    ArchiveSegment seg = { 0 };
+    int mapped = 0;
+    for (size_t i = 0; i < nhits && n > 0 && (size_t)n < sz; i++) {
+        ArchiveGame g;
+        if (mapped != hits[i].seg) {
+            archive_unmap(&seg);
+            mapped = archive_map(pos_dir, hits[i].seg, &seg) == 0 ? hits[i].seg : 0;
+        }
+        if (!mapped || archive_game(&seg, hits[i].game, 0, &g) != 0) {
+            n += snprintf(buf + n, sz - (size_t)n, "segment %d game %u ply %u\n", hits[i].seg, hits[i].game, hits[i].ply);
+            continue;
+        }
+        const char *result = g.winner == 0 ? "1-0" : g.winner == 1 ? "0-1"
+                           : (g.end_reason == END_STALEMATE || g.end_reason == END_DRAW_AGREED) ? "1/2-1/2" : "*";
+        n += snprintf(buf + n, sz - (size_t)n, "segment %d game %u ply %u: room %d %.*s - %.*s %s %s\n",
+                      hits[i].seg, hits[i].game, hits[i].ply, g.room_id, (int)g.white_len, g.white,
+                      (int)g.black_len, g.black, result,
+                      end_reason_name((EndReason)g.end_reason));
+    }
+    archive_unmap(&seg);
+    if (n > 0 && (size_t)n >= sz) n = (int)sz - 1;
+    return n;
+}
@@ -0,0 +1,329 @@
+/**
+ * @file profiles.c
+ * @brief Player profile store: lock-free open-addressing table in a mapped file.
+ *
+ * Lookups hash the name and probe the mapped slots directly; the only writes
+ * on the handshake path are the claim of a new slot and the last-seen stamp.
+ * Game threads update the two records of a finished game under their
+ * per-record sequence counters (see profiles.h); the only shared lock they
+ * take is the leaderboard's, to move the two players.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "profiles.h"
+#include "client.h"
+#include "leaderboard.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+enum { SLOT_EMPTY = 0, SLOT_BUSY = 1, SLOT_READY = 2 };
+
+/**
+ * One record as stored in the file.
+ */
+typedef struct {
+    uint32_t state;         /**< SLOT_EMPTY, SLOT_BUSY while being claimed, SLOT_READY */
+    uint32_t seq;           /**< Odd while the record is being updated */
+    uint64_t hash;
+    char name[NAME_LEN];
+    int64_t last_seen;
+    int32_t rating;
+    uint32_t games, wins, draws, losses;
+    unsigned char reserved[PROFILES_SLOT_SZ - 108];
+} PlayerSlot;
+
+_Static_assert(sizeof(PlayerSlot) == PROFILES_SLOT_SZ, "PlayerSlot must match PROFILES_SLOT_SZ");
+
+/**
+ * File header (first slot-sized block of the file).
+ */
+typedef struct {
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    uint32_t slot_size;
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t created;
+} ProfilesHeader;
+
+static ProfilesHeader *header = NULL;
+static PlayerSlot *slots = NULL;
+static size_t map_len = 0;
+static uint64_t capacity = 0;
+static volatile int profiles_running = 0;
+
+/* Counters (updated atomically) */
+static uint64_t n_lookups, n_created, n_rated, n_full, n_retries;
+
+static uint64_t name_hash(const char *name) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) h = (h ^ *p) * 0x100000001b3ull;
+    return h;
+}
+
+/* --- Table --- */
+
+/**
+ * @brief Finds the slot of name in a table, claiming an empty one if create is set.
+ * @return The slot, or NULL if absent (or the table is full).
+ */
+static PlayerSlot *probe(PlayerSlot *table, uint64_t cap, uint64_t *used, const char *name, int create) {
+    uint64_t h = name_hash(name), mask = cap - 1;
+    for (uint64_t i = h & mask, n = 0; n < cap; i = (i + 1) & mask, n++) {
+        PlayerSlot *s = &table[i];
+        uint32_t st = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+        if (st == SLOT_EMPTY) {
+            if (!create) return NULL;
+            if (__atomic_load_n(used, __ATOMIC_RELAXED) * 100 >= cap * PROFILES_MAX_LOAD_PCT) {
+                STAT_ADD(n_full, 1);
+                return NULL;
+            }
+            if (__atomic_compare_exchange_n(&s->state, &st, SLOT_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                s->hash = h;
+                snprintf(s->name, sizeof(s->name), "%s", name);
+                s->rating = PROFILES_INITIAL_RATING;
+                __atomic_store_n(&s->state, SLOT_READY, __ATOMIC_RELEASE);
+                __atomic_fetch_add(used, 1, __ATOMIC_RELAXED);
+                STAT_ADD(n_created, 1);
+                return s;
+            }
+            /* Lost the race for this slot; st now holds the winner's state */
+        }
+        while (st == SLOT_BUSY) {
+            sched_yield();
+            st = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+        }
+        if (s->hash == h && strncmp(s->name, name, sizeof(s->name)) == 0) return s;
+    }
+    return NULL;
+}
+
+static void write_begin(PlayerSlot *s) {
+    while (1) {
+        uint32_t v = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+        if (!(v & 1) && __atomic_compare_exchange_n(&s->seq, &v, v + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) return;
+        sched_yield();
+    }
+}
+
+static void write_end(PlayerSlot *s) {
+    __atomic_fetch_add(&s->seq, 1, __ATOMIC_RELEASE);
+}
+
+/* --- File --- */
+
+static void init_header(ProfilesHeader *h, uint64_t cap) {
+    memset(h, 0, PROFILES_SLOT_SZ);
+    memcpy(h->magic, PROFILES_MAGIC, 4);
+    h->version = PROFILES_VERSION;
+    h->slot_size = PROFILES_SLOT_SZ;
+    h->capacity = cap;
+    h->created = (uint64_t)time(NULL);
+}
+
+/**
+ * @brief Maps a table file of cap slots (creating it sparse if size is 0).
+ */
+static void *map_table(int fd, uint64_t cap) {
+    size_t len = (size_t)(cap + 1) * PROFILES_SLOT_SZ;
+    struct stat st;
+    if (fstat(fd, &st) != 0) return NULL;
+    if ((size_t)st.st_size < len && ftruncate(fd, (off_t)len) != 0) return NULL;
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/**
+ * @brief Rewrites the table at path into a new file with cap slots (tmp + rename).
+ */
+static int grow(const char *path, uint64_t cap) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    void *p = map_table(fd, cap);
+    if (!p) { close(fd); unlink(tmp); return -1; }
+
+    ProfilesHeader *nh = p;
+    PlayerSlot *ns = (PlayerSlot *)((char *)p + PROFILES_SLOT_SZ);
+    init_header(nh, cap);
+    nh->created = header->created;
+    for (uint64_t i = 0; i < capacity; i++) {
+        if (slots[i].state != SLOT_READY) continue;
+        uint64_t mask = cap - 1, j = slots[i].hash & mask;
+        while (ns[j].state != SLOT_EMPTY) j = (j + 1) & mask;
+        ns[j] = slots[i];
+        ns[j].seq = 0;
+        nh->used++;
+    }
+    int rc = msync(p, (size_t)(cap + 1) * PROFILES_SLOT_SZ, MS_SYNC);
+    munmap(p, (size_t)(cap + 1) * PROFILES_SLOT_SZ);
+    close(fd);
+    if (rc != 0 || rename(tmp, path) != 0) { unlink(tmp); return -1; }
+    return 0;
+}
+
+int profiles_open(const char *path) {
+    if (profiles_running) return 0;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return -1;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(fd); return -1; }
+
+        uint64_t cap = PROFILES_INITIAL_CAPACITY;
+        ProfilesHeader h;
+        int fresh = st.st_size == 0;
+        if (!fresh) {
+            if (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || memcmp(h.magic, PROFILES_MAGIC, 4) != 0
+                || h.version != PROFILES_VERSION || h.slot_size != PROFILES_SLOT_SZ
+                || h.capacity == 0 || (h.capacity & (h.capacity - 1)) != 0
+                || (uint64_t)st.st_size < (h.capacity + 1) * PROFILES_SLOT_SZ) {
+                log_printf("[PROFILES] %s is not a version %d profile file\n", path, PROFILES_VERSION);
+                close(fd);
+                return -1;
+            }
+            cap = h.capacity;
+        }
+
+        void *p = map_table(fd, cap);
+        close(fd);
+        if (!p) return -1;
+        header = p;
+        slots = (PlayerSlot *)((char *)p + PROFILES_SLOT_SZ);
+        map_len = (size_t)(cap + 1) * PROFILES_SLOT_SZ;
+        capacity = cap;
+        if (fresh) init_header(header, cap);
+
+        /* Writers that died mid-update (crash) leave odd counters and claimed slots */
+        for (uint64_t i = 0; i < capacity; i++) {
+            if (slots[i].state == SLOT_BUSY) slots[i].state = SLOT_READY;
+            if (slots[i].seq & 1) slots[i].seq++;
+        }
+
+        if (attempt == 0 && header->used * 2 > capacity) {
+            uint64_t ncap = capacity * 2;
+            while (header->used * 2 > ncap) ncap *= 2;
+            int rc = grow(path, ncap);
+            munmap(p, map_len);
+            header = NULL; slots = NULL;
+            if (rc != 0) { log_printf("[PROFILES] Cannot grow %s: %s\n", path, strerror(errno)); return -1; }
+            log_printf("[PROFILES] Grew %s to %llu slots\n", path, (unsigned long long)ncap);
+            continue;
+        }
+        break;
+    }
+    for (uint64_t i = 0; i < capacity; i++) {
+        if (slots[i].state == SLOT_READY && slots[i].games > 0) leaderboard_insert(slots[i].name, slots[i].rating);
+    }
+    profiles_running = 1;
+    log_printf("[PROFILES] %s: %llu players, %llu slots, %llu ranked\n", path, (unsigned long long)header->used,
+               (unsigned long long)capacity, (unsigned long long)leaderboard_size());
+    return 0;
+}
+
+void profiles_close(void) {
+    if (!profiles_running) return;
+    profiles_running = 0;
+    msync(header, map_len, MS_SYNC);
+    munmap(header, map_len);
+    header = NULL;
+    slots = NULL;
+    leaderboard_clear();
+}
+
+/* --- Records --- */
+
+void profiles_seen(const char *name) {
+    if (!profiles_running || !name[0]) return;
+    STAT_ADD(n_lookups, 1);
+    PlayerSlot *s = probe(slots, capacity, &header->used, name, 1);
+    if (!s) return;
+    write_begin(s);
+    s->last_seen = (int64_t)io_time();
+    write_end(s);
+}
+
+/**
+ * @brief Applies one rated result (1 win, 0 draw, -1 loss) to a record and
+ * moves the player on the leaderboard before the record is released.
+ */
+static void apply_result(PlayerSlot *s, int result, int delta) {
+    write_begin(s);
+    int32_t old = s->rating;
+    s->games++;
+    if (result > 0) s->wins++;
+    else if (result < 0) s->losses++;
+    else s->draws++;
+    s->rating += delta;
+    if (s->games == 1) leaderboard_insert(s->name, s->rating);
+    else leaderboard_move(s->name, old, s->rating);
+    write_end(s);
+}
+
+void profiles_record_game(const Match *m) {
+    if (!profiles_running || !m->white || !m->black || m->moves_count < PROFILES_MIN_RATED_PLIES) return;
+
+    double score;   /* White's */
+    if (m->winner == 0) score = 1.0;
+    else if (m->winner == 1) score = 0.0;
+    else if (m->end_reason == END_STALEMATE || m->end_reason == END_DRAW_AGREED) score = 0.5;
+    else return;
+
+    PlayerSlot *w = probe(slots, capacity, &header->used, m->white->name, 1);
+    PlayerSlot *b = probe(slots, capacity, &header->used, m->black->name, 1);
+    if (!w || !b || w == b) return;
+
+    int32_t rw = __atomic_load_n(&w->rating, __ATOMIC_RELAXED);
+    int32_t rb = __atomic_load_n(&b->rating, __ATOMIC_RELAXED);
+    double expected = 1.0 / (1.0 + pow(10.0, (rb - rw) / 400.0));
+    int delta = (int)lround(PROFILES_ELO_K * (score - expected));
+    int result = score > 0.5 ? 1 : score < 0.5 ? -1 : 0;
+    apply_result(w, result, delta);
+    apply_result(b, -result, -delta);
+    STAT_ADD(n_rated, 1);
+}
+
+int profiles_get(const char *name, PlayerProfile *out) {
+    if (!profiles_running) return -1;
+    STAT_ADD(n_lookups, 1);
+    PlayerSlot *s = probe(slots, capacity, &header->used, name, 0);
+    if (!s) return -1;
+    while (1) {
+        uint32_t v = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (v & 1) { sched_yield(); continue; }
+        memcpy(out->name, s->name, sizeof(out->name));
+        out->games = s->games;
+        out->wins = s->wins;
+        out->draws = s->draws;
+        out->losses = s->losses;
+        out->rating = s->rating;
+        out->last_seen = s->last_seen;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == v) break;
+        STAT_ADD(n_retries, 1);
+    }
+    out->name[sizeof(out->name) - 1] = '\0';
+    return 0;
+}
+
+int profiles_format_stats(char *buf, size_t sz) {
+    if (!profiles_running) return 0;
+    return snprintf(buf, sz, "capacity=%llu players=%llu lookups=%llu created=%llu rated_games=%llu full=%llu read_retries=%llu\n",
+                    (unsigned long long)capacity, (unsigned long long)__atomic_load_n(&header->used, __ATOMIC_RELAXED),
+                    STAT_GET(n_lookups), STAT_GET(n_created), STAT_GET(n_rated), STAT_GET(n_full), STAT_GET(n_retries));
+}
@@ -0,0 +1,548 @@
+/**
+ * @file replica.c
+ * @brief Hot-standby replication: event stream on the primary, live model on the standby.
+ *
+ * Primary: game threads enqueue events (same queue design as journal.c) only
+ * while a standby is attached. The sender thread accepts the standby, encodes
+ * the initial state with every match locked, then streams batches of events,
+ * or a heartbeat when idle. A standby that falls REPLICA_MAX_BACKLOG behind is
+ * dropped and resyncs on its next connection.
+ *
+ * Standby: applies the stream to unregistered matches built with match_alloc()
+ * and match_replay_move(). A new connection is received into a separate table
+ * that replaces the live one only once its initial state is complete, so a
+ * connection lost half way never leaves a partial registry to promote.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "replica.h"
+#include "codec.h"
+#include "journal.h"
+#include "client.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+#define SROOM_BUCKETS 4096
+
+/**
+ * Queued event, payload stored inline.
+ */
+typedef struct ReplicaNode {
+    struct ReplicaNode *next;
+    uint8_t type;
+    int room_id;
+    uint32_t len;
+    unsigned char data[];
+} ReplicaNode;
+
+/**
+ * Standby-side replica of one live room.
+ */
+typedef struct SRoom {
+    struct SRoom *next;         /**< Hash chain */
+    Match *m;                   /**< Unregistered until promotion */
+    char white[NAME_LEN], white_id[ID_LEN];
+    char black[NAME_LEN], black_id[ID_LEN];
+    int has_black;
+    time_t dc_since[2];         /**< When each player disconnected, 0 while connected */
+} SRoom;
+
+typedef enum { ROLE_NONE = 0, ROLE_PRIMARY, ROLE_STANDBY, ROLE_PROMOTED } ReplicaRole;
+
+static ReplicaRole role = ROLE_NONE;
+
+/* Primary */
+static ReplicaNode *head = NULL;
+static ReplicaNode *tail = NULL;
+static size_t queued_bytes = 0;
+static int attached = 0;    /**< Written under queue_lock with every match locked, read under a match lock */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;
+static int listen_sock = -1;
+static char standby_addr[ADDR_LEN] = "none";
+
+/* Standby */
+static SRoom **live_rooms = NULL;
+static int live_count = 0;
+static int model_next_id = 1;
+
+/* Counters (updated atomically) */
+static uint64_t n_records, n_bytes, n_syncs, n_drops;
+
+/* --- Encoding --- */
+
+/**
+ * @brief MOVE payload: the move text, plus "\0 | varint ms" if the mover's
+ * time left is given.
+ */
+static size_t move_payload(unsigned char *buf, size_t sz, const char *mv, const int64_t *left) {
+    size_t n = (size_t)snprintf((char *)buf, sz, "%s", mv);
+    if (left) {
+        buf[n++] = '\0';
+        n += put_varint(buf + n, *left > 0 ? (uint64_t)*left : 0);
+    }
+    return n;
+}
+
+static int encode_record(Buf *b, uint8_t type, int room_id, const void *payload, size_t len) {
+    if (buf_reserve(b, 1 + 10 + 10 + len) != 0) return -1;
+    unsigned char *start = b->data + b->len;
+    size_t n = 0;
+    start[n++] = type;
+    n += put_varint(start + n, (uint64_t)room_id);
+    n += put_varint(start + n, len);
+    if (len) memcpy(start + n, payload, len);
+    b->len += n + len;
+    return 0;
+}
+
+static size_t identity(char *buf, size_t sz, const Client *c) {
+    size_t n = (size_t)snprintf(buf, sz, "%s", c->name) + 1;
+    return n + (size_t)snprintf(buf + n, sz - n, "%s", c->id);
+}
+
+static size_t disconnect_payload(unsigned char *buf, int color, time_t since) {
+    time_t age = io_time() - since;
+    buf[0] = (unsigned char)color;
+    return 1 + put_varint(buf + 1, age > 0 ? (uint64_t)age : 0);
+}
+
+/* --- Primary --- */
+
+/**
+ * @brief Enqueues one event for the sender, if a standby is attached.
+ */
+static void replica_push(uint8_t type, int room_id, const void *data, size_t len) {
+    if (!__atomic_load_n(&attached, __ATOMIC_ACQUIRE)) return;
+    ReplicaNode *node = malloc(sizeof(ReplicaNode) + len);
+    if (!node) return;
+    node->next = NULL;
+    node->type = type;
+    node->room_id = room_id;
+    node->len = (uint32_t)len;
+    if (len) memcpy(node->data, data, len);
+
+    pthread_mutex_lock(&queue_lock);
+    if (!attached) { pthread_mutex_unlock(&queue_lock); free(node); return; }
+    if (tail) { tail->next = node; tail = node; }
+    else { head = tail = node; }
+    queued_bytes += sizeof(ReplicaNode) + len;
+    if (queued_bytes > REPLICA_MAX_BACKLOG) __atomic_store_n(&attached, 0, __ATOMIC_RELEASE); /* Sender drops the standby */
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+static void push_identity(uint8_t type, int room_id, const Client *c, const TimeControl *tc) {
+    char buf[NAME_LEN + ID_LEN + 32];
+    size_t n = identity(buf, sizeof(buf), c);
+    if (tc && tc->mode != TC_PER_MOVE) n += journal_put_time_control((unsigned char *)buf + n, tc);
+    replica_push(type, room_id, buf, n);
+}
+
+void replica_create(const Match *m) {
+    if (attached && m->white) push_identity(RPL_CREATE, m->id, m->white, &m->tc);
+}
+
+void replica_join(const Match *m) {
+    if (attached && m->black) push_identity(RPL_JOIN, m->id, m->black, NULL);
+}
+
+void replica_move(const Match *m, const char *mv) {
+    unsigned char buf[32];
+    const int64_t *left = (m->tc.mode != TC_PER_MOVE && m->moves_count > 0) ? &m->clock_ms[(m->moves_count - 1) & 1] : NULL;
+    if (attached) replica_push(RPL_MOVE, m->id, buf, move_payload(buf, sizeof(buf), mv, left));
+}
+
+void replica_end(const Match *m) {
+    if (attached) replica_push(RPL_END, m->id, NULL, 0);
+}
+
+void replica_disconnect(const Match *m, int color) {
+    unsigned char p[11];
+    if (attached) replica_push(RPL_DISCONNECT, m->id, p, disconnect_payload(p, color, io_time()));
+}
+
+void replica_reconnect(const Match *m, int color) {
+    unsigned char p = (unsigned char)color;
+    if (attached) replica_push(RPL_RECONNECT, m->id, &p, 1);
+}
+
+/**
+ * @brief Encodes one live match as the events that rebuild it (initial state).
+ */
+static void encode_match(Match *m, void *arg) {
+    Buf *b = arg;
+    char buf[NAME_LEN + ID_LEN + 32];
+    unsigned char p[11];
+    if (m->finished || !m->white) return;
+
+    size_t n = identity(buf, sizeof(buf), m->white);
+    if (m->tc.mode != TC_PER_MOVE) n += journal_put_time_control((unsigned char *)buf + n, &m->tc);
+    encode_record(b, RPL_CREATE, m->id, buf, n);
+    if (m->black) encode_record(b, RPL_JOIN, m->id, buf, identity(buf, sizeof(buf), m->black));
+    /* Only each side's last move needs its clock */
+    for (size_t i = 0; i < m->moves_count; i++) {
+        const int64_t *left = (m->tc.mode != TC_PER_MOVE && i + 2 >= m->moves_count) ? &m->clock_ms[i & 1] : NULL;
+        encode_record(b, RPL_MOVE, m->id, buf, move_payload((unsigned char *)buf, sizeof(buf), m->moves[i], left));
+    }
+    if (m->white->sock == -1) encode_record(b, RPL_DISCONNECT, m->id, p, disconnect_payload(p, 0, m->white->disconnect_time));
+    if (m->black && m->black->sock == -1) encode_record(b, RPL_DISCONNECT, m->id, p, disconnect_payload(p, 1, m->black->disconnect_time));
+}
+
+static void detach(void) {
+    pthread_mutex_lock(&queue_lock);
+    __atomic_store_n(&attached, 0, __ATOMIC_RELEASE);
+    ReplicaNode *n = head;
+    head = tail = NULL;
+    queued_bytes = 0;
+    pthread_mutex_unlock(&queue_lock);
+    while (n) { ReplicaNode *next = n->next; free(n); n = next; }
+}
+
+/**
+ * @brief Sends the initial state and then the event stream until the standby goes away.
+ */
+static void serve_standby(int s, Buf *out) {
+    unsigned char vb[10];
+    int next_id = match_next_room_id();
+
+    out->len = 0;
+    match_lock_all();
+    match_foreach_held(encode_match, out);
+    pthread_mutex_lock(&queue_lock);
+    __atomic_store_n(&attached, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&queue_lock);
+    match_unlock_all();
+    encode_record(out, RPL_SYNCED, 0, vb, put_varint(vb, (uint64_t)next_id));
+
+    if (send_all(s, out->data, out->len) != 0) return;
+    STAT_ADD(n_syncs, 1);
+    STAT_ADD(n_bytes, out->len);
+    log_printf("[REPLICA] Standby %s attached, sent %zu bytes of state\n", standby_addr, out->len);
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        if (head == NULL && attached) {
+            uint64_t due = mono_ms() + REPLICA_HEARTBEAT_MS;
+            struct timespec dl = { (time_t)(due / 1000), (long)(due % 1000) * 1000000L };
+            pthread_cond_timedwait(&queue_cond, &queue_lock, &dl);
+        }
+        ReplicaNode *batch = head;
+        head = tail = NULL;
+        queued_bytes = 0;
+        int still = attached;
+        pthread_mutex_unlock(&queue_lock);
+
+        if (!still) {
+            while (batch) { ReplicaNode *next = batch->next; free(batch); batch = next; }
+            STAT_ADD(n_drops, 1);
+            log_printf("[REPLICA] Standby %s fell more than %d bytes behind, dropping it\n", standby_addr, REPLICA_MAX_BACKLOG);
+            return;
+        }
+
+        out->len = 0;
+        uint64_t count = 0;
+        if (!batch) encode_record(out, RPL_HEARTBEAT, 0, NULL, 0);
+        while (batch) {
+            encode_record(out, batch->type, batch->room_id, batch->data, batch->len);
+            count++;
+            ReplicaNode *done = batch;
+            batch = batch->next;
+            free(done);
+        }
+        if (send_all(s, out->data, out->len) != 0) return;
+        STAT_ADD(n_records, count);
+        STAT_ADD(n_bytes, out->len);
+    }
+}
+
+static void *replica_sender_func(void *arg) {
+    (void)arg;
+    Buf out = { 0 };
+    while (1) {
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        int s = accept(listen_sock, (struct sockaddr *)&peer, &plen);
+        if (s < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) { log_printf("[REPLICA] accept failed: %s\n", strerror(errno)); sleep(1); }
+            continue;
+        }
+        int one = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct timeval tv = { REPLICA_TIMEOUT_MS / 1000, (REPLICA_TIMEOUT_MS % 1000) * 1000 };
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer.sin_addr, ip, sizeof(ip));
+        snprintf(standby_addr, sizeof(standby_addr), "%s:%u", ip, ntohs(peer.sin_port));
+
+        serve_standby(s, &out);
+
+        detach();
+        close(s);
+        log_printf("[REPLICA] Standby %s detached\n", standby_addr);
+        snprintf(standby_addr, sizeof(standby_addr), "none");
+    }
+    return NULL;
+}
+
+int replica_start(struct in_addr ip, int port) {
+    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_sock < 0) return -1;
+    int opt = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr = ip;
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_sock, 1) < 0) {
+        close(listen_sock);
+        listen_sock = -1;
+        return -1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, replica_sender_func, NULL) != 0) {
+        close(listen_sock);
+        listen_sock = -1;
+        return -1;
+    }
+    pthread_detach(tid);
+    role = ROLE_PRIMARY;
+    log_printf("[REPLICA] Accepting a standby on port %d\n", port);
+    return 0;
+}
+
+/* --- Standby --- */
+
+static SRoom **room_slot(SRoom **tbl, int id) {
+    SRoom **pp = &tbl[(unsigned)id % SROOM_BUCKETS];
+    while (*pp && (*pp)->m->id != id) pp = &(*pp)->next;
+    return pp;
+}
+
+static void split_identity(const unsigned char *p, size_t len, char *name, size_t name_sz, char *id, size_t id_sz) {
+    const unsigned char *nul = memchr(p, '\0', len);
+    size_t name_len = nul ? (size_t)(nul - p) : len;
+    snprintf(name, name_sz, "%.*s", (int)name_len, (const char *)p);
+    if (nul) snprintf(id, id_sz, "%.*s", (int)(len - name_len - 1), (const char *)nul + 1);
+    else snprintf(id, id_sz, "unknown");
+}
+
+static void room_free(SRoom *r) {
+    match_free(r->m);
+    free(r);
+}
+
+static void table_free(SRoom **tbl) {
+    if (!tbl) return;
+    for (int i = 0; i < SROOM_BUCKETS; i++) {
+        SRoom *r = tbl[i];
+        while (r) { SRoom *next = r->next; room_free(r); r = next; }
+    }
+    free(tbl);
+}
+
+/**
+ * @brief Applies one record to a room table.
+ * @return Number of rooms added (1) or removed (-1).
+ */
+static int model_apply(SRoom **tbl, uint8_t type, int id, const unsigned char *p, size_t len) {
+    SRoom **pp = room_slot(tbl, id);
+    SRoom *r = *pp;
+    if (type == RPL_CREATE) {
+        int added = 1;
+        if (r) { *pp = r->next; room_free(r); added = 0; }
+        r = calloc(1, sizeof(SRoom));
+        if (r) r->m = match_alloc(id);
+        if (!r || !r->m) { free(r); return added - 1; }
+        split_identity(p, len, r->white, sizeof(r->white), r->white_id, sizeof(r->white_id));
+        TimeControl tc;
+        if (journal_get_time_control(p, len, &tc)) match_set_time_control(r->m, &tc);
+        r->next = tbl[(unsigned)id % SROOM_BUCKETS];
+        tbl[(unsigned)id % SROOM_BUCKETS] = r;
+        if (id >= model_next_id) model_next_id = id + 1;
+        return added;
+    }
+    if (!r) return 0;
+    if (type == RPL_JOIN) {
+        split_identity(p, len, r->black, sizeof(r->black), r->black_id, sizeof(r->black_id));
+        r->has_black = 1;
+    } else if (type == RPL_MOVE) {
+        char mv[16];
+        snprintf(mv, sizeof(mv), "%.*s", (int)len, (const char *)p);
+        const unsigned char *nul = memchr(p, '\0', len);
+        uint64_t left;
+        if (match_replay_move(r->m, mv) != 0) log_printf("[REPLICA] Move %s in room %d does not replay, ignoring it\n", mv, id);
+        else if (nul && get_varint(nul + 1, len - (size_t)(nul + 1 - p), &left)) r->m->clock_ms[(r->m->moves_count - 1) & 1] = (int64_t)left;
+    } else if (type == RPL_END) {
+        *pp = r->next;
+        room_free(r);
+        return -1;
+    } else if ((type == RPL_DISCONNECT || type == RPL_RECONNECT) && len >= 1 && p[0] <= 1) {
+        uint64_t age = 0;
+        if (type == RPL_DISCONNECT) get_varint(p + 1, len - 1, &age);
+        r->dc_since[p[0]] = (type == RPL_DISCONNECT) ? io_time() - (time_t)age : 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives from the primary until the connection is lost or goes silent.
+ * The initial state goes into a fresh table that replaces the live one on RPL_SYNCED.
+ * @return 1 if this connection completed its initial state, 0 otherwise.
+ */
+static int follow_stream(int s) {
+    SRoom **tbl = calloc(SROOM_BUCKETS, sizeof(SRoom *));
+    int count = 0, synced = 0;
+    size_t cap = 65536, len = 0;
+    unsigned char *buf = malloc(cap);
+    if (!tbl || !buf) { free(tbl); free(buf); return 0; }
+
+    struct timeval tv = { REPLICA_TIMEOUT_MS / 1000, (REPLICA_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint64_t t0 = mono_ms();
+
+    while (1) {
+        if (len == cap) {
+            unsigned char *nb = realloc(buf, cap * 2);
+            if (!nb) break;
+            buf = nb; cap *= 2;
+        }
+        ssize_t n = recv(s, buf + len, cap - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        STAT_ADD(n_bytes, (uint64_t)n);
+
+        size_t off = 0;
+        while (off < len) {
+            uint64_t room, plen;
+            size_t a = get_varint(buf + off + 1, len - off - 1, &room);
+            size_t b = a ? get_varint(buf + off + 1 + a, len - off - 1 - a, &plen) : 0;
+            if (!b || len - off - 1 - a - b < plen) break;
+            uint8_t type = buf[off];
+            const unsigned char *payload = buf + off + 1 + a + b;
+            if (type == RPL_SYNCED) {
+                uint64_t next;
+                if (get_varint(payload, plen, &next) && (int)next > model_next_id) model_next_id = (int)next;
+                table_free(live_rooms);
+                live_rooms = tbl;
+                live_count = count;
+                synced = 1;
+                STAT_ADD(n_syncs, 1);
+                log_printf("[REPLICA] Synced %d rooms from the primary in %llu ms\n", count, (unsigned long long)(mono_ms() - t0));
+            } else if (type != RPL_HEARTBEAT) {
+                int delta = model_apply(tbl, type, (int)room, payload, plen);
+                if (synced) live_count += delta;
+                else count += delta;
+                STAT_ADD(n_records, 1);
+            }
+            off += 1 + a + b + plen;
+        }
+        memmove(buf, buf + off, len - off);
+        len -= off;
+    }
+    if (!synced) table_free(tbl);
+    free(buf);
+    return synced;
+}
+
+/**
+ * @brief Registers the replicated matches, with their players disconnected.
+ */
+static void promote(void) {
+    uint64_t t0 = mono_ms();
+    int n = 0;
+    for (int i = 0; live_rooms && i < SROOM_BUCKETS; i++) {
+        SRoom *r = live_rooms[i];
+        while (r) {
+            SRoom *next = r->next;
+            Match *m = match_adopt(r->m, r->white, r->white_id, r->has_black ? r->black : NULL, r->has_black ? r->black_id : NULL);
+            if (m) {
+                /* Keep counting the grace period from when the player actually left */
+                pthread_mutex_lock(&m->lock);
+                if (r->dc_since[0] && m->white) m->white->disconnect_time = r->dc_since[0];
+                if (r->dc_since[1] && m->black) m->black->disconnect_time = r->dc_since[1];
+                pthread_mutex_unlock(&m->lock);
+                n++;
+            }
+            free(r);
+            r = next;
+        }
+    }
+    free(live_rooms);
+    live_rooms = NULL;
+    match_reserve_room_ids(model_next_id);
+    role = ROLE_PROMOTED;
+    log_printf("[REPLICA] Promoted to primary with %d rooms in %llu ms\n", n, (unsigned long long)(mono_ms() - t0));
+}
+
+static int connect_primary(const char *host, const char *port) {
+    struct addrinfo hints, *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0 || !res) return -1;
+    int s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (s >= 0 && connect(s, res->ai_addr, res->ai_addrlen) < 0) { close(s); s = -1; }
+    freeaddrinfo(res);
+    return s;
+}
+
+int replica_follow(const char *primary) {
+    char host[256];
+    const char *colon = strrchr(primary, ':');
+    if (!colon || colon == primary || (size_t)(colon - primary) >= sizeof(host)) return -1;
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - primary), primary);
+    const char *port = colon + 1;
+
+    role = ROLE_STANDBY;
+    int synced_once = 0;
+    uint64_t lost_at = 0;
+    log_printf("[REPLICA] Standing by for %s\n", primary);
+    while (1) {
+        int s = connect_primary(host, port);
+        if (s >= 0) {
+            int synced = follow_stream(s);
+            close(s);
+            if (synced) {
+                synced_once = 1;
+                lost_at = mono_ms();
+                log_printf("[REPLICA] Lost the primary, taking over unless it is back within %d ms\n", REPLICA_FAILOVER_MS);
+                continue;
+            }
+        }
+        if (synced_once && mono_ms() - lost_at >= REPLICA_FAILOVER_MS) break;
+        usleep(REPLICA_RETRY_MS * 1000);
+    }
+    promote();
+    return 0;
+}
+
+int replica_format_stats(char *buf, size_t sz) {
+    static const char *names[] = { "none", "primary", "standby", "promoted" };
+    if (role == ROLE_NONE) return 0;
+    return snprintf(buf, sz, "role=%s standby=%s records=%llu bytes=%llu syncs=%llu drops=%llu\n",
+                    names[role], standby_addr, STAT_GET(n_records), STAT_GET(n_bytes), STAT_GET(n_syncs), STAT_GET(n_drops));
+}
@@ -0,0 +1,155 @@
+/**
+ * @file retransmit.c
+ * @brief Ring of numbered messages kept per session (see retransmit.h).
+ *
+ * A buffer belongs to one session and is only touched under its client lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "retransmit.h"
+#include "client.h"
+#include "config.h"
+#include "stats.h"
+
+/**
+ * One held message: the numbered line with its newline, NUL-terminated for
+ * send_raw().
+ */
+typedef struct {
+    char *line;
+    size_t len;
+} Held;
+
+struct Retransmit {
+    uint64_t next_seq;
+    uint64_t first_seq;     /**< Number of q[head], the oldest message held */
+    Held q[RETRANSMIT_MAX_MSGS];
+    unsigned head, count;
+    size_t bytes;
+};
+
+/* Counters (updated atomically) */
+static uint64_t n_sessions, n_numbered, n_evicted, n_gap_free, n_full, n_replayed, n_duplicates;
+
+Retransmit *retransmit_create(uint64_t next_seq) {
+    Retransmit *r = calloc(1, sizeof(Retransmit));
+    if (!r) return NULL;
+    r->next_seq = r->first_seq = next_seq ? next_seq : 1;
+    STAT_ADD(n_sessions, 1);
+    return r;
+}
+
+static void drop_oldest(Retransmit *r) {
+    Held *h = &r->q[r->head];
+    r->bytes -= h->len;
+    free(h->line);
+    h->line = NULL;
+    r->head = (r->head + 1) % RETRANSMIT_MAX_MSGS;
+    r->count--;
+    r->first_seq++;
+}
+
+void retransmit_free(Retransmit *r) {
+    if (!r) return;
+    while (r->count > 0) drop_oldest(r);
+    free(r);
+    STAT_ADD(n_sessions, (uint64_t)-1);
+}
+
+/**
+ * @brief Appends a numbered line, evicting old ones to make room.
+ * A line that cannot be copied ends the held range: nothing before it can
+ * be replayed any more.
+ * @return 0 if the line is held, -1 if memory ran out.
+ */
+static int hold(Retransmit *r, const char *line, size_t len) {
+    while (r->count > 0 && (r->count == RETRANSMIT_MAX_MSGS || r->bytes + len > RETRANSMIT_MAX_BYTES)) {
+        drop_oldest(r);
+        STAT_ADD(n_evicted, 1);
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        while (r->count > 0) drop_oldest(r);
+        r->first_seq = r->next_seq;
+        return -1;
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    Held *h = &r->q[(r->head + r->count) % RETRANSMIT_MAX_MSGS];
+    h->line = copy;
+    h->len = len;
+    r->count++;
+    r->bytes += len;
+    return 0;
+}
+
+size_t retransmit_push(Retransmit *r, const char *payload, char *out, size_t out_sz) {
+    uint64_t seq = r->next_seq++;
+    int n = snprintf(out, out_sz, SEQ_LINE "%llu %s\n", (unsigned long long)seq, payload);
+    if (n < 0) n = 0;
+    if ((size_t)n >= out_sz) { n = (int)out_sz - 1; out[n - 1] = '\n'; }
+    if (r->count == 0) r->first_seq = seq;
+    hold(r, out, (size_t)n);
+    STAT_ADD(n_numbered, 1);
+    return (size_t)n;
+}
+
+uint64_t retransmit_next_seq(const Retransmit *r) {
+    return r->next_seq;
+}
+
+int retransmit_covers(const Retransmit *r, uint64_t last_seen) {
+    if (last_seen >= r->next_seq) return 0;     /* Numbers this session never sent */
+    return last_seen + 1 >= (r->count ? r->first_seq : r->next_seq);
+}
+
+size_t retransmit_replay(const Retransmit *r, uint64_t last_seen, int sock) {
+    size_t sent = 0;
+    for (unsigned i = 0; i < r->count; i++) {
+        if (r->first_seq + i <= last_seen) continue;
+        const Held *h = &r->q[(r->head + i) % RETRANSMIT_MAX_MSGS];
+        send_raw(sock, h->line);
+        sent++;
+    }
+    STAT_ADD(n_replayed, sent);
+    return sent;
+}
+
+size_t retransmit_held(const Retransmit *r) {
+    return r->count;
+}
+
+const char *retransmit_line(const Retransmit *r, size_t i, size_t *len) {
+    const Held *h = &r->q[(r->head + i) % RETRANSMIT_MAX_MSGS];
+    *len = h->len;
+    return h->line;
+}
+
+int retransmit_restore(Retransmit *r, const char *line, size_t len) {
+    size_t pl = strlen(SEQ_LINE);
+    if (len <= pl || memcmp(line, SEQ_LINE, pl) != 0 || line[len - 1] != '\n') return -1;
+    uint64_t seq = strtoull(line + pl, NULL, 10);
+    if (seq == 0) return -1;
+    if (r->count == 0) r->first_seq = seq;
+    else if (seq != r->first_seq + r->count) return -1;
+    if (seq >= r->next_seq) r->next_seq = seq + 1;
+    return hold(r, line, len);
+}
+
+void retransmit_count_resume(int gap_free) {
+    if (gap_free) STAT_ADD(n_gap_free, 1);
+    else STAT_ADD(n_full, 1);
+}
+
+void retransmit_count_duplicate(void) {
+    STAT_ADD(n_duplicates, 1);
+}
+
+int retransmit_format_stats(char *buf, size_t sz) {
+    return snprintf(buf, sz, "sessions=%llu numbered=%llu evicted=%llu gap_free_resumes=%llu full_resumes=%llu replayed=%llu duplicates=%llu\n",
+                    STAT_GET(n_sessions), STAT_GET(n_numbered), STAT_GET(n_evicted), STAT_GET(n_gap_free),
+                    STAT_GET(n_full), STAT_GET(n_replayed), STAT_GET(n_duplicates));
+}
@@ -0,0 +1,118 @@
+/**
+ * @file rtt.c
+ * @brief Round-trip probes and lag credit (see rtt.h).
+ *
+ * A connection's probe state and estimate are written under its client lock
+ * (the watchdog sends, the worker reads the echo); the estimate is read
+ * without it by the move path, one atomic load per field.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "rtt.h"
+#include "client.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+/* Set in rtt_probe_ms once the probe was echoed, so a repeated echo is stale */
+#define PROBE_ANSWERED ((uint64_t)1 << 63)
+
+static unsigned probe_interval_ms = 0;
+static unsigned lagcomp_max_ms = 0;
+
+/* Counters (updated atomically) */
+static uint64_t n_probes, n_echoes, n_stale, n_credits, n_credit_ms;
+
+int rtt_configure(unsigned probe_interval, unsigned lagcomp_max) {
+    if (probe_interval && probe_interval < RTT_MIN_INTERVAL_MS) return -1;
+    probe_interval_ms = probe_interval;
+    lagcomp_max_ms = lagcomp_max;
+    return 0;
+}
+
+unsigned rtt_probe_interval_ms(void) {
+    return probe_interval_ms;
+}
+
+void rtt_probe(Client *c) {
+    if (!probe_interval_ms || !c || c->sock <= 0) return;
+    Client *conn = c->mux ? c->mux : c;
+    uint64_t now = io_mono_ms();
+    char line[48];
+    pthread_mutex_lock(&conn->lock);
+    uint64_t last = conn->rtt_probe_ms & ~PROBE_ANSWERED;
+    /* An unanswered probe gets a second interval: replacing it would make its echo stale */
+    uint64_t wait = (conn->rtt_probe_ms & PROBE_ANSWERED) ? probe_interval_ms : 2ull * probe_interval_ms;
+    if (conn->sock > 0 && (!last || now - last >= wait)) {
+        /* Never 0, which stands for no probe sent */
+        conn->rtt_probe_ms = now ? now : 1;
+        snprintf(line, sizeof(line), RTT_PROBE "%llu\n", (unsigned long long)conn->rtt_probe_ms);
+        conn_flush_tail(conn, 1);
+        send_raw(conn->sock, line);
+        STAT_ADD(n_probes, 1);
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+int rtt_on_echo(Client *c, const char *line) {
+    if (strncmp(line, RTT_PROBE, 4) != 0) return 0;
+    char *end;
+    unsigned long long sent = strtoull(line + 4, &end, 10);
+    uint64_t now = io_mono_ms();
+    pthread_mutex_lock(&c->lock);
+    if (*end != '\0' || sent == 0 || sent != c->rtt_probe_ms || now < sent) {
+        pthread_mutex_unlock(&c->lock);
+        STAT_ADD(n_stale, 1);
+        return 1;
+    }
+    int64_t r = (int64_t)(now - sent) * 1000;
+    if (r > UINT32_MAX / 2) r = UINT32_MAX / 2;
+    if (c->rtt_samples == 0) {
+        __atomic_store_n(&c->srtt_us, (uint32_t)r, __ATOMIC_RELAXED);
+        __atomic_store_n(&c->rttvar_us, (uint32_t)(r / 2), __ATOMIC_RELAXED);
+    } else {
+        int64_t srtt = c->srtt_us, var = c->rttvar_us;
+        int64_t dev = srtt > r ? srtt - r : r - srtt;
+        var += (dev - var) / 4;
+        srtt += (r - srtt) / 8;
+        __atomic_store_n(&c->srtt_us, (uint32_t)srtt, __ATOMIC_RELAXED);
+        __atomic_store_n(&c->rttvar_us, (uint32_t)var, __ATOMIC_RELAXED);
+    }
+    c->rtt_samples++;
+    c->rtt_probe_ms |= PROBE_ANSWERED;
+    pthread_mutex_unlock(&c->lock);
+    STAT_ADD(n_echoes, 1);
+    return 1;
+}
+
+void rtt_reset(Client *c) {
+    pthread_mutex_lock(&c->lock);
+    c->rtt_probe_ms = 0;
+    c->rtt_samples = 0;
+    __atomic_store_n(&c->srtt_us, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->rttvar_us, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&c->lock);
+}
+
+unsigned rtt_lag_credit_ms(const Client *c) {
+    if (!lagcomp_max_ms || !c) return 0;
+    const Client *conn = c->mux ? c->mux : c;
+    unsigned one_way = __atomic_load_n(&conn->srtt_us, __ATOMIC_RELAXED) / 2000;
+    return one_way < lagcomp_max_ms ? one_way : lagcomp_max_ms;
+}
+
+void rtt_count_credit(unsigned ms) {
+    if (!ms) return;
+    STAT_ADD(n_credits, 1);
+    STAT_ADD(n_credit_ms, ms);
+}
+
+int rtt_format_stats(char *buf, size_t sz) {
+    return snprintf(buf, sz, "interval_ms=%u lagcomp_max_ms=%u probes=%llu echoes=%llu stale=%llu credits=%llu credit_ms=%llu\n",
+                    probe_interval_ms, lagcomp_max_ms, STAT_GET(n_probes), STAT_GET(n_echoes),
+                    STAT_GET(n_stale), STAT_GET(n_credits), STAT_GET(n_credit_ms));
+}
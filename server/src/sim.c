@@ -0,0 +1,380 @@
+/**
+ * @file sim.c
+ * @brief Deterministic simulated transport, virtual clock and baton scheduler.
+ *
+ * Every simulated thread is a real pthread, but it only executes while it
+ * holds the baton (running == self). The baton moves only inside recv/sleep,
+ * always to the first runnable thread after the current one in creation
+ * order, so the interleaving depends on nothing but the program itself.
+ * All simulator state is protected by sim_lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "sim.h"
+#include "netio.h"
+
+/**
+ * One side of a simulated connection. Bytes sent by the peer are appended to
+ * buf and consumed from off.
+ */
+typedef struct {
+    int peer;               /**< Descriptor of the other side */
+    int closed;             /**< close() was called on this side */
+    int shut_rd;            /**< Reads return EOF immediately */
+    int shut_wr;            /**< Writes fail with EPIPE */
+    int eof;                /**< Peer closed or shut down its write side */
+    char *buf;
+    size_t off, len, cap;
+} Endpoint;
+
+typedef enum { SIM_READY, SIM_SLEEP, SIM_RECV } SimWait;
+
+typedef struct SimThread {
+    pthread_cond_t cv;
+    SimWait wait;
+    uint64_t wake_at;       /**< Virtual deadline for SIM_SLEEP and timed SIM_RECV (0 = none) */
+    int fd;                 /**< Descriptor a SIM_RECV thread is blocked on */
+    void *(*fn)(void *);
+    void *arg;
+    struct SimThread *next;
+} SimThread;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static SimThread *threads_head = NULL;
+static SimThread *threads_tail = NULL;
+static SimThread *running = NULL;
+static int n_threads = 0;
+static int deadlocked = 0;
+static __thread SimThread *self = NULL;
+
+static Endpoint **endpoints = NULL;
+static size_t n_endpoints = 0, endpoints_cap = 0;
+
+static uint64_t clock_ns = 0;
+static uint64_t trace_hash = 0;
+static uint64_t switch_count = 0;
+
+#define FNV_OFFSET 1469598103934665603ull
+#define FNV_PRIME 1099511628211ull
+
+/* --- Endpoints --- */
+
+static Endpoint *ep_get(int fd) {
+    if (fd < SIM_FD_BASE || (size_t)(fd - SIM_FD_BASE) >= n_endpoints) return NULL;
+    return endpoints[fd - SIM_FD_BASE];
+}
+
+static int ep_readable(int fd) {
+    Endpoint *e = ep_get(fd);
+    return !e || e->closed || e->shut_rd || e->eof || e->len > e->off;
+}
+
+static int ep_new(void) {
+    if (n_endpoints == endpoints_cap) {
+        size_t cap = endpoints_cap ? endpoints_cap * 2 : 64;
+        Endpoint **tmp = realloc(endpoints, cap * sizeof(*tmp));
+        if (!tmp) return -1;
+        endpoints = tmp; endpoints_cap = cap;
+    }
+    Endpoint *e = calloc(1, sizeof(Endpoint));
+    if (!e) return -1;
+    endpoints[n_endpoints] = e;
+    return SIM_FD_BASE + (int)n_endpoints++;
+}
+
+/* --- Scheduler --- */
+
+static int can_run(const SimThread *t) {
+    switch (t->wait) {
+        case SIM_READY: return 1;
+        case SIM_SLEEP: return t->wake_at <= clock_ns;
+        case SIM_RECV:  return ep_readable(t->fd) || (t->wake_at && t->wake_at <= clock_ns);
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds the next runnable thread, scanning from start in creation order.
+ * Advances the virtual clock to the earliest deadline when nobody can run.
+ * @return NULL if every thread is blocked without a deadline.
+ */
+static SimThread *pick_next(SimThread *start) {
+    if (!threads_head) return NULL;
+    while (1) {
+        SimThread *t = start ? start : threads_head;
+        for (int i = 0; i < n_threads; i++) {
+            if (can_run(t)) return t;
+            t = t->next ? t->next : threads_head;
+        }
+        uint64_t next_wake = UINT64_MAX;
+        for (t = threads_head; t; t = t->next) {
+            if (t->wait != SIM_READY && t->wake_at && t->wake_at < next_wake) next_wake = t->wake_at;
+        }
+        if (next_wake == UINT64_MAX) return NULL;
+        clock_ns = next_wake;
+    }
+}
+
+static void hand_to(SimThread *next) {
+    running = next;
+    switch_count++;
+    pthread_cond_signal(&next->cv);
+}
+
+/**
+ * @brief Gives the baton away until the calling thread is runnable again.
+ * Called with sim_lock held and self->wait describing what we wait for.
+ */
+static void park(void) {
+    SimThread *next = pick_next(self->next);
+    if (!next) {
+        /* Nobody can ever wake up: report it and leave the threads parked */
+        deadlocked = 1;
+        running = NULL;
+        pthread_cond_broadcast(&idle_cond);
+        while (1) pthread_cond_wait(&self->cv, &sim_lock);
+    }
+    if (next != self) {
+        hand_to(next);
+        while (running != self) pthread_cond_wait(&self->cv, &sim_lock);
+    }
+    self->wait = SIM_READY;
+    self->wake_at = 0;
+}
+
+static void *sim_trampoline(void *arg) {
+    SimThread *t = (SimThread *)arg;
+
+    pthread_mutex_lock(&sim_lock);
+    self = t;
+    while (running != t) pthread_cond_wait(&t->cv, &sim_lock);
+    pthread_mutex_unlock(&sim_lock);
+
+    t->fn(t->arg);
+
+    pthread_mutex_lock(&sim_lock);
+    SimThread *start = t->next;
+    SimThread **pp = &threads_head;
+    SimThread *prev = NULL;
+    while (*pp != t) { prev = *pp; pp = &(*pp)->next; }
+    *pp = t->next;
+    if (threads_tail == t) threads_tail = prev;
+    n_threads--;
+
+    SimThread *next = pick_next(start);
+    if (next) hand_to(next);
+    else {
+        running = NULL;
+        if (n_threads > 0) deadlocked = 1;
+        pthread_cond_broadcast(&idle_cond);
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_cond_destroy(&t->cv);
+    free(t);
+    return NULL;
+}
+
+static SimThread *thread_new(void *(*fn)(void *), void *arg) {
+    SimThread *t = calloc(1, sizeof(SimThread));
+    if (!t) return NULL;
+    pthread_cond_init(&t->cv, NULL);
+    t->fn = fn;
+    t->arg = arg;
+    t->wait = SIM_READY;
+
+    pthread_mutex_lock(&sim_lock);
+    if (threads_tail) threads_tail->next = t;
+    else threads_head = t;
+    threads_tail = t;
+    n_threads++;
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, sim_trampoline, t) != 0) {
+        pthread_mutex_lock(&sim_lock);
+        SimThread **pp = &threads_head;
+        SimThread *prev = NULL;
+        while (*pp != t) { prev = *pp; pp = &(*pp)->next; }
+        *pp = t->next;
+        if (threads_tail == t) threads_tail = prev;
+        n_threads--;
+        pthread_mutex_unlock(&sim_lock);
+        pthread_cond_destroy(&t->cv);
+        free(t);
+        return NULL;
+    }
+    pthread_detach(tid);
+    return t;
+}
+
+/* --- IoOps implementation --- */
+
+static time_t sim_now(void) {
+    return (time_t)(SIM_EPOCH + clock_ns / 1000000000ull);
+}
+
+static uint64_t sim_mono_ms(void) {
+    return clock_ns / 1000000ull;
+}
+
+static void sim_sleep_us(unsigned int usec) {
+    if (!self) return;
+    pthread_mutex_lock(&sim_lock);
+    self->wait = SIM_SLEEP;
+    self->wake_at = clock_ns + (uint64_t)usec * 1000ull;
+    park();
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static ssize_t recv_until(int fd, void *buf, size_t len, int flags, uint64_t deadline) {
+    pthread_mutex_lock(&sim_lock);
+    while (1) {
+        Endpoint *e = ep_get(fd);
+        if (!e || e->closed) { pthread_mutex_unlock(&sim_lock); errno = EBADF; return -1; }
+        if (e->len > e->off) {
+            size_t n = e->len - e->off;
+            if (n > len) n = len;
+            memcpy(buf, e->buf + e->off, n);
+            e->off += n;
+            if (e->off == e->len) e->off = e->len = 0;
+            pthread_mutex_unlock(&sim_lock);
+            return (ssize_t)n;
+        }
+        if (e->eof || e->shut_rd) { pthread_mutex_unlock(&sim_lock); return 0; }
+        if ((flags & MSG_DONTWAIT) || !self) { pthread_mutex_unlock(&sim_lock); errno = EAGAIN; return -1; }
+        if (deadline && clock_ns >= deadline) { pthread_mutex_unlock(&sim_lock); errno = ETIMEDOUT; return -1; }
+        self->wait = SIM_RECV;
+        self->fd = fd;
+        self->wake_at = deadline;
+        park();
+    }
+}
+
+static ssize_t sim_recv(int fd, void *buf, size_t len, int flags) {
+    return recv_until(fd, buf, len, flags, 0);
+}
+
+static ssize_t sim_send(int fd, const void *buf, size_t len, int flags) {
+    (void)flags;
+    pthread_mutex_lock(&sim_lock);
+    Endpoint *e = ep_get(fd);
+    if (!e || e->closed) { pthread_mutex_unlock(&sim_lock); errno = EBADF; return -1; }
+    Endpoint *p = ep_get(e->peer);
+    if (e->shut_wr || !p || p->closed) { pthread_mutex_unlock(&sim_lock); errno = EPIPE; return -1; }
+
+    if (!p->shut_rd) {
+        if (p->len + len > p->cap) {
+            size_t cap = p->cap ? p->cap : 256;
+            while (cap < p->len + len) cap *= 2;
+            char *tmp = realloc(p->buf, cap);
+            if (!tmp) { pthread_mutex_unlock(&sim_lock); errno = ENOBUFS; return -1; }
+            p->buf = tmp; p->cap = cap;
+        }
+        memcpy(p->buf + p->len, buf, len);
+        p->len += len;
+    }
+
+    const unsigned char *b = (const unsigned char *)buf;
+    trace_hash = (trace_hash ^ (uint64_t)fd) * FNV_PRIME;
+    for (size_t i = 0; i < len; i++) trace_hash = (trace_hash ^ b[i]) * FNV_PRIME;
+    pthread_mutex_unlock(&sim_lock);
+    return (ssize_t)len;
+}
+
+static int sim_close(int fd) {
+    pthread_mutex_lock(&sim_lock);
+    Endpoint *e = ep_get(fd);
+    if (!e || e->closed) { pthread_mutex_unlock(&sim_lock); errno = EBADF; return -1; }
+    e->closed = 1;
+    free(e->buf);
+    e->buf = NULL; e->off = e->len = e->cap = 0;
+    Endpoint *p = ep_get(e->peer);
+    if (p) p->eof = 1;
+    pthread_mutex_unlock(&sim_lock);
+    return 0;
+}
+
+static int sim_shutdown(int fd, int how) {
+    pthread_mutex_lock(&sim_lock);
+    Endpoint *e = ep_get(fd);
+    if (!e || e->closed) { pthread_mutex_unlock(&sim_lock); errno = EBADF; return -1; }
+    if (how == SHUT_RD || how == SHUT_RDWR) e->shut_rd = 1;
+    if (how == SHUT_WR || how == SHUT_RDWR) {
+        e->shut_wr = 1;
+        Endpoint *p = ep_get(e->peer);
+        if (p) p->eof = 1;
+    }
+    pthread_mutex_unlock(&sim_lock);
+    return 0;
+}
+
+static int sim_spawn(void *(*fn)(void *), void *arg) {
+    return thread_new(fn, arg) ? 0 : -1;
+}
+
+static const IoOps sim_ops = {
+    sim_now, sim_mono_ms, sim_sleep_us, sim_send, sim_recv, sim_close, sim_shutdown, sim_spawn
+};
+
+/* --- Public API --- */
+
+void sim_init(void) {
+    pthread_mutex_lock(&sim_lock);
+    for (size_t i = 0; i < n_endpoints; i++) { free(endpoints[i]->buf); free(endpoints[i]); }
+    n_endpoints = 0;
+    clock_ns = 0;
+    trace_hash = FNV_OFFSET;
+    switch_count = 0;
+    deadlocked = 0;
+    pthread_mutex_unlock(&sim_lock);
+    io_set_ops(&sim_ops);
+}
+
+int sim_run(void *(*fn)(void *), void *arg) {
+    SimThread *t = thread_new(fn, arg);
+    if (!t) return -1;
+
+    pthread_mutex_lock(&sim_lock);
+    deadlocked = 0;
+    hand_to(t);
+    while (n_threads > 0 && !deadlocked) pthread_cond_wait(&idle_cond, &sim_lock);
+    int rc = deadlocked ? -1 : 0;
+    pthread_mutex_unlock(&sim_lock);
+    return rc;
+}
+
+int sim_socketpair(int fds[2]) {
+    pthread_mutex_lock(&sim_lock);
+    int a = ep_new();
+    int b = (a >= 0) ? ep_new() : -1;
+    if (b < 0) { pthread_mutex_unlock(&sim_lock); return -1; }
+    ep_get(a)->peer = b;
+    ep_get(b)->peer = a;
+    pthread_mutex_unlock(&sim_lock);
+    fds[0] = a;
+    fds[1] = b;
+    return 0;
+}
+
+ssize_t sim_recv_timeout(int fd, void *buf, size_t len, uint64_t timeout_ms) {
+    return recv_until(fd, buf, len, 0, clock_ns + timeout_ms * 1000000ull);
+}
+
+uint64_t sim_now_ms(void) {
+    return clock_ns / 1000000ull;
+}
+
+uint64_t sim_trace_hash(void) {
+    return trace_hash;
+}
+
+uint64_t sim_switches(void) {
+    return switch_count;
+}
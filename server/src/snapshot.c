@@ -0,0 +1,336 @@
+/**
+ * @file snapshot.c
+ * @brief Fork-based snapshots of live matches and their mmap loader.
+ *
+ * The child of the fork only has the thread that forked, and every other
+ * thread's locks (logging, journal queue, sockets) stay taken forever in its
+ * image. It therefore touches nothing but the frozen matches, malloc and raw
+ * file syscalls, and leaves with _exit(). The parent does all logging.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "snapshot.h"
+#include "codec.h"
+#include "match.h"
+#include "client.h"
+#include "handoff.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+/**
+ * Encoder state passed through match_foreach_held().
+ */
+typedef struct {
+    Buf *b;
+    uint32_t count;
+} SnapWriter;
+
+static char snapshot_path[512];
+static char tmp_path[520];
+static int snapshot_enabled = 0;
+static int snapshot_interval = SNAPSHOT_INTERVAL_SECONDS;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER; /**< One fork at a time */
+
+/* Counters (updated atomically) */
+static uint64_t n_taken, n_failed, last_pause_us, max_pause_us, last_write_ms, last_bytes, last_matches;
+
+/* --- Encoding (child) --- */
+
+static void put_str(Buf *b, const char *s) {
+    size_t n = strlen(s);
+    if (n > 255) n = 255;
+    buf_put_le(b, n, 1);
+    buf_put(b, s, n);
+}
+
+/**
+ * @brief Encodes one match. Finished matches are skipped, they have nothing to resume.
+ */
+static void encode_match(Match *m, void *arg) {
+    SnapWriter *w = arg;
+    Buf *b = w->b;
+    if (m->finished || !m->white) return;
+    w->count++;
+    int has_black = (m->black != NULL);
+
+    int64_t left[2] = { match_clock_left(m, 0), match_clock_left(m, 1) };
+    for (int i = 0; i < 2; i++) {
+        if (left[i] < 0) left[i] = 0;
+        if (left[i] > UINT32_MAX) left[i] = UINT32_MAX;
+    }
+
+    uint8_t flags = (has_black ? SNAP_F_BLACK : 0)
+                  | (m->w_can_kingside ? SNAP_F_WK : 0) | (m->w_can_queenside ? SNAP_F_WQ : 0)
+                  | (m->b_can_kingside ? SNAP_F_BK : 0) | (m->b_can_queenside ? SNAP_F_BQ : 0)
+                  | (m->turn ? SNAP_F_BLACK_TO_MOVE : 0);
+
+    buf_put_le(b, (uint32_t)m->id, 4);
+    buf_put_le(b, flags, 1);
+    buf_put_le(b, (uint8_t)(int8_t)m->ep_r, 1);
+    buf_put_le(b, (uint8_t)(int8_t)m->ep_c, 1);
+    buf_put_le(b, (uint8_t)(int8_t)m->draw_offered_by, 1);
+    buf_put_le(b, (uint8_t)m->tc.mode, 1);
+    buf_put_le(b, (uint32_t)m->tc.base_ms, 4);
+    buf_put_le(b, (uint32_t)m->tc.increment_ms, 4);
+    buf_put_le(b, (uint32_t)left[0], 4);
+    buf_put_le(b, (uint32_t)left[1], 4);
+
+    unsigned char board[32];
+    for (int i = 0; i < 64; i += 2) {
+        int lo = m->state.board[i / 8][i % 8] + 6, hi = m->state.board[(i + 1) / 8][(i + 1) % 8] + 6;
+        board[i / 2] = (unsigned char)(lo | (hi << 4));
+    }
+    buf_put(b, board, sizeof(board));
+
+    put_str(b, m->white->name);
+    put_str(b, m->white->id);
+    if (has_black) { put_str(b, m->black->name); put_str(b, m->black->id); }
+
+    size_t n = m->moves_count > 0xffff ? 0xffff : m->moves_count;
+    buf_put_le(b, n, 2);
+    for (size_t i = 0; i < n; i++) put_str(b, m->moves[i]);
+}
+
+/**
+ * @brief Child side: encodes the frozen registry and replaces the snapshot file.
+ * @return 0 on success, -1 on failure.
+ */
+static int write_snapshot(int next_room_id) {
+    Buf b = { 0 };
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    buf_put(&b, SNAPSHOT_MAGIC, 4);
+    buf_put_le(&b, SNAPSHOT_VERSION, 1);
+    buf_put_le(&b, 0, 3);
+    buf_put_le(&b, (uint64_t)wall.tv_sec * 1000000000ull + (uint64_t)wall.tv_nsec, 8);
+    buf_put_le(&b, (uint32_t)next_room_id, 4);
+    buf_put_le(&b, 0, 4); /* Match count, patched below */
+
+    SnapWriter w = { &b, 0 };
+    match_foreach_held(encode_match, &w);
+    if (b.failed) { free(b.data); return -1; }
+    put_le(b.data + 20, w.count, 4);
+    buf_put_le(&b, crc32(b.data, b.len), 4);
+    if (b.failed) { free(b.data); return -1; }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) { free(b.data); return -1; }
+    int rc = write_all(fd, b.data, b.len);
+    if (rc == 0) rc = fdatasync(fd);
+    close(fd);
+    free(b.data);
+    if (rc == 0) rc = rename(tmp_path, snapshot_path);
+    if (rc != 0) { unlink(tmp_path); return -1; }
+
+    /* Make the rename itself durable */
+    char dir[sizeof(snapshot_path)];
+    snprintf(dir, sizeof(dir), "%s", snapshot_path);
+    char *slash = strrchr(dir, '/');
+    if (slash) *(slash == dir ? slash + 1 : slash) = '\0';
+    else snprintf(dir, sizeof(dir), ".");
+    int dfd = open(dir, O_RDONLY);
+    if (dfd >= 0) { fsync(dfd); close(dfd); }
+    return 0;
+}
+
+/* --- Taking snapshots (parent) --- */
+
+int snapshot_take(void) {
+    if (!snapshot_enabled) return -1;
+    pthread_mutex_lock(&snapshot_lock);
+
+    uint64_t t0 = mono_us();
+    int next_room_id = match_next_room_id();
+    int matches = match_lock_all();
+    pid_t pid = fork();
+    if (pid == 0) _exit(write_snapshot(next_room_id) == 0 ? 0 : 1);
+    match_unlock_all();
+    uint64_t pause = mono_us() - t0;
+
+    if (pid < 0) {
+        log_printf("[SNAPSHOT] fork failed: %s\n", strerror(errno));
+        STAT_ADD(n_failed, 1);
+        pthread_mutex_unlock(&snapshot_lock);
+        return -1;
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    uint64_t total_ms = (mono_us() - t0) / 1000;
+    int ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    STAT_SET(last_pause_us, pause);
+    if (pause > STAT_GET(max_pause_us)) STAT_SET(max_pause_us, pause);
+    if (ok) {
+        struct stat st;
+        STAT_SET(last_bytes, stat(snapshot_path, &st) == 0 ? (uint64_t)st.st_size : 0);
+        STAT_SET(last_write_ms, total_ms);
+        STAT_SET(last_matches, (uint64_t)matches);
+        STAT_ADD(n_taken, 1);
+        log_printf("[SNAPSHOT] %d rooms -> %s (%llu bytes), paused %llu us, written in %llu ms\n",
+                   matches, snapshot_path, STAT_GET(last_bytes), (unsigned long long)pause, (unsigned long long)total_ms);
+    } else {
+        STAT_ADD(n_failed, 1);
+        log_printf("[SNAPSHOT] Writing %s failed (child status %d)\n", snapshot_path, status);
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return ok ? 0 : -1;
+}
+
+static void *snapshot_thread_func(void *arg) {
+    (void)arg;
+    while (1) {
+        sleep((unsigned)snapshot_interval);
+        /* During a hot restart the successor takes over, and takes its own snapshots */
+        if (handoff_frozen()) continue;
+        snapshot_take();
+    }
+    return NULL;
+}
+
+int snapshot_start(const char *path, int interval_s) {
+    snprintf(snapshot_path, sizeof(snapshot_path), "%s", path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (interval_s > 0) snapshot_interval = interval_s;
+    crc32(NULL, 0); /* Build the CRC table here, never in a forked child */
+    snapshot_enabled = 1;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, snapshot_thread_func, NULL) != 0) { snapshot_enabled = 0; return -1; }
+    pthread_detach(tid);
+    log_printf("[SNAPSHOT] Snapshotting to %s every %d s\n", snapshot_path, snapshot_interval);
+    return 0;
+}
+
+/* --- Loading --- */
+
+static int get_str(const unsigned char *p, size_t end, size_t *pos, char *dst, size_t cap) {
+    if (*pos >= end) return -1;
+    size_t n = p[*pos];
+    if (*pos + 1 + n > end || n >= cap) return -1;
+    memcpy(dst, p + *pos + 1, n);
+    dst[n] = '\0';
+    *pos += 1 + n;
+    return 0;
+}
+
+/**
+ * @brief Decodes one match record at *pos and registers it.
+ * @return 0 on success, -1 if the record is malformed.
+ */
+static int load_match(const unsigned char *p, size_t end, size_t *pos) {
+    size_t at = *pos;
+    if (end - at < 57) return -1;
+    int id = (int)(uint32_t)get_le(p + at, 4);
+    uint8_t flags = p[at + 4];
+
+    Match *m = calloc(1, sizeof(Match));
+    if (!m) return -1;
+    pthread_mutex_init(&m->lock, NULL);
+    m->id = id;
+    m->winner = -1;
+    m->end_reason = END_NONE;
+    m->turn = (flags & SNAP_F_BLACK_TO_MOVE) ? 1 : 0;
+    m->w_can_kingside = !!(flags & SNAP_F_WK); m->w_can_queenside = !!(flags & SNAP_F_WQ);
+    m->b_can_kingside = !!(flags & SNAP_F_BK); m->b_can_queenside = !!(flags & SNAP_F_BQ);
+    m->ep_r = (int8_t)p[at + 5];
+    m->ep_c = (int8_t)p[at + 6];
+    m->draw_offered_by = (int8_t)p[at + 7];
+    m->tc.mode = (ClockMode)p[at + 8];
+    m->tc.base_ms = (int)(uint32_t)get_le(p + at + 9, 4);
+    m->tc.increment_ms = (int)(uint32_t)get_le(p + at + 13, 4);
+    m->clock_ms[0] = (uint32_t)get_le(p + at + 17, 4);
+    m->clock_ms[1] = (uint32_t)get_le(p + at + 21, 4);
+    for (int i = 0; i < 64; i++) {
+        int nib = (p[at + 25 + i / 2] >> ((i & 1) * 4)) & 0x0f;
+        m->state.board[i / 8][i % 8] = (Piece)(nib - 6);
+    }
+    at += 57;
+
+    char white[NAME_LEN], white_id[ID_LEN], black[NAME_LEN], black_id[ID_LEN];
+    int has_black = (flags & SNAP_F_BLACK) != 0;
+    int bad = get_str(p, end, &at, white, sizeof(white)) || get_str(p, end, &at, white_id, sizeof(white_id));
+    if (!bad && has_black) bad = get_str(p, end, &at, black, sizeof(black)) || get_str(p, end, &at, black_id, sizeof(black_id));
+    size_t moves = 0;
+    if (!bad && end - at >= 2) { moves = (size_t)get_le(p + at, 2); at += 2; }
+    else bad = 1;
+    for (size_t i = 0; i < moves && !bad; i++) {
+        char mv[16];
+        bad = get_str(p, end, &at, mv, sizeof(mv)) || match_append_move(m, mv) != 0;
+    }
+    if (bad) {
+        for (size_t i = 0; i < m->moves_count; i++) free(m->moves[i]);
+        free(m->moves);
+        pthread_mutex_destroy(&m->lock);
+        free(m);
+        return -1;
+    }
+    /* A waiting room has not used any time */
+    if (!has_black) m->clock_ms[0] = m->clock_ms[1] = m->tc.base_ms;
+
+    *pos = at;
+    return match_adopt(m, white, white_id, has_black ? black : NULL, has_black ? black_id : NULL) ? 0 : -1;
+}
+
+int snapshot_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return 0; }
+    size_t size = (size_t)st.st_size;
+    uint64_t t0 = mono_us();
+    const unsigned char *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    madvise((void *)p, size, MADV_SEQUENTIAL);
+
+    int restored = -1;
+    if (size < SNAPSHOT_HEADER_SZ + 4 || memcmp(p, SNAPSHOT_MAGIC, 4) != 0 || p[4] != SNAPSHOT_VERSION) {
+        log_printf("[SNAPSHOT] %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        goto out;
+    }
+    size_t end = size - 4;
+    uint32_t crc = (uint32_t)get_le(p + end, 4);
+    if (crc32(p, end) != crc) {
+        log_printf("[SNAPSHOT] %s is corrupt (checksum mismatch)\n", path);
+        goto out;
+    }
+    int next_room_id = (int)(uint32_t)get_le(p + 16, 4);
+    uint32_t count = (uint32_t)get_le(p + 20, 4);
+
+    size_t pos = SNAPSHOT_HEADER_SZ;
+    restored = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (load_match(p, end, &pos) != 0) {
+            log_printf("[SNAPSHOT] Record %u of %s is malformed, stopping\n", i + 1, path);
+            break;
+        }
+        restored++;
+    }
+    match_reserve_room_ids(next_room_id);
+    log_printf("[SNAPSHOT] Restored %d rooms from %s (%zu bytes) in %llu us\n",
+               restored, path, size, (unsigned long long)(mono_us() - t0));
+out:
+    munmap((void *)p, size);
+    return restored;
+}
+
+int snapshot_format_stats(char *buf, size_t sz) {
+    if (!snapshot_enabled) return 0;
+    return snprintf(buf, sz, "path=%s interval=%ds taken=%llu failed=%llu last_rooms=%llu last_bytes=%llu last_pause_us=%llu max_pause_us=%llu last_write_ms=%llu\n",
+                    snapshot_path, snapshot_interval, STAT_GET(n_taken), STAT_GET(n_failed), STAT_GET(last_matches),
+                    STAT_GET(last_bytes), STAT_GET(last_pause_us), STAT_GET(max_pause_us), STAT_GET(last_write_ms));
+}
@@ -0,0 +1,262 @@
+/**
+ * @file spectate.c
+ * @brief Spectator queues and event fan-out (see spectate.h).
+ *
+ * One mutex protects every watcher list (m->watchers), queue and c->watch
+ * pointer. Buffers are reference counted atomically: a spectator thread takes
+ * an event off its queue under the lock and writes it after letting go, so
+ * a slow socket never holds the lock. Events are queued by the thread that
+ * holds the match lock, so every spectator sees them in game order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "spectate.h"
+#include "client.h"
+#include "match.h"
+#include "game.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+#include "stats.h"
+
+/**
+ * One formatted event line, shared by every queue it is on.
+ */
+typedef struct SpecBuf {
+    uint32_t refs;
+    uint32_t len;
+    char data[];            /**< Line with its newline, NUL terminated */
+} SpecBuf;
+
+/**
+ * One spectator.
+ */
+struct Watcher {
+    Client *client;
+    Match *m;               /**< NULL once the match is gone */
+    SpecBuf *q[SPECTATE_QUEUE_LEN];
+    unsigned head, count;
+    int resyncs;
+    int dropped;            /**< Connection shut down for falling behind too often */
+    pthread_cond_t ready;   /**< Signalled when an event is queued or the watch ends */
+    struct Watcher *prev, *next;
+};
+
+static pthread_mutex_t spec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Counters (updated atomically) */
+static uint64_t n_watching, n_watches, n_events, n_queued, n_resyncs, n_drops, n_alloc_fail;
+
+/* --- Buffers --- */
+
+static SpecBuf *specbuf_new(const char *line, size_t len) {
+    SpecBuf *b = malloc(sizeof(SpecBuf) + len + 1);
+    if (!b) { STAT_ADD(n_alloc_fail, 1); return NULL; }
+    b->refs = 1;
+    b->len = (uint32_t)len;
+    memcpy(b->data, line, len);
+    b->data[len] = '\0';
+    return b;
+}
+
+static void specbuf_release(SpecBuf *b) {
+    if (b && __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) == 0) free(b);
+}
+
+/**
+ * @brief Formats the W_START line of a match. Caller must hold m->lock.
+ */
+static SpecBuf *snapshot_buf(Match *m) {
+    char fen[128], line[BUFFER_SZ];
+    format_fen(m, fen, sizeof(fen));
+    int n = snprintf(line, sizeof(line), WATCH_STATE "\n", m->id,
+                     m->white ? m->white->name : "-", m->black ? m->black->name : "-",
+                     match_get_remaining_time(m), fen);
+    if (n < 0 || (size_t)n >= sizeof(line)) return NULL;
+    return specbuf_new(line, (size_t)n);
+}
+
+/* --- Queues (called with spec_lock held) --- */
+
+static void push(Watcher *w, SpecBuf *b) {
+    __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+    w->q[(w->head + w->count) % SPECTATE_QUEUE_LEN] = b;
+    w->count++;
+    STAT_ADD(n_queued, 1);
+    pthread_cond_signal(&w->ready);
+}
+
+static void clear_queue(Watcher *w) {
+    for (; w->count > 0; w->count--) {
+        specbuf_release(w->q[w->head]);
+        w->head = (w->head + 1) % SPECTATE_QUEUE_LEN;
+    }
+}
+
+/**
+ * @brief Replaces the queue of a spectator who fell behind by a snapshot
+ * (formatted once per event into *snap), or drops it after too many resyncs.
+ * The snapshot covers the event being queued, except the result of a game
+ * that is over, which follows it.
+ */
+static void resync(Watcher *w, Match *m, SpecBuf *event, SpecBuf **snap) {
+    clear_queue(w);
+    if (++w->resyncs > SPECTATE_MAX_RESYNCS) {
+        w->dropped = 1;
+        STAT_ADD(n_drops, 1);
+        if (w->client->sock > 0) io_shutdown(w->client->sock, SHUT_RDWR);
+        log_printf("[SPECTATE] %s dropped from room %d (too slow).\n", w->client->name, m->id);
+        pthread_cond_signal(&w->ready);
+        return;
+    }
+    STAT_ADD(n_resyncs, 1);
+    if (!*snap) *snap = snapshot_buf(m);
+    if (*snap) push(w, *snap);
+    if (m->finished) push(w, event);
+}
+
+static void unlink_watcher(Watcher *w) {
+    if (w->m) {
+        if (w->prev) w->prev->next = w->next;
+        else w->m->watchers = w->next;
+        if (w->next) w->next->prev = w->prev;
+        w->m = NULL;
+    }
+    w->prev = w->next = NULL;
+}
+
+/* --- Fan-out --- */
+
+/**
+ * @brief Queues one buffer on every spectator of m. Caller holds m->lock.
+ */
+static void fan_out(Match *m, SpecBuf *b) {
+    SpecBuf *snap = NULL;
+    pthread_mutex_lock(&spec_lock);
+    for (Watcher *w = m->watchers; w; w = w->next) {
+        if (w->dropped) continue;
+        if (w->count == SPECTATE_QUEUE_LEN) resync(w, m, b, &snap);
+        else push(w, b);
+    }
+    pthread_mutex_unlock(&spec_lock);
+    specbuf_release(snap);
+    specbuf_release(b);
+    STAT_ADD(n_events, 1);
+}
+
+void spectate_event(Match *m, const char *fmt, ...) {
+    if (!__atomic_load_n(&m->watchers, __ATOMIC_ACQUIRE)) return;
+    char line[BIG_BUFFER_SZ];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n > sizeof(line) - 2) n = (int)sizeof(line) - 2;
+    line[n++] = '\n';
+    SpecBuf *b = specbuf_new(line, (size_t)n);
+    if (b) fan_out(m, b);
+}
+
+void spectate_restart(Match *m) {
+    if (!__atomic_load_n(&m->watchers, __ATOMIC_ACQUIRE)) return;
+    SpecBuf *b = snapshot_buf(m);
+    if (b) fan_out(m, b);
+}
+
+/* --- Spectators --- */
+
+int spectate_watch(Client *c, int room_id) {
+    Match *m = match_lock_by_id(room_id);
+    if (!m) return -1;
+    if (!m->black || !m->started_at || m->finished) { pthread_mutex_unlock(&m->lock); return -1; }
+
+    Watcher *w = calloc(1, sizeof(Watcher));
+    SpecBuf *snap = w ? snapshot_buf(m) : NULL;
+    if (!snap) { free(w); pthread_mutex_unlock(&m->lock); return -1; }
+    w->client = c;
+    pthread_cond_init(&w->ready, NULL);
+
+    pthread_mutex_lock(&spec_lock);
+    push(w, snap);
+    w->m = m;
+    w->next = m->watchers;
+    if (w->next) w->next->prev = w;
+    __atomic_store_n(&m->watchers, w, __ATOMIC_RELEASE);
+    c->watch = w;
+    pthread_mutex_unlock(&spec_lock);
+    pthread_mutex_unlock(&m->lock);
+
+    specbuf_release(snap);
+    STAT_ADD(n_watching, 1);
+    STAT_ADD(n_watches, 1);
+    return 0;
+}
+
+int spectate_pump(Client *c, int wait_ms) {
+    Watcher *w = c->watch;
+    if (!w) return -1;
+    int sent = 0;
+    pthread_mutex_lock(&spec_lock);
+    if (w->count == 0 && w->m && !w->dropped && wait_ms > 0) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += (long)wait_ms * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&w->ready, &spec_lock, &until);
+    }
+    while (w->count > 0 && !w->dropped) {
+        SpecBuf *b = w->q[w->head];
+        w->head = (w->head + 1) % SPECTATE_QUEUE_LEN;
+        w->count--;
+        pthread_mutex_unlock(&spec_lock);
+        pthread_mutex_lock(&c->lock);
+        send_raw(c->sock, b->data);
+        pthread_mutex_unlock(&c->lock);
+        specbuf_release(b);
+        sent++;
+        pthread_mutex_lock(&spec_lock);
+    }
+    int over = (!w->m || w->dropped);
+    pthread_mutex_unlock(&spec_lock);
+    return over ? -1 : sent;
+}
+
+void spectate_leave(Client *c) {
+    Watcher *w = c->watch;
+    if (!w) return;
+    pthread_mutex_lock(&spec_lock);
+    unlink_watcher(w);
+    clear_queue(w);
+    c->watch = NULL;
+    pthread_mutex_unlock(&spec_lock);
+    pthread_cond_destroy(&w->ready);
+    free(w);
+    STAT_ADD(n_watching, (uint64_t)-1);
+}
+
+void spectate_close(Match *m) {
+    if (!__atomic_load_n(&m->watchers, __ATOMIC_ACQUIRE)) return;
+    pthread_mutex_lock(&spec_lock);
+    while (m->watchers) {
+        Watcher *w = m->watchers;
+        unlink_watcher(w);
+        pthread_cond_signal(&w->ready);
+    }
+    pthread_mutex_unlock(&spec_lock);
+}
+
+int spectate_format_stats(char *buf, size_t sz) {
+    return snprintf(buf, sz, "watching=%llu watches=%llu events=%llu queued=%llu resyncs=%llu drops=%llu alloc_failures=%llu\n",
+                    STAT_GET(n_watching), STAT_GET(n_watches), STAT_GET(n_events), STAT_GET(n_queued),
+                    STAT_GET(n_resyncs), STAT_GET(n_drops), STAT_GET(n_alloc_fail));
+}
@@ -0,0 +1,787 @@
+/**
+ * @file tournament.c
+ * @brief Tournament registration, pairing and round driver (see tournament.h).
+ *
+ * One mutex protects the tournament, its counters and every c->tourney
+ * pointer. The tournament thread holds it for a whole tick (board watchdog
+ * checks, pairing and seating) and sends START once it has let go. Messages
+ * for waiting players (TOURNEY_WAIT, TOURNEY_BYE, TOURNEY_END) are queued in
+ * an outbox under the lock and written, in order, after it is released; a
+ * player is not seated while it has a message in there, and tourney_leave()
+ * waits until none is being written to it, so the player outlives the write. Entrants
+ * live in one array in seed order, and a name hash maps players to their
+ * entry; neither changes once the tournament has started, so c->tourney stays
+ * valid until the player leaves the waiting room.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "tournament.h"
+#include "client.h"
+#include "match.h"
+#include "capture.h"
+#include "handoff.h"
+#include "lockstat.h"
+#include "logging.h"
+#include "netio.h"
+#include "config.h"
+
+extern int max_rooms;
+
+typedef enum {
+    PHASE_NONE,
+    PHASE_REGISTERING,
+    PHASE_RUNNING,
+    PHASE_FINISHED
+} Phase;
+
+typedef enum {
+    PAIR_PENDING,           /**< Waiting for both players */
+    PAIR_PLAYING,
+    PAIR_DONE               /**< Result recorded (game, bye or forfeit) */
+} PairState;
+
+/**
+ * One registered player.
+ */
+struct TourneyEntrant {
+    char name[NAME_LEN];
+    int32_t rating;
+    int score;              /**< Half points */
+    int colour_diff;        /**< Games as White minus games as Black */
+    int last_colour;        /**< Colour of the last game played, -1 before the first */
+    int bye_round;          /**< Last round with a bye, 0 if none */
+    int n_opp;
+    int opp[TOURNEY_MAX_ROUNDS]; /**< Opponents met (Swiss only), by index */
+    int buchholz;           /**< Filled in when the standings are computed */
+    int rank;               /**< Final rank, set when the tournament ends */
+    Client *client;         /**< The player while waiting for a game, NULL otherwise */
+    int unsent;             /**< Messages for the player still in the outbox */
+};
+
+typedef struct {
+    int white, black;       /**< Entrant indices, black -1 for a bye */
+    Match *m;               /**< Live game (PAIR_PLAYING only) */
+    PairState state;
+} Pairing;
+
+/**
+ * A message for a waiting player, written once t_lock is released.
+ */
+typedef struct Outgoing {
+    Client *client;
+    TourneyEntrant *entrant;
+    int release;            /**< Clear client->tourney once written (TOURNEY_END) */
+    char text[48];
+    struct Outgoing *next;
+} Outgoing;
+
+static pthread_mutex_t t_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t t_sent = PTHREAD_COND_INITIALIZER;    /**< A message of the outbox was written */
+static volatile int t_running = 0;
+
+static Outgoing *out_head = NULL, *out_tail = NULL;
+static Client *out_sending = NULL;      /**< Player being written to, NULL if none */
+static int out_busy = 0;                /**< A thread is emptying the outbox */
+
+static Phase phase = PHASE_NONE;
+static TourneyKind kind = TOURNEY_SWISS;
+static int rounds = 0, round_no = 0;
+static time_t round_started = 0;
+
+static TourneyEntrant *entrants = NULL;
+static size_t n_entrants = 0, cap_entrants = 0;
+static uint32_t *name_slots = NULL;     /**< Entrant index + 1, 0 for an empty slot */
+static size_t n_slots = 0;
+
+/* Current round, and scratch space sized for all entrants at tourney_begin() */
+static Pairing *pairs = NULL;
+static size_t n_pairs = 0;
+static int *order = NULL, *group = NULL;
+static unsigned char *taken = NULL;
+static Client **seat_white = NULL, **seat_black = NULL;
+static Match **started = NULL;
+static size_t *seat_pair = NULL;
+
+/* Counters (protected by t_lock) */
+static uint64_t n_games, n_byes, n_forfeits, n_live, n_batches;
+static uint64_t pair_ns_last, pair_ns_max, seat_ns_last, seated_last;
+
+static const char *kind_name(TourneyKind k) {
+    return k == TOURNEY_SWISS ? "swiss" : "roundrobin";
+}
+
+static const char *phase_name(Phase p) {
+    switch (p) {
+        case PHASE_REGISTERING: return "registering";
+        case PHASE_RUNNING: return "running";
+        case PHASE_FINISHED: return "finished";
+        default: return "none";
+    }
+}
+
+/* --- Entrant lookup --- */
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static long find_entrant(const char *name) {
+    if (n_slots == 0) return -1;
+    for (size_t i = name_hash(name) & (n_slots - 1);; i = (i + 1) & (n_slots - 1)) {
+        uint32_t v = name_slots[i];
+        if (v == 0) return -1;
+        if (strncmp(entrants[v - 1].name, name, NAME_LEN) == 0) return (long)v - 1;
+    }
+}
+
+/** Rebuilds the name hash for the first n_entrants entries. */
+static void rehash(void) {
+    memset(name_slots, 0, n_slots * sizeof(uint32_t));
+    for (size_t e = 0; e < n_entrants; e++) {
+        size_t i = name_hash(entrants[e].name) & (n_slots - 1);
+        while (name_slots[i]) i = (i + 1) & (n_slots - 1);
+        name_slots[i] = (uint32_t)e + 1;
+    }
+}
+
+/** Makes room for one more entrant (the hash stays at most half full). */
+static int grow(void) {
+    if (n_entrants < cap_entrants) return 0;
+    size_t cap = cap_entrants ? cap_entrants * 2 : 64;
+    TourneyEntrant *e = realloc(entrants, cap * sizeof(TourneyEntrant));
+    if (!e) return -1;
+    entrants = e;
+    uint32_t *slots = calloc(cap * 2, sizeof(uint32_t));
+    if (!slots) return -1;
+    free(name_slots);
+    name_slots = slots;
+    n_slots = cap * 2;
+    cap_entrants = cap;
+    rehash();
+    return 0;
+}
+
+static void free_tournament(void) {
+    free(entrants); entrants = NULL; n_entrants = cap_entrants = 0;
+    free(name_slots); name_slots = NULL; n_slots = 0;
+    free(pairs); pairs = NULL; n_pairs = 0;
+    free(order); order = NULL;
+    free(group); group = NULL;
+    free(taken); taken = NULL;
+    free(seat_white); seat_white = NULL;
+    free(seat_black); seat_black = NULL;
+    free(started); started = NULL;
+    free(seat_pair); seat_pair = NULL;
+}
+
+/* --- Ordering --- */
+
+/** Pairing order: score, then rating, then seed. */
+static int cmp_pairing(const void *a, const void *b) {
+    const TourneyEntrant *x = &entrants[*(const int *)a], *y = &entrants[*(const int *)b];
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->rating != y->rating) return x->rating > y->rating ? -1 : 1;
+    return *(const int *)a - *(const int *)b;
+}
+
+/** Standings order: score, then Buchholz, then rating, then seed. */
+static int cmp_standing(const void *a, const void *b) {
+    const TourneyEntrant *x = &entrants[*(const int *)a], *y = &entrants[*(const int *)b];
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->buchholz != y->buchholz) return x->buchholz > y->buchholz ? -1 : 1;
+    if (x->rating != y->rating) return x->rating > y->rating ? -1 : 1;
+    return *(const int *)a - *(const int *)b;
+}
+
+/** Seeds: rating, then registration order (kept by a stable index tie-break). */
+static int cmp_seed(const void *a, const void *b) {
+    const TourneyEntrant *x = a, *y = b;
+    if (x->rating != y->rating) return x->rating > y->rating ? -1 : 1;
+    return x->rank - y->rank;
+}
+
+/**
+ * @brief Fills out[0..n_entrants) with entrant indices in standings order.
+ */
+static void standings_order(int *out) {
+    for (size_t i = 0; i < n_entrants; i++) {
+        TourneyEntrant *e = &entrants[i];
+        e->buchholz = 0;
+        for (int j = 0; j < e->n_opp; j++) e->buchholz += entrants[e->opp[j]].score;
+        out[i] = (int)i;
+    }
+    qsort(out, n_entrants, sizeof(int), cmp_standing);
+}
+
+static void format_score(int half, char *buf, size_t sz) {
+    snprintf(buf, sz, "%d.%d", half / 2, (half % 2) * 5);
+}
+
+/* --- Outbox --- */
+
+/**
+ * @brief Queues a message for a waiting player. Called with t_lock held.
+ * @param release Whether the player leaves the tournament with it.
+ */
+static void post(Client *c, TourneyEntrant *e, int release, const char *fmt, ...) {
+    Outgoing *o = malloc(sizeof(Outgoing));
+    if (!o) {
+        if (release) __atomic_store_n(&c->tourney, NULL, __ATOMIC_RELEASE);
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(o->text, sizeof(o->text), fmt, ap);
+    va_end(ap);
+    o->client = c;
+    o->entrant = e;
+    o->release = release;
+    o->next = NULL;
+    if (out_tail) out_tail->next = o;
+    else out_head = o;
+    out_tail = o;
+    e->unsent++;
+}
+
+/**
+ * @brief Releases t_lock, then writes the outbox in order. One thread writes
+ * at a time; a thread that finds it busy leaves its messages to that one.
+ * Called with t_lock held.
+ */
+static void unlock_and_send(void) {
+    if (out_busy) { pthread_mutex_unlock(&t_lock); return; }
+    out_busy = 1;
+    while (out_head) {
+        Outgoing *o = out_head;
+        out_head = o->next;
+        if (!out_head) out_tail = NULL;
+        out_sending = o->client;
+        pthread_mutex_unlock(&t_lock);
+        send_protocol_msg(o->client, "%s", o->text);
+        pthread_mutex_lock(&t_lock);
+        out_sending = NULL;
+        o->entrant->unsent--;
+        if (o->release && o->client->tourney == o->entrant) __atomic_store_n(&o->client->tourney, NULL, __ATOMIC_RELEASE);
+        free(o);
+        pthread_cond_broadcast(&t_sent);
+    }
+    out_busy = 0;
+    pthread_cond_broadcast(&t_sent);
+    pthread_mutex_unlock(&t_lock);
+}
+
+/**
+ * @brief Drops the queued messages for c and waits until none is being
+ * written to it. Called with t_lock held.
+ */
+static void drop_outgoing(Client *c) {
+    for (Outgoing **pp = &out_head, *prev = NULL; *pp; ) {
+        Outgoing *o = *pp;
+        if (o->client != c) { prev = o; pp = &o->next; continue; }
+        *pp = o->next;
+        if (out_tail == o) out_tail = prev;
+        o->entrant->unsent--;
+        free(o);
+    }
+    while (out_sending == c) pthread_cond_wait(&t_sent, &t_lock);
+}
+
+/* --- Pairing --- */
+
+/**
+ * @brief How much a player is due White: positive if due White, negative if
+ * due Black, stronger with the colour imbalance.
+ */
+static int white_due(const TourneyEntrant *e) {
+    return -2 * e->colour_diff + (e->last_colour == 1) - (e->last_colour == 0);
+}
+
+static int colours_clash(int a, int b) {
+    int da = white_due(&entrants[a]), db = white_due(&entrants[b]);
+    return (da > 0 && db > 0) || (da < 0 && db < 0);
+}
+
+static int have_met(int a, int b) {
+    const TourneyEntrant *e = &entrants[a];
+    for (int i = 0; i < e->n_opp; i++) if (e->opp[i] == b) return 1;
+    return 0;
+}
+
+/**
+ * @brief Adds a board to the round. a ranks above b; b is -1 for a bye,
+ * which is scored at once.
+ */
+static void add_pair(int a, int b) {
+    Pairing *p = &pairs[n_pairs];
+    p->m = NULL;
+    p->state = PAIR_PENDING;
+    taken[a] = 1;
+    if (b < 0) {
+        TourneyEntrant *e = &entrants[a];
+        p->white = a; p->black = -1;
+        p->state = PAIR_DONE;
+        e->score += 2;
+        e->bye_round = round_no;
+        n_byes++;
+        if (e->client) post(e->client, e, 0, TOURNEY_BYE, round_no);
+    } else {
+        int da = white_due(&entrants[a]), db = white_due(&entrants[b]);
+        int a_white = (da != db) ? da > db : ((n_pairs + (size_t)round_no) & 1) == 1;
+        p->white = a_white ? a : b;
+        p->black = a_white ? b : a;
+        taken[b] = 1;
+        if (kind == TOURNEY_SWISS) {
+            TourneyEntrant *x = &entrants[a], *y = &entrants[b];
+            if (x->n_opp < TOURNEY_MAX_ROUNDS) x->opp[x->n_opp++] = b;
+            if (y->n_opp < TOURNEY_MAX_ROUNDS) y->opp[y->n_opp++] = a;
+        }
+    }
+    n_pairs++;
+}
+
+/**
+ * @brief Pairs the top half of a score group against its bottom half.
+ *
+ * Each top-half player tries the bottom half from its own board on, taking
+ * the first opponent not met before whose colour suits; after
+ * TOURNEY_SWISS_LOOKAHEAD colour clashes it takes the first opponent not met.
+ * Players left unpaired are moved to the front of g in rank order; in the
+ * last group they are paired among themselves, meeting someone again only if
+ * nothing else is left.
+ * @return Number of players left for the next group.
+ */
+static size_t pair_group(int *g, size_t k, int last) {
+    size_t half = k / 2, bottom = k - half;
+    for (size_t i = 0; i < half; i++) {
+        int a = g[i], pick = -1, fallback = -1, clashes = 0;
+        for (size_t j = 0; j < bottom; j++) {
+            int b = g[half + (i + j) % bottom];
+            if (taken[b] || have_met(a, b)) continue;
+            if (fallback < 0) fallback = b;
+            if (!colours_clash(a, b)) { pick = b; break; }
+            if (++clashes >= TOURNEY_SWISS_LOOKAHEAD) break;
+        }
+        if (pick < 0) pick = fallback;
+        if (pick >= 0) add_pair(a, pick);
+    }
+
+    size_t left = 0;
+    for (size_t i = 0; i < k; i++) if (!taken[g[i]]) g[left++] = g[i];
+    if (!last) return left;
+
+    for (size_t i = 0; i < left; i++) {
+        int a = g[i], pick = -1;
+        if (taken[a]) continue;
+        for (size_t j = i + 1; j < left; j++) {
+            int b = g[j];
+            if (taken[b]) continue;
+            if (pick < 0) pick = b;
+            if (!have_met(a, b)) { pick = b; break; }
+        }
+        if (pick >= 0) add_pair(a, pick);
+    }
+    return 0;
+}
+
+static void pair_swiss(void) {
+    size_t n = n_entrants;
+    for (size_t i = 0; i < n; i++) order[i] = (int)i;
+    qsort(order, n, sizeof(int), cmp_pairing);
+
+    /* The lowest ranked player who has not had a bye sits out */
+    if (n & 1) {
+        size_t bye = n - 1;
+        for (size_t i = n; i-- > 0;) {
+            if (!entrants[order[i]].bye_round) { bye = i; break; }
+        }
+        add_pair(order[bye], -1);
+    }
+
+    size_t pos = 0, floaters = 0;
+    while (pos < n) {
+        size_t k = floaters;
+        int score = -1;
+        for (; pos < n; pos++) {
+            int x = order[pos];
+            if (taken[x]) continue;
+            if (score >= 0 && entrants[x].score != score) break;
+            score = entrants[x].score;
+            group[k++] = x;
+        }
+        floaters = pair_group(group, k, pos >= n);
+    }
+}
+
+/**
+ * @brief Circle method: seed 0 stays, the others rotate one place per round.
+ * With an odd number of players the missing seat is a bye.
+ */
+static void pair_round_robin(void) {
+    size_t n = n_entrants, np = n + (n & 1);
+    size_t r = (size_t)round_no - 1;
+    for (size_t i = 0; i < np / 2; i++) {
+        size_t x = (i == 0) ? 0 : 1 + (i - 1 + r) % (np - 1);
+        size_t y = 1 + (np - 2 - i + r) % (np - 1);
+        if (x >= n) add_pair((int)y, -1);
+        else if (y >= n) add_pair((int)x, -1);
+        else add_pair((int)(x < y ? x : y), (int)(x < y ? y : x));
+    }
+}
+
+/* --- Round driver (called with t_lock held) --- */
+
+static void send_end(Client *c, const TourneyEntrant *e) {
+    char score[16];
+    format_score(e->score, score, sizeof(score));
+    send_protocol_msg(c, TOURNEY_END, e->rank, score);
+}
+
+static void post_end(Client *c, TourneyEntrant *e) {
+    char score[16];
+    format_score(e->score, score, sizeof(score));
+    post(c, e, 1, TOURNEY_END, e->rank, score);
+}
+
+/**
+ * @brief Sends TOURNEY_END to the entrants still at a tournament board: games
+ * played out after a stop, or players not back from their last game. told[]
+ * marks the entrants already sent it. Called with m->lock held.
+ */
+static void end_at_board(Match *m, void *arg) {
+    unsigned char *told = arg;
+    if (!m->shared_watchdog) return;
+    Client *players[2] = { m->white, m->black };
+    for (int i = 0; i < 2; i++) {
+        long k = players[i] ? find_entrant(players[i]->name) : -1;
+        if (k < 0 || told[k]) continue;
+        told[k] = 1;
+        send_end(players[i], &entrants[k]);
+    }
+}
+
+/**
+ * @brief Ends the tournament: ranks the players and sends each one its result,
+ * the only time TOURNEY_END is sent. Waiting players go back to the lobby,
+ * seated ones get it at their board.
+ */
+static void finish(void) {
+    phase = PHASE_FINISHED;
+    standings_order(order);
+    memset(taken, 0, n_entrants);
+    for (size_t i = 0; i < n_entrants; i++) {
+        TourneyEntrant *e = &entrants[order[i]];
+        e->rank = (int)i + 1;
+        if (!e->client) continue;
+        /* Leaves the tournament once its result is out */
+        post_end(e->client, e);
+        taken[order[i]] = 1;
+        e->client = NULL;
+    }
+    match_foreach(end_at_board, taken);
+    log_printf("[TOURNEY] Finished after round %d/%d: %zu players, %llu games.\n", round_no, rounds,
+               n_entrants, (unsigned long long)n_games);
+}
+
+static void next_round(time_t now) {
+    if (round_no >= rounds) { finish(); return; }
+    round_no++;
+    round_started = now;
+    n_pairs = 0;
+    memset(taken, 0, n_entrants);
+
+    uint64_t t0 = monotonic_ns();
+    if (kind == TOURNEY_SWISS) pair_swiss();
+    else pair_round_robin();
+    uint64_t ns = monotonic_ns() - t0;
+    pair_ns_last = ns;
+    if (ns > pair_ns_max) pair_ns_max = ns;
+    log_printf("[TOURNEY] Round %d/%d paired: %zu boards in %.1f ms.\n", round_no, rounds, n_pairs, ns / 1e6);
+}
+
+/**
+ * @brief Records the result of a board that has ended.
+ */
+static void record_result(Pairing *p, int winner) {
+    TourneyEntrant *w = &entrants[p->white], *b = &entrants[p->black];
+    p->m = NULL;
+    p->state = PAIR_DONE;
+    n_live--;
+    n_games++;
+    if (phase != PHASE_RUNNING) return;
+    if (winner == 0) w->score += 2;
+    else if (winner == 1) b->score += 2;
+    else { w->score++; b->score++; }
+}
+
+/**
+ * @brief Scores a board whose players did not both show up in time.
+ */
+static void forfeit(Pairing *p) {
+    TourneyEntrant *w = &entrants[p->white], *b = &entrants[p->black];
+    p->state = PAIR_DONE;
+    n_forfeits++;
+    if (w->client) { w->score += 2; post(w->client, w, 0, TOURNEY_BYE, round_no); }
+    if (b->client) { b->score += 2; post(b->client, b, 0, TOURNEY_BYE, round_no); }
+}
+
+/**
+ * @brief Starts every pending board whose players are both waiting, in one
+ * match_create_batch() call, and forfeits the boards past the no-show limit.
+ * @return Number of games started (listed in started[]).
+ */
+static size_t seat_ready(time_t now) {
+    size_t k = 0;
+    for (size_t i = 0; i < n_pairs; i++) {
+        Pairing *p = &pairs[i];
+        if (p->state != PAIR_PENDING) continue;
+        TourneyEntrant *w = &entrants[p->white], *b = &entrants[p->black];
+        /* START must not overtake what the outbox still holds for them */
+        if (w->unsent || b->unsent) continue;
+        if (w->client && b->client) {
+            seat_white[k] = w->client;
+            seat_black[k] = b->client;
+            seat_pair[k++] = i;
+        } else if (now - round_started >= TOURNEY_NOSHOW_SECONDS) {
+            forfeit(p);
+        }
+    }
+    if (max_rooms > 0) {
+        int free_rooms = max_rooms - get_active_room_count();
+        if (free_rooms <= 0) return 0;
+        if (k > (size_t)free_rooms) k = (size_t)free_rooms;
+    }
+    if (k == 0) return 0;
+
+    uint64_t t0 = monotonic_ns();
+    size_t made = match_create_batch(seat_white, seat_black, k, started);
+    seat_ns_last = monotonic_ns() - t0;
+    seated_last = made;
+    n_batches++;
+
+    for (size_t i = 0; i < made; i++) {
+        Pairing *p = &pairs[seat_pair[i]];
+        TourneyEntrant *w = &entrants[p->white], *b = &entrants[p->black];
+        p->m = started[i];
+        p->state = PAIR_PLAYING;
+        n_live++;
+        w->colour_diff++; w->last_colour = 0;
+        b->colour_diff--; b->last_colour = 1;
+        Client *cw = w->client, *cb = b->client;
+        capture_room(cw->conn_id, p->m->id);
+        capture_room(cb->conn_id, p->m->id);
+        cw->paired = 1; cb->paired = 1;
+        __atomic_store_n(&cw->tourney, NULL, __ATOMIC_RELEASE);
+        __atomic_store_n(&cb->tourney, NULL, __ATOMIC_RELEASE);
+        w->client = NULL; b->client = NULL;
+    }
+    return made;
+}
+
+/**
+ * @brief One pass: watchdog checks of the live boards, then the next round
+ * if this one is over, then seating.
+ * @return Number of games started.
+ */
+static size_t tick(time_t now, unsigned *wait_ms) {
+    int all_done = 1;
+    for (size_t i = 0; i < n_pairs; i++) {
+        Pairing *p = &pairs[i];
+        if (p->state == PAIR_PLAYING) {
+            int winner = -1;
+            if (match_watchdog_tick(p->m, &winner, wait_ms)) record_result(p, winner);
+        }
+        if (p->state != PAIR_DONE) all_done = 0;
+    }
+    if (phase != PHASE_RUNNING) return 0;
+    if (all_done) {
+        next_round(now);
+        if (phase != PHASE_RUNNING) return 0;
+    }
+    return seat_ready(now);
+}
+
+static void *tourney_thread(void *arg) {
+    (void)arg;
+    unsigned wait_ms = WATCHDOG_INTERVAL_MS;
+    while (1) {
+        io_usleep(wait_ms * 1000u);
+        wait_ms = WATCHDOG_INTERVAL_MS;
+        /* The successor process runs the games as ordinary ones */
+        if (handoff_frozen()) continue;
+
+        pthread_mutex_lock(&t_lock);
+        /* Woken again for the earliest flag of any board */
+        size_t n = (phase == PHASE_RUNNING || n_live > 0) ? tick(io_time(), &wait_ms) : 0;
+        unlock_and_send();
+        /* The boards keep the watchdog reference until our next tick */
+        for (size_t i = 0; i < n; i++) notify_start(started[i]);
+    }
+    return NULL;
+}
+
+/* --- Public interface --- */
+
+int tourney_start(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, tourney_thread, NULL) != 0) return -1;
+    pthread_detach(tid);
+    t_running = 1;
+    return 0;
+}
+
+int tourney_create(TourneyKind k, int r) {
+    if (!t_running) return -1;
+    pthread_mutex_lock(&t_lock);
+    if (phase == PHASE_RUNNING || n_live > 0) { pthread_mutex_unlock(&t_lock); return -1; }
+    /* The outbox points into the entrants */
+    while (out_busy) pthread_cond_wait(&t_sent, &t_lock);
+    free_tournament();
+    kind = k;
+    rounds = r < 1 ? 1 : (r > TOURNEY_MAX_ROUNDS ? TOURNEY_MAX_ROUNDS : r);
+    round_no = 0;
+    phase = PHASE_REGISTERING;
+    n_games = n_byes = n_forfeits = n_batches = 0;
+    pair_ns_last = pair_ns_max = seat_ns_last = seated_last = 0;
+    pthread_mutex_unlock(&t_lock);
+    log_printf("[TOURNEY] Registration open (%s).\n", kind_name(k));
+    return 0;
+}
+
+int tourney_register(const char *name, int32_t rating) {
+    int rc = -1;
+    pthread_mutex_lock(&t_lock);
+    if (phase == PHASE_REGISTERING) {
+        if (find_entrant(name) >= 0) rc = 1;
+        else if (n_entrants < TOURNEY_MAX_PLAYERS && grow() == 0) {
+            TourneyEntrant *e = &entrants[n_entrants];
+            memset(e, 0, sizeof(*e));
+            snprintf(e->name, sizeof(e->name), "%s", name);
+            e->rating = rating;
+            e->last_colour = -1;
+            e->rank = (int)n_entrants;
+            n_entrants++;
+            size_t i = name_hash(e->name) & (n_slots - 1);
+            while (name_slots[i]) i = (i + 1) & (n_slots - 1);
+            name_slots[i] = (uint32_t)n_entrants;
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&t_lock);
+    return rc;
+}
+
+int tourney_begin(void) {
+    pthread_mutex_lock(&t_lock);
+    if (phase != PHASE_REGISTERING || n_entrants < 2) { pthread_mutex_unlock(&t_lock); return -1; }
+    size_t n = n_entrants;
+    pairs = calloc(n / 2 + 1, sizeof(Pairing));
+    order = calloc(n, sizeof(int));
+    group = calloc(n, sizeof(int));
+    taken = calloc(n, 1);
+    seat_white = calloc(n / 2 + 1, sizeof(Client *));
+    seat_black = calloc(n / 2 + 1, sizeof(Client *));
+    started = calloc(n / 2 + 1, sizeof(Match *));
+    seat_pair = calloc(n / 2 + 1, sizeof(size_t));
+    if (!pairs || !order || !group || !taken || !seat_white || !seat_black || !started || !seat_pair) {
+        pthread_mutex_unlock(&t_lock);
+        return -1;
+    }
+    /* Seed by rating (rank holds the registration order until now) */
+    qsort(entrants, n, sizeof(TourneyEntrant), cmp_seed);
+    for (size_t i = 0; i < n; i++) entrants[i].rank = 0;
+    rehash();
+    if (kind == TOURNEY_ROUND_ROBIN) rounds = (int)(n + (n & 1) - 1);
+    phase = PHASE_RUNNING;
+    next_round(io_time());
+    unlock_and_send();
+    log_printf("[TOURNEY] Started: %s, %zu players, %d rounds.\n", kind_name(kind), n, rounds);
+    return 0;
+}
+
+int tourney_stop(void) {
+    int rc = 0;
+    pthread_mutex_lock(&t_lock);
+    if (phase == PHASE_RUNNING) finish();
+    else if (phase == PHASE_REGISTERING) { free_tournament(); phase = PHASE_NONE; }
+    else rc = -1;
+    unlock_and_send();
+    return rc;
+}
+
+int tourney_ready(Client *c) {
+    int rc = -1;
+    pthread_mutex_lock(&t_lock);
+    long i = (phase == PHASE_RUNNING) ? find_entrant(c->name) : -1;
+    if (i >= 0) {
+        TourneyEntrant *e = &entrants[i];
+        if (!e->client || e->client == c) {
+            post(c, e, 0, TOURNEY_WAIT, round_no);
+            if (e->bye_round == round_no) post(c, e, 0, TOURNEY_BYE, round_no);
+            e->client = c;
+            c->tourney = e;
+            rc = round_no;
+        }
+    }
+    unlock_and_send();
+    return rc;
+}
+
+int tourney_leave(Client *c) {
+    pthread_mutex_lock(&t_lock);
+    TourneyEntrant *e = c->tourney;
+    int rc;
+    if (e) {
+        drop_outgoing(c);
+        e->client = NULL;
+        c->tourney = NULL;
+        rc = 0;
+    } else {
+        rc = (c->match && c->paired) ? 1 : -1;
+    }
+    pthread_mutex_unlock(&t_lock);
+    return rc;
+}
+
+size_t tourney_standings(TourneyStanding *out, size_t n) {
+    size_t count = 0;
+    pthread_mutex_lock(&t_lock);
+    int *idx = n_entrants ? malloc(n_entrants * sizeof(int)) : NULL;
+    if (idx) {
+        standings_order(idx);
+        for (; count < n && count < n_entrants; count++) {
+            const TourneyEntrant *e = &entrants[idx[count]];
+            out[count].rank = (int)count + 1;
+            memcpy(out[count].name, e->name, sizeof(out[count].name));
+            out[count].score = e->score;
+            out[count].buchholz = e->buchholz;
+            out[count].rating = e->rating;
+        }
+        free(idx);
+    }
+    pthread_mutex_unlock(&t_lock);
+    return count;
+}
+
+int tourney_format_stats(char *buf, size_t sz) {
+    if (!t_running) return 0;
+    pthread_mutex_lock(&t_lock);
+    size_t pending = 0;
+    for (size_t i = 0; i < n_pairs; i++) pending += pairs[i].state == PAIR_PENDING;
+    int n = snprintf(buf, sz, "tournament=%s phase=%s round=%d/%d players=%zu boards=%zu live=%llu pending=%zu\n"
+                     "games=%llu byes=%llu forfeits=%llu batches=%llu seated_last=%llu seat_us_last=%.1f "
+                     "pair_us_last=%.1f pair_us_max=%.1f\n",
+                     kind_name(kind), phase_name(phase), round_no, rounds, n_entrants, n_pairs,
+                     (unsigned long long)n_live, pending, (unsigned long long)n_games,
+                     (unsigned long long)n_byes, (unsigned long long)n_forfeits, (unsigned long long)n_batches,
+                     (unsigned long long)seated_last, seat_ns_last / 1000.0, pair_ns_last / 1000.0,
+                     pair_ns_max / 1000.0);
+    pthread_mutex_unlock(&t_lock);
+    return n;
+}